@@ -0,0 +1,90 @@
+/*
+ * Polylib - Polygon Management Library
+ *
+ * Copyright (c) 2010-2011 VCAD System Research Program, RIKEN.
+ * All rights reserved.
+ *
+ * Copyright (c) 2012-2013 Advanced Institute for Computational Science, RIKEN.
+ * All rights reserved.
+ *
+ */
+
+//
+// IDファイルで設定した三角形IDから get_triangle_by_id() で三角形を引けるか
+// を確認する。量子化したグループ(quantize = 16)についても、IDの読み込みで
+// 三角形が復元されないこと、復元した三角形に設定したIDが解放後も残ることを
+// 確認する。
+//
+
+#include <stdio.h>
+#include <iostream>
+#include <fstream>
+#include "Polylib.h"
+#include "file_io/TriMeshIO.h"
+
+using namespace std;
+using namespace PolylibNS;
+
+static int check(int bits)
+{
+  string stl_name = "./car.stl";
+  string id_name  = "./car.id";
+  map<string, string> fmap;
+  fmap[stl_name] = TriMeshIO::input_file_format(stl_name);
+
+  PolygonGroup pg;
+  pg.set_name("car");
+  pg.set_file_name(fmap);
+  if (bits > 0) pg.set_quantize_bits(bits);
+  if (pg.load_stl_file() != PLSTAT_OK) return 1;
+  int n = pg.get_num_triangles();
+
+  // ファイル順と逆向きで、読み込み時の通番(0〜n-1)と重ならないIDを
+  // 書いたIDファイルを作る
+  ofstream os(id_name.c_str());
+  for (int i = 0; i < n; i++) os << 2 * n - 1 - i << endl;
+  os.close();
+
+  PolylibMemoryUsage before, after;
+  PolylibMemory::clear(&before);
+  PolylibMemory::clear(&after);
+  pg.memory_usage(&before);
+  POLYLIB_STAT stat = pg.load_id_file(ID_ASCII);
+  pg.memory_usage(&after);
+  remove(id_name.c_str());
+  if (stat != PLSTAT_OK) return 1;
+
+  // IDインデックスがIDファイルの値で引けるか
+  int bad = 0;
+  vector<PrivateTriangle*> *tri_list = pg.get_triangles();
+  for (int i = 0; i < n; i++) {
+    int id = 2 * n - 1 - i;
+    if ((*tri_list)[i]->get_id() != id) bad++;
+    if (pg.get_triangle_by_id(id) != (*tri_list)[i]) bad++;
+    if (pg.get_triangle_by_id(i) != NULL) bad++;
+  }
+
+  // 復元した三角形に設定したIDが、解放後も量子化データに残るか
+  Vec3f vtx = (*tri_list)[0]->get_vertex()[0];
+  (*tri_list)[0]->set_id(42);
+  pg.rebuild_id_index();
+  pg.release_decoded_triangles();
+  PrivateTriangle *tri = pg.get_triangle_by_id(42);
+  if (tri == NULL || !(tri->get_vertex()[0] == vtx)) bad++;
+  if (pg.get_triangle_by_id(2 * n - 1) != NULL) bad++;
+
+  cout << "quantize:" << bits << " triangles:" << n
+       << " memory before/after load_id_file:" << before.triangles << "/"
+       << after.triangles << " errors:" << bad << endl;
+  if (bits > 0 && after.triangles != before.triangles) bad++;
+  return bad == 0 ? 0 : 1;
+}
+
+int main(){
+
+  int ret = 0;
+  ret |= check(0);
+  ret |= check(16);
+  cout << (ret == 0 ? "OK" : "NG") << endl;
+  return ret;
+}
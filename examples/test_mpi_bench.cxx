@@ -0,0 +1,258 @@
+/*
+ * Polylib - Polygon Management Library
+ *
+ * Copyright (c) 2010-2011 VCAD System Research Program, RIKEN.
+ * All rights reserved.
+ *
+ * Copyright (c) 2012-2013 Advanced Institute for Computational Science, RIKEN.
+ * All rights reserved.
+ *
+ */
+
+//
+// rank0からの配信(MPI_Scatterv)、rank0への収集(MPI_Gatherv)と、
+// 全rankでのデータ分配(load_distributed, save/load_collective, migrate,
+// repartition)の所要時間を計測する。任意のプロセス数で実行でき、
+// 計算領域はMPI_Dims_create()で各rankへ分割する。形状はrank0が作成する
+// バイナリSTLファイル(計算領域全体に一様に散らばる三角形)を用いる。
+//
+// $mpirun -np 1024 ./test_mpi_bench [三角形数] [繰り返し回数]
+//
+// 各処理の全rank中の最大時間と平均時間(1回あたり)をrank0が出力する。
+// いずれかの処理が失敗した場合は終了コード1を返す。
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <iostream>
+#include <fstream>
+#include "mpi.h"
+#include "Polylib.h"
+#include "MPIPolylib.h"
+
+using namespace std;
+using namespace PolylibNS;
+
+// 計算領域全体
+static const float g_origin[3] = { 0, 0, 0 };
+static const float g_length[3] = { 1000, 1000, 1000 };
+
+#define BENCH_STL		"./bench.stl"
+#define BENCH_CONFIG	"./polylib_config_bench.tpp"
+
+// rank毎の計算領域のボクセル数
+#define NVOX	8
+
+// 計測毎にインスタンスを作り直すため、コンストラクタを公開する
+class BenchPolylib : public MPIPolylib {
+public:
+  BenchPolylib() {}
+};
+
+struct MyParallelInfo {
+  float bpos[3]; //基準座標
+  unsigned bbsize[3]; //number of voxel 計算領域
+  unsigned gcsize[3]; //number of guidecell voxel
+  float dx[3]; //size of voxel
+};
+
+static int g_rank;
+static int g_nproc;
+
+//
+// rankの領域。uneven=trueならx方向の幅をrank座標+1に比例させる。
+//
+static void set_area(MyParallelInfo *info, const int dims[3], bool uneven)
+{
+  int coord[3];
+  coord[0] = g_rank % dims[0];
+  coord[1] = (g_rank / dims[0]) % dims[1];
+  coord[2] = g_rank / (dims[0] * dims[1]);
+
+  for (int i = 0; i < 3; i++) {
+    float width = g_length[i] / dims[i];
+    float start = g_origin[i] + width * coord[i];
+    if (i == 0 && uneven) {
+      float total = 0.5f * dims[0] * (dims[0] + 1);
+      float before = 0.5f * coord[0] * (coord[0] + 1);
+      width = g_length[0] * (coord[0] + 1) / total;
+      start = g_origin[0] + g_length[0] * before / total;
+    }
+    info->bpos[i] = start;
+    info->bbsize[i] = NVOX;
+    info->gcsize[i] = 1;
+    info->dx[i] = width / NVOX;
+  }
+}
+
+//
+// 計算領域全体に一様に散らばる三角形のバイナリSTLファイルと、それを
+// 読み込む設定ファイルを作成する。
+//
+static bool make_input(unsigned int num)
+{
+  ofstream os(BENCH_STL, ios::out | ios::binary);
+  char header[80] = "test_mpi_bench";
+  os.write(header, sizeof(header));
+  os.write((const char*)&num, sizeof(num));
+
+  unsigned int seed = 12345;
+  for (unsigned int i = 0; i < num; i++) {
+    float rec[12];
+    float pos[3];
+    for (int j = 0; j < 3; j++) {
+      seed = seed * 1103515245 + 12345;
+      pos[j] = g_origin[j] + g_length[j] * ((seed >> 8) & 0xffff) / 65536.0f;
+    }
+    rec[0] = 0; rec[1] = 0; rec[2] = 1;
+    for (int j = 0; j < 3; j++) {
+      rec[3 + j] = pos[j];
+      rec[6 + j] = pos[j] + (j == 0 ? 1.0f : 0.0f);
+      rec[9 + j] = pos[j] + (j == 1 ? 1.0f : 0.0f);
+    }
+    unsigned short padding = 0;
+    os.write((const char*)rec, sizeof(rec));
+    os.write((const char*)&padding, sizeof(padding));
+  }
+  os.close();
+
+  ofstream cfg(BENCH_CONFIG);
+  cfg << "Polylib {" << endl
+      << "  bench {" << endl
+      << "    filepath = \"" << BENCH_STL << "\"" << endl
+      << "  }" << endl
+      << "}" << endl;
+  cfg.close();
+  return !os.fail() && !cfg.fail();
+}
+
+//
+// 全rankの時間の最大と平均を出力する。
+//
+//  @return	失敗したrankの数(全rankで同じ値)。
+//
+static int report(const char *name, double t, int repeat, POLYLIB_STAT stat)
+{
+  double t_max, t_sum;
+  int    bad = (stat != PLSTAT_OK) ? 1 : 0;
+  int    n_bad;
+  MPI_Reduce(&t, &t_max, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+  MPI_Reduce(&t, &t_sum, 1, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
+  MPI_Allreduce(&bad, &n_bad, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+  if (g_rank == 0) {
+    printf("%-16s max %10.6f s  avg %10.6f s%s\n", name,
+           t_max / repeat, t_sum / g_nproc / repeat, n_bad ? "  (NG)" : "");
+  }
+  return n_bad;
+}
+
+static void show_triangles(MPIPolylib *p_polylib, const char *name)
+{
+  unsigned long long num;
+  double area;
+  if (p_polylib->get_global_stats("bench", &num, &area) != PLSTAT_OK) return;
+  if (g_rank == 0) {
+    printf("%-16s triangles:%llu\n", name, num);
+  }
+}
+
+int main(int argc, char** argv ){
+  POLYLIB_STAT stat;
+  double t0;
+  int n_bad = 0;
+
+  MPI_Init(&argc,&argv);
+  MPI_Comm_rank(MPI_COMM_WORLD,&g_rank);
+  MPI_Comm_size(MPI_COMM_WORLD,&g_nproc);
+
+  unsigned int num = (argc > 1) ? (unsigned int)atoi(argv[1]) : 1000000;
+  int repeat = (argc > 2) ? atoi(argv[2]) : 3;
+  if (repeat < 1) repeat = 1;
+
+  int dims[3] = {0, 0, 0};
+  MPI_Dims_create(g_nproc, 3, dims);
+  if (g_rank == 0) {
+    printf("procs:%d dims:%dx%dx%d triangles:%u repeat:%d\n",
+           g_nproc, dims[0], dims[1], dims[2], num, repeat);
+    if (!make_input(num)) MPI_Abort(MPI_COMM_WORLD, 1);
+  }
+
+  MyParallelInfo info, uneven;
+  set_area(&info, dims, false);
+  set_area(&uneven, dims, true);
+
+  // rank0での読み込みとMPI_Scattervによる配信
+  BenchPolylib *p_polylib = new BenchPolylib();
+  stat = p_polylib->init_parallel_info(MPI_COMM_WORLD,
+				       info.bpos, info.bbsize, info.gcsize, info.dx);
+  if(stat !=PLSTAT_OK) MPI_Abort(MPI_COMM_WORLD, 1);
+
+  MPI_Barrier(MPI_COMM_WORLD);
+  t0 = MPI_Wtime();
+  stat = p_polylib->load_rank0(BENCH_CONFIG);
+  n_bad += report("load_rank0", MPI_Wtime() - t0, 1, stat);
+  show_triangles(p_polylib, "load_rank0");
+
+  // MPI_Gathervによるrank0への収集と保存
+  string fname;
+  MPI_Barrier(MPI_COMM_WORLD);
+  t0 = MPI_Wtime();
+  for (int i = 0; i < repeat && stat == PLSTAT_OK; i++) {
+    stat = p_polylib->save_rank0(&fname, "stl_b", "bench_rank0");
+  }
+  n_bad += report("save_rank0", MPI_Wtime() - t0, repeat, stat);
+
+  // 共有ファイルへの集団書き込み
+  MPI_Barrier(MPI_COMM_WORLD);
+  t0 = MPI_Wtime();
+  for (int i = 0; i < repeat && stat == PLSTAT_OK; i++) {
+    stat = p_polylib->save_collective(&fname, "bench_coll");
+  }
+  n_bad += report("save_collective", MPI_Wtime() - t0, repeat, stat);
+
+  // 隣接rank間の移動
+  MPI_Barrier(MPI_COMM_WORLD);
+  t0 = MPI_Wtime();
+  for (int i = 0; i < repeat && stat == PLSTAT_OK; i++) {
+    stat = p_polylib->migrate();
+  }
+  n_bad += report("migrate", MPI_Wtime() - t0, repeat, stat);
+
+  // 不均等な領域との間の再分割
+  MPI_Barrier(MPI_COMM_WORLD);
+  t0 = MPI_Wtime();
+  for (int i = 0; i < repeat && stat == PLSTAT_OK; i++) {
+    MyParallelInfo *p = (i % 2 == 0) ? &uneven : &info;
+    stat = p_polylib->repartition(p->bpos, p->bbsize, p->gcsize, p->dx);
+  }
+  n_bad += report("repartition", MPI_Wtime() - t0, repeat, stat);
+  delete p_polylib;
+
+  // 全rankでの分割読み込みと全対全通信による配信
+  p_polylib = new BenchPolylib();
+  stat = p_polylib->init_parallel_info(MPI_COMM_WORLD,
+				       info.bpos, info.bbsize, info.gcsize, info.dx);
+  MPI_Barrier(MPI_COMM_WORLD);
+  t0 = MPI_Wtime();
+  if (stat == PLSTAT_OK) stat = p_polylib->load_distributed(BENCH_CONFIG);
+  n_bad += report("load_distributed", MPI_Wtime() - t0, 1, stat);
+  show_triangles(p_polylib, "load_distributed");
+  delete p_polylib;
+
+  // save_collective()で保存した共有ファイルの集団読み込み
+  p_polylib = new BenchPolylib();
+  stat = p_polylib->init_parallel_info(MPI_COMM_WORLD,
+				       info.bpos, info.bbsize, info.gcsize, info.dx);
+  MPI_Barrier(MPI_COMM_WORLD);
+  t0 = MPI_Wtime();
+  if (stat == PLSTAT_OK) {
+    stat = p_polylib->load_collective("./polylib_config_bench_coll.tpp");
+  }
+  n_bad += report("load_collective", MPI_Wtime() - t0, 1, stat);
+  show_triangles(p_polylib, "load_collective");
+  delete p_polylib;
+
+  MPI_Finalize();
+
+  return (n_bad == 0) ? 0 : 1;
+}
@@ -0,0 +1,165 @@
+/*
+ * Polylib - Polygon Management Library
+ *
+ * Copyright (c) 2010-2011 VCAD System Research Program, RIKEN.
+ * All rights reserved.
+ *
+ * Copyright (c) 2012-2013 Advanced Institute for Computational Science, RIKEN.
+ * All rights reserved.
+ *
+ */
+
+//
+// save_collective()でリーフグループ毎の共有ファイルにMPI-IOで書き出した
+// データをload_collective()で読み直し、各rankの三角形(ID、頂点)が
+// 書き出し前と一致すること、共有ファイルに各三角形がちょうど一度だけ
+// 書き出されていることを確認する。
+//
+// $mpirun -np 4 ./test_mpi_io
+//
+
+#include <sys/stat.h>
+#include <iostream>
+#include "mpi.h"
+#include "Polylib.h"
+#include "MPIPolylib.h"
+#include "file_io/stl.h"
+
+using namespace std;
+using namespace PolylibNS;
+
+struct MyParallelInfo {
+  float bpos[3]; //基準座標
+  unsigned bbsize[3]; //number of voxel 計算領域
+  unsigned gcsize[3]; //number of guidecell voxel
+  float dx[3]; //size of voxel
+};
+
+static MyParallelInfo myParaInfos[4] = {
+  {{-1100, -1800,-1800,}, {18,18,18,}, {1, 1,1,}, {100,100,100} },
+  {{-1100,     0,-1800,}, {18,18,18,}, {1, 1,1,}, {100,100,100} },
+  {{-1100, -1800,    0,}, {18,18,18,}, {1, 1,1,}, {100,100,100} },
+  {{-1100,     0,    0,}, {18,18,18,}, {1, 1,1,}, {100,100,100} }
+};
+
+// polylib_config.tppのリーフグループ
+static const char *g_leaves[] = {
+  "sphere", "car", "windmill/blades/blade1", "windmill/blades/blade2",
+  "windmill/blades/blade3", "windmill/tower"
+};
+#define NLEAF	(sizeof(g_leaves) / sizeof(g_leaves[0]))
+
+// 読み直したデータを書き出し前と並べて持つため、二つ目のインスタンスを作る
+class IOPolylib : public MPIPolylib {
+public:
+  IOPolylib() {}
+};
+
+//
+// 自rankの三角形が一致しない数。
+//
+static int compare(PolygonGroup *org, PolygonGroup *pg)
+{
+  vector<PrivateTriangle*> *org_list = org->get_triangles();
+  vector<PrivateTriangle*> *tri_list = pg->get_triangles();
+  int bad = (org_list->size() == tri_list->size()) ? 0 : 1;
+
+  for (size_t i = 0; i < org_list->size(); i++) {
+    const PrivateTriangle *a = (*org_list)[i];
+    const PrivateTriangle *b = pg->get_triangle_by_id(a->get_id());
+    if (b == NULL) {
+      bad++;
+      continue;
+    }
+    for (int j = 0; j < 3; j++) {
+      if (!(a->get_vertex()[j] == b->get_vertex()[j])) {
+        bad++;
+        break;
+      }
+    }
+  }
+  return bad;
+}
+
+int main(int argc, char** argv ){
+  int rank, nproc;
+  POLYLIB_STAT pl_stat;
+
+  MPI_Init(&argc,&argv);
+  MPI_Comm_rank(MPI_COMM_WORLD,&rank);
+  MPI_Comm_size(MPI_COMM_WORLD,&nproc);
+  if (nproc != 4) {
+    if (rank == 0) cerr << "run with 4 processes." << endl;
+    MPI_Abort(MPI_COMM_WORLD, 1);
+  }
+  MyParallelInfo *info = &myParaInfos[rank];
+
+  // 元データ。三角形IDを既定値から変えておく
+  MPIPolylib* p_polylib = MPIPolylib::get_instance();
+  pl_stat = p_polylib->init_parallel_info(MPI_COMM_WORLD,
+				       info->bpos, info->bbsize, info->gcsize, info->dx);
+  if (pl_stat == PLSTAT_OK) pl_stat = p_polylib->load_rank0("./polylib_config.tpp");
+  if (pl_stat != PLSTAT_OK) MPI_Abort(MPI_COMM_WORLD, 1);
+
+  for (size_t l = 0; l < NLEAF; l++) {
+    PolygonGroup *pg = p_polylib->get_group(g_leaves[l]);
+    if (pg == NULL) MPI_Abort(MPI_COMM_WORLD, 1);
+    vector<PrivateTriangle*> *tri_list = pg->get_triangles();
+    for (size_t i = 0; i < tri_list->size(); i++) {
+      (*tri_list)[i]->set_id((*tri_list)[i]->get_id() * 2 + 1);
+    }
+    pg->rebuild_id_index();
+  }
+
+  string config_name;
+  if (p_polylib->save_collective(&config_name, "mpiio") != PLSTAT_OK) {
+    MPI_Abort(MPI_COMM_WORLD, 1);
+  }
+
+  // 共有ファイルから読み直す
+  IOPolylib *coll = new IOPolylib();
+  pl_stat = coll->init_parallel_info(MPI_COMM_WORLD,
+				  info->bpos, info->bbsize, info->gcsize, info->dx);
+  if (pl_stat == PLSTAT_OK) {
+    pl_stat = coll->load_collective("./polylib_config_mpiio.tpp");
+  }
+  if (pl_stat != PLSTAT_OK) MPI_Abort(MPI_COMM_WORLD, 1);
+
+  int ret = 0;
+  for (size_t l = 0; l < NLEAF; l++) {
+    PolygonGroup *pg = coll->get_group(g_leaves[l]);
+    int bad = (pg == NULL) ? 1 : compare(p_polylib->get_group(g_leaves[l]), pg);
+    int n_bad;
+    MPI_Allreduce(&bad, &n_bad, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+
+    // 共有ファイルのレコード数は全rankの三角形数(重複なし)と等しい
+    unsigned long long num = 0;
+    double area;
+    p_polylib->get_global_stats(g_leaves[l], &num, &area);
+
+    if (rank == 0) {
+      string fname = g_leaves[l];
+      for (size_t i = 0; i < fname.size(); i++) {
+        if (fname[i] == '/') fname[i] = '_';
+      }
+      fname += "_mpiio.stlb";
+      struct stat st;
+      unsigned long long records = 0;
+      if (stat(fname.c_str(), &st) == 0) {
+        records = (st.st_size - STL_B_HEADER_SIZE) / STL_B_RECORD_SIZE;
+      }
+      if (records != num) n_bad++;
+
+      cout << g_leaves[l] << " triangles:" << num << " records:" << records
+           << " errors:" << n_bad << endl;
+    }
+    if (n_bad > 0) ret = 1;
+  }
+
+  delete coll;
+  if (rank == 0) cout << (ret == 0 ? "OK" : "NG") << endl;
+
+  MPI_Finalize();
+
+  return ret;
+}
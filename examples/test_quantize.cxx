@@ -0,0 +1,141 @@
+/*
+ * Polylib - Polygon Management Library
+ *
+ * Copyright (c) 2010-2011 VCAD System Research Program, RIKEN.
+ * All rights reserved.
+ *
+ * Copyright (c) 2012-2013 Advanced Institute for Computational Science, RIKEN.
+ * All rights reserved.
+ *
+ */
+
+//
+// 頂点座標を量子化したグループ(quantize = 16, 21)を量子化しないグループと
+// 比べ、復元した頂点の誤差が memory_usage() の quantize_error 以内であること、
+// 矩形領域の検索結果が量子化しない場合の結果を全て含む(保守的である)
+// ことを確認する。
+//
+
+#include <math.h>
+#include <iostream>
+#include <set>
+#include "Polylib.h"
+#include "file_io/TriMeshIO.h"
+
+using namespace std;
+using namespace PolylibNS;
+
+// 検索領域の1軸あたりの分割数
+#define NDIV	4
+
+static bool load(PolygonGroup *pg, string stl_name, int bits)
+{
+  map<string, string> fmap;
+  fmap[stl_name] = TriMeshIO::input_file_format(stl_name);
+  pg->set_name("quantize");
+  pg->set_file_name(fmap);
+  if (bits > 0) pg->set_quantize_bits(bits);
+  return pg->load_stl_file() == PLSTAT_OK;
+}
+
+//
+// 復元した頂点の誤差の最大値。
+//
+static float vertex_error(PolygonGroup *ref, PolygonGroup *pg)
+{
+  float err = 0.0f;
+  vector<PrivateTriangle*> *ref_list = ref->get_triangles();
+  vector<PrivateTriangle*> *tri_list = pg->acquire_triangles();
+  if (ref_list->size() != tri_list->size()) err = -1.0f;
+  for (size_t i = 0; i < ref_list->size() && err >= 0.0f; i++) {
+    if ((*ref_list)[i]->get_id() != (*tri_list)[i]->get_id()) {
+      err = -1.0f;
+      break;
+    }
+    for (int j = 0; j < 3; j++) {
+      Vec3f d = (*ref_list)[i]->get_vertex()[j] - (*tri_list)[i]->get_vertex()[j];
+      for (int k = 0; k < 3; k++) {
+        if (fabs(d[k]) > err) err = fabs(d[k]);
+      }
+    }
+  }
+  pg->release_triangles(tri_list);
+  return err;
+}
+
+//
+// 量子化しない場合の検索結果のうち、量子化したグループの検索結果に
+// 含まれない三角形の数。
+//
+static int missing(PolygonGroup *ref, PolygonGroup *pg, BBox *bbox, bool every)
+{
+  vector<PrivateTriangle*> ref_list, tri_list;
+  ref->search(bbox, every, &ref_list);
+  pg->search(bbox, every, &tri_list);
+
+  set<int> ids;
+  for (size_t i = 0; i < tri_list.size(); i++) ids.insert(tri_list[i]->get_id());
+  int n = 0;
+  for (size_t i = 0; i < ref_list.size(); i++) {
+    if (ids.find(ref_list[i]->get_id()) == ids.end()) n++;
+  }
+  return n;
+}
+
+static int check(string stl_name, int bits)
+{
+  PolygonGroup ref, pg;
+  if (!load(&ref, stl_name, 0) || !load(&pg, stl_name, bits)) return 1;
+  pg.release_decoded_triangles();
+  PolylibMemoryUsage ref_usage, usage;
+  PolylibMemory::clear(&ref_usage);
+  PolylibMemory::clear(&usage);
+  ref.memory_usage(&ref_usage);
+  pg.memory_usage(&usage);
+  size_t ref_mem = ref_usage.triangles;
+  size_t mem = usage.triangles;
+
+  float bound = usage.quantize_error;
+  float err = vertex_error(&ref, &pg);
+  pg.release_decoded_triangles();
+
+  // 形状のBounding Boxを分割した各領域で検索する
+  int n_missing = 0;
+  BBox bbox = ref.get_bbox();
+  Vec3f size = bbox.max - bbox.min;
+  for (int i = 0; i < NDIV * NDIV * NDIV; i++) {
+    int idx[3] = { i % NDIV, (i / NDIV) % NDIV, i / (NDIV * NDIV) };
+    BBox q;
+    q.init();
+    Vec3f lo, hi;
+    for (int k = 0; k < 3; k++) {
+      lo[k] = bbox.min[k] + size[k] * idx[k] / NDIV;
+      hi[k] = bbox.min[k] + size[k] * (idx[k] + 1) / NDIV;
+    }
+    q.add(lo);
+    q.add(hi);
+    n_missing += missing(&ref, &pg, &q, false);
+    n_missing += missing(&ref, &pg, &q, true);
+  }
+  pg.release_decoded_triangles();
+
+  cout << stl_name << " quantize:" << bits
+       << " triangles:" << ref.get_num_triangles()
+       << " memory:" << ref_mem << "->" << mem
+       << " error:" << err << " bound:" << bound
+       << " missing:" << n_missing << endl;
+  if (err < 0.0f || err > bound || n_missing > 0 || mem >= ref_mem) return 1;
+  return 0;
+}
+
+int main(){
+
+  const char *files[] = { "./car.stl", "./sphere.stl", "./tower.stl" };
+  int ret = 0;
+  for (int i = 0; i < 3; i++) {
+    ret |= check(files[i], 16);
+    ret |= check(files[i], 21);
+  }
+  cout << (ret == 0 ? "OK" : "NG") << endl;
+  return ret;
+}
@@ -0,0 +1,127 @@
+/*
+ * Polylib - Polygon Management Library
+ *
+ * Copyright (c) 2010-2011 VCAD System Research Program, RIKEN.
+ * All rights reserved.
+ *
+ * Copyright (c) 2012-2013 Advanced Institute for Computational Science, RIKEN.
+ * All rights reserved.
+ *
+ */
+
+//
+// Polylib::save()でスナップショット(TriMeshIO::FMT_SNAP)として保存した
+// 各リーフグループのファイルを読み直し、三角形(ID、ユーザ定義ID、頂点、
+// 法線、面積)と矩形領域の検索結果、IDによる検索が保存前と一致することを
+// 確認する。
+//
+
+#include <iostream>
+#include <set>
+#include "Polylib.h"
+#include "file_io/TriMeshIO.h"
+
+using namespace std;
+using namespace PolylibNS;
+
+// polylib_config.tppのリーフグループ
+static const char *g_leaves[] = {
+  "sphere", "car", "windmill/blades/blade1", "windmill/blades/blade2",
+  "windmill/blades/blade3", "windmill/tower"
+};
+#define NLEAF	(sizeof(g_leaves) / sizeof(g_leaves[0]))
+
+static bool same_triangle(const PrivateTriangle *a, const PrivateTriangle *b)
+{
+  if (a == NULL || b == NULL) return false;
+  if (a->get_id() != b->get_id() || a->get_exid() != b->get_exid()) return false;
+  for (int i = 0; i < 3; i++) {
+    if (!(a->get_vertex()[i] == b->get_vertex()[i])) return false;
+  }
+  return a->get_normal() == b->get_normal() && a->get_area() == b->get_area();
+}
+
+static set<int> search_ids(PolygonGroup *pg, BBox *bbox)
+{
+  vector<PrivateTriangle*> tri_list;
+  pg->search(bbox, false, &tri_list);
+  set<int> ids;
+  for (size_t i = 0; i < tri_list.size(); i++) ids.insert(tri_list[i]->get_id());
+  return ids;
+}
+
+static int check(PolygonGroup *org, PolygonGroup *pg)
+{
+  int bad = 0;
+  vector<PrivateTriangle*> *org_list = org->get_triangles();
+  vector<PrivateTriangle*> *tri_list = pg->get_triangles();
+  if (org_list->size() != tri_list->size()) return 1;
+
+  for (size_t i = 0; i < org_list->size(); i++) {
+    if (!same_triangle((*org_list)[i], (*tri_list)[i])) bad++;
+    int id = (*org_list)[i]->get_id();
+    if (!same_triangle(pg->get_triangle_by_id(id), (*org_list)[i])) bad++;
+  }
+
+  // Bounding Boxを8分割した各領域で検索する
+  BBox bbox = org->get_bbox();
+  Vec3f center = (bbox.min + bbox.max) * 0.5f;
+  for (int i = 0; i < 8; i++) {
+    BBox q;
+    q.init();
+    Vec3f corner;
+    for (int k = 0; k < 3; k++) {
+      corner[k] = (i & (1 << k)) ? bbox.max[k] : bbox.min[k];
+    }
+    q.add(center);
+    q.add(corner);
+    if (search_ids(org, &q) != search_ids(pg, &q)) bad++;
+  }
+  return bad;
+}
+
+int main(){
+
+  Polylib* pl_instance = Polylib::get_instance();
+  if (pl_instance->load("./polylib_config.tpp") != PLSTAT_OK) return 1;
+
+  // IDとユーザ定義IDを既定値から変えておく
+  for (size_t l = 0; l < NLEAF; l++) {
+    PolygonGroup *pg = pl_instance->get_group(g_leaves[l]);
+    if (pg == NULL) return 1;
+    vector<PrivateTriangle*> *tri_list = pg->get_triangles();
+    int n = tri_list->size();
+    for (int i = 0; i < n; i++) {
+      (*tri_list)[i]->set_id(2 * n - 1 - i);
+      (*tri_list)[i]->set_exid(i % 7);
+    }
+    pg->rebuild_id_index();
+  }
+
+  string config_name;
+  if (pl_instance->save(&config_name, TriMeshIO::FMT_SNAP, "snap") != PLSTAT_OK) {
+    return 1;
+  }
+  cout << "saved: " << config_name << endl;
+
+  // 各リーフグループのスナップショットを読み直す
+  int ret = 0;
+  for (size_t l = 0; l < NLEAF; l++) {
+    PolygonGroup *org = pl_instance->get_group(g_leaves[l]);
+    string snap_name, id_name;
+    org->acq_save_fnames("", "snap", TriMeshIO::FMT_SNAP, &snap_name, &id_name);
+
+    map<string, string> fmap;
+    fmap[snap_name] = TriMeshIO::FMT_SNAP;
+    PolygonGroup pg;
+    pg.set_name(org->get_name());
+    pg.set_file_name(fmap);
+    int bad = (pg.load_stl_file() == PLSTAT_OK) ? check(org, &pg) : 1;
+    cout << g_leaves[l] << " triangles:" << org->get_num_triangles()
+         << " errors:" << bad << endl;
+    if (bad > 0) ret = 1;
+  }
+
+  cout << (ret == 0 ? "OK" : "NG") << endl;
+  return ret;
+}
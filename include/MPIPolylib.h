@@ -17,6 +17,7 @@
 #include "mpi.h"
 #include "Polylib.h"
 #include "groups/PolygonGroup.h"
+#include "polygons/TriangleIdIndex.h"
 
 namespace PolylibNS {
 ////////////////////////////////////////////////////////////////////////////
@@ -35,8 +36,30 @@ struct ParallelInfo {
 	/// 計算領域情報
 	CalcAreaInfo m_area;
 
-	/// migrate除外三角形IDマップ(k:グループID, v:三角形IDリスト)
-	std::map< int, std::vector<int> > m_exclusion_map;
+	/// migrate除外三角形IDマップ(k:グループID, v:三角形IDの索引)。
+	/// select_excluded_trias()でのみ作り直す。
+	std::map< int, TriangleIdIndex > m_exclusion_map;
+};
+
+////////////////////////////////////////////////////////////////////////////
+///
+/// クラス:GlobalQueryHit
+/// MPIPolylibの全rank検索の結果。三角形は見つけたrankからの複製。
+///
+////////////////////////////////////////////////////////////////////////////
+struct GlobalQueryHit {
+	/// 三角形を見つけたrank。見つからなければ-1
+	int m_rank;
+
+	/// 三角形ポリゴンID(PolygonGroup内で一意)
+	int m_id;
+
+	/// 最近傍検索では重心までの距離、線分検索では交差位置のt、
+	/// 矩形領域検索では0
+	float m_dist;
+
+	/// 三角形ポリゴン(頂点、法線、面積、ユーザ定義ID、ユーザ定義状態変数)
+	Triangle m_tri;
 };
 
 ////////////////////////////////////////////////////////////////////////////
@@ -118,6 +141,44 @@ public:
 		ID_FORMAT	id_format = ID_BIN
 	);
 
+	///
+	/// 全rank分散でのデータ構築。
+	/// 指定された設定ファイルを各rankにて読み込み、グループ階層構造を構築する。
+	/// バイナリSTLファイルは各rankが三角形数で均等に分割した範囲だけを読み込み、
+	/// 三角形を各rank領域へ全対全通信で配信する。rank0に全ポリゴンを
+	/// 読み込まないため、load_rank0()のようにrank0のメモリと送信処理が
+	/// 律速とならない。三角形IDはload_rank0()と同じ値となる。
+	/// アスキーSTLファイルとスナップショットは各rankが自領域分だけを読み込む。
+	/// @attention 全rankで同じ設定ファイルを読めることが前提。
+	///
+	/// @param[in] config_filename	初期化ファイル名。未指定時はデフォルトファイルを読む。
+	/// @param[in] scale			頂点座標のスケール。
+	/// @return	POLYLIB_STATで定義される値が返る。
+	///
+	POLYLIB_STAT
+	load_distributed(
+		std::string config_filename = "",
+		float scale = 1.0
+	);
+
+	///
+	/// save_collective()で保存したデータの全rank並列での読み込み。
+	/// 各リーフグループの共有STLファイルとIDファイルを、各rankが三角形数で
+	/// 均等に分割した範囲だけMPI-IOの集団読み込みで読み込み、三角形を
+	/// 各rank領域へ全対全通信で配信する。三角形IDはIDファイルの値となる。
+	/// IDファイルがなければload_distributed()と同じ値となる。
+	/// 一つの非圧縮バイナリSTLファイルでないグループはload_distributed()と
+	/// 同じ方法で読み込む。
+	/// @attention 全rankで同じ設定ファイルを読めることが前提。
+	///
+	/// @param[in] config_filename	初期化ファイル名。未指定時はデフォルトファイルを読む。
+	/// @return	POLYLIB_STATで定義される値が返る。
+	///
+	POLYLIB_STAT
+	load_collective(
+		std::string config_filename = ""
+	);
+
 	///
 	/// Polylib::save()のオーバライドメソッド。
 	/// @attention 並列環境では利用できません。
@@ -169,6 +230,7 @@ public:
 	///
 	/// @param[out] p_config_filename	設定ファイル名返却用stringインスタンスへのポインタ
 	/// @param[in] stl_format	STLファイルフォーマット。 "stl_a":アスキー形式　"stl_b":バイナリ形式
+	///							末尾に.gzを付けると("stl_b.gz"等)STLファイルとIDファイルをgzip圧縮する。
     /// @param[in]  extend				ファイル名に付加する文字列。省略可。省略
 	///									した場合は、付加文字列として本メソッド呼
 	///									び出し時の年月日時分秒(YYYYMMDD24hhmmss)
@@ -184,6 +246,58 @@ public:
 		ID_FORMAT	id_format = ID_BIN
 	);
 
+	///
+	/// 全rank並列での非同期データ保存。
+	/// save_parallel()と同じファイルを出力するが、各rankは三角形ポリゴン情報を
+	/// 複製して設定ファイルを書き出した後に戻り、STLファイルとIDファイルは
+	/// handleの作業スレッドで書き出す。通信は行わない。
+	///
+	/// @param[in,out] handle			非同期保存のハンドル。前回の書き出し中
+	///									であれば、その完了を待ってから登録する。
+	/// @param[out] p_config_filename	設定ファイル名返却用stringインスタンスへのポインタ
+	/// @param[in] stl_format	save_parallel()と同じ。
+	/// @param[in] extend		save_parallel()と同じ。
+	/// @param[in] id_format	三角形IDファイルの出力形式。
+	/// @return	POLYLIB_STATで定義される値が返る。書き出しの結果は
+	///			handle->wait()が返す。
+	///
+	POLYLIB_STAT
+	save_parallel_async(
+		PolylibAsyncSave *handle,
+		std::string *p_config_filename,
+		std::string stl_format,
+		std::string extend = "",
+		ID_FORMAT	id_format = ID_BIN
+	);
+
+	///
+	/// 全rank集団でのデータ保存。
+	/// リーフグループ毎に一つのバイナリSTLファイルとIDファイル(ID_BIN)を
+	/// 全rankで共有し、MPI-IOの集団書き込みで書き出す。各rankの書き込み位置は
+	/// 三角形数の排他的スキャンで求める。ガイドセル領域で複数のrankが持つ
+	/// 三角形は、重心を担当領域に含むrankだけが書き出すので、各三角形は
+	/// ちょうど一度だけ書き出される。設定ファイルはrank0が一つだけ書き出す。
+	/// ファイル名はsave_rank0()と同じで、load_collective()の他、
+	/// load_rank0()、load_distributed()でも読み込める。
+	/// 設定ファイル命名規則は以下の通り
+	///   polylib_config_付加文字列.tpp
+	/// STLファイル命名規則は以下の通り
+	///   ポリゴングループ名称_付加文字列.stlb
+	///
+	/// @param[out] p_config_filename	設定ファイル名返却用stringインスタンスへのポインタ
+    /// @param[in]  extend				ファイル名に付加する文字列。省略可。省略
+	///									した場合は、付加文字列としてrank0での
+	///									本メソッド呼び出し時の年月日時分秒
+	///									(YYYYMMDD24hhmmss)を用いる。
+	/// @return	POLYLIB_STATで定義される値が返る。
+	/// @attention 出力引数p_config_filenameの返却値はrank0でのみ有効
+	///
+	POLYLIB_STAT
+	save_collective(
+		std::string *p_config_filename,
+		std::string extend = ""
+	);
+
 	///
 	/// ポリゴン座標の移動。
 	/// 本クラスインスタンス配下の全PolygonGroupのmoveメソッドが呼び出される。
@@ -202,10 +316,162 @@ public:
 	/// moveメソッドにより移動した三角形ポリゴン情報を隣接PE間でやり取りする。
 	///
 	/// @return	POLYLIB_STATで定義される値が返る。
+	/// @attention	migrate_begin()からmigrate_end()までの間は呼び出せない。
 	///
 	POLYLIB_STAT
 	migrate();
 
+	///
+	/// ポリゴンデータのPE間移動を開始する。migrate()の前半部。
+	/// 移動した三角形ポリゴン情報を隣接PEへ非同期に送信し、受信を登録して
+	/// すぐに戻る。migrate_end()までの間、ソルバは内部セルの計算を行える。
+	///
+	/// @return	POLYLIB_STATで定義される値が返る。
+	/// @attention	migrate_end()を呼ぶまで、ポリゴンの移動・追加・削除や
+	///				他のMPI通信を伴うPolylibのメソッドを呼び出してはならない。
+	///				ポリゴンの検索は行ってよい。
+	///
+	POLYLIB_STAT
+	migrate_begin();
+
+	///
+	/// ポリゴンデータのPE間移動を完了する。migrate()の後半部。
+	/// 受信した三角形ポリゴン情報を到着順に各グループへ追加し、
+	/// 移動可能グループのKD木を再構築して自PE領域外の三角形を削除する。
+	///
+	/// @return	POLYLIB_STATで定義される値が返る。いずれかのrankで三角形の
+	///			追加や再構築に失敗した場合は、全rankでエラーを返す。
+	/// @attention	MPI通信でエラーとなった場合は未完了の受信を取り消し、
+	///				移動は中断したものとして扱う。
+	///
+	POLYLIB_STAT
+	migrate_end();
+
+	///
+	/// 計算領域の再分割。負荷分散等で変わった自PE領域を全rankで各々設定し、
+	/// 全PE領域情報と隣接PEリストを作り直す。ポリゴンデータは再読み込み
+	/// せず、担当が新たに加わった三角形だけを全対全通信で配信し、新しい
+	/// 自PE領域外の三角形は消去する。
+	/// 引数はinit_parallel_info()と同じ。全rankで呼び出すこと。
+	///
+	/// @param[in] bpos		新しい自PE担当領域の基点座標
+	/// @param[in] bbsize	同、計算領域のボクセル数
+	/// @param[in] gcsize	同、ガイドセルのボクセル数
+	/// @param[in] dx		同、ボクセル１辺の長さ
+	/// @return	POLYLIB_STATで定義される値が返る。
+	/// @attention	migrate_begin()からmigrate_end()までの間は呼び出せない。
+	///
+	POLYLIB_STAT
+	repartition(
+		float bpos[3],
+		unsigned int bbsize[3],
+		unsigned int gcsize[3],
+		float dx[3]
+	);
+
+	///
+	/// 負荷分散の提案。全rankのボクセル数からソルバのコストを、三角形の
+	/// 分布と計測した検索・KD木再構築時間(Polylib::set_cost_measure())から
+	/// 形状のコストを見積もり、両者の和が均等になるよう全rank領域を再帰
+	/// 二分割した新しい自PE領域を求める。結果はrepartition()にそのまま渡せる。
+	/// 分割前後の負荷不均衡度はrank0が報告として出力する。全rankで呼び出すこと。
+	///
+	/// @param[in] cell_cost			ソルバの1セルあたりの計算時間(秒)。
+	/// @param[out] new_bpos			提案する自PE担当領域の基点座標
+	/// @param[out] new_bbsize			同、計算領域のボクセル数
+	/// @param[out] imbalance_before	現在の領域での負荷不均衡度(最大/平均)。
+	/// @param[out] imbalance_after		提案する領域での負荷不均衡度の見積もり。
+	/// @return	POLYLIB_STATで定義される値が返る。
+	/// @attention	全rankのボクセル１辺の長さが等しく、全rankの担当領域が
+	///				一つの直方体を隙間なく埋めていること。
+	///				計測時間がなければ三角形1個のコストをセル1個と同じとみなす。
+	///
+	POLYLIB_STAT
+	advise_balance(
+		float cell_cost,
+		float new_bpos[3],
+		unsigned int new_bbsize[3],
+		float *imbalance_before = NULL,
+		float *imbalance_after = NULL
+	);
+
+	///
+	/// 全rankの三角形ポリゴンの数と面積の合計。各rankが所有する三角形
+	/// (PrivateTriangle::is_owned())だけを数えるので、ガイドセル領域で
+	/// 複数rankが持つ三角形も1回だけ数える。全rankで呼び出すこと。
+	///
+	/// @param[in] group_name	グループ名。
+	/// @param[out] num			全rankの三角形ポリゴン数。
+	/// @param[out] area		全rankの面積の合計。
+	/// @return	POLYLIB_STATで定義される値が返る。
+	///
+	POLYLIB_STAT
+	get_global_stats(
+		std::string group_name,
+		unsigned long long *num,
+		double *area
+	);
+
+	///
+	/// 全rankを対象とした最近傍検索。各rankが自分の検索点の並びを与える
+	/// 集団操作で、全rankで呼び出すこと(検索点は0個でもよい)。
+	/// 自rankで見つけた三角形までの距離より近い三角形を持ち得るrank
+	/// (三角形を外包するBounding Boxまでの距離で判定)にだけ問い合わせ、
+	/// 最も近いものを返す。距離の定義はsearch_nearest_polygon()と同じ
+	/// (三角形の重心までの距離)だが、各rankではKD木を分枝限定法で探索する
+	/// ので、近似のない最近傍となる。
+	///
+	/// @param[in] group_name	グループ名。
+	/// @param[in] pos			検索点のリスト。
+	/// @param[out] hits		検索点毎の結果。見つからなければm_rankが-1。
+	/// @return	POLYLIB_STATで定義される値が返る。
+	///
+	POLYLIB_STAT
+	search_nearest_global(
+		std::string group_name,
+		const std::vector<Vec3f>& pos,
+		std::vector<GlobalQueryHit>* hits
+	);
+
+	///
+	/// 全rankを対象とした線分検索。線分orig + t * dir (0 <= t <= tmax)と
+	/// 最初に交差する三角形を返す。集団操作で、全rankで呼び出すこと。
+	/// 自rankで見つけた交差位置より手前で線分と交差するBounding Boxを持つ
+	/// rankにだけ問い合わせる。
+	///
+	/// @param[in] group_name	グループ名。
+	/// @param[in] orig			始点のリスト。
+	/// @param[in] dir			方向ベクトルのリスト(origと同じ要素数)。
+	/// @param[in] tmax			tの上限。
+	/// @param[out] hits		線分毎の結果。交差しなければm_rankが-1。
+	/// @return	POLYLIB_STATで定義される値が返る。
+	///
+	POLYLIB_STAT
+	search_ray_global(
+		std::string group_name,
+		const std::vector<Vec3f>& orig,
+		const std::vector<Vec3f>& dir,
+		float tmax,
+		std::vector<GlobalQueryHit>* hits
+	);
+
+	///
+	/// 全rankを対象とした矩形領域検索。矩形領域と外包するBounding Boxが
+	/// 交差する三角形を、各rankが所有する三角形から重複なく集める。
+	/// 集団操作で、全rankで呼び出すこと。
+	///
+	/// @param[in] group_name	グループ名。
+	/// @param[in] boxes		矩形領域のリスト。
+	/// @param[out] hits		矩形領域毎の結果。順序は不定。
+	/// @return	POLYLIB_STATで定義される値が返る。
+	///
+	POLYLIB_STAT
+	search_box_global(
+		std::string group_name,
+		const std::vector<BBox>& boxes,
+		std::vector< std::vector<GlobalQueryHit> >* hits
+	);
+
 	///
 	/// m_myprocの内容をget
 	/// @return 自PE領域情報
@@ -217,7 +483,22 @@ public:
 	///
 	/// @return 利用中のメモリ量(byte)
 	///
-	unsigned int used_memory_size();
+	size_t used_memory_size();
+
+	///
+	/// MPIPolylibが利用中のメモリ量の内訳を返す。
+	/// Polylibの内訳に、PE領域情報、除外三角形IDリスト、MPI通信用バッファを
+	/// 加えたもの。除外三角形IDリストは該当グループの内訳にも加算される。
+	///
+	/// @param[out] usage		全体のメモリ量の内訳(byte)。
+	/// @param[out] group_usage	グループ毎(フルパス名がキー)のメモリ量の内訳。
+	///							不要な場合はNULL。
+	/// @return	POLYLIB_STATで定義される値が返る。
+	///
+	POLYLIB_STAT used_memory_usage(
+		PolylibMemoryUsage							*usage,
+		std::map<std::string, PolylibMemoryUsage>	*group_usage = NULL
+	);
 
 protected:
 	///
@@ -253,6 +534,8 @@ protected:
 
 	///
 	/// 各PE領域内ポリゴン情報を全rankに送信
+	/// 三角形数を先にMPI_Scatterで配り、三角形はMPI_Scattervで一括して送る。
+	/// 他rankのreceive_polygons_from_rank0()と対で呼ぶ集団通信。
 	///
 	/// @return	POLYLIB_STATで定義される値が返る。
 	///
@@ -275,31 +558,271 @@ protected:
 	);
 
 	///
-	/// 三角形の送信情報を作成。
-	/// 
-	/// @param[in,out] p_vec 情報追加先ベクタ
-	/// @param[in] p_trias グループ内三角形リスト
+	/// 設定ファイルを全rankで読み込んでグループ階層構造を構築し、全rankの
+	/// ガイドセルを含む領域をrank番号順に並べる。
+	///
+	/// @param[in] config_filename	初期化ファイル名。
+	/// @param[out] boxes			全rankのガイドセルを含む領域。
 	/// @return	POLYLIB_STATで定義される値が返る。
 	///
 	POLYLIB_STAT
-	pack_trias(
-		std::vector<float>* p_vec,
-		const std::vector<PrivateTriangle*>* p_trias
+	load_config_all(
+		std::string config_filename,
+		std::vector<BBox>* boxes
 	);
 
 	///
-	/// 三角形IDの送信情報を作成。
-	/// 
-	/// @param[in,out] p_vec 情報追加先ベクタ
-	/// @param[in] p_trias グループ内三角形リスト
+	/// 一つのポリゴングループをload_collective()の方式で読み込む。
+	///
+	/// @param[in,out] p_pg	ポリゴングループ。
+	/// @param[in] boxes	全rankのガイドセルを含む領域(rank番号順)。
 	/// @return	POLYLIB_STATで定義される値が返る。
 	///
 	POLYLIB_STAT
-	pack_tria_ids(
-		std::vector<int>* p_vec,
+	load_collective_group(
+		PolygonGroup* p_pg,
+		const std::vector<BBox>& boxes
+	);
+
+	///
+	/// 一つのポリゴングループをsave_collective()の方式で書き出す。
+	///
+	/// @param[in] p_pg			ポリゴングループ。
+	/// @param[in] stl_fname	共有STLファイル名。
+	/// @param[in] id_fname		共有IDファイル名。
+	/// @param[out] written		全rankの三角形数が0でなく、書き出したか。
+	/// @return	POLYLIB_STATで定義される値が返る。
+	///
+	POLYLIB_STAT
+	save_collective_group(
+		PolygonGroup* p_pg,
+		const std::string& stl_fname,
+		const std::string& id_fname,
+		bool* written
+	);
+
+	///
+	/// 自rankが所有する三角形を抽出する。三角形の重心を担当領域(ガイドセルを
+	/// 含まない)に含むrankのうち、最小のrankを所有者とする。どのrankの
+	/// 担当領域にも含まれなければ、ガイドセル領域が三角形と交差するrankの
+	/// うち、担当領域が最も近いrankを所有者とする。
+	/// 三角形を持つ全rankが同じ所有者を求めるので、所有者はただ一つとなる。
+	///
+	/// @param[in] p_trias	自rankが持つ三角形リスト。
+	/// @param[out] owned	自rankが所有する三角形の追加先。
+	///
+	void
+	select_owned_trias(
+		const std::vector<PrivateTriangle*>* p_trias,
+		std::vector<PrivateTriangle*>* owned
+	);
+
+	///
+	/// 全リーフグループの三角形に、select_owned_trias()で求めた所有フラグを
+	/// 設定する。三角形の分布が変わる読み込み、migrate_end()、repartition()
+	/// の最後に呼び出す。move()からmigrate()までの間は移動前の所有者のまま
+	/// とするので、その間も所有者はただ一つとなる。
+	///
+	void
+	update_ownership();
+
+	///
+	/// 全rankについて、指定したリーフグループの三角形を外包するBounding Box
+	/// を集める。三角形がなければ空のBounding Box(BBox::init())となる。
+	///
+	/// @param[in] leaves	リーフグループリスト。
+	/// @param[out] boxes	rank番号順のBounding Box。
+	/// @return	POLYLIB_STATで定義される値が返る。
+	///
+	POLYLIB_STAT
+	acq_rank_boxes(
+		const std::vector<PolygonGroup*>& leaves,
+		std::vector<BBox>* boxes
+	);
+
+	///
+	/// 全rank検索の問い合わせを全対全通信で送り、受け取った問い合わせを
+	/// 自rankで評価して、回答を全対全通信で送信元rankへ返す。
+	///
+	/// @param[in] kind			検索の種類(MPIPolylib.cxxのGQ_*)。
+	/// @param[in] leaves		検索対象のリーフグループリスト。
+	/// @param[in] send			送信先rank順に詰めた問い合わせ。
+	/// @param[in] send_num		送信先rank毎の問い合わせ数。
+	/// @param[out] replies		受信した回答。送信元rank順。
+	/// @param[out] reply_num	送信元rank毎の回答数。
+	/// @return	POLYLIB_STATで定義される値が返る。
+	///
+	POLYLIB_STAT
+	exchange_queries(
+		int kind,
+		const std::vector<PolygonGroup*>& leaves,
+		const std::vector<char>& send,
+		const std::vector<int>& send_num,
+		std::vector<char>* replies,
+		std::vector<int>* reply_num
+	);
+
+	///
+	/// 固定長レコードを送信先rank毎に全対全通信で送受信する。
+	///
+	/// @param[in] send			送信先rank順に詰めたレコード。
+	/// @param[in] send_num		送信先rank毎のレコード数。
+	/// @param[in] rec_size		レコード1個のバイト数。
+	/// @param[out] recv		受信したレコード。送信元rank順。
+	/// @param[out] recv_num	送信元rank毎のレコード数。
+	/// @return	POLYLIB_STATで定義される値が返る。
+	///
+	POLYLIB_STAT
+	alltoall_records(
+		const std::vector<char>& send,
+		const std::vector<int>& send_num,
+		int rec_size,
+		std::vector<char>* recv,
+		std::vector<int>* recv_num
+	);
+
+	///
+	/// 全rankで共有するファイルに、固定長レコードをMPI-IOの集団書き込みで
+	/// 書き出す。ファイルは切り詰めてから書き出す。
+	///
+	/// @param[in] fname	ファイル名。
+	/// @param[in] head		rank0がファイル先頭に書き出すヘッダ。
+	/// @param[in] head_len	ヘッダ長。0ならヘッダなし。
+	/// @param[in] offset	自rankのレコードの書き込み位置(バイト)。
+	/// @param[in] data		自rankのレコード。
+	/// @param[in] num		自rankのレコード数。
+	/// @param[in] rec_len	レコード長(バイト)。
+	/// @return	POLYLIB_STATで定義される値が返る。
+	///
+	POLYLIB_STAT
+	write_shared_file(
+		const std::string& fname,
+		const char* head,
+		int head_len,
+		MPI_Offset offset,
+		const char* data,
+		int num,
+		int rec_len
+	);
+
+	///
+	/// 全rankで共有するファイルから、固定長レコードをMPI-IOの集団読み込みで
+	/// 読み込む。
+	///
+	/// @param[in] fname	ファイル名。
+	/// @param[in] offset	自rankのレコードの読み込み位置(バイト)。
+	/// @param[out] data	自rankのレコードの格納先。
+	/// @param[in] num		自rankのレコード数。
+	/// @param[in] rec_len	レコード長(バイト)。
+	/// @return	POLYLIB_STATで定義される値が返る。
+	///
+	POLYLIB_STAT
+	read_shared_file(
+		const std::string& fname,
+		MPI_Offset offset,
+		char* data,
+		int num,
+		int rec_len
+	);
+
+	///
+	/// 一つのポリゴングループをload_distributed()の方式で読み込む。
+	///
+	/// @param[in,out] p_pg	ポリゴングループ。
+	/// @param[in] boxes	全rankのガイドセルを含む領域(rank番号順)。
+	/// @param[in] scale	頂点座標のスケール。
+	/// @return	POLYLIB_STATで定義される値が返る。
+	///
+	POLYLIB_STAT
+	load_distributed_group(
+		PolygonGroup* p_pg,
+		const std::vector<BBox>& boxes,
+		float scale
+	);
+
+	///
+	/// 各rankが読み込んだ三角形を領域が交差する全rankへ全対全通信で配信し、
+	/// 受信した三角形でポリゴングループを構築する。グループにidが指定されて
+	/// いれば、全三角形のm_exidをその値とする。
+	///
+	/// @param[in,out] p_pg	ポリゴングループ。
+	/// @param[in] boxes	全rankのガイドセルを含む領域(rank番号順)。
+	/// @param[in] p_trias	自rankが読み込んだ三角形リスト。
+	/// @return	POLYLIB_STATで定義される値が返る。
+	///
+	POLYLIB_STAT
+	exchange_polygons(
+		PolygonGroup* p_pg,
+		const std::vector<BBox>& boxes,
 		const std::vector<PrivateTriangle*>* p_trias
 	);
 
+	///
+	/// 三角形毎に指定したrankへ全対全通信で三角形を送り、受信した三角形を
+	/// 返す。
+	///
+	/// @param[in] p_trias		自rankの三角形リスト。
+	/// @param[in] dest			送信先rank番号リスト(三角形順)。
+	/// @param[in] dest_pos		三角形i番目の送信先はdest[dest_pos[i]]から
+	///							dest[dest_pos[i+1]-1]。
+	/// @param[out] p_recv		受信した三角形の追加先。解放は呼び出し側で行う。
+	/// @return	POLYLIB_STATで定義される値が返る。
+	///
+	POLYLIB_STAT
+	alltoall_polygons(
+		const std::vector<PrivateTriangle*>* p_trias,
+		const std::vector<int>& dest,
+		const std::vector<unsigned int>& dest_pos,
+		std::vector<PrivateTriangle*>* p_recv
+	);
+
+	///
+	/// 全rankのガイドセルを含む領域をrank番号順に取得する。
+	///
+	/// @param[out] boxes	全rankの領域。
+	///
+	void
+	acq_gcell_boxes(
+		std::vector<BBox>* boxes
+	);
+
+	///
+	/// 自PE領域情報を設定し、全rankへ配信して全PE領域情報リストと
+	/// 隣接PE領域情報リストを作成する。設定済みのリストは作り直す。
+	///
+	/// @param[in] bpos		自PE担当領域の基点座標
+	/// @param[in] bbsize	同、計算領域のボクセル数
+	/// @param[in] gcsize	同、ガイドセルのボクセル数
+	/// @param[in] dx		同、ボクセル１辺の長さ
+	/// @return	POLYLIB_STATで定義される値が返る。
+	///
+	POLYLIB_STAT
+	set_parallel_area(
+		float bpos[3],
+		unsigned int bbsize[3],
+		unsigned int gcsize[3],
+		float dx[3]
+	);
+
+	///
+	/// 全rankの処理結果を集約する。一つでもエラーのrankがあればエラーとなる。
+	///
+	/// @param[in] ret	自rankの処理結果。
+	/// @return	全rankで成功ならPLSTAT_OK、そうでなければエラー値。
+	///
+	POLYLIB_STAT
+	reduce_stat(
+		POLYLIB_STAT ret
+	);
+
+	///
+	/// migrate_begin()で登録済みの非同期送受信を解放する。受信は取り消し、
+	/// 送信は取り消さずに完了に任せる。
+	/// migrate_begin()、migrate_end()の途中でMPI通信がエラーとなった場合に利用する。
+	///
+	void
+	cancel_migrate_reqs();
+
 	///
 	/// 自領域内ポリゴンのみ抽出してポリゴン情報を再構築。
 	/// migrate実行後に行う。
@@ -319,6 +842,7 @@ protected:
 
 	///
 	/// 自領域に必要なポリゴン情報をrank0から受信
+	/// rank0のsend_polygons_to_all()と対で呼ぶ集団通信。
 	/// 
 	/// @return	POLYLIB_STATで定義される値が返る。
 	///
@@ -327,12 +851,15 @@ protected:
 
 	///
 	/// 他rankからポリゴン情報をrank0で受信
+	/// 三角形数を先にMPI_Gatherで集め、三角形はMPI_Gathervで一括して受信する。
+	/// 他rankのsend_polygons_to_rank0()と対で呼ぶ集団通信。
 	///
 	POLYLIB_STAT
 	gather_polygons();
 
 	///
 	/// rank0へポリゴン情報を送信
+	/// rank0のgather_polygons()と対で呼ぶ集団通信。
 	///
 	POLYLIB_STAT
 	send_polygons_to_rank0();
@@ -360,6 +887,13 @@ protected:
 	/// 隣接PE担当領域情報リスト
 	std::vector<ParallelInfo*> m_neibour_procs;
 
+	/// rank番号で引く全PE担当領域情報(自PEは&m_myproc)
+	std::vector<ParallelInfo*> m_rank_procs;
+
+	/// rank番号順の全PEの担当領域(ガイドセルを含まない)。三角形の所有者の
+	/// 判定に利用する
+	std::vector<BBox> m_rank_areas;
+
 	/// 自プロセスのランク数
 	int m_myrank;
 
@@ -368,6 +902,28 @@ protected:
 
 	/// 自プロセスが利用するコミュニケーター
 	MPI_Comm m_mycomm;
+
+	/// migrate()の隣接PE毎の送信ヘッダ(グループIDと三角形数の対)。
+	/// 送受信バッファはステップ間で再利用する
+	std::vector< std::vector<int> > m_mig_send_head;
+
+	/// migrate()の隣接PE毎の送信三角形(三角形のレコード)
+	std::vector< std::vector<char> > m_mig_send_buf;
+
+	/// migrate()の隣接PE毎の受信ヘッダ
+	std::vector< std::vector<int> > m_mig_recv_head;
+
+	/// migrate()の隣接PE毎の受信三角形
+	std::vector< std::vector<char> > m_mig_recv_buf;
+
+	/// migrate()の送信MPI_Request。[0,n)がヘッダ、[n,2n)が三角形
+	std::vector<MPI_Request> m_mig_send_reqs;
+
+	/// migrate()の受信MPI_Request。並びは送信と同じ
+	std::vector<MPI_Request> m_mig_recv_reqs;
+
+	/// migrate_begin()を呼び、migrate_end()が未完了か
+	bool m_mig_active;
 };
 
 } //namespace PolylibNS
@@ -13,13 +13,16 @@
 #define polylib_h
 
 #include <vector>
+#include <map>
 #include <iostream>
 #include "polygons/Polygons.h"
 #include "polygons/TriMesh.h"
 #include "polygons/Triangle.h"
 #include "groups/PolygonGroup.h"
 #include "groups/PolygonGroupFactory.h"
+#include "file_io/PolylibAsyncSave.h"
 #include "common/PolylibStat.h"
+#include "common/PolylibMemory.h"
 #include "common/PolylibCommon.h"
 #include "common/BBox.h"
 #include "common/Vec3.h"
@@ -125,6 +128,25 @@ public:
 			float				scale = 1.0
 	);
 
+	///
+	/// PolygoGroup、三角形ポリゴン情報の領域を限定した読み込み。
+	/// load()と同様にグループツリーを作成し、STLファイルからはBounding Box
+	/// が指定領域と交差する三角形だけを読み込む。STLファイルは一定サイズ毎に
+	/// 処理するため、必要なメモリ量は読み込んだ三角形の数に比例する。
+	///
+	///  @param[in] config_name 設定ファイル名。
+	///  @param[in] region		読み込む領域(スケール適用後の座標)。
+	///  @param[in] scale		頂点座標のスケール。
+	///  @return	POLYLIB_STATで定義される値が返る。
+	///  @attention	三角形IDは全体を読み込んだ場合と同じ値になる。
+	///				スナップショットファイルは領域に関わらず全体を読み込む。
+	///
+	POLYLIB_STAT load(
+		std::string			config_name,
+		const BBox			&region,
+		float				scale = 1.0
+	);
+
 	///
 	/// PolygoGroupツリー、三角形ポリゴン情報の保存。
 	/// グループツリーの情報を設定ファイルへ出力。三角形ポリゴン情報をSTL
@@ -140,6 +162,10 @@ public:
 	///  @attention	ファイル名命名規約は次の通り。
 	///			定義ファイル : polylib_config_ランク番号_付加文字.xml。
 	///			STLファイル  : ポリゴングループ名_ランク番号_付加文字.拡張子。
+	///			stl_formatにTriMeshIO::FMT_SNAPを指定すると、STLファイルの代わりに
+	///			KD木を含むスナップショットファイル(拡張子plsnap)を出力する。
+	///			stl_formatの末尾に.gzを付けると("stl_b.gz"等)、gzip圧縮した
+	///			STLファイル(拡張子stlb.gz等)を出力する(要USE_ZLIB)。
 	///
 	POLYLIB_STAT save(
 		std::string			*p_config_name,
@@ -147,6 +173,93 @@ public:
 		std::string			extend = ""
 	);
 
+	///
+	/// PolygonGroupツリー、三角形ポリゴン情報の非同期保存。
+	/// 三角形ポリゴン情報を複製して設定ファイルを書き出した後、STLファイルは
+	/// handleの作業スレッドで書き出す。本メソッドから戻った後はポリゴン情報を
+	/// 変更してよい。書き出しの完了はhandle->wait()で待つ。
+	///
+	///  @param[in,out] handle		非同期保存のハンドル。前回の書き出し中で
+	///								あれば、その完了を待ってから登録する。
+	///  @param[out] p_config_name	保存した設定ファイル名。
+	///  @param[in]	 stl_format		save()と同じ。
+	///  @param[in]  extend			save()と同じ。
+	///  @return	POLYLIB_STATで定義される値が返る。STLファイルの書き出し
+	///				結果はhandle->wait()が返す。
+	///  @attention	スナップショット(TriMeshIO::FMT_SNAP)はKD木を含むため
+	///				複製せず、本メソッド内で書き出す。
+	///
+	POLYLIB_STAT save_async(
+		PolylibAsyncSave	*handle,
+		std::string			*p_config_name,
+		std::string			stl_format,
+		std::string			extend = ""
+	);
+
+	///
+	/// 差分保存の設定。有効にすると、save()、save_async()、
+	/// MPIPolylib::save_parallel()等は前回の保存以降に変更されたグループの
+	/// STLファイルとIDファイルだけを書き出し、変更されていないグループは
+	/// 設定ファイルから前回保存したファイルを参照する。
+	/// 変更はPolygonGroup::is_dirty()で判定する。
+	///
+	///  @param[in] delta	true:差分保存する/false:全グループを書き出す(既定)。
+	///  @attention	参照されるファイルは前回以前の保存で書き出したものなので、
+	///				利用者が削除しないこと。ランク番号、STLファイルフォーマット、
+	///				IDファイルの形式が前回と異なるグループは書き出す。
+	///
+	void set_delta_save(
+		bool	delta
+	) {
+		m_delta_save = delta;
+	}
+
+	///
+	/// 差分保存の設定を取得。
+	///
+	///  @return	true:差分保存する。
+	///
+	bool get_delta_save() const {
+		return m_delta_save;
+	}
+
+	///
+	/// 検索・KD木再構築時間の計測の設定。有効にすると、search_polygons()、
+	/// search_nearest_polygon()の処理時間を検索時間として、move()、
+	/// MPIPolylib::migrate()等のKD木再構築の処理時間を再構築時間として
+	/// 積算する。MPIPolylib::advise_balance()が負荷の見積もりに使う。
+	///
+	///  @param[in] measure	true:計測する/false:計測しない(既定)。
+	///  @attention	計測中は複数のスレッドから同時に検索しないこと。
+	///
+	void set_cost_measure(
+		bool	measure
+	) {
+		m_cost_measure = measure;
+	}
+
+	///
+	/// 積算した検索・KD木再構築時間の取得。
+	///
+	///  @param[out] query_time		検索時間(秒)。
+	///  @param[out] rebuild_time	KD木再構築時間(秒)。
+	///
+	void get_cost_times(
+		double	*query_time,
+		double	*rebuild_time
+	) const {
+		*query_time = m_query_time;
+		*rebuild_time = m_rebuild_time;
+	}
+
+	///
+	/// 積算した検索・KD木再構築時間を0にする。
+	///
+	void reset_cost_times() {
+		m_query_time = 0.0;
+		m_rebuild_time = 0.0;
+	}
+
 	///
 	/// 三角形ポリゴン座標の移動。
 	/// 本クラスインスタンス配下の全PolygonGroupのmoveメソッドが呼び出される。
@@ -179,6 +292,8 @@ public:
 	///   						false:3頂点の一部でも検索領域と重なるものを抽出。
 	///  @return	抽出した三角形ポリゴンのvector。
 	///  @attention 返却した三角形ポリゴンは、削除不可。vectorは要削除。
+	///  @attention 頂点座標を量子化したグループの三角形ポリゴンは、同じ
+	///				グループを次に検索するまで有効。
 	///
 	std::vector<Triangle*>* search_polygons(
 		std::string		group_name, 
@@ -193,12 +308,72 @@ public:
 	///  @param[in] group_name	抽出グループ名。
 	///  @param[in] pos			指定した点。
 	///  @return    検索されたポリゴン
+	///  @attention 頂点座標を量子化したグループの三角形ポリゴンは、同じ
+	///				グループを次に検索するまで有効。
 	///
 	const Triangle* search_nearest_polygon(
 		std::string group_name,
 		const Vec3f&    pos
 	) const;
 
+	///
+	/// 線分orig + t * dir (0 <= t <= tmax)と最初に交差する三角形ポリゴンの
+	/// 検索。ポリゴンの表裏は区別しない。
+	///
+	///  @param[in]  group_name	抽出グループ名。
+	///  @param[in]  orig		始点。
+	///  @param[in]  dir		方向ベクトル。
+	///  @param[in]  tmax		tの上限。
+	///  @param[out] t			交差位置のt。
+	///  @return    検索されたポリゴン。交差しなければNULL。
+	///  @attention 頂点座標を量子化したグループの三角形ポリゴンは、同じ
+	///				グループを次に検索するまで有効。
+	///
+	const Triangle* search_ray_polygon(
+		std::string		group_name,
+		const Vec3f&	orig,
+		const Vec3f&	dir,
+		float			tmax,
+		float			*t
+	) const;
+
+	///
+	/// 自rankが所有する三角形ポリゴンの検索。
+	/// search_polygons()の結果から、他rankが所有するガイドセル領域の複製を
+	/// 除いたものを返す。全rankの結果を合わせると、重複なく1回ずつ現れる。
+	/// 逐次版ではsearch_polygons()と同じ結果となる。
+	///
+	///  @param[in] group_name	抽出グループ名。
+	///  @param[in] min_pos		抽出する矩形領域の最小値。
+	///  @param[in] max_pos		抽出する矩形領域の最大値。
+	///  @param[in] every		true:3頂点が全て検索領域に含まれるものを抽出。
+	///   						false:3頂点の一部でも検索領域と重なるものを抽出。
+	///  @return	抽出した三角形ポリゴンのvector。
+	///  @attention 返却した三角形ポリゴンは、削除不可。vectorは要削除。
+	///
+	std::vector<Triangle*>* search_owned_polygons(
+		std::string		group_name, 
+		Vec3f			min_pos, 
+		Vec3f			max_pos, 
+		bool			every
+	) const;
+
+	///
+	/// 自rankが所有する三角形ポリゴンの数と面積の合計。
+	/// group_nameで指定されたグループの下のリーフグループを対象とする。
+	///
+	///  @param[in]  group_name	グループ名。
+	///  @param[out] num		三角形ポリゴン数。
+	///  @param[out] area		面積の合計。
+	///  @return	POLYLIB_STATで定義される値が返る。
+	///  @see		MPIPolylib::get_global_stats()
+	///
+	POLYLIB_STAT get_owned_stats(
+		std::string			group_name,
+		unsigned long long	*num,
+		double				*area
+	) const;
+
 	///
 	/// 引数のグループ名が既存グループと重複しないかチェック。
 	///
@@ -239,6 +414,19 @@ public:
 		PolygonGroup	*pg
 	);
 
+	///
+	/// PolygonGroupをグループ索引に登録する。
+	/// フルパス名、グループ名、内部IDからget_group()で検索できるようにする。
+	/// 名前と内部IDが確定した時点(build_group_tree())で呼び出される。
+	///
+	///  @param[in] pg		PolygonGroup
+	///  @attention	Polylib内部で使用する関数であり、通常は利用者が用いるもの
+	///				ではない。登録後にグループ名を変更した場合は再登録すること。
+	///
+	void register_group(
+		PolygonGroup	*pg
+	);
+
 	///
 	/// グループ階層構造を標準出力に出力。
 	/// 2010.10.20 引数FILE *追加。
@@ -268,7 +456,21 @@ public:
 	///
 	/// @return 利用中のメモリ量(byte)
 	///
-	unsigned int used_memory_size();
+	size_t used_memory_size();
+
+	///
+	/// Polylibが利用中のメモリ量の内訳を返す。
+	/// 各値はvectorのcapacity等、実際に確保されている領域から算出する。
+	///
+	/// @param[out] usage		全体のメモリ量の内訳(byte)。
+	/// @param[out] group_usage	グループ毎(フルパス名がキー)のメモリ量の内訳。
+	///							不要な場合はNULL。
+	/// @return	POLYLIB_STATで定義される値が返る。
+	///
+	POLYLIB_STAT used_memory_usage(
+		PolylibMemoryUsage							*usage,
+		std::map<std::string, PolylibMemoryUsage>	*group_usage = NULL
+	);
 
 	///
 	/// グループの取得。
@@ -305,6 +507,26 @@ protected:
 	///
 	~Polylib();
 
+	///
+	/// 計測用の時刻取得。計測しない設定ならば0を返す。
+	///
+	///  @return	時刻(秒)。
+	///
+	double cost_clock() const;
+
+	///
+	/// 指定したグループ配下のリーフグループを取得する。
+	/// 指定したグループ自身がリーフならばそのグループとなる。
+	///
+	///  @param[in]  group_name	グループ名。
+	///  @param[out] leaves		リーフグループの追加先。
+	///  @return	POLYLIB_STATで定義される値が返る。
+	///
+	POLYLIB_STAT acq_leaf_groups(
+		std::string					group_name,
+		std::vector<PolygonGroup*>	*leaves
+	) const;
+
 	///
 	/// グループツリー作成。
 	/// TextParser クラスを使い、
@@ -371,12 +593,65 @@ protected:
 	///				込んでm_idを設定する。
 	///				falseならば、STL読み込み時にm_idを自動生成。
 	///  @param[in]	id_format		三角形IDファイルの入力形式。
+	///  @param[in]	scale			頂点座標のスケール。
+	///  @param[in]	region			指定した場合、この領域と交差する三角形だけを
+	///								読み込む。
 	///  @return	POLYLIB_STATで定義される値が返る。
+	///  @attention	OpenMP有効時はリーフグループ毎に並列に読み込むため、
+	///				load_stl_file()等をオーバーライドする場合はスレッド安全に
+	///				すること。エラー時はグループリスト順で最初のエラーを返す。
 	///
 	POLYLIB_STAT load_polygons(
 		bool		with_id_file,
 		ID_FORMAT	id_format,
-		float		scale = 1.0
+		float		scale = 1.0,
+		const BBox	*region = NULL
+	);
+
+	///
+	/// STLファイルとIDファイルの保存。
+	/// ポリゴンを持つ全リーフグループについてファイルを書き出し、
+	/// 設定ファイル用のパラメータを設定する。差分保存では変更のない
+	/// グループは書き出さず、前回のファイル名をstl_fname_mapに登録する。
+	///
+	///  @param[in]		rank_no			ファイル名に付加するランク番号。
+	///  @param[in]		extend			ファイル名に付加する拡張文字列。
+	///  @param[in]		stl_format		STLファイルの出力形式。
+	///  @param[in]		id_format		三角形IDファイルの出力形式。
+	///  @param[in]		with_id_file	trueならば、IDファイルも書き出す。
+	///  @param[in,out]	stl_fname_map	保存したSTLファイル名の登録先。
+	///  @param[in,out]	async			非同期保存のハンドル。指定した場合は
+	///									ポリゴン情報を複製して登録する。
+	///  @return	POLYLIB_STATで定義される値が返る。
+	///  @attention	OpenMP有効時はリーフグループ毎に並列に書き出すため、
+	///				save_stl_file()等をオーバーライドする場合はスレッド安全に
+	///				すること。mk_param_tag()はグループリスト順に逐次に呼ぶ。
+	///
+	POLYLIB_STAT save_polygons(
+		std::string							rank_no,
+		std::string							extend,
+		std::string							stl_format,
+		ID_FORMAT							id_format,
+		bool								with_id_file,
+		std::map<std::string,std::string>	&stl_fname_map,
+		PolylibAsyncSave					*async = NULL
+	);
+
+	///
+	/// PolygonGroupツリー、三角形ポリゴン情報の保存。save()、save_async()の
+	/// 実体。
+	///
+	///  @param[out] p_config_name	保存した設定ファイル名。
+	///  @param[in]	 stl_format		STLファイルフォーマット。
+	///  @param[in]  extend			ファイル名に付加される文字列。
+	///  @param[in,out] async		非同期保存のハンドル。NULLならば同期保存。
+	///  @return	POLYLIB_STATで定義される値が返る。
+	///
+	POLYLIB_STAT save_files(
+		std::string			*p_config_name,
+		std::string			stl_format,
+		std::string			extend,
+		PolylibAsyncSave	*async
 	);
 
 	///
@@ -448,11 +723,16 @@ protected:
 	///	 @param[in]	 extend			ファイ名に付加される文字列。
 	///	 @param[in]	 stl_format		STLファイルフォーマット指定。
        	///  @param[in]	 id_format		三角形IDファイルの出力形式。
+	///  @param[in,out] async		非同期保存のハンドル。NULLならば同期保存。
 	///  @return	POLYLIB_STATで定義される値が返る。
 	///  @attention	ファイル名命名規約は次の通り。
 	///			定義ファイル : polylib_config_ランク番号_付加文字.xml。
 	///			STLファイル  : ポリゴングループ名_ランク番号_付加文字.拡張子。
 	///			IDファイル   : ポリゴングループ名_ランク番号_付加文字.ID。
+	///			stl_formatの末尾に.gzを付けると、STLファイルとIDファイルを
+	///			gzip圧縮して拡張子に.gzを付ける。
+	///			asyncを指定すると、STLファイルとIDファイルはsave_async()と
+	///			同様に作業スレッドで書き出す。
 	///  @attention	MPIPolylibクラスがMPI環境で利用することを想定している。
 	POLYLIB_STAT save_with_rankno(
 		std::string		*p_config_name,
@@ -460,7 +740,8 @@ protected:
 		int				maxrank,
 		std::string		extend,
 		std::string		stl_format,
-		ID_FORMAT		id_format
+		ID_FORMAT		id_format,
+		PolylibAsyncSave	*async = NULL
 	);
 
 	///
@@ -540,6 +821,27 @@ protected:
 	/// ポリゴングループリスト
 	std::vector<PolygonGroup*>	m_pg_list;
 
+	/// グループ索引(フルパス名→PolygonGroup)
+	std::map<std::string, PolygonGroup*>	m_pg_path_map;
+
+	/// グループ索引(グループ名→PolygonGroup、同名の場合は先に登録したもの)
+	std::map<std::string, PolygonGroup*>	m_pg_name_map;
+
+	/// グループ索引(内部ID→PolygonGroup、未登録のIDはNULL)
+	std::vector<PolygonGroup*>				m_pg_id_table;
+
+	/// 差分保存するか？
+	bool						m_delta_save;
+
+	/// 検索・KD木再構築時間を計測するか？
+	bool						m_cost_measure;
+
+	/// 積算した検索時間(秒)。constな検索メソッドで積算する
+	mutable double				m_query_time;
+
+	/// 積算したKD木再構築時間(秒)。
+	double						m_rebuild_time;
+
 
 	// TextParser へのポインタ
 	TextParser* tp;
@@ -19,6 +19,7 @@ extern "C" {  // for C++
 
 #include "mpi.h"
 #include "common/PolylibStat.h"
+#include "common/PolylibMemory.h"
 #include "c_lang/CPolylib.h"
 
 #ifdef HAVE_CONFIG_H
@@ -91,6 +92,18 @@ mpipolylib_load_rank0(char* config_name);
 POLYLIB_STAT
 mpipolylib_load_parallel(char* config_name);
 
+///
+/// MPIPolylib::load_distributedメソッドのラッパー関数。
+/// 全rank分散でのデータ構築。
+/// 指定された設定ファイルを各rankにて読み込み、グループ階層構造を構築する。
+/// バイナリSTLファイルは各rankが分担して読み込み、各rank領域へ配信する。
+///
+/// @param[in] config_filename	初期化ファイル名。NULLならば、polylib_config.xmlを読む。
+/// @return	POLYLIB_STATで定義される値が返る。
+///
+POLYLIB_STAT
+mpipolylib_load_distributed(char* config_name);
+
 ///
 /// MPIPolylib::save_rank0メソッドのラッパー関数。
 /// rank0によるデータ保存。
@@ -187,7 +200,26 @@ POLYLIB_STAT mpipolylib_show_group_info(char* group_name);
 ///
 /// @return 利用中のメモリ量(byte)
 ///
-unsigned int mpipolylib_used_memory_size();
+size_t mpipolylib_used_memory_size();
+
+///
+/// MPIPolylib::used_memory_usageメソッドのラッパー関数。
+/// 利用中のメモリ量の内訳を返す。
+///  @param[out] usage	メモリ量の内訳(byte)。
+///  @return POLYLIB_STATで定義される値が返る。
+///
+POLYLIB_STAT mpipolylib_used_memory_usage(PolylibMemoryUsage *usage);
+
+///
+/// MPIPolylib::used_memory_usageメソッドのラッパー関数。
+/// 指定グループが利用中のメモリ量の内訳を返す。
+///  @param[in]  group_name	グループ名(フルパス)。
+///  @param[out] usage		メモリ量の内訳(byte)。
+///  @return POLYLIB_STATで定義される値が返る。
+///
+POLYLIB_STAT mpipolylib_group_memory_usage(
+	char				*group_name,
+	PolylibMemoryUsage	*usage);
 
 
 
@@ -18,6 +18,7 @@ extern "C" {  // for C++
 #endif
 
 #include "common/PolylibStat.h"
+#include "common/PolylibMemory.h"
 
 #ifdef HAVE_CONFIG_H
 #include "config.h"
@@ -119,9 +120,30 @@ void polylib_show_group_hierarchy();
 POLYLIB_STAT polylib_show_group_info(char* group_name);
 
 ///
+/// Polylibが利用中の概算メモリ量を返す
 ///
+/// @return 利用中のメモリ量(byte)
 ///
-unsigned int polylib_used_memory_size();
+size_t polylib_used_memory_size();
+
+///
+/// Polylib::used_memory_usageメソッドのラッパー関数。
+/// 利用中のメモリ量の内訳を返す。
+///  @param[out] usage	メモリ量の内訳(byte)。
+///  @return POLYLIB_STATで定義される値が返る。
+///
+POLYLIB_STAT polylib_used_memory_usage(PolylibMemoryUsage *usage);
+
+///
+/// Polylib::used_memory_usageメソッドのラッパー関数。
+/// 指定グループが利用中のメモリ量の内訳を返す。
+///  @param[in]  group_name	グループ名(フルパス)。
+///  @param[out] usage		メモリ量の内訳(byte)。
+///  @return POLYLIB_STATで定義される値が返る。
+///
+POLYLIB_STAT polylib_group_memory_usage(
+	char				*group_name,
+	PolylibMemoryUsage	*usage);
 
 #ifdef __cplusplus
 } // extern "C" or extern
@@ -128,6 +128,50 @@ public:
 		return true;
 	}
 
+	///
+	/// 引数で与えられた点とこのBBoxとの距離の2乗を返す。
+	/// @param[in] pos 試行する点
+	/// @return 距離の2乗。点がBBoxに含まれる場合は0。
+	///
+	float distanceSquared(const Vec3f& pos) const {
+		float d2 = 0.0f;
+		for (int i = 0; i < 3; i++) {
+			float d = 0.0f;
+			if (pos.t[i] < min.t[i])		d = min.t[i] - pos.t[i];
+			else if (pos.t[i] > max.t[i])	d = pos.t[i] - max.t[i];
+			d2 += d * d;
+		}
+		return d2;
+	}
+
+	///
+	/// 線分orig + t * dir (0 <= t <= tmax)とBBoxの交差判定を行う(スラブ法)。
+	/// @param[in]  orig	始点
+	/// @param[in]  dir		方向ベクトル
+	/// @param[in]  tmax	tの上限
+	/// @param[out] tnear	交差する場合、BBoxに入る位置のt。始点がBBox内なら0。
+	/// @return 交差する場合はtrue。他はfalse。
+	///
+	bool crossed_ray(const Vec3f& orig, const Vec3f& dir, float tmax,
+					 float *tnear) const {
+		float t0 = 0.0f, t1 = tmax;
+		for (int i = 0; i < 3; i++) {
+			if (min.t[i] > max.t[i]) return false;
+			if (dir.t[i] == 0.0f) {
+				if (orig.t[i] < min.t[i] || max.t[i] < orig.t[i]) return false;
+				continue;
+			}
+			float ta = (min.t[i] - orig.t[i]) / dir.t[i];
+			float tb = (max.t[i] - orig.t[i]) / dir.t[i];
+			if (ta > tb) std::swap(ta, tb);
+			if (ta > t0) t0 = ta;
+			if (tb < t1) t1 = tb;
+			if (t0 > t1) return false;
+		}
+		*tnear = t0;
+		return true;
+	}
+
 	///
 	/// BBoxとBBoxの重複領域の抽出を行う。
 	/// 自身の面と他方の辺との交差判定を行う。
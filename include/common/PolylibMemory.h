@@ -0,0 +1,99 @@
+/*
+ * Polylib - Polygon Management Library
+ *
+ * Copyright (c) 2010-2011 VCAD System Research Program, RIKEN.
+ * All rights reserved.
+ *
+ * Copyright (c) 2012-2013 Advanced Institute for Computational Science, RIKEN.
+ * All rights reserved.
+ *
+ */
+
+#ifndef polylib_memory_h
+#define polylib_memory_h
+
+#include <stddef.h>
+
+////////////////////////////////////////////////////////////////////////////
+///
+/// Polylibが利用中のメモリ量の内訳(byte)
+/// C言語版でも本ヘッダを使用するため、構造体として定義する。
+/// 各値はvectorのcapacity等、実際に確保されている領域から算出する。
+/// quantize_errorのみメモリ量ではなく、量子化による頂点座標の誤差の上限。
+///
+////////////////////////////////////////////////////////////////////////////
+typedef struct {
+	size_t	triangles;			///< 三角形ポリゴンとそのポインタリスト
+	size_t	tree_nodes;			///< KD木のノード
+	size_t	leaf_lists;			///< KD木リーフの要素リストと要素Bounding Box
+	size_t	mpi_buffers;		///< MPI通信用バッファ
+	size_t	exclusion_lists;	///< 隣接PE向け除外三角形IDリスト
+	size_t	others;				///< 上記以外(管理クラス、グループ情報等)
+	float	quantize_error;		///< 頂点座標の量子化誤差の上限(量子化なしは0)
+} PolylibMemoryUsage;
+
+#ifndef C_LANG
+namespace PolylibNS {
+////////////////////////////////////////////////////////////////////////////
+///
+/// PolylibMemoryUsage操作用クラス
+///
+////////////////////////////////////////////////////////////////////////////
+class PolylibMemory {
+public:
+///
+/// 内訳を0クリアする。
+///
+///  @param[out] usage	内訳。
+///
+static void clear(
+	PolylibMemoryUsage	*usage
+) {
+	usage->triangles		= 0;
+	usage->tree_nodes		= 0;
+	usage->leaf_lists		= 0;
+	usage->mpi_buffers		= 0;
+	usage->exclusion_lists	= 0;
+	usage->others			= 0;
+	usage->quantize_error	= 0.0f;
+}
+
+///
+/// 内訳を加算する。量子化誤差は大きい方をとる。
+///
+///  @param[in,out]	dst	加算先の内訳。
+///  @param[in]		src	加算する内訳。
+///
+static void add(
+	PolylibMemoryUsage			*dst,
+	const PolylibMemoryUsage	&src
+) {
+	dst->triangles			+= src.triangles;
+	dst->tree_nodes			+= src.tree_nodes;
+	dst->leaf_lists			+= src.leaf_lists;
+	dst->mpi_buffers		+= src.mpi_buffers;
+	dst->exclusion_lists	+= src.exclusion_lists;
+	dst->others				+= src.others;
+	if (src.quantize_error > dst->quantize_error) {
+		dst->quantize_error = src.quantize_error;
+	}
+}
+
+///
+/// 内訳の合計を求める。量子化誤差は含めない。
+///
+///  @param[in] usage	内訳。
+///  @return	合計値(byte)。
+///
+static size_t total(
+	const PolylibMemoryUsage	&usage
+) {
+	return usage.triangles + usage.tree_nodes + usage.leaf_lists +
+		   usage.mpi_buffers + usage.exclusion_lists + usage.others;
+}
+};
+
+} //namespace PolylibNS
+#endif // C_LANG
+
+#endif // polylib_memory_h
@@ -0,0 +1,199 @@
+/*
+ * Polylib - Polygon Management Library
+ *
+ * Copyright (c) 2010-2011 VCAD System Research Program, RIKEN.
+ * All rights reserved.
+ *
+ * Copyright (c) 2012-2013 Advanced Institute for Computational Science, RIKEN.
+ * All rights reserved.
+ *
+ */
+
+#ifndef polylib_gzip_stream_h
+#define polylib_gzip_stream_h
+
+#include <iostream>
+#include <fstream>
+#include <string>
+
+namespace PolylibNS {
+
+////////////////////////////////////////////////////////////////////////////
+///
+/// クラス:GzipStreamBuf
+/// gzip圧縮ファイルを読み書きするストリームバッファです。
+/// 伸長・圧縮は作業スレッドで行い、複数のブロックを先読み(書き出しでは
+/// 後書き)することで、呼び出し側の解析・整形処理と並行させる。
+/// USE_ZLIBを定義せずにコンパイルした場合、open()は常に失敗する。
+///
+////////////////////////////////////////////////////////////////////////////
+class GzipStreamBuf : public std::streambuf {
+public:
+	///
+	/// コンストラクタ。
+	///
+	GzipStreamBuf();
+
+	///
+	/// デストラクタ。
+	///
+	~GzipStreamBuf();
+
+	///
+	/// ファイルを開く。
+	///
+	///  @param[in] fname	ファイル名。
+	///  @param[in] mode	std::ios::inまたはstd::ios::out。
+	///  @return	true:成功/false:失敗。
+	///
+	bool open(
+		const std::string	&fname,
+		std::ios::openmode	mode
+	);
+
+	///
+	/// ファイルを閉じる。書き出しでは未出力のデータを全て圧縮して書き出す。
+	///
+	///  @return	true:成功/false:読み書きエラー。
+	///
+	bool close();
+
+	///
+	/// ファイル名がgzip圧縮ファイル(拡張子.gz)を示すか。
+	///
+	///  @param[in] fname	ファイル名。
+	///  @return	true:gzip圧縮ファイル。
+	///
+	static bool is_gzip(
+		const std::string	&fname
+	);
+
+	///
+	/// ファイル名から拡張子.gzを取り除く。
+	///
+	///  @param[in] fname	ファイル名。
+	///  @return	.gzを除いたファイル名。.gzで終わらなければそのまま。
+	///
+	static std::string strip_gzip(
+		const std::string	&fname
+	);
+
+	/// gzip圧縮ファイルの拡張子。
+	static const std::string	SUFFIX;
+
+protected:
+	///
+	/// 読み込みバッファが空になった時に、次の伸長済みブロックを取得する。
+	///
+	int_type underflow();
+
+	///
+	/// 書き出しバッファが一杯になった時に、ブロックを作業スレッドへ渡す。
+	///
+	int_type overflow(int_type c);
+
+	///
+	/// 書き出しバッファの内容を作業スレッドへ渡す。
+	///
+	int sync();
+
+private:
+	/// 作業スレッドとの受け渡し状態(GzipStream.cxxで定義)。
+	struct State;
+
+	///
+	/// 作業スレッドの処理。読み込みは空きブロックを先読みで埋め、
+	/// 書き出しは渡されたブロックを順に圧縮して書き出す。
+	///
+	///  @param[in] arg	受け渡し状態(State*)。
+	///
+	static void *worker(void *arg);
+
+	///
+	/// 書き出し中のブロックを作業スレッドへ渡し、次の空きブロックを
+	/// 書き出しバッファとする。
+	///
+	///  @param[in] last	true:最後のブロック。
+	///  @return	true:成功/false:書き込みエラー。
+	///
+	bool flush_block(bool last);
+
+	/// 作業スレッドとの受け渡し状態。開いていなければNULL。
+	State	*m_state;
+};
+
+////////////////////////////////////////////////////////////////////////////
+///
+/// クラス:GzipIFStream
+/// 拡張子が.gzならば伸長しながら、それ以外は通常のファイルとして読み込む
+/// 入力ファイルストリームです。
+///
+////////////////////////////////////////////////////////////////////////////
+class GzipIFStream : public std::istream {
+public:
+	///
+	/// コンストラクタ。
+	///
+	///  @param[in] fname	ファイル名。
+	///  @param[in] mode	オープンモード(通常のファイルのみ有効)。
+	///
+	GzipIFStream(
+		const std::string	&fname,
+		std::ios::openmode	mode = std::ios::in
+	);
+
+	///
+	/// ファイルを閉じる。伸長エラーがあった場合はbadbitを立てる
+	/// (終端に達した場合と区別するため)。
+	///
+	void close();
+
+private:
+	/// 通常のファイルのバッファ。
+	std::filebuf	m_fbuf;
+
+	/// gzip圧縮ファイルのバッファ。
+	GzipStreamBuf	m_gzbuf;
+};
+
+////////////////////////////////////////////////////////////////////////////
+///
+/// クラス:GzipOFStream
+/// 拡張子が.gzならば圧縮しながら、それ以外は通常のファイルとして書き出す
+/// 出力ファイルストリームです。
+///
+////////////////////////////////////////////////////////////////////////////
+class GzipOFStream : public std::ostream {
+public:
+	///
+	/// コンストラクタ。
+	///
+	///  @param[in] fname	ファイル名。
+	///  @param[in] mode	オープンモード(通常のファイルのみ有効)。
+	///
+	GzipOFStream(
+		const std::string	&fname,
+		std::ios::openmode	mode = std::ios::out
+	);
+
+	///
+	/// デストラクタ。
+	///
+	~GzipOFStream();
+
+	///
+	/// ファイルを閉じる。書き込みエラーの場合はfailbitを立てる。
+	///
+	void close();
+
+private:
+	/// 通常のファイルのバッファ。
+	std::filebuf	m_fbuf;
+
+	/// gzip圧縮ファイルのバッファ。
+	GzipStreamBuf	m_gzbuf;
+};
+
+} //namespace PolylibNS
+
+#endif  // polylib_gzip_stream_h
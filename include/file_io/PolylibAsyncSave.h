@@ -0,0 +1,127 @@
+/*
+ * Polylib - Polygon Management Library
+ *
+ * Copyright (c) 2010-2011 VCAD System Research Program, RIKEN.
+ * All rights reserved.
+ *
+ * Copyright (c) 2012-2013 Advanced Institute for Computational Science, RIKEN.
+ * All rights reserved.
+ *
+ */
+
+#ifndef polylib_async_save_h
+#define polylib_async_save_h
+
+#include <pthread.h>
+#include <vector>
+#include <string>
+#include "common/PolylibStat.h"
+#include "common/PolylibCommon.h"
+
+namespace PolylibNS {
+
+class PrivateTriangle;
+
+////////////////////////////////////////////////////////////////////////////
+///
+/// クラス:PolylibAsyncSave
+/// STLファイルとIDファイルを作業スレッドで書き出す、非同期保存のハンドル。
+/// 登録時に三角形を複製して保持するので、書き出し中も元のポリゴン情報を
+/// 変更(移動やマイグレーション)してよい。
+/// Polylib::save_async()、MPIPolylib::save_parallel_async()で使用する。
+///
+////////////////////////////////////////////////////////////////////////////
+class PolylibAsyncSave {
+public:
+	///
+	/// コンストラクタ。
+	///
+	PolylibAsyncSave();
+
+	///
+	/// デストラクタ。書き出し中であれば完了を待つ。
+	///
+	~PolylibAsyncSave();
+
+	///
+	/// 書き出しの完了を待つ。開始していない登録済みのファイルは破棄する。
+	///
+	///  @return	最初に失敗したファイルのPOLYLIB_STAT。全て成功ならPLSTAT_OK。
+	///				書き出しを開始していなければPLSTAT_OK。
+	///
+	POLYLIB_STAT wait();
+
+	///
+	/// 書き出しが完了したか。待たずに返る。
+	///
+	///  @return	true:完了(または開始していない)/false:書き出し中。
+	///
+	bool is_done();
+
+	///
+	/// 書き出すファイルを登録する。tri_listの三角形は複製して保持する。
+	/// 複数のスレッドから同時に呼び出してよいが、書き出し中(start()の後、
+	/// wait()の前)には呼び出せない。
+	///
+	///  @param[in] tri_list	三角形ポリゴンのリスト。
+	///  @param[in] stl_fname	STLファイル名。
+	///  @param[in] stl_format	STLファイルフォーマット。
+	///  @param[in] id_fname	IDファイル名。空文字列ならばIDファイルは出力しない。
+	///  @param[in] id_format	IDファイルの出力形式。
+	///
+	void add_file(
+		const std::vector<PrivateTriangle*>	*tri_list,
+		const std::string					&stl_fname,
+		const std::string					&stl_format,
+		const std::string					&id_fname,
+		ID_FORMAT							id_format
+	);
+
+	///
+	/// 作業スレッドを起動し、登録したファイルの書き出しを開始する。
+	/// スレッドを起動できなければ、呼び出したスレッドで書き出す。
+	///
+	void start();
+
+private:
+	/// 書き出すファイル(PolylibAsyncSave.cxxで定義)。
+	struct File;
+
+	///
+	/// 作業スレッドの処理。登録順にファイルを書き出す。
+	///
+	///  @param[in] arg	PolylibAsyncSave*。
+	///
+	static void *worker(void *arg);
+
+	///
+	/// 登録したファイルを破棄する。
+	///
+	void clear();
+
+	/// 登録したファイル。
+	std::vector<File*>	m_files;
+
+	/// 書き出しの結果。
+	POLYLIB_STAT		m_stat;
+
+	/// 作業スレッドを起動したか。
+	bool				m_running;
+
+	/// 作業スレッドが書き出しを終えたか。
+	bool				m_done;
+
+	/// 作業スレッド。
+	pthread_t			m_thread;
+
+	/// m_files、m_doneの排他制御。
+	pthread_mutex_t		m_mutex;
+
+	// コピー禁止
+	PolylibAsyncSave(const PolylibAsyncSave&);
+	PolylibAsyncSave &operator=(const PolylibAsyncSave&);
+};
+
+} //namespace PolylibNS
+
+#endif  // polylib_async_save_h
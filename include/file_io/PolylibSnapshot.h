@@ -0,0 +1,154 @@
+/*
+ * Polylib - Polygon Management Library
+ *
+ * Copyright (c) 2010-2011 VCAD System Research Program, RIKEN.
+ * All rights reserved.
+ *
+ * Copyright (c) 2012-2013 Advanced Institute for Computational Science, RIKEN.
+ * All rights reserved.
+ *
+ */
+
+#ifndef polylib_snapshot_h
+#define polylib_snapshot_h
+
+#include <string.h>
+#include <iostream>
+#include <string>
+#include "common/PolylibStat.h"
+
+namespace PolylibNS {
+
+class Polygons;
+
+////////////////////////////////////////////////////////////////////////////
+///
+/// クラス:SnapshotReader
+/// スナップショットのバイト列を先頭から順に読み出すためのカーソルです。
+///
+////////////////////////////////////////////////////////////////////////////
+class SnapshotReader {
+public:
+	///
+	/// コンストラクタ。
+	///
+	///  @param[in] buf		読み出すバイト列。
+	///  @param[in] size	バイト列の長さ。
+	///
+	SnapshotReader(const char *buf, size_t size) {
+		m_ptr = buf;
+		m_end = buf + size;
+	}
+
+	///
+	/// 指定バイト数を読み出す。
+	///
+	///  @param[out] data	読み出し先。
+	///  @param[in]	 size	バイト数。
+	///  @return	true:成功/false:データ不足。
+	///
+	bool read(void *data, size_t size) {
+		if ((size_t)(m_end - m_ptr) < size) return false;
+		memcpy(data, m_ptr, size);
+		m_ptr += size;
+		return true;
+	}
+
+	///
+	/// 指定バイト数を読み飛ばし、その先頭アドレスを返す。
+	///
+	///  @param[in]	size	バイト数。
+	///  @return	読み飛ばした領域の先頭。データ不足の場合はNULL。
+	///
+	const char *skip(size_t size) {
+		if ((size_t)(m_end - m_ptr) < size) return NULL;
+		const char *p = m_ptr;
+		m_ptr += size;
+		return p;
+	}
+
+private:
+	/// 現在の読み出し位置。
+	const char	*m_ptr;
+
+	/// バイト列の終端。
+	const char	*m_end;
+};
+
+////////////////////////////////////////////////////////////////////////////
+///
+/// クラス:SnapshotWriter
+/// スナップショットのバイト列をストリームへ順に書き出すためのクラスです。
+///
+////////////////////////////////////////////////////////////////////////////
+class SnapshotWriter {
+public:
+	///
+	/// コンストラクタ。
+	///
+	///  @param[in] os	書き出し先のストリーム。
+	///
+	SnapshotWriter(std::ostream &os) : m_os(os) {}
+
+	///
+	/// 指定バイト数を書き出す。
+	///
+	///  @param[in] data	書き出すデータ。
+	///  @param[in] size	バイト数。
+	///  @return	true:成功/false:書き込みエラー。
+	///
+	bool write(const void *data, size_t size) {
+		if (size > 0) m_os.write((const char*)data, size);
+		return m_os.good();
+	}
+
+private:
+	/// 書き出し先のストリーム。
+	std::ostream	&m_os;
+};
+
+////////////////////////////////////////////////////////////////////////////
+///
+/// クラス:PolylibSnapshot
+/// 三角形ポリゴン(ID、ユーザ定義ID、状態変数を含む)と構築済みのKD木を
+/// ポリゴングループ毎に保存するPolylib独自のバイナリ形式です。
+/// 読み込み時はファイルをメモリマップし、STLの解析とKD木の構築を省略する。
+/// グループ階層構造はこれまで通り設定ファイルに保存される。
+///
+/// ファイル構成(数値はすべて書き出した計算機のバイトオーダー):
+///   マジック(8byte), 版数, バイトオーダー確認値, Polygonsのデータ
+///
+////////////////////////////////////////////////////////////////////////////
+class PolylibSnapshot {
+public:
+	///
+	/// Polygonsをスナップショットファイルに保存する。
+	///
+	///  @param[in] polygons	保存するPolygons。
+	///  @param[in] fname		ファイル名。
+	///  @return	POLYLIB_STATで定義される値が返る。
+	///
+	static POLYLIB_STAT save(
+		const Polygons		*polygons,
+		const std::string	&fname
+	);
+
+	///
+	/// スナップショットファイルからPolygonsを復元する。
+	///
+	///  @param[in,out] polygons	復元先のPolygons。
+	///  @param[in]		fname		ファイル名。
+	///  @return	POLYLIB_STATで定義される値が返る。
+	///
+	static POLYLIB_STAT load(
+		Polygons			*polygons,
+		const std::string	&fname
+	);
+
+	/// ファイル形式の版数。
+	static const int	VERSION;
+};
+
+} //namespace PolylibNS
+
+#endif  // polylib_snapshot_h
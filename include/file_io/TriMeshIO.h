@@ -16,6 +16,7 @@
 #include <map>
 #include "common/PolylibStat.h"
 #include "common/PolylibCommon.h"
+#include "common/BBox.h"
 
 namespace PolylibNS {
 
@@ -29,23 +30,32 @@ class TriMeshIO {
 public:
 	///
 	/// STLファイルを読み込み、tri_listにセットする。
+	/// OBJ、PLYファイルも読み込むことができる。
 	///
 	///  @param[in,out] tri_list	三角形ポリゴンリストの領域。
 	///  @param[in]		fmap		ファイル名、ファイルフォーマットのセット。
+	///  @param[in]		scale		頂点座標のスケール。
+	///  @param[in]		region		指定した場合、Bounding Boxがこの領域と交差
+	///								する三角形だけを読み込む。
 	///  @return	POLYLIB_STATで定義される値が返る。
+	///  @attention	複数ファイルはOpenMP有効時に並列に読み込む。三角形の並びと
+	///				IDはファイル名順に読み込んだ場合と同じになる。領域を指定
+	///				しても、各三角形のIDは全体を読み込んだ場合と同じになる。
 	///
 	static POLYLIB_STAT load(
 		std::vector<PrivateTriangle*>				*tri_list,
 		const std::map<std::string, std::string>	&fmap,
-		float scale = 1.0
+		float scale = 1.0,
+		const BBox *region = NULL
 	);
 
 	///
 	/// tri_listの内容をSTL形式でファイルへ保存。
 	///
 	///  @param[in] tri_list	三角形ポリゴンのリスト(出力内容)。
-	///  @param[in] fname		ファイル名。
-	///  @param[in] fmt			ファイルフォーマット。
+	///  @param[in] fname		ファイル名。拡張子が.gzならばgzip圧縮する。
+	///  @param[in] fmt			ファイルフォーマット。"stl_b.gz"のように
+	///							末尾の.gzは無視する。
 	///  @return	POLYLIB_STATで定義される値が返る。
 	///
 	static POLYLIB_STAT save(
@@ -60,6 +70,7 @@ public:
 	///  @param[in] filename		入力ファイル名。
 	///  @return	判定したファイルフォーマット。
 	///  @attention	ファイル拡張子が"stl"の場合、ファイルを読み込んで判定する。
+	///				拡張子.gzのgzip圧縮ファイルは、.gzの手前の拡張子で判定する。
 	///
 	static std::string input_file_format(
 		const std::string &filename
@@ -73,7 +84,31 @@ public:
 	static const std::string FMT_STL_AA;	///< アスキーファイル
 	static const std::string FMT_STL_B;		///< バイナリファイル
 	static const std::string FMT_STL_BB;	///< バイナリファイル
+	static const std::string FMT_SNAP;		///< スナップショットファイル
+	static const std::string FMT_OBJ;		///< Wavefront OBJファイル(読み込みのみ)
+	static const std::string FMT_PLY;		///< PLYファイル(読み込みのみ)
 	static const std::string DEFAULT_FMT;	///< TrimeshIO.cxxで定義している値
+
+private:
+	///
+	/// STLファイルを1つ読み込み、tri_listに追加する。
+	///
+	///  @param[in,out] tri_list	三角形ポリゴンリストの領域。
+	///  @param[in]		fname		ファイル名。
+	///  @param[in]		fmt			ファイルフォーマット。
+	///  @param[in,out] total		ポリゴンIDの通番。
+	///  @param[in]		scale		頂点座標のスケール。
+	///  @param[in]		region		読み込む領域。NULLならば全て。
+	///  @return	POLYLIB_STATで定義される値が返る。
+	///
+	static POLYLIB_STAT load_file(
+		std::vector<PrivateTriangle*>	*tri_list,
+		const std::string				&fname,
+		const std::string				&fmt,
+		int								*total,
+		float							scale,
+		const BBox						*region
+	);
 };
 
 } //namespace PolylibNS
@@ -0,0 +1,66 @@
+/*
+ * Polylib - Polygon Management Library
+ *
+ * Copyright (c) 2010-2011 VCAD System Research Program, RIKEN.
+ * All rights reserved.
+ *
+ * Copyright (c) 2012-2013 Advanced Institute for Computational Science, RIKEN.
+ * All rights reserved.
+ *
+ */
+
+#ifndef indexed_mesh_h
+#define indexed_mesh_h
+
+#include <vector>
+#include <string>
+#include "polygons/Triangle.h"
+#include "common/PolylibStat.h"
+#include "common/BBox.h"
+
+namespace PolylibNS {
+
+///
+/// Wavefront OBJファイルを読み込み、tri_listに三角形ポリゴン情報を設定する。
+/// 頂点(v)と面(f)のみを使用し、4頂点以上の面は扇形に三角形分割する。
+/// 法線は頂点から計算する。
+///
+///  @param[in,out] tri_list	三角形ポリゴンリストの領域。
+///  @param[in]		fname		ファイル名。拡張子が.gzならば伸長して読み込む。
+///  @param[in,out] total		ポリゴンIDの通番。
+///  @param[in]		scale		頂点座標のスケール。
+///  @param[in]		region		stl_a_load()と同じ。
+///  @return	POLYLIB_STATで定義される値が返る。
+///
+POLYLIB_STAT obj_load(
+	std::vector<PrivateTriangle*>	*tri_list,
+	std::string						fname,
+	int								*total,
+	float							scale=1.0,
+	const BBox						*region=NULL
+);
+
+///
+/// PLYファイル(ascii、binary_little_endian、binary_big_endian)を読み込み、
+/// tri_listに三角形ポリゴン情報を設定する。vertex要素のx,y,zと、face要素の
+/// vertex_indices(またはvertex_index)のみを使用し、それ以外の要素と
+/// プロパティは読み飛ばす。4頂点以上の面は扇形に三角形分割する。
+///
+///  @param[in,out] tri_list	三角形ポリゴンリストの領域。
+///  @param[in]		fname		ファイル名。拡張子が.gzならば伸長して読み込む。
+///  @param[in,out] total		ポリゴンIDの通番。
+///  @param[in]		scale		頂点座標のスケール。
+///  @param[in]		region		stl_a_load()と同じ。
+///  @return	POLYLIB_STATで定義される値が返る。
+///
+POLYLIB_STAT ply_load(
+	std::vector<PrivateTriangle*>	*tri_list,
+	std::string						fname,
+	int								*total,
+	float							scale=1.0,
+	const BBox						*region=NULL
+);
+
+} //namespace PolylibNS
+
+#endif  // indexed_mesh_h
@@ -14,6 +14,7 @@
 
 #include <vector>
 #include "common/PolylibCommon.h"
+#include "common/BBox.h"
 
 namespace PolylibNS {
 
@@ -23,13 +24,18 @@ namespace PolylibNS {
 ///  @param[in,out] tri_list	三角形ポリゴンリストの領域。
 ///  @param[in]		fname		STLファイル名。
 ///  @param[in,out] total		ポリゴンIDの通番。
+///  @param[in]		scale		頂点座標のスケール。
+///  @param[in]		region		指定した場合、Bounding Boxがこの領域と交差する
+///								三角形だけを追加する。IDの通番は読み飛ばした
+///								三角形にも割り当てる。
 ///  @return	POLYLIB_STATで定義される値が返る。
 ///
 POLYLIB_STAT stl_a_load(
 	std::vector<PrivateTriangle*>	*tri_list, 
 	std::string 					fname,
 	int								*total,
-	float							scale=1.0
+	float							scale=1.0,
+	const BBox						*region=NULL
 );
 
 ///
@@ -51,12 +57,98 @@ POLYLIB_STAT stl_a_save(
 ///  @param[in,out] tri_list	三角形ポリゴンリストの領域。
 ///  @param[in]		fname		ファイル名。
 ///  @param[in,out] total		ポリゴンIDの通番。
+///  @param[in]		scale		頂点座標のスケール。
+///  @param[in]		region		stl_a_load()と同じ。
 ///  @return	POLYLIB_STATで定義される値が返る。
 ///
 POLYLIB_STAT stl_b_load(
 	std::vector<PrivateTriangle*>	*tri_list, 
 	std::string						fname,
 	int								*total,
+	float							scale=1.0,
+	const BBox						*region=NULL
+);
+
+///
+/// バイナリモードのSTLファイルを読み取り専用でメモリマップする。
+/// 三角形のレコードはマップ領域を直接参照するので、stl_b_unmap()で
+/// 解放するまで有効。
+///
+///  @param[in]		fname		ファイル名。
+///  @param[out]	map			マップ領域の先頭。
+///  @param[out]	map_size	マップ領域の長さ(byte)。
+///  @param[out]	records		先頭の三角形のレコード。
+///  @param[out]	num			三角形数。
+///  @return	POLYLIB_STATで定義される値が返る。gzip圧縮ファイルなどで
+///			マップできない場合はPLSTAT_NG。
+///
+POLYLIB_STAT stl_b_map(
+	std::string						fname,
+	void							**map,
+	size_t							*map_size,
+	const char						**records,
+	unsigned int					*num
+);
+
+///
+/// stl_b_map()でマップしたファイルを解放する。
+///
+///  @param[in]		map			マップ領域の先頭。NULLなら何もしない。
+///  @param[in]		map_size	マップ領域の長さ(byte)。
+///
+void stl_b_unmap(
+	void							*map,
+	size_t							map_size
+);
+
+///
+/// バイナリモードのSTLファイルのレコード1個を読み取る。
+///
+///  @param[in]		p			STL_B_RECORD_SIZEバイトのレコード。
+///  @param[in]		scale		頂点座標のスケール。
+///  @param[out]	rec			法線(3)と3頂点(9)の12要素。頂点はスケール済み。
+///  @return	2バイトの予備領域の値(ユーザ定義ID)。
+///
+int stl_b_get_record(
+	const char						*p,
+	float							scale,
+	float							*rec
+);
+
+///
+/// バイナリモードのSTLファイルのヘッダから三角形数を取得する。
+/// ファイルサイズが三角形数に足りない場合はエラーとする。
+///
+///  @param[in]		fname		ファイル名。
+///  @param[out]	num			三角形数。
+///  @return	POLYLIB_STATで定義される値が返る。
+///
+POLYLIB_STAT stl_b_num_trias(
+	std::string						fname,
+	unsigned int					*num
+);
+
+///
+/// バイナリモードのSTLファイルからfirst番目以降のnum個の三角形だけを
+/// 読み込み、tri_listに追加する。ファイル全体をマップせず、指定範囲の
+/// レコードを一定量ずつpread()するので、複数プロセスでファイルを分担して
+/// 読み込むことができる。
+///
+///  @param[in,out] tri_list	三角形ポリゴンリストの領域。
+///  @param[in]		fname		ファイル名。
+///  @param[in]		first		読み込む先頭の三角形番号(0始まり)。
+///  @param[in]		num			読み込む三角形数。
+///  @param[in]		id_base		ファイル先頭の三角形に割り当てるID。
+///								三角形IDはid_base+三角形番号となる。
+///  @param[in]		scale		頂点座標のスケール。
+///  @return	POLYLIB_STATで定義される値が返る。
+///
+POLYLIB_STAT stl_b_load_range(
+	std::vector<PrivateTriangle*>	*tri_list, 
+	std::string						fname,
+	unsigned int					first,
+	unsigned int					num,
+	int								id_base,
 	float							scale=1.0
 );
 
@@ -72,6 +164,62 @@ POLYLIB_STAT stl_b_save(
 	std::string						fname
 );
 
+/// バイナリモードのSTLファイルのヘッダ長(コメント80バイトと三角形数)。
+#define STL_B_HEADER_SIZE	84
+
+/// バイナリモードのSTLファイルの三角形1個あたりのレコード長。
+#define STL_B_RECORD_SIZE	50
+
+///
+/// バイナリモードのSTLファイルのヘッダを作成する。stl_b_save()と同じ内容。
+/// MPI-IO等でファイルを分担して書き出す場合に使用する。
+///
+///  @param[out]	p			STL_B_HEADER_SIZEバイトの領域。
+///  @param[in]		num			三角形数。
+///  @return	作成したバイト数(STL_B_HEADER_SIZE)。
+///
+size_t stl_b_put_header(
+	char							*p,
+	unsigned int					num
+);
+
+///
+/// 三角形ポリゴン情報をバイナリモードのSTLファイルのレコードに変換する。
+/// ユーザ定義IDは2バイトの予備領域に記録する。
+///
+///  @param[out]	p			tri_list->size()*STL_B_RECORD_SIZEバイトの領域。
+///  @param[in]		tri_list	三角形ポリゴン情報。
+///  @return	作成したバイト数。
+///
+size_t stl_b_put_records(
+	char								*p,
+	const std::vector<PrivateTriangle*>	*tri_list
+);
+
+///
+/// バイナリモードのSTLファイルのレコードから三角形を作成し、tri_listに
+/// 追加する。
+///
+///  @param[in,out] tri_list	三角形ポリゴンリストの領域。
+///  @param[in]		p			num*STL_B_RECORD_SIZEバイトのレコード。
+///  @param[in]		num			三角形数。
+///  @param[in]		id_base		idsがNULLの場合、先頭の三角形に割り当てるID。
+///								三角形IDはid_base+レコード番号となる。
+///  @param[in]		ids			NULLでなければ、各三角形のID(num個)。
+///  @param[in]		scale		頂点座標のスケール。
+///  @param[in]		region		NULLでなければ、この領域と交差する三角形だけを
+///								作成する。
+///
+void stl_b_get_records(
+	std::vector<PrivateTriangle*>	*tri_list,
+	const char						*p,
+	unsigned int					num,
+	int								id_base,
+	const int						*ids=NULL,
+	float							scale=1.0,
+	const BBox						*region=NULL
+);
+
 ///
 /// STLファイルを読み込みバイナリかアスキーかを判定する。
 ///
@@ -82,6 +230,21 @@ bool is_stl_a(
 	std::string		path
 );
 
+///
+/// テキスト中の浮動小数点数を1つ解析する。localeに依存しない。
+/// ASCII STLの他、OBJ・PLYファイルの読み込みでも使用する。
+///
+///  @param[in]		p			解析開始位置。先頭の空白は読み飛ばす。
+///  @param[in]		end			テキストの終端。
+///  @param[out]	val			解析した値。
+///  @return	解析した数値の次の位置。数値でなければNULL。
+///
+const char *stl_a_parse_float(
+	const char		*p,
+	const char		*end,
+	float			*val
+);
+
 ///
 /// STLファイル名から名称(拡張子を除いた部分)を取得する。
 ///
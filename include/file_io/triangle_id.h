@@ -20,15 +20,17 @@
 namespace PolylibNS {
 
 ///
-/// 三角形ポリゴンIDをIDファイルから読み込み、m_idにセットする。
+/// 三角形ポリゴンIDをIDファイルから読み込む。
 ///
-///  @param[in,out] tri_list	三角形ポリゴン情報。
+///  @param[in,out] ids			三角形ポリゴンID。三角形ポリゴン数の要素を
+///								確保して渡す。
 ///  @param[in]		fname		三角形ポリゴンIDファイル名。
 ///  @param[in]		id_format	三角形ポリゴンIDファイルの入力形式。
 ///  @return	POLYLIB_STATで定義される値が返る
+///  @attention 読み込んだIDはPolygons::set_triangle_ids()で設定すること。
 ///
 POLYLIB_STAT load_id(
-	std::vector<PrivateTriangle*>	*tri_list, 
+	std::vector<int>				*ids, 
 	std::string 					fname,
 	ID_FORMAT						id_format
 );
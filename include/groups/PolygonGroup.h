@@ -16,6 +16,7 @@
 //#include <libxml/tree.h>
 #include "polygons/Triangle.h"
 #include "common/PolylibStat.h"
+#include "common/PolylibMemory.h"
 #include "common/PolylibCommon.h"
 #include "TextParser.h"
 
@@ -25,6 +26,8 @@ class Polylib;
 class Polygons;
 //class PolylibCfgElem;
 class PolylibMoveParams;
+class PolylibAsyncSave;
+class TriangleIdIndex;
 
 ////////////////////////////////////////////////////////////////////////////
 ///
@@ -85,10 +88,13 @@ public:
 	///
 	/// STLファイルからポリゴン情報を読み込み、TriMeshクラスに登録する。
 	///
+	///  @param[in] scale	頂点座標のスケール。
+	///  @param[in] region	指定した場合、この領域と交差する三角形だけを読み込む。
+	///						スナップショットファイルには適用されない。
 	///  @return POLYLIB_STATで定義される値が返る。
 	///  @attention TriMeshクラスのimport()参照。
 	///
-	POLYLIB_STAT load_stl_file(float scale=1.0);
+	POLYLIB_STAT load_stl_file(float scale=1.0, const BBox *region=NULL);
 
 	///
 	/// 三角形ポリゴンIDファイルからポリゴンIDを読み込み、m_internal_idに登録する。
@@ -139,14 +145,116 @@ public:
 	///  @param[in] rank_no		ファイル名に付加するランク番号。
 	///  @param[in] extend		ファイル名に付加する自由文字列。
 	///  @param[in] id_format	三角形IDファイルの出力形式。
+	///  @param[in] gzip		trueならばgzip圧縮して拡張子.gzを付ける。
 	///  @return	POLYLIB_STATで定義される値が返る。
 	/// 
 	POLYLIB_STAT save_id_file(
 		std::string 	rank_no,
 		std::string		extend,
-		ID_FORMAT		id_format
+		ID_FORMAT		id_format,
+		bool			gzip = false
+	);
+
+	///
+	/// ポリゴン情報を複製し、STLファイルとIDファイルの書き出しを非同期保存の
+	/// ハンドルに登録する。ファイル名はsave_stl_file()、save_id_file()と同じ。
+	///
+	///  @param[in,out] async	非同期保存のハンドル。
+	///  @param[in] rank_no		ファイル名に付加するランク番号。
+	///  @param[in] extend		ファイル名に付加する自由文字列。
+	///  @param[in] format		STLファイルフォーマット。
+	///  @param[in,out] stl_fname_map stl ファイル名とポリゴングループのパス
+	///  @param[in] with_id		trueならばIDファイルも書き出す。
+	///  @param[in] id_format	三角形IDファイルの出力形式。
+	///  @return	POLYLIB_STATで定義される値が返る。
+	///  @attention スナップショット(TriMeshIO::FMT_SNAP)は登録できない。
+	///
+	POLYLIB_STAT save_files_async(
+		PolylibAsyncSave	*async,
+		std::string			rank_no,
+		std::string			extend,
+		std::string			format,
+		std::map<std::string,std::string>& stl_fname_map,
+		bool				with_id,
+		ID_FORMAT			id_format
 	);
 
+	///
+	/// 保存するSTLファイル名とIDファイル名を取得する。save_stl_file()、
+	/// save_id_file()と同じファイル名となる。ファイルは作成しない。
+	///
+	///  @param[in] rank_no		ファイル名に付加するランク番号。
+	///  @param[in] extend		ファイル名に付加する自由文字列。
+	///  @param[in] format		STLファイルフォーマット。
+	///  @param[out] stl_fname	STLファイル名。
+	///  @param[out] id_fname	IDファイル名。
+	///
+	void acq_save_fnames(
+		std::string			rank_no,
+		std::string			extend,
+		std::string			format,
+		std::string			*stl_fname,
+		std::string			*id_fname
+	);
+
+	///
+	/// 差分保存で、前回保存したファイルを再利用できるか調べる。
+	/// 前回の保存以降ポリゴン情報が変更されておらず、ランク番号、STLファイル
+	/// フォーマット、IDファイルの有無と形式が同じならば、前回のSTLファイル名を
+	/// stl_fname_mapに登録する。
+	///
+	///  @param[in] rank_no		ファイル名に付加するランク番号。
+	///  @param[in] format		STLファイルフォーマット。
+	///  @param[in,out] stl_fname_map stl ファイル名とポリゴングループのパス
+	///  @param[in] with_id		trueならばIDファイルも必要。
+	///  @param[in] id_format	三角形IDファイルの出力形式。
+	///  @return	true:再利用する/false:書き出しが必要。
+	///
+	bool refer_saved_file(
+		std::string			rank_no,
+		std::string			format,
+		std::map<std::string,std::string>& stl_fname_map,
+		bool				with_id,
+		ID_FORMAT			id_format
+	);
+
+	///
+	/// ファイルを書き出した(非同期保存では登録した)ことを記録し、変更フラグを
+	/// 下ろす。ファイル名はstl_fname_mapに登録されたものを使う。
+	///
+	///  @param[in] rank_no		ファイル名に付加するランク番号。
+	///  @param[in] format		STLファイルフォーマット。
+	///  @param[in] stl_fname_map stl ファイル名とポリゴングループのパス
+	///  @param[in] with_id		trueならばIDファイルも書き出した。
+	///  @param[in] id_format	三角形IDファイルの出力形式。
+	///
+	void mark_saved(
+		std::string			rank_no,
+		std::string			format,
+		const std::map<std::string,std::string>& stl_fname_map,
+		bool				with_id,
+		ID_FORMAT			id_format
+	);
+
+	///
+	/// ポリゴン情報を変更したことを記録する。次回の差分保存で書き出される。
+	/// init()、add_triangles()、rescale_polygons()、set_all_exid_of_trias()と
+	/// Polylib::move()、MPIPolylib::migrate()では自動的に記録される。
+	/// get_triangles()で得た三角形を直接変更した場合に呼び出す。
+	///
+	void set_dirty() {
+		m_dirty = true;
+	}
+
+	///
+	/// 前回の保存以降にポリゴン情報が変更されたか。
+	///
+	///  @return	変更フラグ。
+	///
+	bool is_dirty() const {
+		return m_dirty;
+	}
+
 
 	///
 	/// 設定ファイルに出力するTextParserのリーフを編集する.
@@ -239,6 +347,17 @@ public:
 		std::vector<PrivateTriangle*>	*tri_list
 	) const;
 
+	///
+	/// 自rankが所有する三角形ポリゴンを抽出する。
+	/// 領域分割時に他rankが所有するガイドセル領域の複製を除いたリストとなり、
+	/// 全rankの結果を合わせると各三角形がちょうど1回ずつ現れる。
+	/// 量子化している場合、返却する三角形は検索結果と同様に復元して保持される。
+	///
+	///  @return	抽出したポリゴンリストのポインタ。
+	///  @attention	返却した三角形ポリゴンは、削除不可。vectorは要削除。
+	///
+	const std::vector<PrivateTriangle*>* get_owned_triangles() const;
+
 	/// 
 	/// KD木探索により、指定位置に最も近いポリゴンを検索する。
 	///
@@ -249,6 +368,40 @@ public:
 		const Vec3f&    pos
 	) const;
 
+	///
+	/// KD木探索により、指定位置から距離max_dist未満で最も近いポリゴンを
+	/// 検索する。距離は三角形の重心までの距離で、KD木を分枝限定法で探索
+	/// するので、近似のない最近傍となる。
+	///
+	///  @param[in]     pos			指定位置
+	///  @param[in]     max_dist	距離の上限
+	///  @param[out]    dist		検索されたポリゴンの重心までの距離
+	///  @return    検索されたポリゴン。max_dist未満になければNULL。
+	///  @attention オーバーロードメソッドあり。
+	///
+	const PrivateTriangle* search_nearest(
+		const Vec3f&	pos,
+		float			max_dist,
+		float			*dist
+	) const;
+
+	///
+	/// KD木探索により、線分orig + t * dir (0 <= t <= tmax)と最初に交差する
+	/// ポリゴンを検索する。ポリゴンの表裏は区別しない。
+	///
+	///  @param[in]     orig	始点
+	///  @param[in]     dir		方向ベクトル
+	///  @param[in]     tmax	tの上限
+	///  @param[out]    t		交差位置のt
+	///  @return    検索されたポリゴン。交差しなければNULL。
+	///
+	const PrivateTriangle* search_ray(
+		const Vec3f&	orig,
+		const Vec3f&	dir,
+		float			tmax,
+		float			*t
+	) const;
+
 	///
 	/// PolygonGroupのフルパス名を取得する。
 	///
@@ -263,18 +416,36 @@ public:
 	///
 	std::string acq_file_name();
 
+	///
+	/// ポリゴン情報がスナップショットファイルから読み込まれるかどうか。
+	///
+	///  @return true:スナップショットファイル1個が指定されている。
+	///
+	bool is_snapshot() const;
+
 	///
 	/// PE領域間移動する三角形ポリゴンリストの取得。
 	///
-	///  @param[in]	neibour_bbox		隣接PE領域バウンディングボックス。
-	///  @param[in]	exclude_tria_ids	領域移動対象外三角形IDリスト。
+	///  @param[in]	neibour_bbox	隣接PE領域バウンディングボックス。
+	///  @param[in]	exclude_index	領域移動対象外三角形IDの索引。
 	///  @return	検索結果三角形リスト。
 	///
 	const std::vector<PrivateTriangle*>* search_outbounded(
-		BBox				neibour_bbox,
-		std::vector<int>	*exclude_tria_ids
+		BBox					neibour_bbox,
+		const TriangleIdIndex	*exclude_index
 	);
 
+	///
+	/// 三角形IDで三角形ポリゴンを取得。
+	///
+	///  @param[in]	id	三角形ID。
+	///  @return	三角形ポリゴン。該当するIDが無い場合はNULL。
+	///  @attention	戻り値はPolylib内で保持されるアドレス値なので、deleteしないで下さい。
+	///
+	PrivateTriangle *get_triangle_by_id(
+		int		id
+	) const;
+
 	///
 	/// 三角形リストの追加。
 	///
@@ -286,6 +457,27 @@ public:
 		std::vector<PrivateTriangle*>	*tri_list
 	);
 
+	///
+	/// 三角形リストの追加。三角形を複製せずにインスタンスを引き取る。
+	///
+	///  @param[in,out]	tri_list	三角形ポリゴンリストのポインタ。戻り時は空になる。
+	///  @return	POLYLIB_STATで定義される値が返る。
+	///  @attention	三角形IDが重複した三角形は追加せずにdeleteする。
+	///				KD木の再構築はしない。
+	///
+	POLYLIB_STAT adopt_triangles(
+		std::vector<PrivateTriangle*>	*tri_list
+	);
+
+	///
+	/// 三角形リストをID順に並べ替える。
+	/// add_triangles()、adopt_triangles()は末尾に追加するので、保存時などに
+	/// ID順が必要な場合に一度だけ呼び出す。
+	///
+	///  @attention	KD木の再構築はしない。
+	///
+	void sort_triangles_by_id();
+
 	///
 	/// ポリゴン情報を再構築する。（KD木の再構築をおこなう）
 	///
@@ -304,6 +496,17 @@ public:
 		int irank = -1
 	);
 
+	///
+	/// グループが利用中のメモリ量の内訳を加算する。
+	/// 三角形ポリゴン、KD木、グループ情報のみが対象で、MPI関連の領域は
+	/// 含まない。
+	///
+	///  @param[in,out] usage	メモリ量の内訳(byte)。
+	///
+	virtual void memory_usage(
+		PolylibMemoryUsage	*usage
+	);
+
   // add keno 20120331
   /// ポリゴングループの要素数を返す
   int get_group_num_tria( void );
@@ -452,6 +655,68 @@ public:
 		return m_polygons->get_tri_list();
 	}
 
+	///
+	/// 三角形ポリゴン数を取得。三角形ポリゴンは復元しない。
+	///
+	/// @return 三角形ポリゴン数。
+	///
+	int get_num_triangles() const {
+		return m_polygons->get_num_triangles();
+	}
+
+	///
+	/// 全三角形ポリゴンを読み出すための一時的なリストを取得。
+	/// 量子化している場合も復元した三角形を保持しないので、保存や集計では
+	/// get_triangles()の代わりにこちらを利用する。
+	///
+	/// @return 三角形ポリゴンリスト。
+	/// @attention 使用後はrelease_triangles()で解放すること。
+	///
+	std::vector<PrivateTriangle*>* acquire_triangles() const {
+		return m_polygons->acquire_tri_list();
+	}
+
+	///
+	/// acquire_triangles()で取得したリストを解放。
+	///
+	/// @param[in] tri_list	acquire_triangles()で取得したリスト。
+	///
+	void release_triangles(std::vector<PrivateTriangle*>* tri_list) const {
+		m_polygons->release_tri_list(tri_list);
+	}
+
+	///
+	/// 三角形ポリゴンの所有フラグを設定。
+	///
+	/// @param[in] idx		三角形ポリゴンリストのインデックス。
+	/// @param[in] owned	所有フラグ。
+	///
+	void set_triangle_owned(int idx, bool owned) {
+		m_polygons->set_triangle_owned(idx, owned);
+	}
+
+	///
+	/// 量子化している場合に、検索などで復元して保持している三角形ポリゴンを
+	/// 解放する。検索関数は復元した三角形を保持したままにするので、
+	/// 不要になった時点で呼び出し側が明示的に呼ぶ。
+	///
+	/// @attention 解放前に取得した三角形ポリゴンのポインタは無効となる。
+	/// @attention 他スレッドの検索と同時に呼んではならない。
+	///
+	void release_decoded_triangles() {
+		m_polygons->release_triangles();
+	}
+
+	///
+	/// 三角形IDインデックスを作成し直す。
+	///
+	/// @attention get_triangles()で取得した三角形ポリゴンのIDを直接変更した
+	///			場合は、get_triangle_by_id()の前に呼ぶこと。
+	///
+	void rebuild_id_index() {
+		m_polygons->rebuild_id_index();
+	}
+
 	///
 	/// Polygonクラスが管理するKD木クラスを取得。
 	///
@@ -461,6 +726,15 @@ public:
 		return m_polygons->get_vtree();
 	}
 
+	///
+	/// Polygonクラスが管理する全三角形ポリゴンを外包するBoundingBoxを取得。
+	///
+	/// @return BoundingBox。
+	///
+	BBox get_bbox() const {
+		return m_polygons->get_bbox();
+	}
+
 	///
 	/// ポリゴングループIDを取得。
 	/// メンバー名修正( m_id -> m_internal_id) 2010.10.20
@@ -501,6 +775,15 @@ public:
 		return m_id;
 	}
 
+	///
+	/// 設定ファイルでユーザ定義IDが指定されているか。
+	///
+	///  @return 指定されていればtrue。
+	///
+	bool get_id_defined() const {
+		return m_id_defined;
+	}
+
 	///
 	/// 移動対象フラグを取得。
 	///
@@ -510,6 +793,43 @@ public:
 		return m_movable;
 	}
 
+	///
+	/// 頂点座標の量子化ビット数を設定。次回のポリゴン再構築から有効となる。
+	///
+	///  @param[in] bits	1軸あたりのビット数(16または21)。0で量子化しない。
+	///  @return	POLYLIB_STATで定義される値が返る。
+	///
+	POLYLIB_STAT set_quantize_bits(int bits);
+
+	///
+	/// 頂点座標の量子化ビット数を取得。
+	///
+	///  @return	1軸あたりのビット数。0は量子化しない。
+	///
+	int get_quantize_bits() const;
+
+	///
+	/// 量子化による頂点座標の誤差の上限(各軸の絶対値)を取得。
+	///
+	///  @return	誤差の上限。量子化していない場合は0。
+	///
+	float get_quantize_error() const;
+
+	///
+	/// バイナリSTLファイルをメモリマップしたまま保持するかを設定。
+	/// 次回のポリゴン読み込みから有効となる。
+	///
+	///  @param[in] keep	trueならマップしたまま保持する。
+	///  @attention	get_triangles()を呼ぶか三角形を追加・移動すると、その時点で
+	///				全三角形をマップからコピーする。
+	///
+	void set_keep_mapped(bool keep);
+
+	///
+	/// バイナリSTLファイルをメモリマップしたまま保持するかを取得。
+	///
+	bool get_keep_mapped() const;
+
 	///
 	/// move()による移動前三角形一時保存リストの個数を取得。
 	///
@@ -633,11 +953,30 @@ private:
 	///
 	///  @param[in] rank_no	ファイル名に付加するランク番号。
 	///  @param[in] extend	ファイル名に付加する自由文字列。
+	///  @param[in] gzip	trueならば拡張子.gzを付ける。
 	///  @return	POLYLIB_STATで定義される値が返る。
 	///
 	char *mk_id_fname(
 		std::string		extend,
-		std::string		rank_no
+		std::string		rank_no,
+		bool			gzip = false
+	);
+
+	///
+	/// 差分保存でファイルを再利用できるか判定するための、保存条件の文字列を
+	/// 作成。
+	///
+	///  @param[in] rank_no		ファイル名に付加するランク番号。
+	///  @param[in] format		STLファイルフォーマット。
+	///  @param[in] with_id		trueならばIDファイルも書き出す。
+	///  @param[in] id_format	三角形IDファイルの出力形式。
+	///  @return	保存条件の文字列。
+	///
+	std::string mk_saved_key(
+		std::string		rank_no,
+		std::string		format,
+		bool			with_id,
+		ID_FORMAT		id_format
 	);
 
 	///
@@ -679,6 +1018,15 @@ protected:
 	/// KD木の再構築が必要か？
 	bool								m_need_rebuild;
 
+	/// 前回の保存以降にポリゴン情報が変更されたか？
+	bool								m_dirty;
+
+	/// 前回保存したSTLファイル名。
+	std::string							m_saved_fname;
+
+	/// 前回保存した条件(ランク番号、フォーマット、IDファイルの形式)。
+	std::string							m_saved_key;
+
 	/// move()による移動前三角形一時保存リスト。
 	std::vector<PrivateTriangle*>		*m_trias_before_move;
 	
@@ -19,12 +19,15 @@
 #include "common/Vec3.h"
 #include "common/BBox.h"
 #include "common/PolylibStat.h"
+#include "common/PolylibMemory.h"
 #include "common/PolylibCommon.h"
 
 namespace PolylibNS {
 
 class Triangle;
 class PrivateTriangle;
+class SnapshotReader;
+class SnapshotWriter;
 
 ////////////////////////////////////////////////////////////////////////////
 ///
@@ -63,15 +66,33 @@ public:
 		const std::vector<PrivateTriangle*>		*trias
 	) = 0;
 
+	///
+	/// 三角形ポリゴンリストに引数で与えられる三角形を複製せずに追加する。
+	///
+	///  @param[in,out] trias 追加する三角形ポリゴンリスト。戻り時は空になる。
+	///  @attention 三角形のインスタンスの所有権は呼び出し側から移る。
+	///
+	virtual void adopt(
+		std::vector<PrivateTriangle*>		*trias
+	) = 0;
+
+	///
+	/// 三角形ポリゴンリストをID順に並べ替える。
+	///
+	virtual void sort_by_id() = 0;
+
 	///
 	/// STLファイルを読み込みデータの初期化。
 	///
 	///  @param[in] fname	ファイル名とファイルフォーマットのmap。
+	///  @param[in] scale	頂点座標のスケール。
+	///  @param[in] region	指定した場合、この領域と交差する三角形だけを読み込む。
 	///  @return	POLYLIB_STATで定義される値が返る。
 	///
 	virtual POLYLIB_STAT import(
 		const std::map<std::string, std::string>	fname,
-		float scale = 1.0
+		float scale = 1.0,
+		const BBox *region = NULL
 	) = 0;
 
 	///
@@ -160,6 +181,40 @@ public:
 		const Vec3f&    pos
 	) const = 0;
 
+	///
+	/// KD木探索により、指定位置から距離max_dist未満で最も近いポリゴンを
+	/// 検索する。距離は三角形の重心までの距離で、KD木を分枝限定法で探索
+	/// するので、近似のない最近傍となる。
+	///
+	///  @param[in]     pos			指定位置
+	///  @param[in]     max_dist	距離の上限
+	///  @param[out]    dist		検索されたポリゴンの重心までの距離
+	///  @return    検索されたポリゴン。max_dist未満になければNULL。
+	///  @attention オーバーロードメソッドあり。
+	///
+	virtual const PrivateTriangle* search_nearest(
+		const Vec3f&	pos,
+		float			max_dist,
+		float			*dist
+	) const = 0;
+
+	///
+	/// KD木探索により、線分orig + t * dir (0 <= t <= tmax)と最初に交差する
+	/// ポリゴンを検索する。ポリゴンの表裏は区別しない。
+	///
+	///  @param[in]     orig	始点
+	///  @param[in]     dir		方向ベクトル
+	///  @param[in]     tmax	tの上限
+	///  @param[out]    t		交差位置のt
+	///  @return    検索されたポリゴン。交差しなければNULL。
+	///
+	virtual const PrivateTriangle* search_ray(
+		const Vec3f&	orig,
+		const Vec3f&	dir,
+		float			tmax,
+		float			*t
+	) const = 0;
+
 	///
 	/// 配下の全ポリゴンのm_exid値を指定値にする。
 	///
@@ -169,6 +224,76 @@ public:
 		const int id
 	) const = 0;
 
+	///
+	/// 頂点座標の量子化ビット数を設定する。次回のbuild()から有効となる。
+	///
+	///  @param[in] bits	1軸あたりのビット数(16または21)。0で量子化しない。
+	///  @return	POLYLIB_STATで定義される値が返る。
+	///
+	virtual POLYLIB_STAT set_quantize_bits(
+		int		bits
+	) = 0;
+
+	///
+	/// 頂点座標の量子化ビット数を取得する。
+	///
+	///  @return	1軸あたりのビット数。0は量子化しない。
+	///
+	virtual int get_quantize_bits() const = 0;
+
+	///
+	/// 量子化による頂点座標の誤差の上限(各軸の絶対値)を取得する。
+	///
+	///  @return	誤差の上限。量子化していない場合は0。
+	///
+	virtual float get_quantize_error() const = 0;
+
+	///
+	/// バイナリSTLファイルをメモリマップしたまま保持するかを設定する。
+	/// 次回のimport()から有効となる。
+	///
+	///  @param[in] keep	trueならマップしたまま保持する。
+	///
+	virtual void set_keep_mapped(
+		bool	keep
+	) = 0;
+
+	///
+	/// バイナリSTLファイルをメモリマップしたまま保持するかを取得する。
+	///
+	virtual bool get_keep_mapped() const = 0;
+
+	///
+	/// 三角形ポリゴンとKD木が利用中のメモリ量の内訳を加算する。
+	///
+	///  @param[in,out] usage	メモリ量の内訳(byte)。
+	///
+	virtual void memory_usage(
+		PolylibMemoryUsage	*usage
+	) const = 0;
+
+	///
+	/// 三角形ポリゴンとKD木をスナップショット形式で書き出す。
+	///
+	///  @param[in,out] wr	書き出し先。
+	///  @return	POLYLIB_STATで定義される値が返る。
+	///  @attention PolylibSnapshotクラスから利用する。
+	///
+	virtual POLYLIB_STAT save_snapshot(
+		SnapshotWriter	&wr
+	) const = 0;
+
+	///
+	/// スナップショット形式のデータから三角形ポリゴンとKD木を復元する。
+	///
+	///  @param[in,out] rd	読み出し元。
+	///  @return	POLYLIB_STATで定義される値が返る。
+	///  @attention PolylibSnapshotクラスから利用する。
+	///
+	virtual POLYLIB_STAT load_snapshot(
+		SnapshotReader	&rd
+	) = 0;
+
 	//=======================================================================
 	// Setter/Getter
 	//=======================================================================
@@ -177,10 +302,100 @@ public:
 	///
 	/// @return 三角形ポリゴンのリスト。
 	///
-	std::vector<PrivateTriangle*> *get_tri_list() const {
+	virtual std::vector<PrivateTriangle*> *get_tri_list() const {
 		return m_tri_list;
 	}
 
+	///
+	/// 三角形ポリゴンを取得。
+	///
+	/// @param[in] idx	三角形ポリゴンリストのインデックス。
+	/// @return 三角形ポリゴン。
+	///
+	virtual PrivateTriangle *get_triangle(int idx) const {
+		return (*m_tri_list)[idx];
+	}
+
+	///
+	/// 三角形ポリゴン数を取得。三角形ポリゴンは復元しない。
+	///
+	/// @return 三角形ポリゴン数。
+	///
+	int get_num_triangles() const {
+		return (m_tri_list == NULL) ? 0 : (int)m_tri_list->size();
+	}
+
+	///
+	/// 全三角形ポリゴンを読み出すための一時的なリストを取得。
+	/// 保存や集計のように全三角形を読み出すだけの処理で利用する。
+	/// 量子化している場合は、未復元の三角形を一時的に復元したリストを返す。
+	///
+	/// @return 三角形ポリゴンのリスト。並びはget_triangle()のインデックス順。
+	/// @attention 使用後はrelease_tri_list()で解放すること。
+	///
+	virtual std::vector<PrivateTriangle*> *acquire_tri_list() const {
+		return m_tri_list;
+	}
+
+	///
+	/// acquire_tri_list()で取得したリストを解放。
+	///
+	/// @param[in] tri_list	acquire_tri_list()で取得したリスト。
+	///
+	virtual void release_tri_list(
+		std::vector<PrivateTriangle*>	*
+	) const {}
+
+	///
+	/// 三角形ポリゴンの所有フラグを設定。三角形ポリゴンは復元しない。
+	///
+	/// @param[in] idx		三角形ポリゴンリストのインデックス。
+	/// @param[in] owned	所有フラグ。
+	///
+	virtual void set_triangle_owned(int idx, bool owned);
+
+	///
+	/// 全三角形ポリゴンの三角形IDを設定し、三角形IDインデックスを作成し直す。
+	/// 三角形ポリゴンは復元しない。
+	///
+	/// @param[in] ids	三角形ID。並びは三角形ポリゴンリストのインデックス順。
+	/// @return	POLYLIB_STATで定義される値が返る。
+	///
+	virtual POLYLIB_STAT set_triangle_ids(const std::vector<int> &ids);
+
+	///
+	/// 三角形IDインデックスを作成し直す。
+	///
+	/// @attention get_tri_list()などで取得した三角形ポリゴンのIDを直接
+	///			変更した場合は、get_triangle_by_id()の前に呼ぶこと。
+	///
+	virtual void rebuild_id_index() {}
+
+	///
+	/// 量子化している場合に、検索などで復元して保持している三角形ポリゴンを
+	/// 解放する。
+	///
+	/// @attention 解放前に取得した三角形ポリゴンのポインタは無効となる。
+	///
+	virtual void release_triangles() {}
+
+	///
+	/// 三角形IDで三角形ポリゴンを取得。
+	///
+	/// @param[in] id	三角形ID。
+	/// @return 三角形ポリゴン。該当するIDが無い場合はNULL。
+	///
+	virtual PrivateTriangle *get_triangle_by_id(int id) const = 0;
+
+	///
+	/// 三角形ポリゴンを外包するBounding Boxを取得。
+	/// get_triangle()で三角形を取得せずにKD木を作成するために利用する。
+	///
+	/// @param[in]  idx		三角形ポリゴンリストのインデックス。
+	/// @param[out] ebox	min xyz, max xyzの順の6要素。
+	///
+	virtual void get_triangle_bbox(int idx, float *ebox) const;
+
 	///
 	/// KD木クラスを取得。
 	///
@@ -188,6 +403,13 @@ public:
 	///
 	virtual VTree *get_vtree() const = 0;
 
+	///
+	/// 全三角形ポリゴンを外包するBoundingBoxを取得。
+	///
+	/// @return BoundingBox。
+	///
+	virtual BBox get_bbox() const = 0;
+
 private:
 	///
 	/// 三角形ポリゴンリストの初期化。
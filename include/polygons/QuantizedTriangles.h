@@ -0,0 +1,249 @@
+/*
+ * Polylib - Polygon Management Library
+ *
+ * Copyright (c) 2010-2011 VCAD System Research Program, RIKEN.
+ * All rights reserved.
+ *
+ * Copyright (c) 2012-2013 Advanced Institute for Computational Science, RIKEN.
+ * All rights reserved.
+ *
+ */
+
+#ifndef polylib_quantized_triangles_h
+#define polylib_quantized_triangles_h
+
+#include <string>
+#include <vector>
+#include "common/Vec3.h"
+#include "common/BBox.h"
+#include "common/PolylibStat.h"
+
+namespace PolylibNS {
+
+class PrivateTriangle;
+
+////////////////////////////////////////////////////////////////////////////
+///
+/// クラス:QuantizedTriangles
+/// 三角形ポリゴンを省メモリ形式で保持するクラスです。
+/// 頂点座標はBounding Boxを基準に1軸あたり16bitまたは21bitの整数に量子化し、
+/// 法線ベクトルはoctahedral符号化(16bit x 2)で保持する。
+/// バイナリSTLファイルをメモリマップし、頂点座標と法線をマップ領域に
+/// 置いたまま参照する形式も扱う(誤差なし)。
+///
+////////////////////////////////////////////////////////////////////////////
+class QuantizedTriangles {
+public:
+	///
+	/// コンストラクタ。
+	///
+	QuantizedTriangles();
+
+	///
+	/// デストラクタ。
+	///
+	~QuantizedTriangles();
+
+	///
+	/// 三角形ポリゴンリストを量子化して保持する。
+	///
+	///  @param[in] tri_list	量子化する三角形ポリゴンリスト。
+	///  @param[in] bbox		全三角形ポリゴンを外包するBounding Box。
+	///  @param[in] bits		1軸あたりのビット数(16または21)。
+	///  @return	POLYLIB_STATで定義される値が返る。
+	///
+	POLYLIB_STAT encode(
+		const std::vector<PrivateTriangle*>	*tri_list,
+		const BBox							&bbox,
+		int									bits
+	);
+
+	///
+	/// バイナリSTLファイルをメモリマップし、頂点座標と法線はマップ領域に
+	/// 置いたまま保持する。三角形IDなどの属性だけを配列にコピーする。
+	///
+	///  @param[in] fname	バイナリSTLファイル名。
+	///  @param[in] scale	頂点座標のスケール。
+	///  @param[in] id_base	先頭の三角形に割り当てるID。
+	///  @return	POLYLIB_STATで定義される値が返る。マップできない場合は
+	///			PLSTAT_NG。
+	///
+	POLYLIB_STAT map_stl_b(
+		const std::string					&fname,
+		float								scale,
+		int									id_base
+	);
+
+	///
+	/// 保持している三角形ポリゴンを全て削除する。マップしたファイルは解放する。
+	///
+	void clear();
+
+	///
+	/// 量子化した三角形ポリゴンを復元する。
+	///
+	///  @param[in] idx	三角形のインデックス。
+	///  @return	復元した三角形ポリゴン。deleteは呼び出し側で行うこと。
+	///
+	PrivateTriangle *decode(
+		int		idx
+	) const;
+
+	///
+	/// 復元後の頂点座標を取得する。
+	///
+	///  @param[in]  idx	三角形のインデックス。
+	///  @param[out] vtx	3頂点の座標。
+	///
+	void get_vertex(
+		int		idx,
+		Vec3f	vtx[3]
+	) const;
+
+	///
+	/// 復元後の頂点座標を外包するBounding Boxを取得する。
+	///
+	///  @param[in]  idx	三角形のインデックス。
+	///  @param[out] ebox	min xyz, max xyzの順の6要素。
+	///
+	void get_bbox(
+		int		idx,
+		float	*ebox
+	) const;
+
+	///
+	/// 三角形ポリゴンIDを取得。
+	///
+	int get_id(int idx) const {
+		return m_id[idx];
+	}
+
+	///
+	/// 三角形ポリゴンIDを設定。
+	///
+	void set_id(int idx, int id) {
+		m_id[idx] = id;
+	}
+
+	///
+	/// ユーザ定義IDを設定。
+	///
+	void set_exid(int idx, int id) {
+		m_exid[idx] = id;
+	}
+
+	///
+	/// ユーザ定義状態変数を設定。
+	///
+	void set_shell(int idx, int val) {
+		m_shell[idx] = val;
+	}
+
+	///
+	/// 自rankが所有する三角形かを設定。
+	///
+	void set_owned(int idx, bool owned) {
+		m_owned[idx] = owned ? 1 : 0;
+	}
+
+	///
+	/// 保持している三角形数。
+	///
+	int size() const {
+		return m_id.size();
+	}
+
+	///
+	/// 1軸あたりのビット数。
+	///
+	int get_bits() const {
+		return m_bits;
+	}
+
+	///
+	/// 頂点座標をマップしたバイナリSTLファイルに置いているか。
+	///
+	bool is_mapped() const {
+		return m_records != NULL;
+	}
+
+	///
+	/// 復元した頂点座標の元の座標に対する誤差の上限(各軸の絶対値)。
+	///
+	float get_error() const {
+		return m_error;
+	}
+
+	///
+	/// 利用しているメモリ量を返す。
+	///
+	///  @return	利用中のメモリ量(byte)
+	///  @attention	マップしたファイルの領域は含めない。
+	///
+	size_t memory_size() const;
+
+private:
+	///
+	/// 座標を量子化する。
+	///
+	unsigned int quantize(float v, int axis) const;
+
+	///
+	/// 量子化した座標を復元する。
+	///
+	float dequantize(unsigned int q, int axis) const {
+		return (float)((double)m_origin[axis] + (double)m_step[axis] * q);
+	}
+
+	//=======================================================================
+	// クラス変数
+	//=======================================================================
+	/// 1軸あたりのビット数。
+	int								m_bits;
+
+	/// 量子化の基準点(Bounding Boxの最小点)。
+	Vec3f							m_origin;
+
+	/// 量子化の刻み幅。
+	Vec3f							m_step;
+
+	/// 復元誤差の上限。
+	float							m_error;
+
+	/// 16bit量子化時の頂点座標(三角形1つにつき9要素)。
+	std::vector<unsigned short>		m_vtx16;
+
+	/// 21bit量子化時の頂点座標(三角形1つにつき3要素、1頂点を64bitに格納)。
+	std::vector<unsigned long long>	m_vtx21;
+
+	/// マップしたバイナリSTLファイルの領域。
+	void							*m_map;
+
+	/// マップした領域の長さ(byte)。
+	size_t							m_map_size;
+
+	/// マップ時の先頭の三角形のレコード。マップしていなければNULL。
+	const char						*m_records;
+
+	/// マップ時の頂点座標のスケール。
+	float							m_scale;
+
+	/// octahedral符号化した法線ベクトル(三角形1つにつき2要素)。
+	std::vector<short>				m_normal;
+
+	/// 三角形ポリゴンID。
+	std::vector<int>				m_id;
+
+	/// ユーザ定義ID。
+	std::vector<int>				m_exid;
+
+	/// ユーザ定義状態変数。
+	std::vector<int>				m_shell;
+
+	/// 自rankが所有する三角形か(1:所有する/0:他rankが所有する)。
+	std::vector<char>				m_owned;
+};
+
+} //namespace PolylibNS
+
+#endif  // polylib_quantized_triangles_h
@@ -12,11 +12,17 @@
 #ifndef polylib_trimesh_h
 #define polylib_trimesh_h
 
+#include <pthread.h>
+
 namespace PolylibNS {
 
 class Polygons;
 class VTree;
 class PrivateTriangle;
+class QuantizedTriangles;
+class TriangleIdIndex;
+class SnapshotReader;
+class SnapshotWriter;
 
 ////////////////////////////////////////////////////////////////////////////
 ///
@@ -52,21 +58,46 @@ public:
 	///
 	/// @param[in] trias	設定する三角形ポリゴンリスト。
 	/// @attention m_idが重複するインスタンスは追加されない。
+	/// @attention 追加した三角形はリストの末尾に並ぶ(既存の並びは変えない)。
 	/// @attention KD木の再構築は行わない。
 	///
 	void add(
 		const std::vector<PrivateTriangle*>  *trias
 	);
 
+	///
+	/// 三角形ポリゴンリストに引数で与えられる三角形を複製せずに追加する。
+	///
+	/// @param[in,out] trias	追加する三角形ポリゴンリスト。戻り時は空になる。
+	/// @attention 三角形のインスタンスはTriMeshが引き取る。m_idが重複して
+	///			追加しなかったインスタンスはdeleteする。
+	/// @attention 追加した三角形はリストの末尾に並ぶ(既存の並びは変えない)。
+	/// @attention KD木の再構築は行わない。
+	///
+	void adopt(
+		std::vector<PrivateTriangle*>  *trias
+	);
+
+	///
+	/// 三角形ポリゴンリストをID順に並べ替え、IDインデックスを作り直す。
+	///
+	/// @attention 量子化している場合は全三角形を復元する。
+	/// @attention KD木の再構築は行わない。
+	///
+	void sort_by_id();
+
 	///
 	/// ファイルからデータの初期化。
 	///
 	///  @param[in] fmap	ファイル名、ファイルフォーマット。
+	///  @param[in] scale	頂点座標のスケール。
+	///  @param[in] region	指定した場合、この領域と交差する三角形だけを読み込む。
 	///  @return PLSTAT_OK=成功/false=失敗
 	///
 	POLYLIB_STAT import(
 		const std::map<std::string, std::string> fmap,
-		float scale = 1.0
+		float scale = 1.0,
+		const BBox *region = NULL
 	);
 
 	///
@@ -158,6 +189,40 @@ public:
 		const Vec3f&    pos
 	) const;
 
+	///
+	/// KD木探索により、指定位置から距離max_dist未満で最も近いポリゴンを
+	/// 検索する。距離は三角形の重心までの距離で、KD木を分枝限定法で探索
+	/// するので、近似のない最近傍となる。
+	///
+	///  @param[in]     pos			指定位置
+	///  @param[in]     max_dist	距離の上限
+	///  @param[out]    dist		検索されたポリゴンの重心までの距離
+	///  @return    検索されたポリゴン。max_dist未満になければNULL。
+	///  @attention オーバーロードメソッドあり。
+	///
+	const PrivateTriangle* search_nearest(
+		const Vec3f&	pos,
+		float			max_dist,
+		float			*dist
+	) const;
+
+	///
+	/// KD木探索により、線分orig + t * dir (0 <= t <= tmax)と最初に交差する
+	/// ポリゴンを検索する。ポリゴンの表裏は区別しない。
+	///
+	///  @param[in]     orig	始点
+	///  @param[in]     dir		方向ベクトル
+	///  @param[in]     tmax	tの上限
+	///  @param[out]    t		交差位置のt
+	///  @return    検索されたポリゴン。交差しなければNULL。
+	///
+	const PrivateTriangle* search_ray(
+		const Vec3f&	orig,
+		const Vec3f&	dir,
+		float			tmax,
+		float			*t
+	) const;
+
 	///
 	/// 配下の全ポリゴンのm_exid値を指定値にする。
 	///
@@ -167,6 +232,181 @@ public:
 		const int	id
 	) const;
 
+	///
+	/// 頂点座標の量子化ビット数を設定する。次回のbuild()から有効となる。
+	/// 量子化を有効にすると、build()時に全三角形をm_bbox基準で量子化して
+	/// 保持し、三角形ポリゴンのインスタンスは参照された時に復元する。
+	/// 形状が変化しない大規模なグループ向けの省メモリ機能である。
+	///
+	///  @param[in] bits	1軸あたりのビット数(16または21)。0で量子化しない。
+	///  @return	POLYLIB_STATで定義される値が返る。
+	///
+	POLYLIB_STAT set_quantize_bits(
+		int		bits
+	);
+
+	///
+	/// 頂点座標の量子化ビット数を取得する。
+	///
+	int get_quantize_bits() const {
+		return m_quant_bits;
+	}
+
+	///
+	/// 量子化による頂点座標の誤差の上限(各軸の絶対値)を取得する。
+	///
+	float get_quantize_error() const;
+
+	///
+	/// バイナリSTLファイルをメモリマップしたまま保持するかを設定する。
+	/// 次回のimport()から有効となる。有効にすると、単一の非圧縮バイナリSTL
+	/// ファイルを領域指定なしで読み込む場合に、頂点座標をマップ領域に
+	/// 置いたまま保持し、三角形ポリゴンのインスタンスは参照された時に作る。
+	/// get_tri_list()などで三角形を書き換え得る場合と三角形を追加した場合は、
+	/// その時点で全三角形をコピーしてマップから切り離す(copy-on-write)。
+	/// 量子化の指定よりも優先する。
+	///
+	///  @param[in] keep	trueならマップしたまま保持する。
+	///
+	void set_keep_mapped(
+		bool	keep
+	) {
+		m_keep_mapped = keep;
+	}
+
+	///
+	/// バイナリSTLファイルをメモリマップしたまま保持するかを取得する。
+	///
+	bool get_keep_mapped() const {
+		return m_keep_mapped;
+	}
+
+	///
+	/// 三角形ポリゴンとKD木が利用中のメモリ量の内訳を加算する。
+	/// 量子化している場合は量子化誤差の上限も内訳に反映する。
+	///
+	///  @param[in,out] usage	メモリ量の内訳(byte)。
+	///
+	void memory_usage(
+		PolylibMemoryUsage	*usage
+	) const;
+
+	///
+	/// 三角形ポリゴンとKD木をスナップショット形式で書き出す。
+	/// 量子化している場合は、復元した頂点座標を書き出す。
+	///
+	///  @param[in,out] wr	書き出し先。
+	///  @return	POLYLIB_STATで定義される値が返る。
+	///
+	POLYLIB_STAT save_snapshot(
+		SnapshotWriter	&wr
+	) const;
+
+	///
+	/// スナップショット形式のデータから三角形ポリゴンとKD木を復元する。
+	/// 量子化が有効な場合は、保存されたKD木は使わずにbuild()で再構築する。
+	///
+	///  @param[in,out] rd	読み出し元。
+	///  @return	POLYLIB_STATで定義される値が返る。
+	///
+	POLYLIB_STAT load_snapshot(
+		SnapshotReader	&rd
+	);
+
+	///
+	/// 三角形ポリゴンのリストを取得。
+	/// 量子化している場合は、全三角形ポリゴンを復元して保持してから返す。
+	/// マップしたファイルを参照している場合は、返したリストが書き換えられ
+	/// 得るので、次のbuild()かrelease_triangles()でマップから切り離す。
+	/// 読み出すだけの場合はacquire_tri_list()を利用すること。
+	///
+	/// @return 三角形ポリゴンのリスト。
+	///
+	std::vector<PrivateTriangle*> *get_tri_list() const;
+
+	///
+	/// 三角形ポリゴンを取得。
+	/// 量子化している場合は、未復元であれば復元して保持してから返す。
+	/// 複数スレッドから同時に呼び出してもよい。
+	///
+	/// @param[in] idx	三角形ポリゴンリストのインデックス。
+	/// @return 三角形ポリゴン。
+	///
+	PrivateTriangle *get_triangle(int idx) const;
+
+	///
+	/// 全三角形ポリゴンを読み出すための一時的なリストを取得。
+	/// 量子化している場合は、未復元の三角形を一時的に復元したリストを返し、
+	/// 復元した三角形は保持しない。
+	///
+	/// @return 三角形ポリゴンのリスト。
+	/// @attention 使用後はrelease_tri_list()で解放すること。
+	///
+	std::vector<PrivateTriangle*> *acquire_tri_list() const;
+
+	///
+	/// acquire_tri_list()で取得したリストを解放。
+	/// 一時的に復元した三角形ポリゴンも解放する。
+	///
+	/// @param[in] tri_list	acquire_tri_list()で取得したリスト。
+	///
+	void release_tri_list(
+		std::vector<PrivateTriangle*>	*tri_list
+	) const;
+
+	///
+	/// 三角形ポリゴンの所有フラグを設定。
+	/// 量子化している場合は量子化データにも設定し、三角形は復元しない。
+	///
+	/// @param[in] idx		三角形ポリゴンリストのインデックス。
+	/// @param[in] owned	所有フラグ。
+	///
+	void set_triangle_owned(int idx, bool owned);
+
+	///
+	/// 全三角形ポリゴンの三角形IDを設定し、三角形IDインデックスを作成し直す。
+	/// 量子化している場合は量子化データのIDを直接書き換え、三角形ポリゴンは
+	/// 復元しない。
+	///
+	/// @param[in] ids	三角形ID。並びは三角形ポリゴンリストのインデックス順。
+	/// @return	POLYLIB_STATで定義される値が返る。
+	///
+	POLYLIB_STAT set_triangle_ids(const std::vector<int> &ids);
+
+	///
+	/// 三角形IDインデックスを作成し直す。
+	///
+	void rebuild_id_index() {
+		build_id_index();
+	}
+
+	///
+	/// 三角形IDで三角形ポリゴンを取得。
+	///
+	/// @param[in] id	三角形ID。
+	/// @return 三角形ポリゴン。該当するIDが無い場合はNULL。
+	///
+	PrivateTriangle *get_triangle_by_id(int id) const;
+
+	///
+	/// 三角形ポリゴンを外包するBounding Boxを取得。
+	///
+	/// @param[in]  idx		三角形ポリゴンリストのインデックス。
+	/// @param[out] ebox	min xyz, max xyzの順の6要素。
+	///
+	void get_triangle_bbox(int idx, float *ebox) const;
+
+	///
+	/// 量子化している場合に、復元済みの三角形ポリゴンを解放する。
+	/// 三角形ID、ユーザ定義ID、ユーザ定義状態変数は量子化データへ書き戻され、
+	/// 三角形IDが変わっていれば三角形IDインデックスを作成し直す。
+	///
+	/// @attention 解放前に取得した三角形ポリゴンのポインタは無効となる。
+	///			頂点座標の変更は保存されないので、変更した場合はbuild()を
+	///			先に行うこと。
+	///
+	void release_triangles();
+
 	//=======================================================================
 	// Setter/Getter
 	//=======================================================================
@@ -192,6 +432,45 @@ private:
 	///
 	void init_tri_list();
 
+	///
+	/// 三角形IDインデックスを三角形ポリゴンリストから作成し直す。
+	///
+	void build_id_index();
+
+	///
+	/// add()とadopt()の共通処理。三角形ポリゴンリストに追加してID順に並べる。
+	///
+	/// @param[in] trias	追加する三角形ポリゴンリスト。
+	/// @param[in] copy		trueなら複製を追加、falseならインスタンスを引き取る。
+	///
+	void merge(
+		const std::vector<PrivateTriangle*>	*trias,
+		bool								copy
+	);
+
+	///
+	/// 量子化している場合に、全三角形ポリゴンを復元して量子化データを破棄する。
+	///
+	void expand_triangles();
+
+	///
+	/// 全三角形ポリゴンを量子化し、三角形ポリゴンのインスタンスを解放する。
+	///
+	///  @return	POLYLIB_STATで定義される値が返る。
+	///
+	POLYLIB_STAT compact_triangles();
+
+	///
+	/// 検索に用いる矩形領域を求める。
+	/// 量子化している場合は誤差の上限だけ広げた領域となる。
+	///
+	///  @param[in] bbox	指定された検索領域。
+	///  @return	検索に用いる矩形領域。
+	///
+	BBox search_bbox(
+		const BBox	*bbox
+	) const;
+
 	//=======================================================================
 	// クラス変数
 	//=======================================================================
@@ -203,6 +482,26 @@ private:
 
 	/// MAX要素数。
 	int		m_max_elements;
+
+	/// 頂点座標の量子化ビット数(0:量子化しない)。
+	int		m_quant_bits;
+
+	/// 量子化した三角形ポリゴン(量子化していない場合はNULL)。
+	/// バイナリSTLファイルをマップしたまま保持している場合も使う。
+	QuantizedTriangles	*m_qtris;
+
+	/// バイナリSTLファイルをメモリマップしたまま保持するか。
+	bool	m_keep_mapped;
+
+	/// マップしたファイルを参照中に、get_tri_list()で書き換え可能な
+	/// 三角形ポリゴンのリストを渡したか。
+	mutable bool	m_list_exposed;
+
+	/// 三角形IDから三角形ポリゴンリストのインデックスを引くハッシュ表。
+	TriangleIdIndex		*m_id_index;
+
+	/// 復元した三角形ポリゴンのリストへの登録を排他する。
+	mutable pthread_mutex_t	m_decode_mutex;
 };
 
 } //namespace PolylibNS
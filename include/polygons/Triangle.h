@@ -28,7 +28,10 @@ public:
 	///
 	/// コンストラクタ。
 	///
-	Triangle(){};
+	Triangle() {
+		m_exid = 0;
+		m_shell = 0;
+	};
 
 	///
 	/// コンストラクタ。
@@ -42,6 +45,8 @@ public:
 		m_vertex[0] = vertex[0];
 		m_vertex[1] = vertex[1];
 		m_vertex[2] = vertex[2];
+		m_exid = 0;
+		m_shell = 0;
 		calc_normal();
 		calc_area();
 	}
@@ -61,6 +66,8 @@ public:
 		m_vertex[1] = vertex[1];
 		m_vertex[2] = vertex[2];
 		m_normal = normal;
+		m_exid = 0;
+		m_shell = 0;
 		calc_area();
 	}
 
@@ -81,6 +88,8 @@ public:
 		m_vertex[2] = vertex[2];
 		m_normal = normal;
 		m_area = area;
+		m_exid = 0;
+		m_shell = 0;
 	}
 
 	//=======================================================================
@@ -229,6 +238,7 @@ public:
 		int		id
 	) : Triangle(vertex) {
 		m_id = id;
+		m_owned = true;
 	}
 
 	///
@@ -244,6 +254,7 @@ public:
 		int		id
 	) : Triangle(vertex, normal) {
 		m_id = id;
+		m_owned = true;
 	}
 
 	///
@@ -261,6 +272,7 @@ public:
 		int		id
 	) : Triangle(vertex, normal, area) {
 		m_id = id;
+		m_owned = true;
 	}
 
 	///
@@ -274,17 +286,21 @@ public:
 		int			id
 	) : Triangle(tri.get_vertex(), tri.get_normal()) {
 		m_id = id;
+		m_owned = true;
 	}
 
 	///
-	/// コンストラクタ。
+	/// コンストラクタ。法線、面積、ユーザ定義ID、状態変数も複製する。
 	///
 	/// @param[in] tri		ポリゴン。
 	///
 	PrivateTriangle(
 		const PrivateTriangle	&tri 
-	) : Triangle(tri.get_vertex(), tri.get_normal()) {
+	) : Triangle(tri.get_vertex(), tri.get_normal(), tri.get_area()) {
+		m_exid = tri.m_exid;
+		m_shell = tri.m_shell;
 		m_id = tri.m_id;
+		m_owned = tri.m_owned;
 	}
 
 	///
@@ -303,6 +319,7 @@ public:
 			m_vertex[i].t[2] = *dim++;
 		}
 		m_id = id;
+		m_owned = true;
 		calc_normal();
 		calc_area();
 	}
@@ -324,6 +341,21 @@ public:
 	///
 	int get_id() const				{return m_id;}
 
+	///
+	/// 自rankが所有する三角形かを設定。
+	///
+	///  @param[in] owned	true:所有する/false:他rankが所有するガイドセル領域の複製。
+	///
+	void set_owned(bool owned)		{m_owned = owned;}
+
+	///
+	/// 自rankが所有する三角形かを返す。
+	/// 領域分割時の所有rankはMPIPolylibが設定する。逐次版では常にtrue。
+	///
+	///  @return true:所有する/false:他rankが所有する。
+	///
+	bool is_owned() const			{return m_owned;}
+
 protected:
 	//=======================================================================
 	// クラス変数
@@ -331,6 +363,11 @@ protected:
 	/// PolygonGroup内で一意となる三角形ポリゴンID。
 	///
 	int m_id;
+
+	/// 自rankが所有する三角形か。
+	/// 全rankで1つの三角形を所有するのは1rankだけとなる。
+	///
+	bool m_owned;
 };
 
 } //namespace PolylibNS
@@ -0,0 +1,124 @@
+/*
+ * Polylib - Polygon Management Library
+ *
+ * Copyright (c) 2010-2011 VCAD System Research Program, RIKEN.
+ * All rights reserved.
+ *
+ * Copyright (c) 2012-2013 Advanced Institute for Computational Science, RIKEN.
+ * All rights reserved.
+ *
+ */
+
+#ifndef polylib_triangle_id_index_h
+#define polylib_triangle_id_index_h
+
+#include <vector>
+#include <cstddef>
+
+namespace PolylibNS {
+
+////////////////////////////////////////////////////////////////////////////
+///
+/// クラス:TriangleIdIndex
+/// 三角形IDから三角形ポリゴンリストのインデックスを引くためのハッシュ表です。
+/// オープンアドレス法(線形探査)で実装しており、登録・検索は平均O(1)。
+/// 要素の個別削除は行わず、リストが再構成された場合はclear()して作り直す。
+///
+////////////////////////////////////////////////////////////////////////////
+class TriangleIdIndex {
+public:
+	///
+	/// コンストラクタ。
+	///
+	TriangleIdIndex();
+
+	///
+	/// 登録済みの全要素を削除する。
+	///
+	void clear();
+
+	///
+	/// 指定要素数を再ハッシュなしで登録できるよう領域を確保する。
+	///
+	///  @param[in] num	要素数。
+	///
+	void reserve(
+		size_t	num
+	);
+
+	///
+	/// 三角形IDとインデックスの対を登録する。
+	///
+	///  @param[in] id	三角形ID。
+	///  @param[in] idx	三角形ポリゴンリストのインデックス(0以上)。
+	///  @return	true:登録した/false:既に同じIDが登録済み(上書きしない)。
+	///
+	bool insert(
+		int		id,
+		int		idx
+	);
+
+	///
+	/// 三角形IDに対応するインデックスを検索する。
+	///
+	///  @param[in] id	三角形ID。
+	///  @return	インデックス。未登録の場合は-1。
+	///
+	int find(
+		int		id
+	) const;
+
+	///
+	/// 登録済みの要素数を返す。
+	///
+	size_t size() const {
+		return m_num;
+	}
+
+	///
+	/// 利用中のメモリ量を返す。
+	///
+	///  @return	メモリ量(byte)。
+	///
+	size_t memory_size() const;
+
+private:
+	///
+	/// ハッシュ表の大きさを変更し、登録済み要素を再配置する。
+	///
+	///  @param[in] cap	新しいスロット数(2のべき乗)。
+	///
+	void rehash(
+		size_t	cap
+	);
+
+	///
+	/// 三角形IDのハッシュ値からスロット位置を求める。
+	///
+	size_t slot(
+		int		id
+	) const {
+		// Fibonacci hashing
+		return (size_t)(((unsigned int)id * 2654435769U) >> m_shift)
+			   & (m_keys.size() - 1);
+	}
+
+	//=======================================================================
+	// クラス変数
+	//=======================================================================
+	/// スロット毎の三角形ID。
+	std::vector<int>	m_keys;
+
+	/// スロット毎のインデックス(-1は空きスロット)。
+	std::vector<int>	m_vals;
+
+	/// 登録済みの要素数。
+	size_t				m_num;
+
+	/// ハッシュ値からスロット位置を求める際のシフト量。
+	int					m_shift;
+};
+
+} //namespace PolylibNS
+
+#endif  // polylib_triangle_id_index_h
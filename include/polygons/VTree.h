@@ -22,62 +22,9 @@ namespace PolylibNS {
 
 class BBox;
 class PrivateTriangle;
-
-////////////////////////////////////////////////////////////////////////////
-///
-/// クラス:VElement
-/// KD木構造の要素クラスです。
-///
-////////////////////////////////////////////////////////////////////////////
-class VElement {
-public:
-	///
-	/// コンストラクタ。
-	///
-	/// @param[in] tri ポリゴン情報のポインタ。
-	/// @attention ポインタを格納するが、参照のみ。deleteは行わない。
-	///
-	VElement(
-		PrivateTriangle* tri
-	);
-
-	//=======================================================================
-	// Setter/Getter
-	//=======================================================================
-	///
-	/// triangle。
-	///
-	PrivateTriangle* get_triangle() {
-		return m_tri;
-	}
-
-	///
-	/// Center position of bbox on triangle.
-	/// 
-	Vec3f get_pos() const {
-		return m_pos;
-	}
-
-	///
-	/// Bounding box of this triangle
-	///
-	BBox get_bbox() const {
-		return m_bbox;
-	}
-
-private:
-	//=======================================================================
-	// クラス変数
-	//=======================================================================
-	/// triangle
-	PrivateTriangle	*m_tri;
-
-	/// Center position of bbox on triangle.
-	Vec3f			m_pos;
-
-	/// Bounding box of this triangle
-	BBox			m_bbox;
-};
+class Polygons;
+class SnapshotReader;
+class SnapshotWriter;
 
 ////////////////////////////////////////////////////////////////////////////
 ///  
@@ -100,7 +47,13 @@ public:
 	///
  	/// ノードを２つの子供ノードに分割する。
  	///
-	void split(const int& max_elem);
+	///  @param[in] max_elem	リーフノードが所持できる最大要素数。
+	///  @param[in] elm_bbox	VTreeが保持する三角形毎のBounding Box配列。
+	///
+	void split(
+		const int&		max_elem,
+		const float		*elm_bbox
+	);
 
 #ifdef USE_DEPTH
 	///
@@ -153,11 +106,31 @@ public:
 	///
 	/// このノードのBounding Boxを引数で与えられる要素を含めた大きさに変更する。
 	///
-	/// @param[in] p 要素。
+	/// @param[in] ebox 要素のBounding Box(min xyz, max xyzの順の6要素)。
 	///
-	void set_bbox_search(const VElement *p) {
-		m_bbox_search.add(p->get_bbox().min);
-		m_bbox_search.add(p->get_bbox().max);
+	void set_bbox_search(const float *ebox) {
+		m_bbox_search.add(Vec3f(ebox[0], ebox[1], ebox[2]));
+		m_bbox_search.add(Vec3f(ebox[3], ebox[4], ebox[5]));
+	}
+
+	///
+	/// 検索用BBoxを設定。
+	///
+	/// @param[in] bbox 検索用bbox。
+	///
+	void set_bbox_search(const BBox& bbox) {
+		m_bbox_search = bbox;
+	}
+
+	///
+	/// 子供ノードを設定。
+	///
+	/// @param[in] left		左のNode。
+	/// @param[in] right	右のNode。
+	///
+	void set_children(VNode *left, VNode *right) {
+		m_left = left;
+		m_right = right;
 	}
 
 	///
@@ -199,19 +172,19 @@ public:
 	///
 	/// 要素のリストを取得。
 	///
-	/// @return 要素のリスト。
+	/// @return 要素(三角形ポリゴンリストのインデックス)のリスト。
 	///
-	std::vector<VElement*>& get_vlist() {
+	std::vector<int>& get_vlist() {
 		return m_vlist;
 	}
 
 	///
 	/// 木の要素を設定。
 	///
-	/// @param[in] elm。
+	/// @param[in] idx 三角形ポリゴンリストのインデックス。
 	///
-	void set_element(VElement* elm) {
-		m_vlist.push_back(elm);
+	void set_element(int idx) {
+		m_vlist.push_back(idx);
 	}
 
 	///
@@ -259,8 +232,8 @@ private:
 	/// KD木の軸の方向インデックス。
 	AxisEnum				m_axis;
 
-	/// ノードの管理する要素リスト。
-	std::vector<VElement*>	m_vlist;
+	/// ノードの管理する要素リスト(三角形ポリゴンリストのインデックス)。
+	std::vector<int>		m_vlist;
 
 	/// KD木検索用のBouding Box。
 	BBox					m_bbox_search;
@@ -275,6 +248,8 @@ private:
 ///
 /// クラス:VTree
 /// リーフを三角形ポリゴンとするKD木クラスです。
+/// リーフは三角形ポリゴンリストのインデックスを保持し、三角形毎のBounding
+/// Boxは本クラスが一つの配列にまとめて保持する。
 ///
 ////////////////////////////////////////////////////////////////////////////
 class VTree {
@@ -285,11 +260,15 @@ public:
 	/// @param[in] max_elem	最大要素数。
 	/// @param[in] bbox		VTreeのbox範囲。
 	/// @param[in] tri_list	木構造の元になるポリゴンのリスト。
+	/// @param[in] polygons	tri_listを管理するPolygons。指定した場合、三角形と
+	///						そのBounding Boxはpolygons経由で取得する。
+	/// @attention tri_listは参照のみ。木の再構築までtri_listの並びを変更しないこと。
 	///
 	VTree(
 		int								max_elem, 
 		const BBox						bbox, 
-		std::vector<PrivateTriangle*>	*tri_list
+		std::vector<PrivateTriangle*>	*tri_list,
+		const Polygons					*polygons = NULL
 	);
 
 	///
@@ -354,24 +333,122 @@ public:
 		const Vec3f&    pos
 	) const;
 
+	///
+	/// KD木探索により、指定位置から距離max_dist未満で最も近いポリゴンを
+	/// 検索する。距離は三角形の重心までの距離で、KD木を分枝限定法で探索
+	/// するので、近似のない最近傍となる。
+	///
+	///  @param[in]     pos			指定位置
+	///  @param[in]     max_dist	距離の上限
+	///  @param[out]    dist		検索されたポリゴンの重心までの距離
+	///  @return    検索されたポリゴン。max_dist未満になければNULL。
+	///  @attention オーバーロードメソッドあり。
+	///
+	const PrivateTriangle* search_nearest(
+		const Vec3f&	pos,
+		float			max_dist,
+		float			*dist
+	) const;
+
+	///
+	/// KD木探索により、線分orig + t * dir (0 <= t <= tmax)と最初に交差する
+	/// ポリゴンを検索する。ポリゴンの表裏は区別しない。
+	///
+	///  @param[in]     orig	始点。
+	///  @param[in]     dir		方向ベクトル。
+	///  @param[in]     tmax	tの上限。
+	///  @param[out]    t		交差位置のt。交差しなければ変更しない。
+	///  @return    検索されたポリゴン。交差しなければNULL。
+	///
+	const PrivateTriangle* search_ray(
+		const Vec3f&	orig,
+		const Vec3f&	dir,
+		float			tmax,
+		float			*t
+	) const;
+
 	///
 	/// KD木クラスが利用しているメモリ量を返す。
 	///
 	///  @return	利用中のメモリ量(byte)
 	///
-	unsigned int memory_size();
+	size_t memory_size() const;
+
+	///
+	/// KD木クラスが利用しているメモリ量の内訳を返す。
+	///
+	///  @param[out] node_size	ノード(VTree自身を含む)のメモリ量(byte)。
+	///  @param[out] leaf_size	リーフ要素リストと要素Bounding Boxのメモリ量(byte)。
+	///
+	void memory_usage(
+		size_t	*node_size,
+		size_t	*leaf_size
+	) const;
+
+	///
+	/// KD木をスナップショット形式で書き出す。
+	///
+	///  @param[in,out] wr	書き出し先。
+	///  @return	POLYLIB_STATで定義される値が返る。
+	///
+	POLYLIB_STAT save_snapshot(
+		SnapshotWriter	&wr
+	) const;
+
+	///
+	/// スナップショット形式のデータからKD木を復元する。
+	///
+	///  @param[in,out]	rd			読み出し元。
+	///  @param[in]		tri_list	木構造の元になるポリゴンのリスト。
+	///  @param[in]		polygons	tri_listを管理するPolygons。
+	///  @return	復元したKD木。データが不正な場合はNULL。
+	///
+	static VTree *load_snapshot(
+		SnapshotReader					&rd,
+		std::vector<PrivateTriangle*>	*tri_list,
+		const Polygons					*polygons
+	);
 
 private:
+	///
+	/// 空のKD木を作成する。load_snapshot()から利用する。
+	///
+	VTree();
+
+	///
+	/// ノードを前順にスナップショット形式で書き出す。
+	///
+	///  @param[in]		vn	書き出すノード。
+	///  @param[in,out] wr	書き出し先。
+	///  @return	true:成功/false:書き込みエラー。
+	///
+	bool save_node(
+		VNode			*vn,
+		SnapshotWriter	&wr
+	) const;
+
+	///
+	/// 前順に書き出されたノードを復元する。
+	///
+	///  @param[in,out]	rd		読み出し元。
+	///  @param[in]		depth	ノードの深さ。
+	///  @return	復元したノード。データが不正な場合はNULL。
+	///
+	VNode *load_node(
+		SnapshotReader	&rd,
+		int				depth
+	);
+
 	///
 	/// 三角形をKD木構造に組み込む際に、どのノードへ組み込むかを検索する。
 	///
 	///  @param[in]		vn		検索対象のノードへのポインタ。
-	///  @param[in]		elm		組み込む三角形。
+	///  @param[in]		idx		組み込む三角形のインデックス。
 	///  @param[in,out]	vnode	検索結果。
 	///
 	void traverse(
 		VNode		*vn, 
-		VElement	*elm, 
+		int			idx, 
 		VNode		**vnode
 	) const;
 
@@ -382,13 +459,45 @@ private:
 	///  @param[in]		bbox	VTreeのbox範囲。
 	///  @param[in]		every	true:ポリゴンの頂点がすべて含まれるNodeを検索。
 	///							false:それ以外。
-	///  @param[in,out]	vlist	検索結果配列へのポインタ。
+	///  @param[in,out]	tri_list	検索結果配列へのポインタ。
 	///
 	void search_recursive(
+		VNode							*vn, 
+		const BBox						&bbox, 
+		bool							every, 
+		std::vector<PrivateTriangle*>	*tri_list
+	) const;
+
+	///
+	/// 線分と最初に交差する三角形ポリゴンをKD木構造から検索する。
+	///
+	///  @param[in]		vn		検索対象のノードへのポインタ。
+	///  @param[in]		orig	始点。
+	///  @param[in]		dir		方向ベクトル。
+	///  @param[in,out]	tbest	これまでに見つけた交差位置のt。
+	///  @param[in,out]	hit		これまでに見つけたポリゴン。
+	///
+	void search_ray_recursive(
+		VNode					*vn, 
+		const Vec3f				&orig, 
+		const Vec3f				&dir, 
+		float					*tbest, 
+		const PrivateTriangle	**hit
+	) const;
+
+	///
+	/// 指定位置に最も近い三角形ポリゴンをKD木構造から分枝限定法で検索する。
+	///
+	///  @param[in]		vn		検索対象のノードへのポインタ。
+	///  @param[in]		pos		指定位置。
+	///  @param[in,out]	dist2	これまでに見つけた重心までの距離の2乗。
+	///  @param[in,out]	hit		これまでに見つけたポリゴン。
+	///
+	void search_nearest_bounded(
 		VNode					*vn, 
-		const BBox				&bbox, 
-		bool					every, 
-		std::vector<VElement*>	*vlist
+		const Vec3f				&pos, 
+		float					*dist2, 
+		const PrivateTriangle	**hit
 	) const;
 
 	///
@@ -406,17 +515,35 @@ private:
 	);
 
 	///
-	/// KD木の総ノード数と総ポリゴン数を数える。
+	/// KD木の総ノード数とリーフ要素リストの確保済み要素数を数える。
 	///
-	///  @param[in]	 vnode		親ノードへのポインタ。
-	///  @param[out] node_cnt	ノード数。
-	///  @param[out] poly_cnt	ポリゴン数。
+	///  @param[in]		vnode		ノードへのポインタ。
+	///  @param[in,out]	node_cnt	ノード数。
+	///  @param[in,out]	elem_cap	リーフ要素リストの確保済み要素数。
 	///
 	void node_count(
-		VNode			*vnode, 
-		unsigned int	*node_cnt, 
-		unsigned int	*poly_cnt
-	);
+		VNode	*vnode, 
+		size_t	*node_cnt, 
+		size_t	*elem_cap
+	) const;
+
+	///
+	/// 三角形のBounding Boxを取得。
+	///
+	///  @param[in]	idx	三角形ポリゴンリストのインデックス。
+	///  @return	min xyz, max xyzの順に並んだ6要素の配列。
+	///
+	const float *elm_bbox(int idx) const {
+		return &m_elm_bbox[(size_t)idx * 6];
+	}
+
+	///
+	/// 三角形を取得。
+	///
+	///  @param[in]	idx	三角形ポリゴンリストのインデックス。
+	///  @return	三角形ポリゴン。
+	///
+	PrivateTriangle *triangle(int idx) const;
 
 	//=======================================================================
 	// クラス変数
@@ -426,6 +553,15 @@ private:
 
 	/// リーフノードが所持できる最大要素数。
 	int		m_max_elements;
+
+	/// 木構造の元になるポリゴンのリスト(参照のみ)。
+	std::vector<PrivateTriangle*>	*m_tri_list;
+
+	/// tri_listを管理するPolygons(参照のみ)。
+	const Polygons					*m_polygons;
+
+	/// 三角形毎のBounding Box(三角形1つにつきmin xyz, max xyzの6要素)。
+	std::vector<float>				m_elm_bbox;
 };
 
 } //namespace PolylibNS
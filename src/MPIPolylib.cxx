@@ -9,27 +9,585 @@
  *
  */
 
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
 #include <iostream>
 #include <sstream>
 #include <iomanip>
 #include <vector>
 #include <map>
+#include <cmath>
+#include <cfloat>
+#include <algorithm>
 //#include "groups/PolygonGroup.h"
 //#include "c_lang/CMPIPolylib.h"
 #include "mpi.h"
 #include "MPIPolylib.h"
+#include "file_io/TriMeshIO.h"
+#include "file_io/stl.h"
+#include "file_io/GzipStream.h"
 
 // MPI通信用メッセージタグ
 #define	MPITAG_NUM_CONFIG			1
 #define	MPITAG_CONFIG				2
 #define	MPITAG_NUM_TRIAS			3
-#define MPITAG_TRIA_IDS				4
 #define MPITAG_TRIAS				5
 
 
+// 全rank検索の種類
+#define GQ_NEAREST					0
+#define GQ_RAY						1
+#define GQ_BOX						2
+
+
 using namespace std;
 using namespace PolylibNS;
 
+////////////////////////////////////////////////////////////////////////////
+///
+/// クラス:RankGrid
+/// 三角形を配信するrankを求めるため、全rank領域を覆う一様格子の各セルに
+/// 交差するrankを登録したもの。load_distributed()で利用する。
+///
+////////////////////////////////////////////////////////////////////////////
+class RankGrid {
+public:
+	///
+	/// コンストラクタ。
+	///
+	///  @param[in] boxes	全rankの領域(rank番号順)。
+	///
+	RankGrid(const vector<BBox> &boxes) : m_boxes(boxes) {
+		m_bbox.init();
+		for (unsigned int r = 0; r < boxes.size(); r++) {
+			m_bbox.add(boxes[r].min);
+			m_bbox.add(boxes[r].max);
+		}
+
+		// 一軸あたりrank数の立方根の２倍のセル数とする
+		int n = 2 * (int)ceil(pow((double)boxes.size(), 1.0/3.0));
+		for (int i = 0; i < 3; i++) {
+			m_n[i] = n > 0 ? n : 1;
+			m_cell[i] = (m_bbox.max[i] - m_bbox.min[i]) / m_n[i];
+		}
+		m_cells.resize(m_n[0] * m_n[1] * m_n[2]);
+		m_stamp.assign(boxes.size(), 0);
+		m_cur = 0;
+
+		for (unsigned int r = 0; r < boxes.size(); r++) {
+			int lo[3], hi[3];
+			if (!cell_range(boxes[r], lo, hi)) continue;
+			for (int k = lo[2]; k <= hi[2]; k++)
+			for (int j = lo[1]; j <= hi[1]; j++)
+			for (int i = lo[0]; i <= hi[0]; i++) {
+				m_cells[(k * m_n[1] + j) * m_n[0] + i].push_back(r);
+			}
+		}
+	}
+
+	///
+	/// 指定領域と交差するrankを求める。
+	///
+	///  @param[in]	 bbox	三角形のBounding Box。
+	///  @param[out] ranks	交差するrank番号の追加先。
+	///
+	void find(const BBox &bbox, vector<int> *ranks) {
+		int lo[3], hi[3];
+		if (!cell_range(bbox, lo, hi)) return;
+		m_cur++;
+		for (int k = lo[2]; k <= hi[2]; k++)
+		for (int j = lo[1]; j <= hi[1]; j++)
+		for (int i = lo[0]; i <= hi[0]; i++) {
+			const vector<int> &cell = m_cells[(k * m_n[1] + j) * m_n[0] + i];
+			for (unsigned int c = 0; c < cell.size(); c++) {
+				int r = cell[c];
+				if (m_stamp[r] == m_cur) continue;
+				m_stamp[r] = m_cur;
+				if (m_boxes[r].crossed(bbox)) ranks->push_back(r);
+			}
+		}
+	}
+
+private:
+	///
+	/// 指定領域が掛かるセル番号の範囲を求める。
+	///
+	///  @return	全rank領域の外ならfalse。
+	///
+	bool cell_range(const BBox &bbox, int lo[3], int hi[3]) const {
+		if (!m_bbox.crossed(bbox)) return false;
+		for (int i = 0; i < 3; i++) {
+			lo[i] = cell_index(bbox.min[i], i);
+			hi[i] = cell_index(bbox.max[i], i);
+		}
+		return true;
+	}
+
+	///
+	/// 座標値を含むセル番号を求める。範囲外は端のセルに丸める。
+	///
+	int cell_index(float x, int axis) const {
+		if (!(m_cell[axis] > 0.0f)) return 0;
+		float f = (x - m_bbox.min[axis]) / m_cell[axis];
+		if (f < 0.0f) return 0;
+		if (f >= (float)m_n[axis]) return m_n[axis] - 1;
+		return (int)f;
+	}
+
+	/// 全rankの領域。
+	const vector<BBox>			&m_boxes;
+
+	/// 全rank領域を覆う領域。
+	BBox						m_bbox;
+
+	/// 各軸のセル数。
+	int							m_n[3];
+
+	/// 各軸のセル幅。
+	float						m_cell[3];
+
+	/// セル毎の交差するrank番号リスト。
+	vector< vector<int> >		m_cells;
+
+	/// rank毎の最終検査番号(重複検査の防止)。
+	vector<unsigned int>		m_stamp;
+
+	/// 現在の検査番号。
+	unsigned int				m_cur;
+};
+
+////////////////////////////////////////////////////////////////////////////
+///
+/// クラス:CostGrid
+/// 全rank領域を覆うボクセル格子上で計算コストを見積もり、再帰二分割で
+/// rank数の直方体ブロックに分ける。advise_balance()で利用する。
+/// 形状のコストはボクセルをまとめたビン毎に持ち、ビン内では一様とみなす。
+///
+////////////////////////////////////////////////////////////////////////////
+class CostGrid {
+public:
+	///
+	/// コンストラクタ。
+	///
+	///  @param[in] n			各軸のボクセル数。
+	///  @param[in] bin			ビン１辺のボクセル数。
+	///  @param[in] cell_cost	1ボクセルのコスト。
+	///  @param[in] geom		ビン毎の形状のコスト(x軸が最も内側)。
+	///
+	CostGrid(const int n[3], const int bin[3], double cell_cost,
+			 const vector<double> &geom) : m_cell_cost(cell_cost), m_geom(geom) {
+		for (int i = 0; i < 3; i++) {
+			m_n[i] = n[i];
+			m_bin[i] = bin[i];
+			m_nb[i] = (n[i] + bin[i] - 1) / bin[i];
+		}
+	}
+
+	///
+	/// ブロックのコストを求める。
+	///
+	///  @param[in] lo	ブロックの最小ボクセル番号。
+	///  @param[in] hi	ブロックの最大ボクセル番号+1。
+	///
+	double cost(const int lo[3], const int hi[3]) const {
+		vector<double> prof;
+		profile(lo, hi, 0, &prof);
+		double sum = 0.0;
+		for (unsigned int i = 0; i < prof.size(); i++) sum += prof[i];
+		return sum;
+	}
+
+	///
+	/// ブロックを再帰二分割し、コストが均等になるようrankに割り当てる。
+	/// 最も長い軸を、rank数の比でコストを分ける面で切る。
+	///
+	///  @param[in]	 lo		ブロックの最小ボクセル番号。
+	///  @param[in]	 hi		ブロックの最大ボクセル番号+1。
+	///  @param[in]	 r0		割り当てる最初のrank。
+	///  @param[in]	 r1		割り当てる最後のrank+1。
+	///  @param[out] blocks	rank毎のlo[3]、hi[3]。
+	///  @return	rank数より小さいブロックがあり分けられなければfalse。
+	///
+	bool bisect(const int lo[3], const int hi[3], int r0, int r1,
+				vector<int> *blocks) const {
+		int nr = r1 - r0;
+		if (nr == 1) {
+			for (int i = 0; i < 3; i++) {
+				(*blocks)[r0 * 6 + i] = lo[i];
+				(*blocks)[r0 * 6 + 3 + i] = hi[i];
+			}
+			return true;
+		}
+		int nl = nr / 2;
+
+		int axis = 0;
+		for (int i = 1; i < 3; i++) {
+			if (hi[i] - lo[i] > hi[axis] - lo[axis]) axis = i;
+		}
+		int len = hi[axis] - lo[axis];
+		long long slab = 1;
+		for (int i = 0; i < 3; i++) {
+			if (i != axis) slab *= hi[i] - lo[i];
+		}
+
+		vector<double> prof;
+		profile(lo, hi, axis, &prof);
+		double total = 0.0;
+		for (int v = 0; v < len; v++) total += prof[v];
+		double target = total * nl / nr;
+
+		// 両側にrank数以上のボクセルを残す面のうち、目標に最も近い面
+		int best = -1;
+		double best_diff = 0.0, acc = 0.0;
+		for (int p = 1; p < len; p++) {
+			acc += prof[p - 1];
+			if ((long long)p * slab < nl || (long long)(len - p) * slab < nr - nl) {
+				continue;
+			}
+			double diff = fabs(acc - target);
+			if (best < 0 || diff < best_diff) {
+				best = p;
+				best_diff = diff;
+			}
+		}
+		if (best < 0) return false;
+
+		int mid_hi[3], mid_lo[3];
+		for (int i = 0; i < 3; i++) {
+			mid_hi[i] = hi[i];
+			mid_lo[i] = lo[i];
+		}
+		mid_hi[axis] = lo[axis] + best;
+		mid_lo[axis] = lo[axis] + best;
+		return bisect(lo, mid_hi, r0, r0 + nl, blocks) &&
+			   bisect(mid_lo, hi, r0 + nl, r1, blocks);
+	}
+
+private:
+	///
+	/// ブロック内の、指定軸に垂直なボクセル層毎のコストを求める。
+	///
+	void profile(const int lo[3], const int hi[3], int axis,
+				 vector<double> *prof) const {
+		int len = hi[axis] - lo[axis];
+		long long slab = 1;
+		for (int i = 0; i < 3; i++) {
+			if (i != axis) slab *= hi[i] - lo[i];
+		}
+		prof->assign(len, m_cell_cost * slab);
+
+		int blo[3], bhi[3];
+		for (int i = 0; i < 3; i++) {
+			blo[i] = lo[i] / m_bin[i];
+			bhi[i] = (hi[i] - 1) / m_bin[i];
+		}
+		int b[3];
+		for (b[2] = blo[2]; b[2] <= bhi[2]; b[2]++)
+		for (b[1] = blo[1]; b[1] <= bhi[1]; b[1]++)
+		for (b[0] = blo[0]; b[0] <= bhi[0]; b[0]++) {
+			double w = m_geom[(b[2] * m_nb[1] + b[1]) * m_nb[0] + b[0]];
+			if (w == 0.0) continue;
+
+			// ビンとブロックの重なりの割合。指定軸はボクセル１層分の割合
+			int a0 = 0, a1 = 0;
+			for (int i = 0; i < 3; i++) {
+				int b0 = b[i] * m_bin[i];
+				int b1 = std::min(b0 + m_bin[i], m_n[i]);
+				int c0 = std::max(lo[i], b0);
+				int c1 = std::min(hi[i], b1);
+				if (i == axis) {
+					a0 = c0;
+					a1 = c1;
+					w /= b1 - b0;
+				}
+				else {
+					w *= (double)(c1 - c0) / (b1 - b0);
+				}
+			}
+			for (int v = a0; v < a1; v++) (*prof)[v - lo[axis]] += w;
+		}
+	}
+
+	/// 各軸のボクセル数。
+	int							m_n[3];
+
+	/// ビン１辺のボクセル数。
+	int							m_bin[3];
+
+	/// 各軸のビン数。
+	int							m_nb[3];
+
+	/// 1ボクセルのコスト。
+	double						m_cell_cost;
+
+	/// ビン毎の形状のコスト。
+	const vector<double>		&m_geom;
+};
+
+//
+// 三角形の送受信レコード。全rankが同じPolylibを使う前提で、版は持たない。
+// 法線と面積も送るので、受信側で再計算しない
+//
+struct TriaRec {
+	/// 三角形ポリゴンID
+	int		id;
+	/// ユーザ定義ID
+	int		exid;
+	/// ユーザ定義状態変数
+	int		shell;
+	/// 面積
+	float	area;
+	/// 頂点座標
+	float	vtx[9];
+	/// 法線ベクトル
+	float	normal[3];
+};
+
+//
+// 三角形をレコードとしてpの位置に書き込む
+//
+static void set_tria_rec(
+	char					*p,
+	const PrivateTriangle	*tri
+) {
+	TriaRec rec;
+	rec.id = tri->get_id();
+	rec.exid = tri->get_exid();
+	rec.shell = tri->get_shell();
+	rec.area = tri->get_area();
+	const Vec3f *v = tri->get_vertex();
+	for (int k = 0; k < 3; k++) {
+		for (int l = 0; l < 3; l++) rec.vtx[k*3 + l] = v[k][l];
+	}
+	Vec3f n = tri->get_normal();
+	for (int l = 0; l < 3; l++) rec.normal[l] = n[l];
+	memcpy(p, &rec, sizeof(TriaRec));
+}
+
+//
+// 三角形リストのレコードを送信バッファの末尾に詰める
+//
+static void pack_tria_recs(
+	vector<char>					*buf,
+	const vector<PrivateTriangle*>	*trias
+) {
+	if (trias == NULL || trias->empty()) return;
+	size_t pos = buf->size();
+	buf->resize(pos + trias->size() * sizeof(TriaRec));
+	for (size_t i = 0; i < trias->size(); i++) {
+		set_tria_rec(&(*buf)[pos + i * sizeof(TriaRec)], trias->at(i));
+	}
+}
+
+//
+// 受信バッファのnum個のレコードから三角形を作ってリストの末尾に追加し、
+// 次のレコードの位置を返す
+//
+static const char *unpack_tria_recs(
+	const char					*p,
+	unsigned int				num,
+	vector<PrivateTriangle*>	*trias
+) {
+	TriaRec rec;
+	Vec3f v[3];
+	trias->reserve(trias->size() + num);
+	for (unsigned int i = 0; i < num; i++) {
+		memcpy(&rec, p, sizeof(TriaRec));
+		p += sizeof(TriaRec);
+		for (int k = 0; k < 3; k++) {
+			v[k] = Vec3f(rec.vtx[k*3], rec.vtx[k*3 + 1], rec.vtx[k*3 + 2]);
+		}
+		PrivateTriangle *tri = new PrivateTriangle(v,
+			Vec3f(rec.normal[0], rec.normal[1], rec.normal[2]), rec.area, rec.id);
+		tri->set_exid(rec.exid);
+		tri->set_shell(rec.shell);
+		trias->push_back(tri);
+	}
+	return p;
+}
+
+//
+// 固定長レコード1個分のMPIデータ型を作る。使用後はMPI_Type_free()で解放する。
+// 送受信数をレコード単位にして、intの上限を超えないようにする
+//
+static int commit_rec_type(
+	int				rec_size,
+	MPI_Datatype	*type
+) {
+	int ret = MPI_Type_contiguous(rec_size, MPI_BYTE, type);
+	if (ret != MPI_SUCCESS) return ret;
+	return MPI_Type_commit(type);
+}
+
+//
+// 全rank検索の問い合わせ。search_*_global()で送受信する
+//
+struct QueryRec {
+	/// 送信元rankでの検索番号
+	int		qidx;
+	/// 最近傍:検索点、線分:始点、矩形領域:最小値
+	float	a[3];
+	/// 線分:方向ベクトル、矩形領域:最大値
+	float	b[3];
+	/// 最近傍:距離の上限、線分:tの上限
+	float	bound;
+};
+
+//
+// 全rank検索の回答。三角形1個分。TriaRecと同じく法線と面積も送るので、
+// 受信側で再計算しない
+//
+struct HitRec {
+	/// 送信元rankでの検索番号
+	int		qidx;
+	/// 三角形ポリゴンID
+	int		id;
+	/// 距離または交差位置のt
+	float	dist;
+	/// 面積
+	float	area;
+	/// 頂点座標
+	float	vtx[9];
+	/// 法線ベクトル
+	float	normal[3];
+	/// ユーザ定義ID
+	int		exid;
+	/// ユーザ定義状態変数
+	int		shell;
+};
+
+//
+// 三角形を回答に詰める
+//
+static void set_hit_rec(
+	HitRec					*rec,
+	int						qidx,
+	const PrivateTriangle	*tri,
+	float					dist
+) {
+	rec->qidx = qidx;
+	rec->id = tri->get_id();
+	rec->dist = dist;
+	rec->area = tri->get_area();
+	const Vec3f *v = tri->get_vertex();
+	for (int k = 0; k < 3; k++) {
+		for (int l = 0; l < 3; l++) rec->vtx[k*3 + l] = v[k][l];
+	}
+	Vec3f n = tri->get_normal();
+	for (int l = 0; l < 3; l++) rec->normal[l] = n[l];
+	rec->exid = tri->get_exid();
+	rec->shell = tri->get_shell();
+}
+
+//
+// 回答を検索結果にする
+//
+static void set_global_hit(
+	GlobalQueryHit	*hit,
+	int				rank,
+	const HitRec	&rec
+) {
+	Vec3f v[3];
+	for (int k = 0; k < 3; k++) {
+		v[k] = Vec3f(rec.vtx[k*3], rec.vtx[k*3 + 1], rec.vtx[k*3 + 2]);
+	}
+	hit->m_rank = rank;
+	hit->m_id = rec.id;
+	hit->m_dist = rec.dist;
+	hit->m_tri = Triangle(v,
+		Vec3f(rec.normal[0], rec.normal[1], rec.normal[2]), rec.area);
+	hit->m_tri.set_exid(rec.exid);
+	hit->m_tri.set_shell(rec.shell);
+}
+
+//
+// 送信先rank毎の問い合わせを送信データに詰める
+//
+static void pack_query_recs(
+	const vector< vector<QueryRec> >	&queries,
+	vector<char>						*send,
+	vector<int>							*send_num
+) {
+	send_num->resize(queries.size());
+	for (size_t r = 0; r < queries.size(); r++) {
+		(*send_num)[r] = queries[r].size();
+		if (queries[r].empty()) continue;
+		const char *p = (const char*)&queries[r][0];
+		send->insert(send->end(), p, p + queries[r].size() * sizeof(QueryRec));
+	}
+}
+
+//
+// 全rank検索の問い合わせを自rankの三角形で評価し、回答を追加する。
+// 最近傍と線分は最良の1個を、矩形領域は所有する三角形を全て回答とする。
+// 上限(bound)以上のものは回答しない
+//
+static void eval_query(
+	int								kind,
+	const vector<PolygonGroup*>		&leaves,
+	const QueryRec					&q,
+	vector<HitRec>					*hits
+) {
+	Vec3f a(q.a[0], q.a[1], q.a[2]);
+	Vec3f b(q.b[0], q.b[1], q.b[2]);
+	const PrivateTriangle *best = NULL;
+	float best_dist = q.bound;
+
+	vector<PolygonGroup*>::const_iterator it;
+	for (it = leaves.begin(); it != leaves.end(); it++) {
+		if ((*it)->get_num_triangles() == 0) continue;
+
+		if (kind == GQ_NEAREST) {
+			float dist;
+			const PrivateTriangle *tri = (*it)->search_nearest(a, best_dist, &dist);
+			if (tri != NULL) {
+				best = tri;
+				best_dist = dist;
+			}
+		}
+		else if (kind == GQ_RAY) {
+			float t;
+			const PrivateTriangle *tri = (*it)->search_ray(a, b, best_dist, &t);
+			if (tri != NULL && t < best_dist) {
+				best = tri;
+				best_dist = t;
+			}
+		}
+		else {
+			BBox bbox(a, b);
+			vector<PrivateTriangle*> tri_list;
+			(*it)->search(&bbox, false, &tri_list);
+			for (size_t i = 0; i < tri_list.size(); i++) {
+				if (tri_list[i]->is_owned() == false) continue;
+				HitRec rec;
+				set_hit_rec(&rec, q.qidx, tri_list[i], 0.0f);
+				hits->push_back(rec);
+			}
+		}
+	}
+
+	if (best != NULL) {
+		HitRec rec;
+		set_hit_rec(&rec, q.qidx, best, best_dist);
+		hits->push_back(rec);
+	}
+}
+
+//
+// 移動処理で復元した三角形を解放する。送信バッファは三角形を複製して
+// 持つので、詰め終われば不要となる
+//
+static void release_decoded(
+	const vector<PolygonGroup*>		&leaves
+) {
+	vector<PolygonGroup*>::const_iterator it;
+	for (it = leaves.begin(); it != leaves.end(); it++) {
+		(*it)->release_decoded_triangles();
+	}
+}
+
 ////////////////////////////////////////////////////////////////////////////
 /// 
 /// クラス:MPIPolylib
@@ -59,8 +617,6 @@ MPIPolylib::init_parallel_info(
 #ifdef DEBUG
 	PL_DBGOSH << "MPIPolylib::init_parallel_info() in. " << endl;
 #endif
-	int i;
-
 	// MPI情報の設定
 	m_mycomm = comm;
 	MPI_Comm_rank(comm, &m_myrank);
@@ -77,114 +633,8 @@ MPIPolylib::init_parallel_info(
 	PL_DBGOSH << "m_myrank: " << m_myrank << " m_numproc: " << m_numproc << endl;
 #endif
 
-	float bbsize_f[3], gcsize_f[3];
-	for (i = 0; i < 3; i++) {
-		bbsize_f[i] = (float)bbsize[i];
-		gcsize_f[i] = (float)gcsize[i];
-	}
-
-	Vec3f v_bbsize(bbsize_f[0],bbsize_f[1],bbsize_f[2]);
-	Vec3f v_gcsize(gcsize_f[0],gcsize_f[1],gcsize_f[2]);
-	Vec3f v_bpos(bpos[0],bpos[1],bpos[2]);
-	Vec3f v_dx(dx[0],dx[1],dx[2]);
-
-	// 自PE領域情報を設定
-	m_myproc.m_comm = comm;
-	m_myproc.m_rank = m_myrank;
-	m_myproc.m_area.m_bpos = v_bpos;
-	m_myproc.m_area.m_bbsize = v_bbsize;
-	m_myproc.m_area.m_gcsize = v_gcsize;
-	m_myproc.m_area.m_dx = dx;
-	m_myproc.m_area.m_gcell_min = v_bpos-( v_gcsize )*v_dx;
-	m_myproc.m_area.m_gcell_max = v_bpos+( v_bbsize+v_gcsize )*v_dx;
-	m_myproc.m_area.m_gcell_bbox.add(m_myproc.m_area.m_gcell_min);
-	m_myproc.m_area.m_gcell_bbox.add(m_myproc.m_area.m_gcell_max);
-
-#ifdef DEBUG
-	PL_DBGOSH << "(my_rank:" << m_myrank << "):" <<"bpos      :" << v_bpos  << endl;
-	PL_DBGOSH << "(my_rank:" << m_myrank << "):" <<"bbsize    :" << v_bbsize << endl;
-	PL_DBGOSH << "(my_rank:" << m_myrank << "):" <<"gcsize    :" << v_gcsize << endl;
-	PL_DBGOSH << "(my_rank:" << m_myrank << "):" <<"dx        :" << v_dx << endl;
-	PL_DBGOSH << "(my_rank:" << m_myrank << "):" <<"gcell_min :"
-		 << m_myproc.m_area.m_gcell_min << endl;
-	PL_DBGOSH << "(my_rank:" << m_myrank << "):" <<"gcell_max :"
-		 << m_myproc.m_area.m_gcell_max << endl;
-#endif
-
-	// 送信データ作成
-	float send_buf[12];
-	for (i = 0; i < 3; i++) {
-		send_buf[i] = v_bpos[i];
-	}
-	for (i = 0; i < 3; i++) {
-		send_buf[3+i] = v_bbsize[i];
-	}
-	for (i = 0; i < 3; i++) {
-		send_buf[6+i] = v_gcsize[i];
-	}
-	for (i = 0; i < 3; i++) {
-		send_buf[9+i] = v_dx[i];
-	}
-
-	// 受信領域確保
-	float* recv_buf = new float[12 * m_numproc];
-
-	// Allgather通信を行う
-	if (MPI_Allgather(send_buf, 12, MPI_FLOAT, recv_buf, 12, MPI_FLOAT, comm) != MPI_SUCCESS) {
-		PL_ERROSH << "[ERROR]MPIPolylib::init_parallel_info():MPI_Allgather "
-				  << "faild." << endl;
-		return PLSTAT_MPI_ERROR;
-	}
-
-	// 受信データの展開
-	for (int irank = 0; irank < m_numproc; irank++) {
-		// 自PE領域情報はスキップ
-		if( irank == m_myrank ) continue;
-		for (i = 0; i < 3; i++) {
-			v_bpos[i] = recv_buf[i + 12*irank];
-		}
-		for (i = 0; i < 3; i++) {
-			v_bbsize[i] = recv_buf[3 + i + 12*irank];
-		} 
-		for (i = 0; i < 3; i++) {
-			v_gcsize[i] = recv_buf[6 + i + 12*irank];
-		} 
-		for (i = 0; i < 3; i++) {
-			v_dx[i]	= recv_buf[9 + i + 12*irank];
-		}
-#ifdef DEBUG
-		PL_DBGOSH << "(rank:" << irank << "):" <<"bpos  :" << v_bpos  << endl;
-		PL_DBGOSH << "(rank:" << irank << "):" <<"bbsize:" << v_bbsize << endl;
-		PL_DBGOSH << "(rank:" << irank << "):" <<"gcsize:" << v_gcsize << endl;
-		PL_DBGOSH << "(rank:" << irank << "):" <<"dx    :" << v_dx << endl;
-#endif
-		ParallelInfo* proc = new (ParallelInfo);
-		proc->m_comm = comm;
-		proc->m_rank = irank;
-		proc->m_area.m_bpos = v_bpos;
-		proc->m_area.m_bbsize = v_bbsize;
-		proc->m_area.m_gcsize = v_gcsize;
-		proc->m_area.m_dx = v_dx;
-		proc->m_area.m_gcell_min = v_bpos-( v_gcsize )*v_dx;
-		proc->m_area.m_gcell_max = v_bpos+( v_bbsize+v_gcsize )*v_dx;
-		proc->m_area.m_gcell_bbox.add(proc->m_area.m_gcell_min);
-		proc->m_area.m_gcell_bbox.add(proc->m_area.m_gcell_max);
-
-		// 全PE領域情報リストに追加
-		m_other_procs.push_back(proc);
-
-		// 自PE領域と隣接するPE領域情報はm_neibour_procsにも追加
-		if( m_myproc.m_area.m_gcell_bbox.crossed(proc->m_area.m_gcell_bbox) ) {
-			m_neibour_procs.push_back(proc);
-#ifdef DEBUG
-		PL_DBGOSH << m_myrank << ": " << "neighbour rank:" << proc->m_rank  << endl;
-#endif
-		}
-	}
-	// 受信領域あとしまつ
-	delete[] recv_buf;
-
-	return PLSTAT_OK;
+	// 自PE領域と全PE領域情報を設定
+	return set_parallel_area( bpos, bbsize, gcsize, dx );
 }
 
 
@@ -377,6 +827,9 @@ MPIPolylib::load_rank0(
 	      return ret;
 	    }
 	}
+
+	// ガイドセル領域の三角形の所有者を設定
+	update_ownership();
  
 	return PLSTAT_OK;
 
@@ -402,9 +855,90 @@ MPIPolylib::load_parallel(
 		return ret;
 	}
 
+	// ガイドセル領域の三角形の所有者を設定
+	update_ownership();
+
+	return PLSTAT_OK;
+}
+
+// public /////////////////////////////////////////////////////////////////////
+POLYLIB_STAT
+MPIPolylib::load_distributed(
+	std::string config_filename,
+	float scale
+)
+{
+#ifdef DEBUG
+	PL_DBGOSH << m_myrank << ": " << "MPIPolylib::load_distributed() in. " << endl;
+#endif
+	POLYLIB_STAT ret;
+
+	// 設定ファイルは全rankで読み込み、グループ階層構造を構築する
+	vector<BBox> boxes;
+	if( (ret = load_config_all( config_filename, &boxes )) != PLSTAT_OK ) {
+		PL_ERROSH << "[ERROR]MPIPolylib::load_distributed():load_config_all()"
+				  << " faild. returns:" << PolylibStat2::String(ret) << endl;
+		return ret;
+	}
+
+	// リーフグループ毎に読み込む。全rankが同じ順序で通信する
+	vector<PolygonGroup*>::iterator group_itr;
+	for (group_itr = m_pg_list.begin(); group_itr != m_pg_list.end(); group_itr++) {
+		if( (*group_itr)->get_children().empty() == false ) continue;
+
+		if( (ret = load_distributed_group( *group_itr, boxes, scale )) != PLSTAT_OK ) {
+			PL_ERROSH << "[ERROR]MPIPolylib::load_distributed():"
+					  << "load_distributed_group() faild. returns:"
+					  << PolylibStat2::String(ret) << endl;
+			return ret;
+		}
+	}
+
+	// ガイドセル領域の三角形の所有者を設定
+	update_ownership();
+
+	return PLSTAT_OK;
+}
+
+// public /////////////////////////////////////////////////////////////////////
+POLYLIB_STAT
+MPIPolylib::load_collective(
+	std::string config_filename
+)
+{
+#ifdef DEBUG
+	PL_DBGOSH << m_myrank << ": " << "MPIPolylib::load_collective() in. " << endl;
+#endif
+	POLYLIB_STAT ret;
+
+	// 設定ファイルは全rankで読み込み、グループ階層構造を構築する
+	vector<BBox> boxes;
+	if( (ret = load_config_all( config_filename, &boxes )) != PLSTAT_OK ) {
+		PL_ERROSH << "[ERROR]MPIPolylib::load_collective():load_config_all()"
+				  << " faild. returns:" << PolylibStat2::String(ret) << endl;
+		return ret;
+	}
+
+	// リーフグループ毎に読み込む。全rankが同じ順序で通信する
+	vector<PolygonGroup*>::iterator group_itr;
+	for (group_itr = m_pg_list.begin(); group_itr != m_pg_list.end(); group_itr++) {
+		if( (*group_itr)->get_children().empty() == false ) continue;
+
+		if( (ret = load_collective_group( *group_itr, boxes )) != PLSTAT_OK ) {
+			PL_ERROSH << "[ERROR]MPIPolylib::load_collective():"
+					  << "load_collective_group() faild. returns:"
+					  << PolylibStat2::String(ret) << endl;
+			return ret;
+		}
+	}
+
+	// ガイドセル領域の三角形の所有者を設定
+	update_ownership();
+
 	return PLSTAT_OK;
 }
 
+
 #if 0 
 // old version
 // public /////////////////////////////////////////////////////////////////////
@@ -522,13 +1056,115 @@ MPIPolylib::save_parallel(
 	return PLSTAT_OK;
 }
 
-
-// public ////////////////////////////////////////////////////////////////////
+// public /////////////////////////////////////////////////////////////////////
 POLYLIB_STAT
-MPIPolylib::move(
-	PolylibMoveParams &params
-)
-{
+MPIPolylib::save_parallel_async(
+	PolylibAsyncSave *handle,
+	std::string *p_config_filename,
+	std::string stl_format,
+	std::string extend,
+	ID_FORMAT	id_format
+)
+{
+#ifdef DEBUG
+	PL_DBGOSH << "MPIPolylib::save_parallel_async() in. " << endl;
+#endif
+	POLYLIB_STAT ret;
+
+	if (handle == NULL) {
+		PL_ERROSH << "[ERROR]MPIPolylib::save_parallel_async():handle is NULL." << endl;
+		return PLSTAT_NG;
+	}
+
+	// 各ランク毎に複製して登録し、作業スレッドで保存
+	if( (ret = Polylib::save_with_rankno( p_config_filename, m_myrank, m_numproc-1, extend, stl_format, id_format, handle)) != PLSTAT_OK ) {
+		PL_ERROSH << "[ERROR]MPIPolylib::save_parallel_async():Polylib::save_with_rankno():failed. returns:" << PolylibStat2::String(ret) << endl;
+		return ret;
+	}
+	return PLSTAT_OK;
+}
+
+// public /////////////////////////////////////////////////////////////////////
+POLYLIB_STAT
+MPIPolylib::save_collective(
+	std::string *p_config_filename,
+	std::string extend
+)
+{
+#ifdef DEBUG
+	PL_DBGOSH << "MPIPolylib::save_collective() in. " << endl;
+#endif
+	POLYLIB_STAT ret;
+	char my_extend[128];
+
+	// 拡張文字列がカラであれば、rank0の現在時刻から作成して全rankで共有する
+	memset( my_extend, 0, sizeof(my_extend) );
+	if( m_myrank == 0 ) {
+		if( extend == "" ) {
+			time_t		timer = time(NULL);
+			struct tm	*date = localtime(&timer);
+			sprintf(my_extend, "%04d%02d%02d%02d%02d%02d",
+				date->tm_year+1900, date->tm_mon+1, date->tm_mday,
+				date->tm_hour,      date->tm_min,   date->tm_sec);
+		}
+		else {
+			sprintf(my_extend, "%s", extend.c_str());
+		}
+	}
+	if (MPI_Bcast( my_extend, sizeof(my_extend), MPI_CHAR, 0, m_mycomm ) != MPI_SUCCESS) {
+		PL_ERROSH << "[ERROR]MPIPolylib::save_collective():MPI_Bcast faild." << endl;
+		return PLSTAT_MPI_ERROR;
+	}
+
+	// リーフグループ毎に共有ファイルへ書き出す。全rankが同じ順序で通信する
+	map<string,string> stl_fname_map;
+	vector<PolygonGroup*> leaves;
+	vector<PolygonGroup*>::iterator group_itr;
+	for (group_itr = m_pg_list.begin(); group_itr != m_pg_list.end(); group_itr++) {
+		if( (*group_itr)->get_children().empty() == false ) continue;
+
+		string stl_fname, id_fname;
+		bool written;
+		(*group_itr)->acq_save_fnames( "", my_extend, TriMeshIO::FMT_STL_B,
+									   &stl_fname, &id_fname );
+		ret = save_collective_group( *group_itr, stl_fname, id_fname, &written );
+		if( ret != PLSTAT_OK ) {
+			PL_ERROSH << "[ERROR]MPIPolylib::save_collective():"
+					  << "save_collective_group() faild. returns:"
+					  << PolylibStat2::String(ret) << endl;
+			return ret;
+		}
+		if( written ) {
+			stl_fname_map.insert( map<string,string>::value_type(
+						(*group_itr)->acq_fullpath(), stl_fname ) );
+			leaves.push_back( *group_itr );
+		}
+	}
+
+	// 設定ファイルはrank0だけが書き出す
+	if( m_myrank != 0 ) return PLSTAT_OK;
+
+	for (group_itr = leaves.begin(); group_itr != leaves.end(); group_itr++) {
+		if( (ret = (*group_itr)->mk_param_tag( tp, "", "", "" )) != PLSTAT_OK ) {
+			return ret;
+		}
+	}
+	clearfilepath( tp );
+	setfilepath( stl_fname_map );
+
+	char *config_name = save_config_file( "", my_extend, TriMeshIO::FMT_STL_B );
+	if( config_name == NULL ) return PLSTAT_NG;
+	*p_config_filename = string( config_name );
+	return PLSTAT_OK;
+}
+
+
+// public ////////////////////////////////////////////////////////////////////
+POLYLIB_STAT
+MPIPolylib::move(
+	PolylibMoveParams &params
+)
+{
 #ifdef DEBUG
 	PL_DBGOSH << "MPIPolylib::move() in. " << endl;
 #endif
@@ -555,9 +1191,13 @@ MPIPolylib::move(
 				PL_ERROSH << "[ERROR]MPIPolylib::move():(*group_itr)->move() failed. returns:" << PolylibStat2::String(ret) << endl;
 				return ret;
 			}
+			p_pg->set_dirty();
 
 			// KD木を再構築 (三角形同士の位置関係が変化したため、再構築が必要)
-			if( (ret = p_pg->rebuild_polygons()) != PLSTAT_OK ) {
+			double t0 = cost_clock();
+			ret = p_pg->rebuild_polygons();
+			if( m_cost_measure ) m_rebuild_time += cost_clock() - t0;
+			if( ret != PLSTAT_OK ) {
 				PL_ERROSH << "[ERROR]MPIPolylib::move():(*group_itr)->rebuild_polygons() failed. returns:" << PolylibStat2::String(ret) << endl;
 				return ret;
 			}
@@ -576,390 +1216,1127 @@ MPIPolylib::migrate(
 	PL_DBGOSH << "MPIPolylib::migrate() in. " << endl;
 #endif
 	POLYLIB_STAT ret;
-	unsigned int i, j;
+
+	// 分割実行中のmigrateがあれば、そのバッファを使ってしまうのでエラー
+	if( m_mig_active ) {
+		PL_ERROSH << "[ERROR]MPIPolylib::migrate():migrate is in progress."
+				  << endl;
+		return PLSTAT_NG;
+	}
+
+	if( (ret = migrate_begin()) != PLSTAT_OK ) return ret;
+	return migrate_end();
+}
+
+// public /////////////////////////////////////////////////////////////////////
+POLYLIB_STAT
+MPIPolylib::migrate_begin(
+)
+{
+#ifdef DEBUG
+	PL_DBGOSH << "MPIPolylib::migrate_begin() in. " << endl;
+#endif
+	int n;
 	vector<PolygonGroup*>::iterator group_itr;
 	PolygonGroup *p_pg;
-	vector<ParallelInfo*>::iterator procs_itr;
-
 	vector<PrivateTriangle*> const *p_trias;
-	vector<int>   send_num_trias;
-	int          *p_send_num_trias_array;
-	vector<int>   send_tria_ids;
-	int          *p_send_tria_ids_array;
-	vector<float> send_trias;
-	float        *p_send_trias_array;
-
-	// 送信バッファ領域をMPI_WaitAll()後に纏めてdeleteするための
-	// 配列アドレス記憶用ベクタ
-	vector<int*>  send_num_trias_bufs;
-	vector<int*>  send_tria_ids_bufs;
-	vector<float*> send_trias_bufs;
-
-	// 送信用MPI_Reqeust配列を確保
-	MPI_Request *mpi_reqs = new MPI_Request[ m_neibour_procs.size() * 3 ]; // 隣接PEごとに3回Isendする
-	MPI_Status  *mpi_stats = new MPI_Status[ m_neibour_procs.size() * 3 ];
-	int reqs_pos = 0;
-
-	//隣接PEごとに移動三角形情報を送信
-	for (procs_itr = m_neibour_procs.begin(); procs_itr != m_neibour_procs.end(); procs_itr++) {
-
-		// 送信用一時データ初期化
-		send_num_trias.clear();
-		send_trias.clear();
-		send_tria_ids.clear();
-		
+
+	if( m_mig_active ) {
+		PL_ERROSH << "[ERROR]MPIPolylib::migrate_begin():migrate is already "
+				  << "in progress." << endl;
+		return PLSTAT_NG;
+	}
+
+	// 隣接PE毎の送受信バッファはステップ間で再利用する
+	int n_neib = m_neibour_procs.size();
+	int n_head = m_pg_list.size() * 2;
+	m_mig_send_head.resize( n_neib );
+	m_mig_send_buf.resize( n_neib );
+	m_mig_recv_head.resize( n_neib );
+	m_mig_recv_buf.resize( n_neib );
+
+	// 送受信用MPI_Request配列。[0,n_neib)がヘッダ、[n_neib,2*n_neib)が三角形
+	m_mig_send_reqs.assign( n_neib * 2 + 1, MPI_REQUEST_NULL );
+	m_mig_recv_reqs.assign( n_neib * 2 + 1, MPI_REQUEST_NULL );
+
+	// 全隣接PEのヘッダ(グループIDとグループ毎三角形数の対)の受信を先に登録する。
+	// グループ情報は各rank共有しているのでヘッダ長は予め分かっている
+	for( n=0; n<n_neib; n++ ) {
+		m_mig_recv_head[n].resize( n_head );
+		if (MPI_Irecv( n_head > 0 ? &m_mig_recv_head[n][0] : NULL, n_head, MPI_INT,
+					m_neibour_procs[n]->m_rank, MPITAG_NUM_TRIAS, m_mycomm,
+					&m_mig_recv_reqs[n] ) != MPI_SUCCESS) {
+			PL_ERROSH << "[ERROR]MPIPolylib::migrate_begin():MPI_Irecv,"
+					  << "MPITAG_NUM_TRIAS faild." << endl;
+			cancel_migrate_reqs();
+			return PLSTAT_MPI_ERROR;
+		}
+	}
+
+	//隣接PEごとに移動三角形情報を詰めて送信
+	for( n=0; n<n_neib; n++ ) {
+		ParallelInfo *proc = m_neibour_procs[n];
+		vector<int> &head = m_mig_send_head[n];
+		vector<PrivateTriangle*> trias;
+		head.clear();
+
 		// 全ポリゴングループに対して
 		for( group_itr=m_pg_list.begin(); group_itr!=m_pg_list.end(); group_itr++ ) {
 			p_pg = (*group_itr);
 			p_trias = NULL;
 
-			// ポリゴン情報を持つグループだけ
-			//if( p_pg->get_triangles() != NULL
-			// && p_pg->get_triangles()->size() != 0 ) {
-
 			// 移動する可能性のあるポリゴングループのみ対象
 #ifdef DEBUG
 PL_DBGOSH << "pg_name:" << p_pg->get_name() << " movable:" << p_pg->get_movable() << endl;
 #endif
 			if( p_pg->get_movable() ) {
 
-				// 当該隣接PE領域への移動除外三角形IDリストを取得
-				map< int, vector<int> >::iterator const itr =
-					(*procs_itr)->m_exclusion_map.find( p_pg->get_internal_id() );
+				// 当該隣接PE領域への移動除外三角形IDの索引を取得
+				map< int, TriangleIdIndex >::iterator const itr =
+					proc->m_exclusion_map.find( p_pg->get_internal_id() );
 
 				// 当該隣接PE領域内にある移動フラグONの三角形を取得
 				p_trias = p_pg->search_outbounded(
-					(*procs_itr)->m_area.m_gcell_bbox, &((*itr).second) );
+					proc->m_area.m_gcell_bbox, &((*itr).second) );
 			}
 
-			// グループIDと当該グループの三角形数の対を送信データに追加
-			pack_num_trias( &send_num_trias, p_pg->get_internal_id(), p_trias );
-
-			// 三角形情報を送信データに追加
-			pack_trias( &send_trias, p_trias );
-
-			// 三角形ID情報を送信データに追加
-			pack_tria_ids( &send_tria_ids, p_trias );
+			// グループIDと当該グループの三角形数の対をヘッダに追加
+			pack_num_trias( &head, p_pg->get_internal_id(), p_trias );
 
 			// search結果の後始末
-			if( p_trias ) delete p_trias;
+			if( p_trias ) {
+				trias.insert( trias.end(), p_trias->begin(), p_trias->end() );
+				delete p_trias;
+			}
 		}
 
-		//-----  送信データをシリアライズ
-		// 送信データ初期化
-		p_send_num_trias_array = NULL;
-		p_send_tria_ids_array  = NULL;
-		p_send_trias_array     = NULL;
+		// 三角形のレコードを一つのメッセージに詰める。バッファは容量を残して再利用する
+		m_mig_send_buf[n].clear();
+		pack_tria_recs( &m_mig_send_buf[n], &trias );
 
-		// グループID,グループ毎三角形数リスト
-		if( send_num_trias.size() > 0 ) {
-			p_send_num_trias_array = new int[ send_num_trias.size() ];
-		}
-		for( i=0; i<send_num_trias.size(); i++ ) {
-			p_send_num_trias_array[i] = send_num_trias[i];
-		}
-		// 三角形IDリスト
-		if( send_tria_ids.size() > 0 ) {
-			p_send_tria_ids_array  = new int[ send_tria_ids.size() ];
-		}
-		for( i=0; i<send_tria_ids.size(); i++ ) {
-			p_send_tria_ids_array[i] = send_tria_ids[i];
-		}
-		// 三角形頂点リスト
-		if( send_trias.size() > 0 ) {
-			p_send_trias_array = new float[ send_trias.size() ];
-		}
-		for( i=0; i<send_trias.size(); i++ ) {
-			p_send_trias_array[i] = send_trias[i];
-		}
+		// 検索で復元した三角形はバッファに複製済みなので解放する
+		release_decoded( m_pg_list );
 
-		// 送信データの先頭アドレスを記憶（MPI_Wait後にdeleteするため）
-		send_num_trias_bufs.push_back( p_send_num_trias_array );
-		send_tria_ids_bufs.push_back( p_send_tria_ids_array );
-		send_trias_bufs.push_back( p_send_trias_array );
-
-		// 当該PEへ非同期送信 (MPI_Wait()は後でまとめて行う)
 #ifdef DEBUG
 		PL_DBGOSH << "sending polygons rank:" << m_myrank <<  "->rank:"
-				  << (*procs_itr)->m_rank << " ";
-		for( i=0; i< send_num_trias.size(); i+=2 ) {
-			PL_DBGOS << "(gid:" << send_num_trias[i] 
-					 << ",num_tria:" << send_num_trias[i+1] << ")";
+				  << proc->m_rank << " ";
+		for( unsigned int i=0; i< head.size(); i+=2 ) {
+			PL_DBGOS << "(gid:" << head[i] << ",num_tria:" << head[i+1] << ")";
 		}
 		PL_DBGOS << endl;
 #endif
-		if (MPI_Isend( p_send_num_trias_array, send_num_trias.size(),
-					MPI_INT, (*procs_itr)->m_rank, MPITAG_NUM_TRIAS,
-					m_mycomm, &mpi_reqs[reqs_pos++] ) != MPI_SUCCESS) {
-			PL_ERROSH << "[ERROR]MPIPolylib::migrate():MPI_Isend,"
+		// 当該PEへ非同期送信 (MPI_Wait()は後でまとめて行う)。
+		// 三角形がなければヘッダだけを送る
+		if (MPI_Isend( head.empty() ? NULL : &head[0], head.size(), MPI_INT, proc->m_rank,
+					MPITAG_NUM_TRIAS, m_mycomm, &m_mig_send_reqs[n] ) != MPI_SUCCESS) {
+			PL_ERROSH << "[ERROR]MPIPolylib::migrate_begin():MPI_Isend,"
 					  << "MPITAG_NUM_TRIAS faild." << endl;
+			cancel_migrate_reqs();
 			return PLSTAT_MPI_ERROR;
 		}
-		if (MPI_Isend( p_send_tria_ids_array,  send_tria_ids.size(),
-					MPI_INT, (*procs_itr)->m_rank, MPITAG_TRIA_IDS,
-					m_mycomm, &mpi_reqs[reqs_pos++] ) != MPI_SUCCESS) {
-			PL_ERROSH << "[ERROR]MPIPolylib::migrate():MPI_Isend,"
-					  << " MPITAG_TRIA_IDS faild." << endl;
-			return PLSTAT_MPI_ERROR;
-		}
-		if (MPI_Isend( p_send_trias_array,     send_trias.size(),
-					MPI_FLOAT, (*procs_itr)->m_rank, MPITAG_TRIAS,
-					m_mycomm, &mpi_reqs[reqs_pos++] ) != MPI_SUCCESS) {
-			PL_ERROSH << "[ERROR]MPIPolylib::migrate():MPI_Isend,"
+		if( trias.size() > 0 &&
+			MPI_Isend( &m_mig_send_buf[n][0], m_mig_send_buf[n].size(), MPI_BYTE,
+					proc->m_rank, MPITAG_TRIAS, m_mycomm,
+					&m_mig_send_reqs[n_neib + n] ) != MPI_SUCCESS) {
+			PL_ERROSH << "[ERROR]MPIPolylib::migrate_begin():MPI_Isend,"
 					  << " MPITAG_TRIAS faild." << endl;
+			cancel_migrate_reqs();
 			return PLSTAT_MPI_ERROR;
 		}
 	}
 
-	//隣接PEごとに移動三角形情報を受信
-	for (procs_itr = m_neibour_procs.begin(); procs_itr != m_neibour_procs.end(); procs_itr++) {
-		int pos_id, pos_tria;
-		MPI_Request mpi_req;
-		MPI_Status  mpi_stat;
+	// 全ての送受信を登録できてから、migrate_end()を受け付ける
+	m_mig_active = true;
 
-		// グループIDとグループ毎三角形数の対を非同期受信
-		// グループ情報は各rank共有しているのでグループ数は予め分かっている
-		int *p_intarray = new int[ m_pg_list.size()*2 ];
-		if (MPI_Irecv( p_intarray, m_pg_list.size()*2, MPI_INT, (*procs_itr)->m_rank,
-					MPITAG_NUM_TRIAS, m_mycomm, &mpi_req ) != MPI_SUCCESS) {
-			PL_ERROSH << "[ERROR]MPIPolylib::migrate():MPI_Irecv,"
-					  << ",MPITAG_NUM_TRIAS faild." << endl;
-			return PLSTAT_MPI_ERROR;
-		}
-		if (MPI_Wait( &mpi_req, &mpi_stat ) != MPI_SUCCESS) {
-			PL_ERROSH << "[ERROR]MPIPolylib::migrate():MPI_Wait,"
-					  << "MPITAG_NUM_TRIAS faild." << endl;
-			return PLSTAT_MPI_ERROR;
-		}
 #ifdef DEBUG
-		PL_DBGOSH << "receiving polygons rank:" << (*procs_itr)->m_rank
-				  <<  "->rank:" << m_myrank << " ";
-		for( i=0; i< m_pg_list.size()*2-1; i+=2 ) {
-			PL_DBGOS << "(gid:" << p_intarray[i] 
-					 << ",num_tria:" << p_intarray[i+1] << ")";
-		}
-		PL_DBGOS << endl;
+	PL_DBGOSH << "MPIPolylib::migrate_begin() out normaly." << endl;
 #endif
+	return PLSTAT_OK;
+}
 
-		// 受信三角形数を算出
-		int total_tria_num = 0;
-		for( i=1; i<m_pg_list.size() * 2; i+=2 ){
-			total_tria_num += p_intarray[i];
-		}
+// protected //////////////////////////////////////////////////////////////////
+void
+MPIPolylib::cancel_migrate_reqs(
+)
+{
+#ifdef DEBUG
+	PL_DBGOSH << "MPIPolylib::cancel_migrate_reqs() in. " << endl;
+#endif
+	unsigned int i;
 
-		// 三角形IDリストを非同期受信
-		int *p_idarray = new int[ total_tria_num ];
-		if (MPI_Irecv( p_idarray,  total_tria_num, MPI_INT, (*procs_itr)->m_rank,
-					 MPITAG_TRIA_IDS, m_mycomm, &mpi_req ) != MPI_SUCCESS) {
-			PL_ERROSH << "[ERROR]MPIPolylib::migrate():MPI_Irecv,"
-					  << "MPI_INT faild." << endl;
-			return PLSTAT_MPI_ERROR;
-		}
-		if (MPI_Wait( &mpi_req, &mpi_stat ) != MPI_SUCCESS) {
-			PL_ERROSH << "[ERROR]MPIPolylib::migrate():MPI_Wait,"
-					  << "MPI_INT faild." << endl;
-			return PLSTAT_MPI_ERROR;
-		}
+	// 送受信バッファはメンバなので、完了を待たずに解放してよい。
+	// 送信の取り消しはMPI-4で非推奨なので、送信は解放だけして完了に任せる
+	for( i=0; i<m_mig_recv_reqs.size(); i++ ) {
+		if( m_mig_recv_reqs[i] == MPI_REQUEST_NULL ) continue;
+		MPI_Cancel( &m_mig_recv_reqs[i] );
+		MPI_Request_free( &m_mig_recv_reqs[i] );
+	}
+	for( i=0; i<m_mig_send_reqs.size(); i++ ) {
+		if( m_mig_send_reqs[i] == MPI_REQUEST_NULL ) continue;
+		MPI_Request_free( &m_mig_send_reqs[i] );
+	}
+	m_mig_active = false;
+}
+
+// public /////////////////////////////////////////////////////////////////////
+POLYLIB_STAT
+MPIPolylib::migrate_end(
+)
+{
+#ifdef DEBUG
+	PL_DBGOSH << "MPIPolylib::migrate_end() in. " << endl;
+#endif
+	POLYLIB_STAT ret = PLSTAT_OK;
+	unsigned int i, j;
+	int n;
+	vector<PolygonGroup*>::iterator group_itr;
+	PolygonGroup *p_pg;
 
-		// 三角形リストを非同期受信
-		float *p_triaarray = new float[ total_tria_num*3*3 ];
-		if (MPI_Irecv( p_triaarray, total_tria_num*3*3, MPI_FLOAT, (*procs_itr)->m_rank,
-					MPITAG_TRIAS, m_mycomm, &mpi_req ) != MPI_SUCCESS) {
-			PL_ERROSH << "[ERROR]MPIPolylib::migrate():MPI_Irecv,MPI_FLOAT"
-					  << " faild." << endl;
+	if( !m_mig_active ) {
+		PL_ERROSH << "[ERROR]MPIPolylib::migrate_end():migrate_begin() was "
+				  << "not called." << endl;
+		return PLSTAT_NG;
+	}
+
+	int n_neib = m_mig_recv_head.size();
+	int n_head = m_pg_list.size() * 2;
+
+	// 到着した順に処理する。ヘッダが届いたら三角形の受信を登録し、
+	// 三角形が届いたら各ポリゴングループに追加する
+	for (;;) {
+		int idx;
+		MPI_Status mpi_stat;
+		if (MPI_Waitany( n_neib * 2, &m_mig_recv_reqs[0], &idx, &mpi_stat ) != MPI_SUCCESS) {
+			PL_ERROSH << "[ERROR]MPIPolylib::migrate_end():MPI_Waitany faild." << endl;
+			cancel_migrate_reqs();
 			return PLSTAT_MPI_ERROR;
 		}
-		if (MPI_Wait( &mpi_req, &mpi_stat ) != MPI_SUCCESS) {
-			PL_ERROSH << "[ERROR]MPIPolylib::migrate():MPI_Wait,MPI_FLOAT"
-					  << " faild." << endl;
-			return PLSTAT_MPI_ERROR;
+		if( idx == MPI_UNDEFINED ) break;
+
+		if( idx < n_neib ) {
+			const vector<int> &head = m_mig_recv_head[idx];
+#ifdef DEBUG
+			PL_DBGOSH << "receiving polygons rank:" << m_neibour_procs[idx]->m_rank
+					  <<  "->rank:" << m_myrank << " ";
+			for( i=0; i<(unsigned int)n_head; i+=2 ) {
+				PL_DBGOS << "(gid:" << head[i] << ",num_tria:" << head[i+1] << ")";
+			}
+			PL_DBGOS << endl;
+#endif
+			// 受信三角形数を算出
+			int total_tria_num = 0;
+			for( i=1; i<(unsigned int)n_head; i+=2 ) {
+				total_tria_num += head[i];
+			}
+			if( total_tria_num == 0 ) continue;
+
+			vector<char> &buf = m_mig_recv_buf[idx];
+			buf.resize( (size_t)total_tria_num * sizeof(TriaRec) );
+			if (MPI_Irecv( &buf[0], buf.size(), MPI_BYTE,
+						m_neibour_procs[idx]->m_rank, MPITAG_TRIAS, m_mycomm,
+						&m_mig_recv_reqs[n_neib + idx] ) != MPI_SUCCESS) {
+				PL_ERROSH << "[ERROR]MPIPolylib::migrate_end():MPI_Irecv,"
+						  << "MPITAG_TRIAS faild." << endl;
+				cancel_migrate_reqs();
+				return PLSTAT_MPI_ERROR;
+			}
+			continue;
 		}
 
-		// 各ポリゴングループに対して三角形情報を追加
-		pos_id = 0;
-		pos_tria = 0;
-		for( i=0; i<m_pg_list.size()*2-1; i+=2 ){
+		// 各ポリゴングループに対して三角形情報を追加。
+		// 追加できなくても他rankとの送受信は最後まで続け、結果は全rankで揃える
+		n = idx - n_neib;
+		const vector<int> &head = m_mig_recv_head[n];
+		const char *p_rec = &m_mig_recv_buf[n][0];
+		for( i=0; i<(unsigned int)n_head; i+=2 ){
 
 			// ポリゴングループID
-			int pg_id = p_intarray[i];
+			int pg_id = head[i];
 
 			// 当該ポリゴングループの三角形数
-			unsigned int num_trias = p_intarray[i+1];
+			unsigned int num_trias = head[i+1];
+			if( num_trias == 0 ) continue;
 
 			// グループIDのポリゴングループインスタンス取得
 			PolygonGroup* p_pg = get_group( pg_id );
 			if( p_pg == NULL ) {
-				PL_ERROSH << "[ERROR]MPIPolylib::migrate():invalid pg_id:"
+				PL_ERROSH << "[ERROR]MPIPolylib::migrate_end():invalid pg_id:"
 					  	<< pg_id << endl;
-				return PLSTAT_NG;
+				p_rec += (size_t)num_trias * sizeof(TriaRec);
+				ret = PLSTAT_NG;
+				continue;
 			}
 
-			// PrivateTriangleのベクタ - 受信データ配列からベクタへの変換用
+			// 受信したレコードから三角形を作り、複製せずにポリゴングループへ渡す
 			vector<PrivateTriangle*> tria_vec;
-
-			// ベクタに受信データ内容をコピー
-			for( j=0; j<num_trias; j++ ) {
-				tria_vec.push_back(
-						new PrivateTriangle(&p_triaarray[pos_tria], p_idarray[pos_id]) );
-				pos_id++;
-				pos_tria+=9;
-			}
-
-			// ポリゴングループに三角形リストを追加
-			if( (ret = p_pg->add_triangles( &tria_vec )) != PLSTAT_OK ) {
-				PL_ERROSH << "[ERROR]MPIPolylib::migrate():p_pg->add_triangles() failed. returns:"
-						  << PolylibStat2::String(ret) << endl;
-				return ret;
-			}
-
-			// ベクタの内容あとしまつ
-			for( j=0; j<num_trias; j++ ) {
-				delete tria_vec.at(j);
+			p_rec = unpack_tria_recs( p_rec, num_trias, &tria_vec );
+			POLYLIB_STAT stat = p_pg->adopt_triangles( &tria_vec );
+			if( stat != PLSTAT_OK ) {
+				PL_ERROSH << "[ERROR]MPIPolylib::migrate_end():p_pg->adopt_triangles() failed. returns:"
+						  << PolylibStat2::String(stat) << endl;
+				for( j=0; j<tria_vec.size(); j++ ) {
+					delete tria_vec.at(j);
+				}
+				ret = stat;
 			}
 		}
-
-		// 受信領域あとしまつ
-		delete[] p_intarray;
-		delete[] p_idarray;
-		delete[] p_triaarray;
 	}
 
 	// MPI_Isend()を纏めてアンロック
-	if (MPI_Waitall( m_neibour_procs.size()*3, mpi_reqs, mpi_stats ) != MPI_SUCCESS) {
-		PL_ERROSH << "[ERROR]MPIPolylib::migrate():MPI_Waitall failed." << endl;
+	if (MPI_Waitall( n_neib * 2, &m_mig_send_reqs[0], MPI_STATUSES_IGNORE ) != MPI_SUCCESS) {
+		PL_ERROSH << "[ERROR]MPIPolylib::migrate_end():MPI_Waitall failed." << endl;
+		cancel_migrate_reqs();
 		return PLSTAT_MPI_ERROR;
 	}
 
-	// 送信データ領域をdelete
-	for( i=0; i<send_num_trias_bufs.size(); i++ ) {
-		delete[] send_num_trias_bufs.at(i);
-	}
-	for( i=0; i<send_tria_ids_bufs.size(); i++ ) {
-		delete[] send_tria_ids_bufs.at(i);
-	}
-	for( i=0; i<send_trias_bufs.size(); i++ ) {
-		delete[] send_trias_bufs.at(i);
-	}
+	// 全ての送受信が完了したので、以降はバッファを再利用してよい
+	m_mig_active = false;
 
 	// 移動してきた三角形を含めたKD木を再構築
-	for (group_itr = m_pg_list.begin(); group_itr != m_pg_list.end(); group_itr++) {
+	double t0 = cost_clock();
+	for (group_itr = m_pg_list.begin();
+		 ret == PLSTAT_OK && group_itr != m_pg_list.end(); group_itr++) {
 		p_pg = (*group_itr);
 
 		// 移動可能グループだけ
-		if( p_pg->get_movable() && p_pg->get_triangles() != NULL ) {
+		if( p_pg->get_movable() && p_pg->get_num_triangles() != 0 ) {
 
 			// KD木を再構築
 			if( (ret=p_pg->rebuild_polygons()) != PLSTAT_OK ) {
-				PL_ERROSH << "[ERROR]MPIPolylib::migrate():p_pg->rebuild_polygons() failed. returns:"
+				PL_ERROSH << "[ERROR]MPIPolylib::migrate_end():p_pg->rebuild_polygons() failed. returns:"
 						  << PolylibStat2::String(ret) << endl;
-				return ret;
 			}
 		}
 	}
 	
 	// 自PE領域外ポリゴン情報を消去
-	if( erase_outbounded_polygons() != PLSTAT_OK ) {
-		PL_ERROSH << "[ERROR]MPIPolylib::migrate():rebuild_polygons() failed." << endl;
+	if( ret == PLSTAT_OK && (ret = erase_outbounded_polygons()) != PLSTAT_OK ) {
+		PL_ERROSH << "[ERROR]MPIPolylib::migrate_end():erase_outbounded_polygons() failed. returns:"
+				  << PolylibStat2::String(ret) << endl;
 	}
+	if( m_cost_measure ) m_rebuild_time += cost_clock() - t0;
 
-	// 後始末 2010.08.24
-	delete[] mpi_reqs;
-	delete[] mpi_stats;
+	// いずれかのrankで失敗していれば、全rankで同じエラーを返す
+	if( (ret = reduce_stat( ret )) != PLSTAT_OK ) return ret;
+
+	// 移動した三角形の所有者を設定し直す
+	update_ownership();
 
 #ifdef DEBUG
-	PL_DBGOSH << "MPIPolylib::migrate() out normaly." << endl;
+	PL_DBGOSH << "MPIPolylib::migrate_end() out normaly." << endl;
 #endif
 	return PLSTAT_OK;
 }
 
 
 // public /////////////////////////////////////////////////////////////////////
-ParallelInfo* MPIPolylib::get_proc(int rank)
+POLYLIB_STAT
+MPIPolylib::repartition(
+	float bpos[3], 
+	unsigned int bbsize[3], 
+	unsigned int gcsize[3], 
+	float dx[3]
+)
 {
-	vector<ParallelInfo*>::iterator itr;
-	itr = m_other_procs.begin();
-	for (; itr != m_other_procs.end(); itr++) {
-		if ((*itr)->m_rank == rank) {
-			return(*itr);
-		}
-	}
-	return NULL;
-}
+#ifdef DEBUG
+	PL_DBGOSH << "MPIPolylib::repartition() in. " << endl;
+#endif
+	POLYLIB_STAT ret = PLSTAT_OK;
+	unsigned int i, j, k;
+	vector<PolygonGroup*>::iterator group_itr;
+	PolygonGroup *p_pg;
 
+	if( m_mig_active ) {
+		PL_ERROSH << "[ERROR]MPIPolylib::repartition():migrate is in progress."
+				  << endl;
+		ret = PLSTAT_NG;
+	}
+	if( (ret = reduce_stat( ret )) != PLSTAT_OK ) return ret;
+
+	// 変更前後の全rankの領域
+	vector<BBox> old_boxes, new_boxes;
+	acq_gcell_boxes( &old_boxes );
+	if( (ret = set_parallel_area( bpos, bbsize, gcsize, dx )) != PLSTAT_OK ) {
+		PL_ERROSH << "[ERROR]MPIPolylib::repartition():set_parallel_area() faild."
+				  << endl;
+	}
+	if( (ret = reduce_stat( ret )) != PLSTAT_OK ) return ret;
+	acq_gcell_boxes( &new_boxes );
+	RankGrid old_grid( old_boxes );
+	RankGrid new_grid( new_boxes );
 
-// public /////////////////////////////////////////////////////////////////////
-unsigned int MPIPolylib::used_memory_size()
-{
-	unsigned int								size;
-	map< int, vector<int> >::iterator	ex;
-	vector<ParallelInfo *>::iterator			pi;
+	// リーフグループ毎に、新たに領域が掛かるようになったrankへ三角形を
+	// 全対全通信で送る。全rankが同じ順序で通信する
+	for (group_itr = m_pg_list.begin(); group_itr != m_pg_list.end(); group_itr++) {
+		p_pg = (*group_itr);
+		if( p_pg->get_children().empty() == false ) continue;
+
+		vector<PrivateTriangle*> empty;
+		vector<PrivateTriangle*> *p_trias = p_pg->acquire_triangles();
+		if( p_trias == NULL ) p_trias = &empty;
+
+		vector<int> dest, ranks, holders;
+		vector<unsigned int> dest_pos( p_trias->size() + 1, 0 );
+		for( i=0; i<p_trias->size(); i++ ) {
+			const Vec3f *v = p_trias->at(i)->get_vertex();
+			BBox bbox;
+			bbox.init();
+			bbox.add( v[0] );
+			bbox.add( v[1] );
+			bbox.add( v[2] );
+			ranks.clear();
+			new_grid.find( bbox, &ranks );
+
+			int sender = -1;
+			for( j=0; j<ranks.size(); j++ ) {
+				int r = ranks[j];
+
+				// 変更前から保持しているrankには送らない
+				if( r == m_myrank || old_boxes[r].crossed( bbox ) ) continue;
+
+				// 変更前に保持していたrankのうち、最小のrankだけが送る
+				if( sender < 0 ) {
+					holders.clear();
+					old_grid.find( bbox, &holders );
+					sender = m_myrank;
+					for( k=0; k<holders.size(); k++ ) {
+						if( holders[k] < sender ) sender = holders[k];
+					}
+				}
+				if( sender != m_myrank ) break;
+				dest.push_back( r );
+			}
+			dest_pos[i+1] = dest.size();
+		}
 
-	// Polylibクラスが管理している領域を取得
-	size = Polylib::used_memory_size();
+		// 受信した三角形を複製せずに追加し、KD木を再構築
+		vector<PrivateTriangle*> tria_vec;
+		ret = alltoall_polygons( p_trias, dest, dest_pos, &tria_vec );
+		if( p_trias != &empty ) p_pg->release_triangles( p_trias );
+		double t0 = cost_clock();
+		if( ret == PLSTAT_OK ) ret = p_pg->adopt_triangles( &tria_vec );
+		if( ret == PLSTAT_OK ) ret = p_pg->rebuild_polygons();
+		if( m_cost_measure ) m_rebuild_time += cost_clock() - t0;
+		for( i=0; i<tria_vec.size(); i++ ) {
+			delete tria_vec.at(i);
+		}
+		if( (ret = reduce_stat( ret )) != PLSTAT_OK ) {
+			PL_ERROSH << "[ERROR]MPIPolylib::repartition():exchange of "
+					  << p_pg->get_name() << " faild. returns:"
+					  << PolylibStat2::String(ret) << endl;
+			return ret;
+		}
+	}
 
-	// 自PE担当領域情報
-	size += sizeof(ParallelInfo);
-	size += m_myproc.m_exclusion_map.size() * (sizeof(int)+sizeof(vector<int>));
-	for (ex = m_myproc.m_exclusion_map.begin(); 
-							ex != m_myproc.m_exclusion_map.end(); ex++) {
-		size += ex->second.size() * sizeof(int);
+	// 新しい自PE領域外ポリゴン情報を消去
+	double t0 = cost_clock();
+	ret = erase_outbounded_polygons();
+	if( m_cost_measure ) m_rebuild_time += cost_clock() - t0;
+	if( ret != PLSTAT_OK ) {
+		PL_ERROSH << "[ERROR]MPIPolylib::repartition():"
+				  << "erase_outbounded_polygons() faild." << endl;
+		return ret;
 	}
 
-	// 自PEを除く全PE担当領域情報リスト
-	size += sizeof(vector<ParallelInfo *>);
-	for (pi = m_other_procs.begin(); pi != m_other_procs.end(); pi++) {
-		size += sizeof(ParallelInfo);
-		size += (*pi)->m_exclusion_map.size() * (sizeof(int)+sizeof(vector<int>));
-		for (ex = (*pi)->m_exclusion_map.begin(); 
-									ex != (*pi)->m_exclusion_map.end(); ex++) {
-			size += ex->second.size() * sizeof(int);
+	// 隣接PEが変わるので、移動可能グループのmigrate除外三角形IDリストを作り直す
+	for (group_itr = m_pg_list.begin(); group_itr != m_pg_list.end(); group_itr++) {
+		p_pg = (*group_itr);
+		if( p_pg->get_movable() == false ) continue;
+		if( (ret = select_excluded_trias( p_pg )) != PLSTAT_OK ) {
+			PL_ERROSH << "[ERROR]MPIPolylib::repartition():"
+					  << "select_excluded_trias() faild." << endl;
+			return ret;
 		}
 	}
 
-	// 隣接PE担当領域情報リスト
-	size += sizeof(vector<ParallelInfo *>);
-	size += m_neibour_procs.size() * sizeof(vector<ParallelInfo *>);
+	// 新しい担当領域で三角形の所有者を設定し直す
+	update_ownership();
 
-	// 自プロセスのランク数、全プロセス数
-	size += sizeof(int) * 2;
+#ifdef DEBUG
+	PL_DBGOSH << "MPIPolylib::repartition() out normaly." << endl;
+#endif
+	return PLSTAT_OK;
+}
 
-	// 自プロセスが利用するコミュニケーター
-	size += sizeof(MPI_Comm);
+// public /////////////////////////////////////////////////////////////////////
+POLYLIB_STAT
+MPIPolylib::advise_balance(
+	float cell_cost,
+	float new_bpos[3],
+	unsigned int new_bbsize[3],
+	float *imbalance_before,
+	float *imbalance_after
+)
+{
+#ifdef DEBUG
+	PL_DBGOSH << "MPIPolylib::advise_balance() in. " << endl;
+#endif
+	unsigned int i;
+	int r, k;
+	vector<PolygonGroup*>::iterator group_itr;
 
-	return size;
-}
+	// 全rankの担当領域をボクセル番号で表す。全rankが同じ領域情報を持つので
+	// 以下の検査結果は全rankで一致する
+	Vec3f dx = m_myproc.m_area.m_dx;
+	Vec3f gmin = m_myproc.m_area.m_bpos;
+	for( r=0; r<m_numproc; r++ ) {
+		const CalcAreaInfo &area = m_rank_procs[r]->m_area;
+		for( k=0; k<3; k++ ) {
+			if( fabs( area.m_dx[k] - dx[k] ) > dx[k] * 1.0e-4f ) {
+				PL_ERROSH << "[ERROR]MPIPolylib::advise_balance():dx differs "
+						  << "between ranks." << endl;
+				return PLSTAT_NG;
+			}
+			if( area.m_bpos[k] < gmin[k] ) gmin[k] = area.m_bpos[k];
+		}
+	}
+	int n[3] = { 0, 0, 0 };
+	vector<int> cur_blocks( m_numproc * 6 );
+	long long volume = 0;
+	for( r=0; r<m_numproc; r++ ) {
+		const CalcAreaInfo &area = m_rank_procs[r]->m_area;
+		long long vol = 1;
+		for( k=0; k<3; k++ ) {
+			int lo = (int)floor( (area.m_bpos[k] - gmin[k]) / dx[k] + 0.5f );
+			int hi = lo + (int)area.m_bbsize[k];
+			cur_blocks[r * 6 + k] = lo;
+			cur_blocks[r * 6 + 3 + k] = hi;
+			if( hi > n[k] ) n[k] = hi;
+			vol *= hi - lo;
+		}
+		volume += vol;
+	}
+	if( volume != (long long)n[0] * n[1] * n[2] ) {
+		PL_ERROSH << "[ERROR]MPIPolylib::advise_balance():rank areas do not "
+				  << "fill a box." << endl;
+		return PLSTAT_NG;
+	}
 
+	// 1軸あたり最大64ビンの粗い格子で形状のコストを集計する
+	int bin[3], nb[3];
+	for( k=0; k<3; k++ ) {
+		bin[k] = (n[k] + 63) / 64;
+		if( bin[k] < 1 ) bin[k] = 1;
+		nb[k] = (n[k] + bin[k] - 1) / bin[k];
+	}
 
-// protected //////////////////////////////////////////////////////////////////
-MPIPolylib::MPIPolylib() : Polylib()
-{
-}
+	// 自rankの三角形数と計測時間。所有する三角形の重心だけを集めて重複を避ける
+	vector<Vec3f> owned;
+	unsigned long long num_trias = 0;
+	for (group_itr = m_pg_list.begin(); group_itr != m_pg_list.end(); group_itr++) {
+		if( (*group_itr)->get_children().empty() == false ) continue;
+		vector<PrivateTriangle*> *p_trias = (*group_itr)->acquire_triangles();
+		if( p_trias == NULL ) continue;
+		num_trias += p_trias->size();
+		for( i=0; i<p_trias->size(); i++ ) {
+			if( p_trias->at(i)->is_owned() == false ) continue;
+			const Vec3f *v = p_trias->at(i)->get_vertex();
+			owned.push_back( ( v[0] + v[1] + v[2] ) / 3.0f );
+		}
+		(*group_itr)->release_triangles( p_trias );
+	}
+	double my_time = m_query_time + m_rebuild_time;
+	double sum_time = 0.0;
+	unsigned long long sum_trias = 0;
+	if (MPI_Allreduce( &my_time, &sum_time, 1, MPI_DOUBLE, MPI_SUM, m_mycomm ) != MPI_SUCCESS ||
+		MPI_Reduce( &num_trias, &sum_trias, 1, MPI_UNSIGNED_LONG_LONG, MPI_SUM, 0,
+					m_mycomm ) != MPI_SUCCESS) {
+		PL_ERROSH << "[ERROR]MPIPolylib::advise_balance():MPI_Allreduce faild." << endl;
+		return PLSTAT_MPI_ERROR;
+	}
 
+	// 三角形1個のコスト。計測時間は自rankの所有する三角形に割り振る。
+	// 計測時間がなければセル1個と同じとする
+	double tria_cost = ( cell_cost > 0.0f ) ? cell_cost : 1.0;
+	if( sum_time > 0.0 ) {
+		tria_cost = owned.empty() ? 0.0 : my_time / owned.size();
+	}
+	vector<double> geom( nb[0] * nb[1] * nb[2], 0.0 );
+	for( i=0; i<owned.size(); i++ ) {
+		const Vec3f &c = owned[i];
+		int b[3];
+		for( k=0; k<3; k++ ) {
+			int vox = (int)floor( (c[k] - gmin[k]) / dx[k] );
+			if( vox < 0 ) vox = 0;
+			if( vox >= n[k] ) vox = n[k] - 1;
+			b[k] = vox / bin[k];
+		}
+		geom[(b[2] * nb[1] + b[1]) * nb[0] + b[0]] += tria_cost;
+	}
+	vector<double> sum_geom( geom.size() );
+	if (MPI_Reduce( &geom[0], &sum_geom[0], geom.size(), MPI_DOUBLE, MPI_SUM, 0,
+					m_mycomm ) != MPI_SUCCESS) {
+		PL_ERROSH << "[ERROR]MPIPolylib::advise_balance():MPI_Reduce faild." << endl;
+		return PLSTAT_MPI_ERROR;
+	}
 
-// protected //////////////////////////////////////////////////////////////////
-MPIPolylib::~MPIPolylib()
-{
-	vector<ParallelInfo*>::iterator itr;
+	// rank0で分割を求めて配信する
+	vector<int> blocks( m_numproc * 6 + 1, 0 );
+	float factor[3] = { 0.0f, 0.0f, 0.0f };		// 分割の可否、前後の不均衡度
+	if( m_myrank == 0 ) {
+		CostGrid grid( n, bin, cell_cost, sum_geom );
+		int lo[3] = { 0, 0, 0 };
+		if( grid.bisect( lo, n, 0, m_numproc, &blocks ) ) {
+			double before_max = 0.0, before_sum = 0.0;
+			double after_max = 0.0, after_sum = 0.0;
+			for( r=0; r<m_numproc; r++ ) {
+				double c0 = grid.cost( &cur_blocks[r * 6], &cur_blocks[r * 6 + 3] );
+				double c1 = grid.cost( &blocks[r * 6], &blocks[r * 6 + 3] );
+				before_max = std::max( before_max, c0 );
+				after_max = std::max( after_max, c1 );
+				before_sum += c0;
+				after_sum += c1;
+			}
+			factor[0] = 1.0f;
+			factor[1] = ( before_sum > 0.0 ) ? before_max * m_numproc / before_sum : 1.0;
+			factor[2] = ( after_sum > 0.0 ) ? after_max * m_numproc / after_sum : 1.0;
+
+			// 報告
+			PL_DBGOSH << "MPIPolylib::advise_balance():triangles:" << sum_trias
+					  << " voxels:" << n[0] << "x" << n[1] << "x" << n[2]
+					  << " polylib time:" << sum_time << endl;
+			PL_DBGOSH << "MPIPolylib::advise_balance():imbalance factor (max/mean) "
+					  << "before:" << factor[1] << " after:" << factor[2] << endl;
+		}
+	}
+	if (MPI_Bcast( &blocks[0], m_numproc * 6, MPI_INT, 0, m_mycomm ) != MPI_SUCCESS ||
+		MPI_Bcast( factor, 3, MPI_FLOAT, 0, m_mycomm ) != MPI_SUCCESS) {
+		PL_ERROSH << "[ERROR]MPIPolylib::advise_balance():MPI_Bcast faild." << endl;
+		return PLSTAT_MPI_ERROR;
+	}
+	if( factor[0] == 0.0f ) {
+		PL_ERROSH << "[ERROR]MPIPolylib::advise_balance():too few voxels to "
+				  << "divide into ranks." << endl;
+		return PLSTAT_NG;
+	}
 
-	// 全PE領域情報リストを消去
-	for ( itr=m_other_procs.begin(); itr != m_other_procs.end(); itr++ ) {
-		delete *itr;
+	// 自rankの新しい担当領域
+	for( k=0; k<3; k++ ) {
+		int lo = blocks[m_myrank * 6 + k];
+		int hi = blocks[m_myrank * 6 + 3 + k];
+		new_bpos[k] = gmin[k] + lo * dx[k];
+		new_bbsize[k] = hi - lo;
 	}
-	// 隣接PE領域情報リストについては、m_other_procsの内容と同じインスタンスを保持
-	// するため、上記の処理で消去済。
-}
+	if( imbalance_before != NULL ) *imbalance_before = factor[1];
+	if( imbalance_after != NULL ) *imbalance_after = factor[2];
 
+	return PLSTAT_OK;
+}
 
-// protected //////////////////////////////////////////////////////////////////
+// public /////////////////////////////////////////////////////////////////////
 POLYLIB_STAT
-MPIPolylib::broadcast_config(
-	string config_contents
+MPIPolylib::get_global_stats(
+	std::string group_name,
+	unsigned long long *num,
+	double *area
 )
 {
 #ifdef DEBUG
-	PL_DBGOSH << "MPIPolylib::broadcast_config() in. " << endl;
+	PL_DBGOSH << "MPIPolylib::get_global_stats() in. " << endl;
 #endif
-
+	POLYLIB_STAT ret;
+	unsigned long long my_num;
+	double my_area;
+
+	// 所有する三角形だけを数えるので、合計しても重複しない
+	ret = reduce_stat( get_owned_stats( group_name, &my_num, &my_area ) );
+	if( ret != PLSTAT_OK ) return ret;
+
+	if (MPI_Allreduce( &my_num, num, 1, MPI_UNSIGNED_LONG_LONG, MPI_SUM,
+					   m_mycomm ) != MPI_SUCCESS ||
+		MPI_Allreduce( &my_area, area, 1, MPI_DOUBLE, MPI_SUM,
+					   m_mycomm ) != MPI_SUCCESS) {
+		PL_ERROSH << "[ERROR]MPIPolylib::get_global_stats():MPI_Allreduce faild." << endl;
+		return PLSTAT_MPI_ERROR;
+	}
+	return PLSTAT_OK;
+}
+
+// public /////////////////////////////////////////////////////////////////////
+POLYLIB_STAT
+MPIPolylib::search_nearest_global(
+	std::string group_name,
+	const vector<Vec3f>& pos,
+	vector<GlobalQueryHit>* hits
+)
+{
+#ifdef DEBUG
+	PL_DBGOSH << "MPIPolylib::search_nearest_global() in. " << endl;
+#endif
+	POLYLIB_STAT ret;
+	unsigned int i;
+	int r;
+
+	vector<PolygonGroup*> leaves;
+	if( (ret = reduce_stat( acq_leaf_groups( group_name, &leaves ) )) != PLSTAT_OK ) {
+		return ret;
+	}
+	vector<BBox> boxes;
+	if( (ret = acq_rank_boxes( leaves, &boxes )) != PLSTAT_OK ) return ret;
+
+	// 自rankで検索し、それより近い三角形を持ち得るrankへ問い合わせる
+	GlobalQueryHit none;
+	none.m_rank = -1;
+	none.m_id = -1;
+	none.m_dist = 0.0;
+	hits->assign( pos.size(), none );
+	vector< vector<QueryRec> > queries( m_numproc );
+	for( i=0; i<pos.size(); i++ ) {
+		QueryRec q;
+		q.qidx = i;
+		for( int k=0; k<3; k++ ) {
+			q.a[k] = pos[i][k];
+			q.b[k] = 0.0;
+		}
+		q.bound = FLT_MAX;
+
+		vector<HitRec> mine;
+		eval_query( GQ_NEAREST, leaves, q, &mine );
+		if( mine.empty() == false ) {
+			set_global_hit( &hits->at(i), m_myrank, mine[0] );
+			q.bound = mine[0].dist;
+		}
+
+		for( r=0; r<m_numproc; r++ ) {
+			if( r == m_myrank ) continue;
+			if( boxes[r].min[0] > boxes[r].max[0] ) continue;
+			float d2 = boxes[r].distanceSquared( pos[i] );
+			if( q.bound == FLT_MAX || d2 < q.bound * q.bound ) queries[r].push_back( q );
+		}
+	}
+
+	// 全rankの回答から最も近いものを選ぶ。同じ距離ならrank番号の小さい方
+	vector<char> send, replies;
+	vector<int> send_num, reply_num;
+	pack_query_recs( queries, &send, &send_num );
+	if( (ret = exchange_queries( GQ_NEAREST, leaves, send, send_num,
+								 &replies, &reply_num )) != PLSTAT_OK ) {
+		return ret;
+	}
+	const HitRec *recs = (const HitRec*)( replies.empty() ? NULL : &replies[0] );
+	int n = 0;
+	for( r=0; r<m_numproc; r++ ) {
+		for( int j=0; j<reply_num[r]; j++, n++ ) {
+			GlobalQueryHit &hit = hits->at( recs[n].qidx );
+			if( hit.m_rank < 0 || recs[n].dist < hit.m_dist ||
+				( recs[n].dist == hit.m_dist && r < hit.m_rank ) ) {
+				set_global_hit( &hit, r, recs[n] );
+			}
+		}
+	}
+	return PLSTAT_OK;
+}
+
+// public /////////////////////////////////////////////////////////////////////
+POLYLIB_STAT
+MPIPolylib::search_ray_global(
+	std::string group_name,
+	const vector<Vec3f>& orig,
+	const vector<Vec3f>& dir,
+	float tmax,
+	vector<GlobalQueryHit>* hits
+)
+{
+#ifdef DEBUG
+	PL_DBGOSH << "MPIPolylib::search_ray_global() in. " << endl;
+#endif
+	POLYLIB_STAT ret;
+	unsigned int i;
+	int r;
+
+	if( orig.size() != dir.size() ) {
+		PL_ERROSH << "[ERROR]MPIPolylib::search_ray_global():orig and dir"
+				  << " differ in size." << endl;
+		return reduce_stat( PLSTAT_NG );
+	}
+	vector<PolygonGroup*> leaves;
+	if( (ret = reduce_stat( acq_leaf_groups( group_name, &leaves ) )) != PLSTAT_OK ) {
+		return ret;
+	}
+	vector<BBox> boxes;
+	if( (ret = acq_rank_boxes( leaves, &boxes )) != PLSTAT_OK ) return ret;
+
+	// 自rankで検索し、その交差位置より手前で線分と交差するrankへ問い合わせる
+	GlobalQueryHit none;
+	none.m_rank = -1;
+	none.m_id = -1;
+	none.m_dist = 0.0;
+	hits->assign( orig.size(), none );
+	vector< vector<QueryRec> > queries( m_numproc );
+	for( i=0; i<orig.size(); i++ ) {
+		QueryRec q;
+		q.qidx = i;
+		for( int k=0; k<3; k++ ) {
+			q.a[k] = orig[i][k];
+			q.b[k] = dir[i][k];
+		}
+		q.bound = tmax;
+
+		vector<HitRec> mine;
+		eval_query( GQ_RAY, leaves, q, &mine );
+		if( mine.empty() == false ) {
+			set_global_hit( &hits->at(i), m_myrank, mine[0] );
+			q.bound = mine[0].dist;
+		}
+
+		for( r=0; r<m_numproc; r++ ) {
+			if( r == m_myrank ) continue;
+			float tnear;
+			if( boxes[r].crossed_ray( orig[i], dir[i], q.bound, &tnear ) ) {
+				queries[r].push_back( q );
+			}
+		}
+	}
+
+	// 全rankの回答から最も手前のものを選ぶ。同じ位置ならrank番号の小さい方
+	vector<char> send, replies;
+	vector<int> send_num, reply_num;
+	pack_query_recs( queries, &send, &send_num );
+	if( (ret = exchange_queries( GQ_RAY, leaves, send, send_num,
+								 &replies, &reply_num )) != PLSTAT_OK ) {
+		return ret;
+	}
+	const HitRec *recs = (const HitRec*)( replies.empty() ? NULL : &replies[0] );
+	int n = 0;
+	for( r=0; r<m_numproc; r++ ) {
+		for( int j=0; j<reply_num[r]; j++, n++ ) {
+			GlobalQueryHit &hit = hits->at( recs[n].qidx );
+			if( hit.m_rank < 0 || recs[n].dist < hit.m_dist ||
+				( recs[n].dist == hit.m_dist && r < hit.m_rank ) ) {
+				set_global_hit( &hit, r, recs[n] );
+			}
+		}
+	}
+	return PLSTAT_OK;
+}
+
+// public /////////////////////////////////////////////////////////////////////
+POLYLIB_STAT
+MPIPolylib::search_box_global(
+	std::string group_name,
+	const vector<BBox>& qboxes,
+	vector< vector<GlobalQueryHit> >* hits
+)
+{
+#ifdef DEBUG
+	PL_DBGOSH << "MPIPolylib::search_box_global() in. " << endl;
+#endif
+	POLYLIB_STAT ret;
+	unsigned int i;
+	int r;
+
+	vector<PolygonGroup*> leaves;
+	if( (ret = reduce_stat( acq_leaf_groups( group_name, &leaves ) )) != PLSTAT_OK ) {
+		return ret;
+	}
+	vector<BBox> boxes;
+	if( (ret = acq_rank_boxes( leaves, &boxes )) != PLSTAT_OK ) return ret;
+
+	// 自rankの所有する三角形を集め、矩形領域と交差するrankへ問い合わせる
+	hits->assign( qboxes.size(), vector<GlobalQueryHit>() );
+	vector< vector<QueryRec> > queries( m_numproc );
+	for( i=0; i<qboxes.size(); i++ ) {
+		QueryRec q;
+		q.qidx = i;
+		for( int k=0; k<3; k++ ) {
+			q.a[k] = qboxes[i].min[k];
+			q.b[k] = qboxes[i].max[k];
+		}
+		q.bound = 0.0;
+
+		vector<HitRec> mine;
+		eval_query( GQ_BOX, leaves, q, &mine );
+		hits->at(i).resize( mine.size() );
+		for( unsigned int j=0; j<mine.size(); j++ ) {
+			set_global_hit( &hits->at(i)[j], m_myrank, mine[j] );
+		}
+
+		for( r=0; r<m_numproc; r++ ) {
+			if( r == m_myrank ) continue;
+			if( boxes[r].crossed( qboxes[i] ) ) queries[r].push_back( q );
+		}
+	}
+
+	// 所有者は1rankだけなので、回答をそのまま追加すれば重複しない
+	vector<char> send, replies;
+	vector<int> send_num, reply_num;
+	pack_query_recs( queries, &send, &send_num );
+	if( (ret = exchange_queries( GQ_BOX, leaves, send, send_num,
+								 &replies, &reply_num )) != PLSTAT_OK ) {
+		return ret;
+	}
+	const HitRec *recs = (const HitRec*)( replies.empty() ? NULL : &replies[0] );
+	int n = 0;
+	for( r=0; r<m_numproc; r++ ) {
+		for( int j=0; j<reply_num[r]; j++, n++ ) {
+			GlobalQueryHit hit;
+			set_global_hit( &hit, r, recs[n] );
+			hits->at( recs[n].qidx ).push_back( hit );
+		}
+	}
+	return PLSTAT_OK;
+}
+
+// public /////////////////////////////////////////////////////////////////////
+ParallelInfo* MPIPolylib::get_proc(int rank)
+{
+	// 自PEはm_other_procsに含まれないので返さない
+	if (rank < 0 || rank >= (int)m_rank_procs.size() || rank == m_myrank) {
+		return NULL;
+	}
+	return m_rank_procs[rank];
+}
+
+
+// public /////////////////////////////////////////////////////////////////////
+size_t MPIPolylib::used_memory_size()
+{
+	PolylibMemoryUsage	usage;
+
+	used_memory_usage(&usage);
+	return PolylibMemory::total(usage);
+}
+
+// public /////////////////////////////////////////////////////////////////////
+POLYLIB_STAT MPIPolylib::used_memory_usage(
+	PolylibMemoryUsage					*usage,
+	map<string, PolylibMemoryUsage>		*group_usage
+) {
+	POLYLIB_STAT						ret;
+	map< int, TriangleIdIndex >::iterator	ex;
+	vector<ParallelInfo *>::iterator	pi;
+	vector<ParallelInfo *>				procs;
+
+	// Polylibクラスが管理している領域を取得
+	ret = Polylib::used_memory_usage(usage, group_usage);
+	if (ret != PLSTAT_OK) return ret;
+
+	// MPIPolylibクラスの追加分、PE領域情報リスト
+	usage->others += sizeof(MPIPolylib) - sizeof(Polylib);
+	usage->others += m_other_procs.capacity() * sizeof(ParallelInfo *);
+	usage->others += m_neibour_procs.capacity() * sizeof(ParallelInfo *);
+	usage->others += m_other_procs.size() * sizeof(ParallelInfo);
+	usage->others += m_rank_procs.capacity() * sizeof(ParallelInfo *);
+	usage->others += m_rank_areas.capacity() * sizeof(BBox);
+
+	// 除外三角形IDリスト(自PEと他PE全て)
+	procs.push_back(&m_myproc);
+	procs.insert(procs.end(), m_other_procs.begin(), m_other_procs.end());
+	for (pi = procs.begin(); pi != procs.end(); pi++) {
+		for (ex = (*pi)->m_exclusion_map.begin(); 
+									ex != (*pi)->m_exclusion_map.end(); ex++) {
+			// mapのノード(要素+木構造のポインタ3つと色)とIDの索引
+			size_t size = sizeof(*ex) + sizeof(void *) * 4;
+			size += ex->second.memory_size() - sizeof(TriangleIdIndex);
+			usage->exclusion_lists += size;
+
+			if (group_usage == NULL) continue;
+			PolygonGroup *pg = get_group(ex->first);
+			if (pg != NULL) {
+				(*group_usage)[pg->acq_fullpath()].exclusion_lists += size;
+			}
+		}
+	}
+
+	// migrate用送受信バッファ(容量を残して再利用するので、確保済みの容量)
+	usage->mpi_buffers += m_mig_send_head.capacity() * sizeof(vector<int>);
+	usage->mpi_buffers += m_mig_recv_head.capacity() * sizeof(vector<int>);
+	usage->mpi_buffers += m_mig_send_buf.capacity() * sizeof(vector<char>);
+	usage->mpi_buffers += m_mig_recv_buf.capacity() * sizeof(vector<char>);
+	for (size_t i = 0; i < m_mig_send_head.size(); i++) {
+		usage->mpi_buffers += m_mig_send_head[i].capacity() * sizeof(int);
+	}
+	for (size_t i = 0; i < m_mig_recv_head.size(); i++) {
+		usage->mpi_buffers += m_mig_recv_head[i].capacity() * sizeof(int);
+	}
+	for (size_t i = 0; i < m_mig_send_buf.size(); i++) {
+		usage->mpi_buffers += m_mig_send_buf[i].capacity();
+	}
+	for (size_t i = 0; i < m_mig_recv_buf.size(); i++) {
+		usage->mpi_buffers += m_mig_recv_buf[i].capacity();
+	}
+	usage->mpi_buffers += m_mig_send_reqs.capacity() * sizeof(MPI_Request);
+	usage->mpi_buffers += m_mig_recv_reqs.capacity() * sizeof(MPI_Request);
+
+	return PLSTAT_OK;
+}
+
+
+// protected //////////////////////////////////////////////////////////////////
+MPIPolylib::MPIPolylib() : Polylib()
+{
+	m_mig_active = false;
+}
+
+
+// protected //////////////////////////////////////////////////////////////////
+MPIPolylib::~MPIPolylib()
+{
+	vector<ParallelInfo*>::iterator itr;
+
+	// 全PE領域情報リストを消去
+	for ( itr=m_other_procs.begin(); itr != m_other_procs.end(); itr++ ) {
+		delete *itr;
+	}
+	// 隣接PE領域情報リストについては、m_other_procsの内容と同じインスタンスを保持
+	// するため、上記の処理で消去済。
+}
+
+
+// protected //////////////////////////////////////////////////////////////////
+POLYLIB_STAT
+MPIPolylib::set_parallel_area(
+	float bpos[3], 
+	unsigned int bbsize[3], 
+	unsigned int gcsize[3], 
+	float dx[3]
+)
+{
+	int i;
+	vector<ParallelInfo*>::iterator itr;
+
+	// 設定済みの全PE領域情報リストを消去
+	for ( itr=m_other_procs.begin(); itr != m_other_procs.end(); itr++ ) {
+		delete *itr;
+	}
+	m_other_procs.clear();
+	m_neibour_procs.clear();
+	m_rank_procs.assign( m_numproc, (ParallelInfo*)NULL );
+	m_rank_procs[m_myrank] = &m_myproc;
+
+	float bbsize_f[3], gcsize_f[3];
+	for (i = 0; i < 3; i++) {
+		bbsize_f[i] = (float)bbsize[i];
+		gcsize_f[i] = (float)gcsize[i];
+	}
+
+	Vec3f v_bbsize(bbsize_f[0],bbsize_f[1],bbsize_f[2]);
+	Vec3f v_gcsize(gcsize_f[0],gcsize_f[1],gcsize_f[2]);
+	Vec3f v_bpos(bpos[0],bpos[1],bpos[2]);
+	Vec3f v_dx(dx[0],dx[1],dx[2]);
+
+	// 自PE領域情報を設定
+	m_myproc.m_comm = m_mycomm;
+	m_myproc.m_rank = m_myrank;
+	m_myproc.m_area.m_bpos = v_bpos;
+	m_myproc.m_area.m_bbsize = v_bbsize;
+	m_myproc.m_area.m_gcsize = v_gcsize;
+	m_myproc.m_area.m_dx = dx;
+	m_myproc.m_area.m_gcell_min = v_bpos-( v_gcsize )*v_dx;
+	m_myproc.m_area.m_gcell_max = v_bpos+( v_bbsize+v_gcsize )*v_dx;
+	m_myproc.m_area.m_gcell_bbox.init();
+	m_myproc.m_area.m_gcell_bbox.add(m_myproc.m_area.m_gcell_min);
+	m_myproc.m_area.m_gcell_bbox.add(m_myproc.m_area.m_gcell_max);
+
+#ifdef DEBUG
+	PL_DBGOSH << "(my_rank:" << m_myrank << "):" <<"bpos      :" << v_bpos  << endl;
+	PL_DBGOSH << "(my_rank:" << m_myrank << "):" <<"bbsize    :" << v_bbsize << endl;
+	PL_DBGOSH << "(my_rank:" << m_myrank << "):" <<"gcsize    :" << v_gcsize << endl;
+	PL_DBGOSH << "(my_rank:" << m_myrank << "):" <<"dx        :" << v_dx << endl;
+	PL_DBGOSH << "(my_rank:" << m_myrank << "):" <<"gcell_min :"
+		 << m_myproc.m_area.m_gcell_min << endl;
+	PL_DBGOSH << "(my_rank:" << m_myrank << "):" <<"gcell_max :"
+		 << m_myproc.m_area.m_gcell_max << endl;
+#endif
+
+	// 送信データ作成
+	float send_buf[12];
+	for (i = 0; i < 3; i++) {
+		send_buf[i] = v_bpos[i];
+	}
+	for (i = 0; i < 3; i++) {
+		send_buf[3+i] = v_bbsize[i];
+	}
+	for (i = 0; i < 3; i++) {
+		send_buf[6+i] = v_gcsize[i];
+	}
+	for (i = 0; i < 3; i++) {
+		send_buf[9+i] = v_dx[i];
+	}
+
+	// 受信領域確保
+	float* recv_buf = new float[12 * m_numproc];
+
+	// Allgather通信を行う
+	if (MPI_Allgather(send_buf, 12, MPI_FLOAT, recv_buf, 12, MPI_FLOAT, m_mycomm) != MPI_SUCCESS) {
+		PL_ERROSH << "[ERROR]MPIPolylib::set_parallel_area():MPI_Allgather "
+				  << "faild." << endl;
+		return PLSTAT_MPI_ERROR;
+	}
+
+	// 受信データの展開
+	for (int irank = 0; irank < m_numproc; irank++) {
+		// 自PE領域情報はスキップ
+		if( irank == m_myrank ) continue;
+		for (i = 0; i < 3; i++) {
+			v_bpos[i] = recv_buf[i + 12*irank];
+		}
+		for (i = 0; i < 3; i++) {
+			v_bbsize[i] = recv_buf[3 + i + 12*irank];
+		} 
+		for (i = 0; i < 3; i++) {
+			v_gcsize[i] = recv_buf[6 + i + 12*irank];
+		} 
+		for (i = 0; i < 3; i++) {
+			v_dx[i]	= recv_buf[9 + i + 12*irank];
+		}
+#ifdef DEBUG
+		PL_DBGOSH << "(rank:" << irank << "):" <<"bpos  :" << v_bpos  << endl;
+		PL_DBGOSH << "(rank:" << irank << "):" <<"bbsize:" << v_bbsize << endl;
+		PL_DBGOSH << "(rank:" << irank << "):" <<"gcsize:" << v_gcsize << endl;
+		PL_DBGOSH << "(rank:" << irank << "):" <<"dx    :" << v_dx << endl;
+#endif
+		ParallelInfo* proc = new (ParallelInfo);
+		proc->m_comm = m_mycomm;
+		proc->m_rank = irank;
+		proc->m_area.m_bpos = v_bpos;
+		proc->m_area.m_bbsize = v_bbsize;
+		proc->m_area.m_gcsize = v_gcsize;
+		proc->m_area.m_dx = v_dx;
+		proc->m_area.m_gcell_min = v_bpos-( v_gcsize )*v_dx;
+		proc->m_area.m_gcell_max = v_bpos+( v_bbsize+v_gcsize )*v_dx;
+		proc->m_area.m_gcell_bbox.add(proc->m_area.m_gcell_min);
+		proc->m_area.m_gcell_bbox.add(proc->m_area.m_gcell_max);
+
+		// 全PE領域情報リストに追加
+		m_other_procs.push_back(proc);
+		m_rank_procs[irank] = proc;
+
+		// 自PE領域と隣接するPE領域情報はm_neibour_procsにも追加
+		if( m_myproc.m_area.m_gcell_bbox.crossed(proc->m_area.m_gcell_bbox) ) {
+			m_neibour_procs.push_back(proc);
+#ifdef DEBUG
+		PL_DBGOSH << m_myrank << ": " << "neighbour rank:" << proc->m_rank  << endl;
+#endif
+		}
+	}
+	// 受信領域あとしまつ
+	delete[] recv_buf;
+
+	// 全rankの担当領域(ガイドセルを含まない)をrank番号順に並べる。
+	// 全rankで同じ値となるよう、同じ式で求める
+	m_rank_areas.resize( m_numproc );
+	for (int irank = 0; irank < m_numproc; irank++) {
+		const CalcAreaInfo &area = m_rank_procs[irank]->m_area;
+		m_rank_areas[irank].init();
+		m_rank_areas[irank].add( area.m_bpos );
+		m_rank_areas[irank].add( area.m_bpos + area.m_bbsize * area.m_dx );
+	}
+
+	return PLSTAT_OK;
+}
+
+
+// protected //////////////////////////////////////////////////////////////////
+POLYLIB_STAT
+MPIPolylib::broadcast_config(
+	string config_contents
+)
+{
+#ifdef DEBUG
+	PL_DBGOSH << "MPIPolylib::broadcast_config() in. " << endl;
+#endif
+
 	// 文字数を送信(NULL文字も文字数にカウント）
 	int data = config_contents.size()+1;
 	if (MPI_Bcast( &data, 1, MPI_INT, 0, m_mycomm ) != MPI_SUCCESS) {
@@ -968,13 +2345,231 @@ MPIPolylib::broadcast_config(
 		return PLSTAT_MPI_ERROR;
 	}
 
-	// ファイル内容文字列の送信
-	if (MPI_Bcast( (void*)(config_contents.c_str()), config_contents.size()+1,
-				MPI_CHAR, 0, m_mycomm ) != MPI_SUCCESS) {
-		PL_ERROSH << "[ERROR]MPIPolylib::broadcast_config():MPI_Bcast,"
-				  << "MPI_CHAR faild." << endl;
+	// ファイル内容文字列の送信
+	if (MPI_Bcast( (void*)(config_contents.c_str()), config_contents.size()+1,
+				MPI_CHAR, 0, m_mycomm ) != MPI_SUCCESS) {
+		PL_ERROSH << "[ERROR]MPIPolylib::broadcast_config():MPI_Bcast,"
+				  << "MPI_CHAR faild." << endl;
+		return PLSTAT_MPI_ERROR;
+	}
+
+	return PLSTAT_OK;
+}
+
+
+// protected //////////////////////////////////////////////////////////////////
+POLYLIB_STAT
+MPIPolylib::send_polygons_to_all(
+)
+{
+#ifdef DEBUG
+	PL_DBGOSH << "MPIPolylib::send_polygons_to_all() in. " << endl;
+#endif
+	int rank;
+	vector<PolygonGroup*>::iterator group_itr;
+	PolygonGroup *p_pg;
+	vector<PrivateTriangle*> const *p_trias;
+
+	// rank順に送信データを詰める。PE領域情報はget_proc()でrankから引く
+	// (rank0自身はNULL)
+
+	// 送信データ。rank順に連結し、各rankのレコード数と先頭位置を記録する
+	vector<int>   send_num_trias;
+	vector<char>  send_recs;
+	vector<int>   rec_counts( m_numproc ), rec_displs( m_numproc );
+	int           num_recs = 0;
+
+	// 全PEに対して
+	for( rank=0; rank<m_numproc; rank++ ) {
+		rec_displs[rank] = num_recs;
+
+		// 全グループに対して
+		for (group_itr = m_pg_list.begin(); group_itr != m_pg_list.end(); group_itr++) {
+			p_pg = (*group_itr);
+			p_trias = NULL;
+
+			// ポリゴン情報を持つグループだけ。rank0自身の分は三角形数0とする
+			ParallelInfo *proc = get_proc( rank );
+			if( proc != NULL && p_pg->get_num_triangles() != 0 ) {
+
+				// 当該PE領域内に一部でも含まれるポリゴンを検索
+				p_trias = p_pg->search( &(proc->m_area.m_gcell_bbox), false );
+			}
+
+			// グループIDと当該グループの三角形数の対を送信データに追加
+			pack_num_trias( &send_num_trias, p_pg->get_internal_id(), p_trias );
+
+			// 三角形を送信データに追加
+			pack_tria_recs( &send_recs, p_trias );
+
+			// search結果の後始末
+			if( p_trias ) delete p_trias;
+		}
+
+		rec_counts[rank] = send_recs.size() / sizeof(TriaRec) - num_recs;
+		num_recs += rec_counts[rank];
+
+#ifdef DEBUG
+		PL_DBGOSH << "sending polygons rank:0->rank:" << rank << " ";
+		for( unsigned int i=rank*m_pg_list.size()*2; i<(rank+1)*m_pg_list.size()*2; i+=2 ) {
+			PL_DBGOS << "(gid:" << send_num_trias[i] 
+					 << ",num_tria:" << send_num_trias[i+1] << ")";
+		}
+		PL_DBGOS << endl;
+#endif
+	}
+
+	// 検索で復元した三角形は送信データに複製済みなので解放する
+	for (group_itr = m_pg_list.begin(); group_itr != m_pg_list.end(); group_itr++) {
+		(*group_itr)->release_decoded_triangles();
+	}
+
+	// 全PEへ一括して配信。グループ数は全rank共通なので、グループID,
+	// グループ毎三角形数リストは固定長。受信側はこれから受信サイズを求める
+	if (MPI_Scatter( send_num_trias.empty() ? NULL : &send_num_trias[0],
+		m_pg_list.size() * 2, MPI_INT,
+		MPI_IN_PLACE, m_pg_list.size() * 2, MPI_INT, 0, m_mycomm ) != MPI_SUCCESS) {
+		PL_ERROSH << "[ERROR]MPIPolylib::send_polygons_to_all():MPI_Scatter,"
+				  << "num_trias faild." << endl;
+		return PLSTAT_MPI_ERROR;
+	}
+	MPI_Datatype rec_type;
+	if (commit_rec_type( sizeof(TriaRec), &rec_type ) != MPI_SUCCESS) {
+		PL_ERROSH << "[ERROR]MPIPolylib::send_polygons_to_all():MPI_Type_commit"
+				  << " faild." << endl;
+		return PLSTAT_MPI_ERROR;
+	}
+	int ret = MPI_Scatterv( send_recs.empty() ? NULL : &send_recs[0],
+		&rec_counts[0], &rec_displs[0], rec_type,
+		MPI_IN_PLACE, 0, rec_type, 0, m_mycomm );
+	MPI_Type_free( &rec_type );
+	if (ret != MPI_SUCCESS) {
+		PL_ERROSH << "[ERROR]MPIPolylib::send_polygons_to_all():MPI_Scatterv,"
+				  << "trias faild." << endl;
+		return PLSTAT_MPI_ERROR;
+	}
+	return PLSTAT_OK;
+}
+
+
+// protected //////////////////////////////////////////////////////////////////
+POLYLIB_STAT
+MPIPolylib::pack_num_trias(
+	vector<int>* p_vec,
+	int group_id,
+	const vector<PrivateTriangle*>* p_trias
+)
+{
+#ifdef DEBUG
+	PL_DBGOSH << "MPIPolylib::pack_num_trias() in. " << endl;
+#endif
+	// 出力配列に、グループID、グループ内三角形数、の順に追加
+	int num = 0;
+	if( p_trias ) num = p_trias->size();
+	p_vec->push_back( group_id );
+	p_vec->push_back( num );
+
+	return PLSTAT_OK;
+}
+
+
+// protected //////////////////////////////////////////////////////////////////
+POLYLIB_STAT
+MPIPolylib::erase_outbounded_polygons(
+)
+{
+#ifdef DEBUG
+	PL_DBGOSH << "MPIPolylib::erase_outbounded_polygons() in. " << endl;
+#endif
+	POLYLIB_STAT ret;
+	unsigned int i;
+	vector<PolygonGroup*>::iterator group_itr;
+	vector<PrivateTriangle*> const *p_trias;
+	vector<PrivateTriangle*>  copy_trias;
+	PolygonGroup *p_pg;
+
+	// 各ポリゴングループのポリゴン情報を自領域分のみで再構築
+	// 全グループに対して
+	for (group_itr = m_pg_list.begin(); group_itr != m_pg_list.end(); group_itr++) {
+		p_pg = (*group_itr);
+
+		// ポリゴン情報を持つグループだけ
+		if( p_pg->get_num_triangles() != 0 ) {
+
+			// 自領域内に一部でも含まれるポリゴンを検索
+			p_trias = p_pg->search( &(m_myproc.m_area.m_gcell_bbox), false );
+
+			// 消去するポリゴンがなければ再構築しない(差分保存の変更フラグも
+			// 立てない)。検索で復元した三角形は解放する
+			if( p_trias && (int)p_trias->size() == p_pg->get_num_triangles() ) {
+				delete p_trias;
+				p_pg->release_decoded_triangles();
+				continue;
+			}
+
+			// 検索結果のディープコピーを作成
+			copy_trias.clear();
+			if( p_trias ) {
+				for( i=0; i<p_trias->size(); i++ ) {
+					copy_trias.push_back( new PrivateTriangle(*(p_trias->at(i))) );
+				}
+			}
+
+			// 検索結果でポリゴン情報を再構築
+			if( (ret = p_pg->init( &copy_trias, true )) != PLSTAT_OK ) {
+				PL_ERROSH << "[ERROR]MPIPolylib::erase_outbounded_polygons():p_pg->init() failed. returns:"
+						  << PolylibStat2::String(ret) << endl;
+				return ret;
+			}
+
+			// search結果の後始末
+			if( p_trias ) delete p_trias;
+			for( i=0; i<copy_trias.size(); i++ ) {
+				delete copy_trias.at(i);
+			}
+		}
+	}
+	return PLSTAT_OK;
+}
+
+
+// protected //////////////////////////////////////////////////////////////////
+POLYLIB_STAT
+MPIPolylib::broadcast_config_from_rank0(
+)
+{
+#ifdef DEBUG
+	PL_DBGOSH << "MPIPolylib::broadcast_config_from_rank0() in. " << endl;
+#endif
+	POLYLIB_STAT ret;
+	int str_len;
+	char *p_str;
+	string config_str;
+
+	// 文字数をb_castで受信(NULL文字も文字数に含まれる)
+	if (MPI_Bcast( &str_len, 1, MPI_INT, 0, m_mycomm ) != MPI_SUCCESS) {
+		PL_ERROSH << "[ERROR]MPIPolylib::broadcast_config_from_rank0()"
+				  << ":MPI_Bcast,MPI_INT faild." << endl;
+		return PLSTAT_MPI_ERROR;
+	}
+
+	// XML文字列をb_castで受信
+	p_str = new char[str_len];
+	if (MPI_Bcast( p_str, str_len, MPI_CHAR, 0, m_mycomm ) != MPI_SUCCESS) {
+		PL_ERROSH << "[ERROR]MPIPolylib::broadcast_config_from_rank0()"
+				  << ":MPI_Bcast,MPI_CHAR faild." << endl;
 		return PLSTAT_MPI_ERROR;
 	}
+#ifdef DEBUG
+	PL_DBGOSH << "received config-string:" << p_str << endl;
+#endif
+
+	// XML文字列からグループ階層構造を構築
+	config_str = p_str;
+	if( (ret = make_group_tree( config_str )) != PLSTAT_OK ) {
+		PL_ERROSH << "[ERROR]MPIPolylib::broadcast_config_from_rank0():make_group_tree() faild. returns:" << ret << endl;
+		return ret;
+	}
 
 	return PLSTAT_OK;
 }
@@ -982,401 +2577,786 @@ MPIPolylib::broadcast_config(
 
 // protected //////////////////////////////////////////////////////////////////
 POLYLIB_STAT
-MPIPolylib::send_polygons_to_all(
+MPIPolylib::receive_polygons_from_rank0(
 )
 {
 #ifdef DEBUG
-	PL_DBGOSH << "MPIPolylib::send_polygons_to_all() in. " << endl;
+	PL_DBGOSH << "MPIPolylib::receive_polygons_from_rank0() in. " << endl;
 #endif
-	unsigned int i;
-	vector<ParallelInfo*>::iterator	proc_itr;
-	vector<PolygonGroup*>::iterator group_itr;
-	PolygonGroup *p_pg;
-	vector<PrivateTriangle*> const *p_trias;
-
-	vector<int>   send_num_trias;
-	int          *p_send_num_trias_array;
-	vector<int>   send_tria_ids;
-	int          *p_send_tria_ids_array;
-	vector<float> send_trias;
-	float        *p_send_trias_array;
 
-	// 全PEに対して
-	for (proc_itr = m_other_procs.begin(); proc_itr != m_other_procs.end(); proc_itr++) {
+	unsigned int i, j;
 
-		// 送信用一時データ初期化
-		p_trias = NULL;
-		send_num_trias.clear();
-		send_trias.clear();
-		send_tria_ids.clear();
-		
-		// 全グループに対して
-		for (group_itr = m_pg_list.begin(); group_itr != m_pg_list.end(); group_itr++) {
-			p_pg = (*group_itr);
-			p_trias = NULL;
+	// グループIDとグループ毎三角形数の対をrank0から受信
+	// グループ情報は配信済みなので、グループ数は予め分かっている
+	vector<int> num_trias_array( m_pg_list.size() * 2 + 1 );
+	if (MPI_Scatter( NULL, 0, MPI_INT, &num_trias_array[0], m_pg_list.size() * 2,
+				MPI_INT, 0, m_mycomm ) != MPI_SUCCESS) {
+		PL_ERROSH << "[ERROR]MPIPolylib::receive_polygons_from_rank0()"
+				  << ":MPI_Scatter,num_trias faild." << endl;
+		return PLSTAT_MPI_ERROR;
+	}
+#ifdef DEBUG
+	PL_DBGOSH << "    num_trias:(";
+	for( i=0; i< m_pg_list.size()*2; i++ ) {
+		PL_DBGOS << num_trias_array[i] << ",";
+	}
+	PL_DBGOS << ")" << endl;
+#endif
 
-			// ポリゴン情報を持つグループだけ
-			if( p_pg->get_triangles() != NULL && p_pg->get_triangles()->size() != 0 ) {
+	// 自領域の全三角形数を算出
+	unsigned int total_tria_num = 0;
+	for( i=1; i<m_pg_list.size() * 2; i+=2 ){
+		total_tria_num += num_trias_array[i];
+	}
 
-				// 当該PE領域内に一部でも含まれるポリゴンを検索
-				p_trias = p_pg->search( &((*proc_itr)->m_area.m_gcell_bbox), false );
-			}
+	// 三角形のレコードをrank0から受信
+	vector<char> recs( total_tria_num * sizeof(TriaRec) + 1 );
+	MPI_Datatype rec_type;
+	if (commit_rec_type( sizeof(TriaRec), &rec_type ) != MPI_SUCCESS) {
+		PL_ERROSH << "[ERROR]MPIPolylib::receive_polygons_from_rank0()"
+				  << ":MPI_Type_commit faild." << endl;
+		return PLSTAT_MPI_ERROR;
+	}
+	int ret = MPI_Scatterv( NULL, NULL, NULL, rec_type, &recs[0], total_tria_num,
+				rec_type, 0, m_mycomm );
+	MPI_Type_free( &rec_type );
+	if (ret != MPI_SUCCESS) {
+		PL_ERROSH << "[ERROR]MPIPolylib::receive_polygons_from_rank0()"
+				  << ":MPI_Scatterv,trias faild." << endl;
+		return PLSTAT_MPI_ERROR;
+	}
 
-			// グループIDと当該グループの三角形数の対を送信データに追加
-			pack_num_trias( &send_num_trias, p_pg->get_internal_id(), p_trias );
+	// 各ポリゴングループに対して三角形情報を設定＆KD木構築
+	const char *p_rec = &recs[0];
+	for( i=0; i<m_pg_list.size()*2; i+=2 ){	// 偶数番目の値を処理
 
-			// 三角形情報を送信データに追加
-			pack_trias( &send_trias, p_trias );
+		// ポリゴングループID
+		int pg_id = num_trias_array[i];
 
-			// 三角形ID情報を送信データに追加
-			pack_tria_ids( &send_tria_ids, p_trias );
+		// 当該ポリゴングループの三角形数
+		unsigned int num_trias = num_trias_array[i+1];
 
-			// search結果の後始末
-			if( p_trias ) delete p_trias;
+		// グループIDのポリゴングループインスタンス取得
+		PolygonGroup* p_pg = get_group( pg_id );
+		if( p_pg == NULL ) {
+			PL_ERROSH << "[ERROR]MPIPolylib::receive_polygons_from_rank0():invalid pg_id:"
+					  << pg_id << endl;
+			return PLSTAT_NG;
 		}
 
-		//----  送信データをシリアライズ
-		// 送信データ配列初期化
-		p_send_num_trias_array = NULL;
-		p_send_tria_ids_array  = NULL;
-		p_send_trias_array     = NULL;
- 
-		// グループID,グループ毎三角形数リスト
-		if( send_num_trias.size() > 0 ) {
-			p_send_num_trias_array = new int[ send_num_trias.size() ];
-		}
-		for( i=0; i<send_num_trias.size(); i++ ) {
-			p_send_num_trias_array[i] = send_num_trias[i];
-		}
-		// 三角形IDリスト
-		if( send_tria_ids.size() > 0 ) {
-			p_send_tria_ids_array  = new int[ send_tria_ids.size() ];
+		// 受信したレコードからPrivateTriangleのベクタ生成
+		vector<PrivateTriangle*> tria_vec;
+		p_rec = unpack_tria_recs( p_rec, num_trias, &tria_vec );
+
+		// ポリゴングループに三角形リストを設定、KD木構築
+		POLYLIB_STAT stat = p_pg->init( &tria_vec, true );
+
+		// ベクタの内容あとしまつ
+		for( j=0; j<num_trias; j++ ) {
+			delete tria_vec.at(j);
 		}
-		for( i=0; i<send_tria_ids.size(); i++ ) {
-			p_send_tria_ids_array[i] = send_tria_ids[i];
+		if( stat != PLSTAT_OK ) {
+			PL_ERROSH << "[ERROR]MPIPolylib::receive_polygons_from_rank0():p_pg->init() failed:" << endl;
+			return PLSTAT_NG;
 		}
-		// 三角形頂点座標リスト
-		if( send_trias.size() > 0 ) {
-			p_send_trias_array = new float[ send_trias.size() ];
+	}
+
+#ifdef DEBUG
+	PL_DBGOSH << "MPIPolylib::receive_polygons_from_rank0() out. " << endl;
+#endif
+	return PLSTAT_OK;
+}
+
+
+// protected //////////////////////////////////////////////////////////////////
+POLYLIB_STAT
+MPIPolylib::load_distributed_group(
+	PolygonGroup* p_pg,
+	const vector<BBox>& boxes,
+	float scale
+)
+{
+#ifdef DEBUG
+	PL_DBGOSH << "MPIPolylib::load_distributed_group() in. " << endl;
+#endif
+	POLYLIB_STAT ret = PLSTAT_OK;
+	unsigned int i;
+	map<string, string> fmap = p_pg->get_file_name();
+	map<string, string>::iterator it;
+	if( fmap.empty() ) return PLSTAT_OK;
+
+	bool binary = true;
+	for( it = fmap.begin(); it != fmap.end(); it++ ) {
+		if( it->second != TriMeshIO::FMT_STL_B &&
+			it->second != TriMeshIO::FMT_STL_BB ) binary = false;
+		if( GzipStreamBuf::is_gzip( it->first ) ) binary = false;
+	}
+
+	// アスキーSTL、gzip圧縮ファイルとスナップショットは分割して読めないので、
+	// 各rankが自領域分だけを読み込む
+	if( binary == false ) {
+		ret = p_pg->load_stl_file( scale, &(m_myproc.m_area.m_gcell_bbox) );
+		if( ret == PLSTAT_OK && p_pg->is_snapshot() ) {
+			vector<PrivateTriangle*> const *p_trias;
+			vector<PrivateTriangle*> copy_trias;
+			p_trias = p_pg->search( &(m_myproc.m_area.m_gcell_bbox), false );
+			if( p_trias ) {
+				for( i=0; i<p_trias->size(); i++ ) {
+					copy_trias.push_back( new PrivateTriangle(*(p_trias->at(i))) );
+				}
+				delete p_trias;
+			}
+			ret = p_pg->init( &copy_trias, true );
+			for( i=0; i<copy_trias.size(); i++ ) {
+				delete copy_trias.at(i);
+			}
 		}
-		for( i=0; i<send_trias.size(); i++ ) {
-			p_send_trias_array[i] = send_trias[i];
+		return reduce_stat( ret );
+	}
+
+	// ファイル毎の三角形数をrank0で取得して配信する
+	vector<unsigned int> nums( fmap.size(), 0 );
+	int stat = PLSTAT_OK;
+	if( m_myrank == 0 ) {
+		for( it = fmap.begin(), i = 0; it != fmap.end() && stat == PLSTAT_OK; it++, i++ ) {
+			stat = stl_b_num_trias( it->first, &nums[i] );
 		}
+	}
+	if (MPI_Bcast( &nums[0], nums.size(), MPI_UNSIGNED, 0, m_mycomm ) != MPI_SUCCESS ||
+		MPI_Bcast( &stat, 1, MPI_INT, 0, m_mycomm ) != MPI_SUCCESS) {
+		PL_ERROSH << "[ERROR]MPIPolylib::load_distributed_group():MPI_Bcast"
+				  << " faild." << endl;
+		return PLSTAT_MPI_ERROR;
+	}
+	if( stat != PLSTAT_OK ) return (POLYLIB_STAT)stat;
+
+	// 各ファイルの三角形をrank数で等分し、自rankの担当分を読み込む。
+	// 三角形IDはファイル名順の通番(Polylib::load()と同じ)
+	vector<PrivateTriangle*> trias;
+	int id_base = 0;
+	for( it = fmap.begin(), i = 0; it != fmap.end() && ret == PLSTAT_OK; it++, i++ ) {
+		unsigned int first = (unsigned int)(
+				(unsigned long long)nums[i] * m_myrank / m_numproc );
+		unsigned int last  = (unsigned int)(
+				(unsigned long long)nums[i] * (m_myrank + 1) / m_numproc );
+		ret = stl_b_load_range( &trias, it->first, first, last - first,
+								id_base, scale );
+		id_base += nums[i];
+	}
+
+	if( (ret = reduce_stat( ret )) == PLSTAT_OK ) {
+		ret = exchange_polygons( p_pg, boxes, &trias );
+	}
 
-		// 当該PEへ送信
+	for( i=0; i<trias.size(); i++ ) {
+		delete trias.at(i);
+	}
+	return ret;
+}
+
+
+// protected //////////////////////////////////////////////////////////////////
+POLYLIB_STAT
+MPIPolylib::exchange_polygons(
+	PolygonGroup* p_pg,
+	const vector<BBox>& boxes,
+	const vector<PrivateTriangle*>* p_trias
+)
+{
 #ifdef DEBUG
-		PL_DBGOSH << "sending polygons rank:0->rank:" << (*proc_itr)->m_rank << " ";
-		for( i=0; i< send_num_trias.size(); i+=2 ) {
-			PL_DBGOS << "(gid:" << send_num_trias[i] 
-					 << ",num_tria:" << send_num_trias[i+1] << ")";
-		}
-		PL_DBGOS << endl;
+	PL_DBGOSH << "MPIPolylib::exchange_polygons() in. " << endl;
 #endif
-		if (MPI_Send( p_send_num_trias_array, send_num_trias.size(), MPI_INT,
-			(*proc_itr)->m_rank, MPITAG_NUM_TRIAS, m_mycomm ) != MPI_SUCCESS) {
-			PL_ERROSH << "[ERROR]MPIPolylib::send_polygons_to_all():MPI_Send,"
-					  << "MPITAG_NUM_TRIAS faild." << endl;
-			return PLSTAT_MPI_ERROR;
+	unsigned int i;
+	RankGrid grid( boxes );
+
+	// 三角形毎の送信先rankを求める
+	vector<int> dest;
+	vector<unsigned int> dest_pos( p_trias->size() + 1, 0 );
+	for( i=0; i<p_trias->size(); i++ ) {
+		const Vec3f *v = p_trias->at(i)->get_vertex();
+		BBox bbox;
+		bbox.init();
+		bbox.add( v[0] );
+		bbox.add( v[1] );
+		bbox.add( v[2] );
+		grid.find( bbox, &dest );
+		dest_pos[i+1] = dest.size();
+	}
+
+	// 全対全通信で三角形を配信
+	vector<PrivateTriangle*> tria_vec;
+	POLYLIB_STAT ret = alltoall_polygons( p_trias, dest, dest_pos, &tria_vec );
+	if( ret != PLSTAT_OK ) return ret;
+
+	// m_idが指定されていたら、その値で全三角形のm_exidを更新
+	// (PolygonGroup::load_stl_file()と同じ)
+	if( p_pg->get_id_defined() ) {
+		for( i=0; i<tria_vec.size(); i++ ) {
+			tria_vec.at(i)->set_exid( p_pg->get_id() );
 		}
-		if (MPI_Send( p_send_tria_ids_array,  send_tria_ids.size(),  MPI_INT,
-			(*proc_itr)->m_rank, MPITAG_TRIA_IDS,  m_mycomm ) != MPI_SUCCESS) {
-			PL_ERROSH << "[ERROR]MPIPolylib::send_polygons_to_all():MPI_Send,"
-					  << "MPITAG_TRIA_IDS faild." << endl;
-			return PLSTAT_MPI_ERROR;
+	}
+
+	// ポリゴングループに三角形リストを設定、KD木構築
+	ret = p_pg->init( &tria_vec, true );
+	if( ret != PLSTAT_OK ) {
+		PL_ERROSH << "[ERROR]MPIPolylib::exchange_polygons():p_pg->init() failed."
+				  << " returns:" << PolylibStat2::String(ret) << endl;
+	}
+	for( i=0; i<tria_vec.size(); i++ ) {
+		delete tria_vec.at(i);
+	}
+	return reduce_stat( ret );
+}
+
+
+// protected //////////////////////////////////////////////////////////////////
+POLYLIB_STAT
+MPIPolylib::alltoall_polygons(
+	const vector<PrivateTriangle*>* p_trias,
+	const vector<int>& dest,
+	const vector<unsigned int>& dest_pos,
+	vector<PrivateTriangle*>* p_recv
+)
+{
+	unsigned int i, j;
+	int r;
+
+	// 送信先rank毎の三角形数
+	vector<int> send_num( m_numproc, 0 );
+	for( i=0; i<dest.size(); i++ ) send_num[dest[i]]++;
+
+	// 三角形のレコードを送信先rank順に詰める
+	vector<int> fill( m_numproc, 0 );
+	for( r=1; r<m_numproc; r++ ) fill[r] = fill[r-1] + send_num[r-1];
+	vector<char> send( dest.size() * sizeof(TriaRec) );
+	for( i=0; i<p_trias->size(); i++ ) {
+		for( j=dest_pos[i]; j<dest_pos[i+1]; j++ ) {
+			set_tria_rec( &send[ fill[dest[j]]++ * sizeof(TriaRec) ], p_trias->at(i) );
 		}
-		if (MPI_Send( p_send_trias_array,     send_trias.size(),     MPI_FLOAT,
-			(*proc_itr)->m_rank, MPITAG_TRIAS,     m_mycomm ) != MPI_SUCCESS) {
-			PL_ERROSH << "[ERROR]MPIPolylib::send_polygons_to_all():MPI_Send,"
-					  << "MPITAG_TRIAS faild." << endl;
-			return PLSTAT_MPI_ERROR;
+	}
+
+	// 送受信数を交換してレコードを交換
+	vector<char> recv;
+	vector<int>  recv_num;
+	POLYLIB_STAT ret = alltoall_records( send, send_num, sizeof(TriaRec), &recv, &recv_num );
+	if( ret != PLSTAT_OK ) return ret;
+
+	// 送信元rank順に追加する(load_distributed()では三角形ID順になる)
+	unsigned int total_tria_num = recv.size() / sizeof(TriaRec);
+	if( total_tria_num > 0 ) unpack_tria_recs( &recv[0], total_tria_num, p_recv );
+	return PLSTAT_OK;
+}
+
+
+// protected //////////////////////////////////////////////////////////////////
+POLYLIB_STAT
+MPIPolylib::acq_rank_boxes(
+	const vector<PolygonGroup*>& leaves,
+	vector<BBox>* boxes
+)
+{
+	BBox mybox;
+	mybox.init();
+	vector<PolygonGroup*>::const_iterator it;
+	for( it = leaves.begin(); it != leaves.end(); it++ ) {
+		if( (*it)->get_num_triangles() == 0 ) continue;
+		BBox b = (*it)->get_bbox();
+		mybox.add( b.min );
+		mybox.add( b.max );
+	}
+
+	float send_buf[6] = { mybox.min[0], mybox.min[1], mybox.min[2],
+						  mybox.max[0], mybox.max[1], mybox.max[2] };
+	vector<float> recv_buf( 6 * m_numproc );
+	if (MPI_Allgather( send_buf, 6, MPI_FLOAT, &recv_buf[0], 6, MPI_FLOAT,
+					   m_mycomm ) != MPI_SUCCESS) {
+		PL_ERROSH << "[ERROR]MPIPolylib::acq_rank_boxes():MPI_Allgather faild."
+				  << endl;
+		return PLSTAT_MPI_ERROR;
+	}
+	boxes->resize( m_numproc );
+	for( int r=0; r<m_numproc; r++ ) {
+		(*boxes)[r] = BBox( &recv_buf[r*6], &recv_buf[r*6 + 3] );
+	}
+	return PLSTAT_OK;
+}
+
+
+// protected //////////////////////////////////////////////////////////////////
+POLYLIB_STAT
+MPIPolylib::exchange_queries(
+	int kind,
+	const vector<PolygonGroup*>& leaves,
+	const vector<char>& send,
+	const vector<int>& send_num,
+	vector<char>* replies,
+	vector<int>* reply_num
+)
+{
+	POLYLIB_STAT ret;
+	int r;
+
+	// 問い合わせを送受信
+	vector<char> recv;
+	vector<int> recv_num;
+	if( (ret = alltoall_records( send, send_num, sizeof(QueryRec),
+								 &recv, &recv_num )) != PLSTAT_OK ) {
+		return ret;
+	}
+
+	// 受け取った問い合わせを評価し、送信元rank毎に回答を詰める
+	vector< vector<HitRec> > hits( m_numproc );
+	const QueryRec *q = (const QueryRec*)( recv.empty() ? NULL : &recv[0] );
+	int n = 0;
+	for( r=0; r<m_numproc; r++ ) {
+		for( int j=0; j<recv_num[r]; j++, n++ ) {
+			eval_query( kind, leaves, q[n], &hits[r] );
 		}
+	}
+
+	vector<char> reply_send;
+	vector<int> reply_send_num( m_numproc );
+	for( r=0; r<m_numproc; r++ ) {
+		reply_send_num[r] = hits[r].size();
+		if( hits[r].empty() ) continue;
+		const char *p = (const char*)&hits[r][0];
+		reply_send.insert( reply_send.end(), p, p + hits[r].size() * sizeof(HitRec) );
+	}
+
+	// 回答を送受信
+	return alltoall_records( reply_send, reply_send_num, sizeof(HitRec),
+							 replies, reply_num );
+}
+
+
+// protected //////////////////////////////////////////////////////////////////
+POLYLIB_STAT
+MPIPolylib::alltoall_records(
+	const vector<char>& send,
+	const vector<int>& send_num,
+	int rec_size,
+	vector<char>* recv,
+	vector<int>* recv_num
+)
+{
+	int r;
+
+	// 送受信数を交換
+	recv_num->assign( m_numproc, 0 );
+	if (MPI_Alltoall( (void*)&send_num[0], 1, MPI_INT, &(*recv_num)[0], 1, MPI_INT,
+					  m_mycomm ) != MPI_SUCCESS) {
+		PL_ERROSH << "[ERROR]MPIPolylib::alltoall_records():MPI_Alltoall"
+				  << " faild." << endl;
+		return PLSTAT_MPI_ERROR;
+	}
 
-		// 送信データの後始末
-		if( p_send_num_trias_array ) delete[] p_send_num_trias_array;
-		if( p_send_tria_ids_array )  delete[] p_send_tria_ids_array;
-		if( p_send_trias_array )     delete[] p_send_trias_array;
+	// レコードを交換。送受信数と位置はレコード単位
+	vector<int> send_pos( m_numproc ), recv_pos( m_numproc );
+	int send_total = 0, recv_total = 0;
+	for( r=0; r<m_numproc; r++ ) {
+		send_pos[r] = send_total;
+		send_total += send_num[r];
+		recv_pos[r] = recv_total;
+		recv_total += (*recv_num)[r];
+	}
+	MPI_Datatype rec_type;
+	if (commit_rec_type( rec_size, &rec_type ) != MPI_SUCCESS) {
+		PL_ERROSH << "[ERROR]MPIPolylib::alltoall_records():MPI_Type_commit"
+				  << " faild." << endl;
+		return PLSTAT_MPI_ERROR;
+	}
+	char dummy = 0;
+	char *send_buf = send.empty() ? &dummy : (char*)&send[0];
+	recv->resize( (size_t)recv_total * rec_size + 1 );
+	int ret = MPI_Alltoallv( send_buf, (int*)&send_num[0], &send_pos[0], rec_type,
+					   &(*recv)[0], &(*recv_num)[0], &recv_pos[0], rec_type,
+					   m_mycomm );
+	MPI_Type_free( &rec_type );
+	if (ret != MPI_SUCCESS) {
+		PL_ERROSH << "[ERROR]MPIPolylib::alltoall_records():MPI_Alltoallv"
+				  << " faild." << endl;
+		return PLSTAT_MPI_ERROR;
 	}
+	recv->resize( (size_t)recv_total * rec_size );
 	return PLSTAT_OK;
 }
 
-
 // protected //////////////////////////////////////////////////////////////////
 POLYLIB_STAT
-MPIPolylib::pack_num_trias(
-	vector<int>* p_vec,
-	int group_id,
-	const vector<PrivateTriangle*>* p_trias
+MPIPolylib::load_config_all(
+	std::string config_filename,
+	vector<BBox>* boxes
 )
 {
-#ifdef DEBUG
-	PL_DBGOSH << "MPIPolylib::pack_num_trias() in. " << endl;
-#endif
-	// 出力配列に、グループID、グループ内三角形数、の順に追加
-	int num = 0;
-	if( p_trias ) num = p_trias->size();
-	p_vec->push_back( group_id );
-	p_vec->push_back( num );
+	POLYLIB_STAT ret;
+	try {
+		tp->read(config_filename);
+		ret = make_group_tree(tp);
+	}
+	catch( POLYLIB_STAT e ){
+		ret = e;
+	}
+	if( (ret = reduce_stat( ret )) != PLSTAT_OK ) return ret;
 
+	// 全rankの領域をrank番号順に並べる
+	acq_gcell_boxes( boxes );
 	return PLSTAT_OK;
 }
 
 
 // protected //////////////////////////////////////////////////////////////////
-POLYLIB_STAT
-MPIPolylib::pack_trias(
-	vector<float>* p_vec,
-	const vector<PrivateTriangle*>* p_trias
+void
+MPIPolylib::acq_gcell_boxes(
+	vector<BBox>* boxes
 )
 {
-#ifdef DEBUG
-	PL_DBGOSH << "MPIPolylib::pack_trias() in. " << endl;
-#endif
-	if( p_trias == NULL ) return PLSTAT_OK;
-
-	// 出力配列に、三角形頂点座標を順に追加
-	for( unsigned int i=0; i<p_trias->size(); i++ ) {
-		for( unsigned int j=0; j<3; j++ ) {
-			for( unsigned int k=0; k<3; k++ ) {
-				p_vec->push_back( p_trias->at(i)->get_vertex()[j][k] );
-			}
-		}
+	boxes->assign( m_numproc, BBox() );
+	(*boxes)[m_myrank] = m_myproc.m_area.m_gcell_bbox;
+	vector<ParallelInfo*>::iterator proc_itr;
+	for (proc_itr = m_other_procs.begin(); proc_itr != m_other_procs.end(); proc_itr++) {
+		(*boxes)[(*proc_itr)->m_rank] = (*proc_itr)->m_area.m_gcell_bbox;
 	}
-	return PLSTAT_OK;
 }
 
 
 // protected //////////////////////////////////////////////////////////////////
 POLYLIB_STAT
-MPIPolylib::pack_tria_ids(
-	vector<int>* p_vec,
-	const vector<PrivateTriangle*>* p_trias
+MPIPolylib::load_collective_group(
+	PolygonGroup* p_pg,
+	const vector<BBox>& boxes
 )
 {
 #ifdef DEBUG
-	PL_DBGOSH << "MPIPolylib::pack_tria_ids() in. " << endl;
+	PL_DBGOSH << "MPIPolylib::load_collective_group() in. " << endl;
 #endif
-	if( p_trias == NULL ) return PLSTAT_OK;
+	unsigned int i;
+	map<string, string> fmap = p_pg->get_file_name();
+	if( fmap.empty() ) return PLSTAT_OK;
+
+	// 一つの非圧縮バイナリSTLファイルでなければload_distributed()と同じ
+	string stl_fname = fmap.begin()->first;
+	if( fmap.size() != 1 ||
+		(fmap.begin()->second != TriMeshIO::FMT_STL_B &&
+		 fmap.begin()->second != TriMeshIO::FMT_STL_BB) ||
+		GzipStreamBuf::is_gzip( stl_fname ) ) {
+		return load_distributed_group( p_pg, boxes, 1.0 );
+	}
+
+	// IDファイル名はSTLファイルの拡張子をidに替えたもの
+	string id_fname = stl_fname;
+	string::size_type pos = id_fname.find_last_of(".");
+	if( pos != string::npos ) id_fname.erase( pos );
+	id_fname += ".id";
 
-	// 出力配列に、三角形IDを順に追加
-	for( unsigned int i=0; i<p_trias->size(); i++ ) {
-		p_vec->push_back( p_trias->at(i)->get_id() );
+	// rank0がヘッダの三角形数とIDファイルの有無を取得して配信する
+	unsigned int info[3] = { PLSTAT_OK, 0, 0 };
+	if( m_myrank == 0 ) {
+		info[0] = stl_b_num_trias( stl_fname, &info[1] );
+		info[2] = access( id_fname.c_str(), R_OK ) == 0 ? 1 : 0;
 	}
-	return PLSTAT_OK;
+	if (MPI_Bcast( info, 3, MPI_UNSIGNED, 0, m_mycomm ) != MPI_SUCCESS) {
+		PL_ERROSH << "[ERROR]MPIPolylib::load_collective_group():MPI_Bcast"
+				  << " faild." << endl;
+		return PLSTAT_MPI_ERROR;
+	}
+	if( info[0] != PLSTAT_OK ) return (POLYLIB_STAT)info[0];
+
+	// 三角形をrank数で等分し、自rankの担当分を読み込む
+	unsigned int num = info[1];
+	unsigned int first = (unsigned int)(
+			(unsigned long long)num * m_myrank / m_numproc );
+	unsigned int last  = (unsigned int)(
+			(unsigned long long)num * (m_myrank + 1) / m_numproc );
+	unsigned int n = last - first;
+
+	vector<char> recs( (size_t)n * STL_B_RECORD_SIZE + 1 );
+	POLYLIB_STAT ret = read_shared_file( stl_fname,
+			STL_B_HEADER_SIZE + (MPI_Offset)first * STL_B_RECORD_SIZE,
+			&recs[0], n, STL_B_RECORD_SIZE );
+	if( ret != PLSTAT_OK ) return ret;
+
+	vector<int> ids( n + 1 );
+	if( info[2] ) {
+		ret = read_shared_file( id_fname, (MPI_Offset)first * sizeof(int),
+								(char*)&ids[0], n, sizeof(int) );
+		if( ret != PLSTAT_OK ) return ret;
+	}
+
+	// IDファイルがなければファイル内の通番をIDとする
+	vector<PrivateTriangle*> trias;
+	stl_b_get_records( &trias, &recs[0], n, (int)first,
+					   info[2] ? &ids[0] : NULL );
+	vector<char>().swap( recs );
+
+	ret = exchange_polygons( p_pg, boxes, &trias );
+	for( i=0; i<trias.size(); i++ ) {
+		delete trias.at(i);
+	}
+	return ret;
 }
 
 
 // protected //////////////////////////////////////////////////////////////////
 POLYLIB_STAT
-MPIPolylib::erase_outbounded_polygons(
+MPIPolylib::save_collective_group(
+	PolygonGroup* p_pg,
+	const string& stl_fname,
+	const string& id_fname,
+	bool* written
 )
 {
 #ifdef DEBUG
-	PL_DBGOSH << "MPIPolylib::erase_outbounded_polygons() in. " << endl;
+	PL_DBGOSH << "MPIPolylib::save_collective_group() in. " << endl;
 #endif
-	POLYLIB_STAT ret;
 	unsigned int i;
-	vector<PolygonGroup*>::iterator group_itr;
-	vector<PrivateTriangle*> const *p_trias;
-	vector<PrivateTriangle*>  copy_trias;
-	PolygonGroup *p_pg;
+	*written = false;
+
+	// ガイドセル領域の三角形を除き、自rankが所有する三角形だけを書き出す。
+	// 量子化している場合も復元した三角形を保持しないように、先にレコードを作る
+	vector<PrivateTriangle*> *p_trias = p_pg->acquire_triangles();
+	vector<PrivateTriangle*> owned;
+	for( i=0; i<p_trias->size(); i++ ) {
+		if( p_trias->at(i)->is_owned() ) owned.push_back( p_trias->at(i) );
+	}
+	vector<char> recs( owned.size() * STL_B_RECORD_SIZE + 1 );
+	stl_b_put_records( &recs[0], &owned );
+	vector<int> ids( owned.size() + 1 );
+	for( i=0; i<owned.size(); i++ ) ids[i] = owned[i]->get_id();
+	p_pg->release_triangles( p_trias );
+
+	// 書き込み位置(三角形番号)を排他的スキャンで求める
+	unsigned long long num = owned.size(), first = 0, total = 0;
+	if (MPI_Exscan( &num, &first, 1, MPI_UNSIGNED_LONG_LONG, MPI_SUM,
+					m_mycomm ) != MPI_SUCCESS ||
+		MPI_Allreduce( &num, &total, 1, MPI_UNSIGNED_LONG_LONG, MPI_SUM,
+					   m_mycomm ) != MPI_SUCCESS) {
+		PL_ERROSH << "[ERROR]MPIPolylib::save_collective_group():"
+				  << "MPI_Exscan/MPI_Allreduce faild." << endl;
+		return PLSTAT_MPI_ERROR;
+	}
+	// MPI_Exscanはrank0の受信値を設定しない
+	if( m_myrank == 0 ) first = 0;
+
+	// ポリゴンがなければファイル出力不要(Polylib::save()と同じ)
+	if( total == 0 ) return PLSTAT_OK;
+	if( total > 0xffffffffULL ) {
+		PL_ERROSH << "[ERROR]MPIPolylib::save_collective_group():Too many "
+				  << "triangles for STL binary:" << total << endl;
+		return PLSTAT_NG;
+	}
 
-	// 各ポリゴングループのポリゴン情報を自領域分のみで再構築
-	// 全グループに対して
-	for (group_itr = m_pg_list.begin(); group_itr != m_pg_list.end(); group_itr++) {
-		p_pg = (*group_itr);
+	char head[STL_B_HEADER_SIZE];
+	stl_b_put_header( head, (unsigned int)total );
 
-		// ポリゴン情報を持つグループだけ
-		if( p_pg->get_triangles() != NULL && p_pg->get_triangles()->size() != 0 ) {
+	POLYLIB_STAT ret = write_shared_file( stl_fname, head, STL_B_HEADER_SIZE,
+			STL_B_HEADER_SIZE + (MPI_Offset)first * STL_B_RECORD_SIZE,
+			&recs[0], (int)num, STL_B_RECORD_SIZE );
+	if( ret != PLSTAT_OK ) return ret;
+	ret = write_shared_file( id_fname, NULL, 0, (MPI_Offset)first * sizeof(int),
+							 (char*)&ids[0], (int)num, sizeof(int) );
+	if( ret != PLSTAT_OK ) return ret;
 
-			// 自領域内に一部でも含まれるポリゴンを検索
-			p_trias = p_pg->search( &(m_myproc.m_area.m_gcell_bbox), false );
+	*written = true;
+	return PLSTAT_OK;
+}
 
-			// 検索結果のディープコピーを作成
-			copy_trias.clear();
-			if( p_trias ) {
-				for( i=0; i<p_trias->size(); i++ ) {
-					copy_trias.push_back( new PrivateTriangle(*(p_trias->at(i))) );
-				}
-			}
 
-			// 検索結果でポリゴン情報を再構築
-			if( (ret = p_pg->init( &copy_trias, true )) != PLSTAT_OK ) {
-				PL_ERROSH << "[ERROR]MPIPolylib::erase_outbounded_polygons():p_pg->init() failed. returns:"
-						  << PolylibStat2::String(ret) << endl;
-				return ret;
+// protected //////////////////////////////////////////////////////////////////
+void
+MPIPolylib::select_owned_trias(
+	const vector<PrivateTriangle*>* p_trias,
+	vector<PrivateTriangle*>* owned
+)
+{
+	unsigned int i;
+	int r;
+
+	// 全rankの担当領域はset_parallel_area()で求めたものを使う
+	const vector<BBox> &areas = m_rank_areas;
+
+	// 重心が自rankのガイドセル領域内にあれば、重心を含む担当領域は自rankか
+	// 隣接rankのものなので、それらだけをrank番号順に調べる
+	vector<int> cand;
+	cand.push_back( m_myrank );
+	for( i=0; i<m_neibour_procs.size(); i++ ) {
+		cand.push_back( m_neibour_procs[i]->m_rank );
+	}
+	sort( cand.begin(), cand.end() );
+
+	for( i=0; i<p_trias->size(); i++ ) {
+		const Vec3f *v = p_trias->at(i)->get_vertex();
+		Vec3f c = ( v[0] + v[1] + v[2] ) / 3.0f;
+
+		int owner = -1;
+		for( unsigned int j=0; j<cand.size(); j++ ) {
+			if( areas[cand[j]].contain( c ) ) {
+				owner = cand[j];
+				break;
 			}
+		}
 
-			// search結果の後始末
-			if( p_trias ) delete p_trias;
-			for( i=0; i<copy_trias.size(); i++ ) {
-				delete copy_trias.at(i);
+		// どの担当領域にも含まれなければ(計算領域外、領域間の隙間)、
+		// 三角形を持つrank(ガイドセル領域が三角形と交差するrank)のうち、
+		// 担当領域が最も近いrankとする
+		if( owner < 0 ) {
+			BBox tbox;
+			tbox.init();
+			tbox.add( v[0] );
+			tbox.add( v[1] );
+			tbox.add( v[2] );
+			float min_dist = 0.0;
+			for( r=0; r<m_numproc; r++ ) {
+				const ParallelInfo *proc = m_rank_procs[r];
+				if( r != m_myrank && !proc->m_area.m_gcell_bbox.crossed( tbox ) ) continue;
+				float dist = 0.0;
+				for( int k=0; k<3; k++ ) {
+					float d = 0.0;
+					if( c[k] < areas[r].min[k] )		d = areas[r].min[k] - c[k];
+					else if( c[k] > areas[r].max[k] )	d = c[k] - areas[r].max[k];
+					dist += d * d;
+				}
+				if( owner < 0 || dist < min_dist ) {
+					owner = r;
+					min_dist = dist;
+				}
 			}
 		}
+
+		if( owner == m_myrank ) owned->push_back( p_trias->at(i) );
 	}
-	return PLSTAT_OK;
 }
 
 
 // protected //////////////////////////////////////////////////////////////////
-POLYLIB_STAT
-MPIPolylib::broadcast_config_from_rank0(
+void
+MPIPolylib::update_ownership(
 )
 {
 #ifdef DEBUG
-	PL_DBGOSH << "MPIPolylib::broadcast_config_from_rank0() in. " << endl;
+	PL_DBGOSH << "MPIPolylib::update_ownership() in. " << endl;
 #endif
-	POLYLIB_STAT ret;
-	int str_len;
-	char *p_str;
-	string config_str;
+	unsigned int i;
+	vector<PolygonGroup*>::iterator group_itr;
 
-	// 文字数をb_castで受信(NULL文字も文字数に含まれる)
-	if (MPI_Bcast( &str_len, 1, MPI_INT, 0, m_mycomm ) != MPI_SUCCESS) {
-		PL_ERROSH << "[ERROR]MPIPolylib::broadcast_config_from_rank0()"
-				  << ":MPI_Bcast,MPI_INT faild." << endl;
-		return PLSTAT_MPI_ERROR;
+	for (group_itr = m_pg_list.begin(); group_itr != m_pg_list.end(); group_itr++) {
+		if( (*group_itr)->get_children().empty() == false ) continue;
+
+		// 量子化している場合も三角形を復元して保持しないように、所有フラグは
+		// インデックスで設定する。ownedはp_triasと同じ順序で並ぶ
+		vector<PrivateTriangle*> *p_trias = (*group_itr)->acquire_triangles();
+		if( p_trias == NULL ) continue;
+
+		vector<PrivateTriangle*> owned;
+		select_owned_trias( p_trias, &owned );
+		unsigned int j = 0;
+		for( i=0; i<p_trias->size(); i++ ) {
+			bool is_owned = ( j < owned.size() && owned[j] == p_trias->at(i) );
+			if( is_owned ) j++;
+			(*group_itr)->set_triangle_owned( i, is_owned );
+		}
+		(*group_itr)->release_triangles( p_trias );
 	}
+}
 
-	// XML文字列をb_castで受信
-	p_str = new char[str_len];
-	if (MPI_Bcast( p_str, str_len, MPI_CHAR, 0, m_mycomm ) != MPI_SUCCESS) {
-		PL_ERROSH << "[ERROR]MPIPolylib::broadcast_config_from_rank0()"
-				  << ":MPI_Bcast,MPI_CHAR faild." << endl;
+
+// protected //////////////////////////////////////////////////////////////////
+POLYLIB_STAT
+MPIPolylib::write_shared_file(
+	const string& fname,
+	const char* head,
+	int head_len,
+	MPI_Offset offset,
+	const char* data,
+	int num,
+	int rec_len
+)
+{
+	MPI_File fh;
+	if (MPI_File_open( m_mycomm, const_cast<char*>(fname.c_str()),
+					   MPI_MODE_WRONLY | MPI_MODE_CREATE, MPI_INFO_NULL,
+					   &fh ) != MPI_SUCCESS) {
+		PL_ERROSH << "[ERROR]MPIPolylib::write_shared_file():Can't open "
+				  << fname << endl;
 		return PLSTAT_MPI_ERROR;
 	}
-#ifdef DEBUG
-	PL_DBGOSH << "received config-string:" << p_str << endl;
-#endif
 
-	// XML文字列からグループ階層構造を構築
-	config_str = p_str;
-	if( (ret = make_group_tree( config_str )) != PLSTAT_OK ) {
-		PL_ERROSH << "[ERROR]MPIPolylib::broadcast_config_from_rank0():make_group_tree() faild. returns:" << ret << endl;
-		return ret;
+	// 集団操作は全rankで呼び出す。前回のファイルより短い場合に備えて切り詰める
+	bool ok = MPI_File_set_size( fh, 0 ) == MPI_SUCCESS;
+	if( m_myrank == 0 && head_len > 0 ) {
+		ok = MPI_File_write_at( fh, 0, const_cast<char*>(head), head_len,
+								MPI_BYTE, MPI_STATUS_IGNORE ) == MPI_SUCCESS && ok;
 	}
 
-	return PLSTAT_OK;
+	MPI_Datatype rec_type;
+	MPI_Type_contiguous( rec_len, MPI_BYTE, &rec_type );
+	MPI_Type_commit( &rec_type );
+	ok = MPI_File_write_at_all( fh, offset, const_cast<char*>(data), num,
+								rec_type, MPI_STATUS_IGNORE ) == MPI_SUCCESS && ok;
+	MPI_Type_free( &rec_type );
+	ok = MPI_File_close( &fh ) == MPI_SUCCESS && ok;
+
+	if( !ok ) {
+		PL_ERROSH << "[ERROR]MPIPolylib::write_shared_file():Error in saving: "
+				  << fname << endl;
+	}
+	return reduce_stat( ok ? PLSTAT_OK : PLSTAT_MPI_ERROR );
 }
 
 
 // protected //////////////////////////////////////////////////////////////////
 POLYLIB_STAT
-MPIPolylib::receive_polygons_from_rank0(
+MPIPolylib::read_shared_file(
+	const string& fname,
+	MPI_Offset offset,
+	char* data,
+	int num,
+	int rec_len
 )
 {
-#ifdef DEBUG
-	PL_DBGOSH << "MPIPolylib::receive_polygons_from_rank0() in. " << endl;
-#endif
-
-	unsigned int i, j;
-	unsigned int pos_id, pos_tria;
-	MPI_Status mpi_stat;
-
-	// グループIDとグループ毎三角形数の対をrank0から受信
-	// グループ情報は配信済みなので、グループ数は予め分かっている
-	int *p_intarray = new int[ m_pg_list.size() * 2 ];
-	if (MPI_Recv( p_intarray, m_pg_list.size() * 2, MPI_INT, 0, 
-				MPITAG_NUM_TRIAS, m_mycomm, &mpi_stat ) != MPI_SUCCESS) {
-		PL_ERROSH << "[ERROR]MPIPolylib::receive_polygons_from_rank0()"
-				  << ":MPI_Recv,MPITAG_NUM_TRIAS faild." << endl;
+	MPI_File fh;
+	if (MPI_File_open( m_mycomm, const_cast<char*>(fname.c_str()),
+					   MPI_MODE_RDONLY, MPI_INFO_NULL, &fh ) != MPI_SUCCESS) {
+		PL_ERROSH << "[ERROR]MPIPolylib::read_shared_file():Can't open "
+				  << fname << endl;
 		return PLSTAT_MPI_ERROR;
 	}
-#ifdef DEBUG
-	PL_DBGOSH << "    pintarray:(";
-	for( i=0; i< m_pg_list.size()*2; i++ ) {
-		PL_DBGOS << p_intarray[i] << ",";
-	}
-	PL_DBGOS << ")" << endl;
-#endif
 
-	// 自領域の全三角形数を算出
-	unsigned int total_tria_num = 0;
-	for( i=1; i<m_pg_list.size() * 2; i+=2 ){
-		total_tria_num += p_intarray[i];
+	// ファイルが短ければ読み込んだレコード数が足りない
+	MPI_Datatype rec_type;
+	MPI_Status status;
+	int count = 0;
+	MPI_Type_contiguous( rec_len, MPI_BYTE, &rec_type );
+	MPI_Type_commit( &rec_type );
+	bool ok = MPI_File_read_at_all( fh, offset, data, num, rec_type,
+									&status ) == MPI_SUCCESS &&
+			  MPI_Get_count( &status, rec_type, &count ) == MPI_SUCCESS &&
+			  count == num;
+	MPI_Type_free( &rec_type );
+	ok = MPI_File_close( &fh ) == MPI_SUCCESS && ok;
+
+	if( !ok ) {
+		PL_ERROSH << "[ERROR]MPIPolylib::read_shared_file():Error in loading: "
+				  << fname << endl;
 	}
+	return reduce_stat( ok ? PLSTAT_OK : PLSTAT_STL_IO_ERROR );
+}
 
-	// 三角形IDリストをrank0から受信
-	int *p_idarray = new int[ total_tria_num ];
-	if (MPI_Recv( p_idarray,  total_tria_num, MPI_INT, 0, 
-				MPITAG_TRIA_IDS, m_mycomm, &mpi_stat ) != MPI_SUCCESS) {
-		PL_ERROSH << "[ERROR]MPIPolylib::receive_polygons_from_rank0()"
-				  << ":MPI_Recv,MPITAG_TRIA_IDS faild." << endl;
-		return PLSTAT_MPI_ERROR;
-	}
-#ifdef DEBUG
-	PL_DBGOSH << "    pidarray:(";
-	for( i=0; i<total_tria_num; i++ ) {
-		PL_DBGOS << p_idarray[i] << ",";
-	}
-	PL_DBGOS << ")" << endl;
-#endif
 
-	// 三角形リストをrank0から受信
-	float *p_triaarray = new float[ total_tria_num * 3 * 3 ];
-	if (MPI_Recv( p_triaarray, total_tria_num * 3 * 3, MPI_FLOAT, 0, 
-				MPITAG_TRIAS, m_mycomm, &mpi_stat ) != MPI_SUCCESS) {
-		PL_ERROSH << "[ERROR]MPIPolylib::receive_polygons_from_rank0()"
-				  << ":MPI_Recv,MPITAG_TRIAS faild." << endl;
+// protected //////////////////////////////////////////////////////////////////
+POLYLIB_STAT
+MPIPolylib::reduce_stat(
+	POLYLIB_STAT ret
+)
+{
+	int stat = ret;
+	int all_stat = PLSTAT_OK;
+	if (MPI_Allreduce( &stat, &all_stat, 1, MPI_INT, MPI_MAX, m_mycomm )
+		!= MPI_SUCCESS) {
+		PL_ERROSH << "[ERROR]MPIPolylib::reduce_stat():MPI_Allreduce faild."
+				  << endl;
 		return PLSTAT_MPI_ERROR;
 	}
-#ifdef DEBUG
-	PL_DBGOSH << "    ptriaarray:(";
-	for( i=0; i<total_tria_num*3*3; i++ ) {
-		PL_DBGOS << p_triaarray[i] << ",";
-	}
-	PL_DBGOS << ")" << endl;
-#endif
-
-	// 各ポリゴングループに対して三角形情報を設定＆KD木構築
-	pos_id = 0;
-	pos_tria = 0;
-	for( i=0; i<m_pg_list.size()*2-1; i+=2 ){	// 偶数番目の値を処理
-
-		// ポリゴングループID
-		int pg_id = p_intarray[i];
-
-		// 当該ポリゴングループの三角形数
-		unsigned int num_trias = p_intarray[i+1];
-
-		// グループIDのポリゴングループインスタンス取得
-		PolygonGroup* p_pg = get_group( pg_id );
-		if( p_pg == NULL ) {
-			PL_ERROSH << "[ERROR]MPIPolylib::receive_polygons_from_rank0():invalid pg_id:"
-					  << pg_id << endl;
-			return PLSTAT_NG;
-		}
-
-		// PrivateTriangleのベクタ生成
-		vector<PrivateTriangle*> tria_vec;
-
-		// ベクタに受信データ内容を設定
-		for( j=0; j<num_trias; j++ ) {
-			tria_vec.push_back( new PrivateTriangle(&p_triaarray[pos_tria], p_idarray[pos_id]) );
-			pos_id++;
-			pos_tria+=9;
-		}
-
-		// ポリゴングループに三角形リストを設定、KD木構築
-		if( p_pg->init( &tria_vec, true ) != PLSTAT_OK ) {
-			PL_ERROSH << "[ERROR]MPIPolylib::receive_polygons_from_rank0():p_pg->init() failed:" << endl;
-			return PLSTAT_NG;
-		}
-
-		// ベクタの内容あとしまつ
-		for( j=0; j<num_trias; j++ ) {
-			delete tria_vec.at(j);
-		}
-	}
-
-	// 受信領域あとしまつ
-	delete[] p_intarray;
-	delete[] p_idarray;
-	delete[] p_triaarray;
-
-#ifdef DEBUG
-	PL_DBGOSH << "MPIPolylib::receive_polygons_from_rank0() out. " << endl;
-#endif
-	return PLSTAT_OK;
+	return (POLYLIB_STAT)all_stat;
 }
 
 
@@ -1392,59 +3372,66 @@ MPIPolylib::gather_polygons(
 	POLYLIB_STAT ret;
 	unsigned int i, j;
 	int rank;
-	unsigned int pos_id, pos_tria;
-	MPI_Status mpi_stat;
-
-	// 全rankからポリゴン情報を受信
-	for( rank=1; rank<m_numproc; rank++ ) {
-
-		// グループIDとグループ毎三角形数の対を受信
-		// グループ情報は全rank共通なので、グループ数は予め分かっている
-		int *p_intarray = new int[ m_pg_list.size() * 2 ];
-		if (MPI_Recv( p_intarray, m_pg_list.size() * 2, MPI_INT, rank, 
-					MPITAG_NUM_TRIAS, m_mycomm, &mpi_stat ) != MPI_SUCCESS) {
-			PL_ERROSH << "[ERROR]MPIPolylib::gather_polygons()"
-					  << ":MPI_Recv,MPITAG_NUM_TRIAS faild.:rank=" << rank 
-					  << endl;
-			return PLSTAT_MPI_ERROR;
-		}
+	vector<PolygonGroup*>::iterator group_itr;
 
-		// 受信する全三角形数を算出
-		unsigned int total_tria_num = 0;
-		for( i=1; i<m_pg_list.size() * 2; i+=2 ){
-			total_tria_num += p_intarray[i];
-		}
+	// グループIDとグループ毎三角形数の対を全rankから一括して受信
+	// グループ情報は全rank共通なので、グループ数は予め分かっている
+	// rank0自身の分は三角形数0として受信領域に設定しておく
+	unsigned int num_pairs = m_pg_list.size() * 2;
+	vector<int> num_trias_array;
+	for (group_itr = m_pg_list.begin(); group_itr != m_pg_list.end(); group_itr++) {
+		pack_num_trias( &num_trias_array, (*group_itr)->get_internal_id(), NULL );
+	}
+	num_trias_array.resize( num_pairs * m_numproc );
+	if (MPI_Gather( MPI_IN_PLACE, num_pairs, MPI_INT,
+				num_trias_array.empty() ? NULL : &num_trias_array[0], num_pairs, MPI_INT,
+				0, m_mycomm ) != MPI_SUCCESS) {
+		PL_ERROSH << "[ERROR]MPIPolylib::gather_polygons()"
+				  << ":MPI_Gather,num_trias faild." << endl;
+		return PLSTAT_MPI_ERROR;
+	}
 
-		// 三角形IDリストを受信
-		int *p_idarray = new int[ total_tria_num ];
-		if (MPI_Recv( p_idarray,  total_tria_num, MPI_INT, rank, 
-					MPITAG_TRIA_IDS, m_mycomm, &mpi_stat ) != MPI_SUCCESS) {
-			PL_ERROSH << "[ERROR]MPIPolylib::gather_polygons()"
-					  << ":MPI_Recv,MPITAG_TRIA_IDS faild.:rank=" << rank 
-					  << endl;
-			return PLSTAT_MPI_ERROR;
+	// rank毎の三角形数から受信位置を算出
+	vector<int> rec_counts( m_numproc ), rec_displs( m_numproc );
+	unsigned int total_tria_num = 0;
+	for( rank=0; rank<m_numproc; rank++ ) {
+		rec_counts[rank] = 0;
+		for( i=1; i<num_pairs; i+=2 ){
+			rec_counts[rank] += num_trias_array[rank*num_pairs + i];
 		}
+		rec_displs[rank] = total_tria_num;
+		total_tria_num += rec_counts[rank];
+	}
 
-		// 三角形リストを受信
-		float *p_triaarray = new float[ total_tria_num * 3 * 3 ];
-		if (MPI_Recv( p_triaarray, total_tria_num * 3 * 3, MPI_FLOAT, rank, 
-					MPITAG_TRIAS, m_mycomm, &mpi_stat ) != MPI_SUCCESS) {
-			PL_ERROSH << "[ERROR]MPIPolylib::gather_polygons()"
-					  << ":MPI_Recv,MPITAG_TRIA_IDS faild.:rank=" << rank 
-					  << endl;
-			return PLSTAT_MPI_ERROR;
-		}
+	// 三角形のレコードを全rankから受信
+	vector<char> recs( total_tria_num * sizeof(TriaRec) + 1 );
+	MPI_Datatype rec_type;
+	if (commit_rec_type( sizeof(TriaRec), &rec_type ) != MPI_SUCCESS) {
+		PL_ERROSH << "[ERROR]MPIPolylib::gather_polygons()"
+				  << ":MPI_Type_commit faild." << endl;
+		return PLSTAT_MPI_ERROR;
+	}
+	int mpi_ret = MPI_Gatherv( MPI_IN_PLACE, 0, rec_type,
+				&recs[0], &rec_counts[0], &rec_displs[0], rec_type, 0, m_mycomm );
+	MPI_Type_free( &rec_type );
+	if (mpi_ret != MPI_SUCCESS) {
+		PL_ERROSH << "[ERROR]MPIPolylib::gather_polygons()"
+				  << ":MPI_Gatherv,trias faild." << endl;
+		return PLSTAT_MPI_ERROR;
+	}
 
-		// 各ポリゴングループに対して受信した三角形情報を追加
-		pos_id = 0;
-		pos_tria = 0;
-		for( i=0; i<m_pg_list.size() * 2; i++ ){
+	// 各ポリゴングループに対して受信した三角形情報を追加
+	const char *p_rec = &recs[0];
+	vector<bool> received( m_pg_list.size(), false );
+	for( rank=1; rank<m_numproc; rank++ ) {
+		for( i=0; i<num_pairs; i+=2 ){
 
 			// ポリゴングループID
-			int pg_id = p_intarray[i];
+			int pg_id = num_trias_array[rank*num_pairs + i];
 
 			// 当該ポリゴングループの三角形数
-			unsigned int num_trias = p_intarray[i+1];
+			unsigned int num_trias = num_trias_array[rank*num_pairs + i + 1];
+			if( num_trias > 0 ) received[i/2] = true;
 
 			// グループIDのポリゴングループインスタンス取得
 			PolygonGroup* p_pg = get_group( pg_id );
@@ -1454,35 +3441,26 @@ MPIPolylib::gather_polygons(
 				return PLSTAT_NG;
 			}
 
-			// PrivateTriangleのベクタ生成
+			// 受信したレコードから三角形を作り、他rankが所有する三角形として
+			// 複製せずにポリゴングループへ渡す
 			vector<PrivateTriangle*> tria_vec;
-
-			// ベクタに受信データ内容を設定
+			p_rec = unpack_tria_recs( p_rec, num_trias, &tria_vec );
 			for( j=0; j<num_trias; j++ ) {
-				tria_vec.push_back( new PrivateTriangle(&p_triaarray[pos_tria], p_idarray[pos_id]) );
-				pos_id++;
-				pos_tria+=9;
+				tria_vec[j]->set_owned( false );
 			}
-
-			// ポリゴングループに三角形リストを追加
-			if( (ret = p_pg->add_triangles( &tria_vec )) != PLSTAT_OK ) {
-				PL_ERROSH << "[ERROR]MPIPolylib::gather_polygons():p_pg->init() failed. returns:" << PolylibStat2::String(ret) << endl;
+			if( (ret = p_pg->adopt_triangles( &tria_vec )) != PLSTAT_OK ) {
+				PL_ERROSH << "[ERROR]MPIPolylib::gather_polygons():p_pg->adopt_triangles() failed. returns:" << PolylibStat2::String(ret) << endl;
+				for( j=0; j<tria_vec.size(); j++ ) {
+					delete tria_vec.at(j);
+				}
 				return ret;
 			}
-
-			// ベクタの内容あとしまつ
-			for( j=0; j<num_trias; j++ ) {
-				delete tria_vec.at(j);
-			}
-
-			// 次のポリゴングループID位置へ
-			i++;
 		}
+	}
 
-		// 受信領域あとしまつ
-		if( p_intarray != NULL )  delete[] p_intarray;
-		if( p_idarray != NULL )   delete[] p_idarray;
-		if( p_triaarray != NULL ) delete[] p_triaarray;
+	// 受信した三角形は末尾に追加されるので、保存するグループをID順に並べる
+	for( i=0; i<m_pg_list.size(); i++ ) {
+		if( received[i] ) m_pg_list[i]->sort_triangles_by_id();
 	}
 
 	return PLSTAT_OK;
@@ -1497,95 +3475,71 @@ MPIPolylib::send_polygons_to_rank0(
 #ifdef DEBUG
 	PL_DBGOSH << "MPIPolylib::send_polygons_to_rank0() in. " << endl;
 #endif
-	unsigned int i;
 	vector<PolygonGroup*>::iterator group_itr;
 	PolygonGroup *p_pg;
-	vector<PrivateTriangle*> const *p_trias;
+	vector<PrivateTriangle*> *p_trias;
+	vector<PrivateTriangle*> owned;
 
 	vector<int>   send_num_trias;
-	int          *p_send_num_trias_array;
-	vector<int>   send_tria_ids;
-	int          *p_send_tria_ids_array;
-	vector<float> send_trias;
-	float        *p_send_trias_array;
-
-	// 送信用一時データ初期化
-	p_trias = NULL;
-	send_num_trias.clear();
-	send_trias.clear();
-	send_tria_ids.clear();
-	
+	vector<char>  send_recs;
+
 	// 全グループに対して
 	for (group_itr = m_pg_list.begin(); group_itr != m_pg_list.end(); group_itr++) {
 		p_pg = (*group_itr);
+		p_trias = NULL;
+		owned.clear();
 
 		// ポリゴン情報を持つグループだけ
-		if( p_pg->get_triangles() != NULL && p_pg->get_triangles()->size() != 0 ) {
+		if( p_pg->get_num_triangles() != 0 ) {
 
-			// 当該PE領域内に一部でも含まれるポリゴンを検索
-			p_trias = p_pg->search( &(m_myproc.m_area.m_gcell_bbox), false );
+			// 自rankが所有するポリゴンだけを送る。ガイドセル領域の三角形は
+			// 所有するrankが送るので、rank0で重複しない
+			p_trias = p_pg->acquire_triangles();
+			for( unsigned int i=0; i<p_trias->size(); i++ ) {
+				if( p_trias->at(i)->is_owned() ) owned.push_back( p_trias->at(i) );
+			}
 		}
 
 		// グループIDと当該グループの三角形数の対を送信データに追加
-		pack_num_trias( &send_num_trias, p_pg->get_internal_id(), p_trias );
-
-		// 三角形情報を送信データに追加
-		pack_trias( &send_trias, p_trias );
+		pack_num_trias( &send_num_trias, p_pg->get_internal_id(), &owned );
 
-		// 三角形ID情報を送信データに追加
-		pack_tria_ids( &send_tria_ids, p_trias );
-
-		// search結果の後始末
-		if( p_trias ) delete p_trias;
-		p_trias = NULL;
+		// 三角形を送信データに追加。一時的に復元した三角形は詰めた後で解放する
+		pack_tria_recs( &send_recs, &owned );
+		if( p_trias ) p_pg->release_triangles( p_trias );
 	}
 
-	// 送信データをシリアライズ
-	p_send_num_trias_array = new int[ send_num_trias.size() ];
-	for( i=0; i<send_num_trias.size(); i++ )
-		p_send_num_trias_array[i] = send_num_trias[i];
-
-	p_send_tria_ids_array  = new int[ send_tria_ids.size() ];
-	for( i=0; i<send_tria_ids.size(); i++ )
-		p_send_tria_ids_array[i] = send_tria_ids[i];
-
-	p_send_trias_array =     new float[ send_trias.size() ];
-	for( i=0; i<send_trias.size(); i++ )
-		p_send_trias_array[i] = send_trias[i];
-
-	// rank0へ送信
+	// rank0へ一括して送信。rank0はgather_polygons()で受信する
 #ifdef DEBUG
 	PL_DBGOSH << "sending polygons rank:" << m_myrank << " -> rank:0 ";
-	for( i=0; i< send_num_trias.size(); i+=2 ) {
+	for( unsigned int i=0; i< send_num_trias.size(); i+=2 ) {
 		PL_DBGOS << "(gid:" << send_num_trias[i] 
 				 << ",num_tria:" << send_num_trias[i+1] << ")";
 	}
 	PL_DBGOS << endl;
 #endif
-	if (MPI_Send( p_send_num_trias_array, send_num_trias.size(), MPI_INT, 0,
-					MPITAG_NUM_TRIAS, m_mycomm ) != MPI_SUCCESS) {
+	if (MPI_Gather( send_num_trias.empty() ? NULL : &send_num_trias[0],
+					send_num_trias.size(), MPI_INT,
+					NULL, 0, MPI_INT, 0, m_mycomm ) != MPI_SUCCESS) {
 		PL_ERROSH << "[ERROR]MPIPolylib::send_polygons_to_rank0()"
-				  << ":MPI_Send,MPITAG_NUM_TRIAS faild." << endl;
+				  << ":MPI_Gather,num_trias faild." << endl;
 		return PLSTAT_MPI_ERROR;
 	}
-	if (MPI_Send( p_send_tria_ids_array,  send_tria_ids.size(),  MPI_INT, 0,
-					MPITAG_TRIA_IDS,  m_mycomm ) != MPI_SUCCESS) {
+	MPI_Datatype rec_type;
+	if (commit_rec_type( sizeof(TriaRec), &rec_type ) != MPI_SUCCESS) {
 		PL_ERROSH << "[ERROR]MPIPolylib::send_polygons_to_rank0()"
-				  << ":MPI_Send,MPITAG_TRIA_IDS faild." << endl;
+				  << ":MPI_Type_commit faild." << endl;
 		return PLSTAT_MPI_ERROR;
 	}
-	if (MPI_Send( p_send_trias_array,     send_trias.size(),   MPI_FLOAT, 0,
-					MPITAG_TRIAS,     m_mycomm ) != MPI_SUCCESS) {
+	int ret = MPI_Gatherv( send_recs.empty() ? NULL : &send_recs[0],
+					send_recs.size() / sizeof(TriaRec), rec_type,
+					NULL, NULL, NULL, rec_type, 0, m_mycomm );
+	MPI_Type_free( &rec_type );
+	if (ret != MPI_SUCCESS) {
 		PL_ERROSH << "[ERROR]MPIPolylib::send_polygons_to_rank0()"
-				  << ":MPI_Send,MPITAG_TRIAS faild." << endl;
+				  << ":MPI_Gatherv,trias faild." << endl;
 		return PLSTAT_MPI_ERROR;
 	}
 
-	// 送信データの後始末
-	delete[] p_send_num_trias_array;
-	delete[] p_send_tria_ids_array;
-	delete[] p_send_trias_array;
-
 	return PLSTAT_OK;
 }
 
@@ -1601,28 +3555,31 @@ MPIPolylib::select_excluded_trias(
 
 	unsigned int i, j;
 	vector<PrivateTriangle*> const *p_trias;
-	vector<int> ids;
 
 	// 全隣接PEについて
 	for( i=0; i<m_neibour_procs.size(); i++ ) {
+		// migrate除外三角形IDマップの当該グループの索引を作り直す
+		TriangleIdIndex &ids =
+			m_neibour_procs.at(i)->m_exclusion_map[p_pg->get_internal_id()];
 		ids.clear();
 
-		// 隣接PE領域(ガイドセル含)に懸かる三角形IDリストを作成
+		// 隣接PE領域(ガイドセル含)に懸かる三角形IDを登録
 		p_trias = p_pg->search( &(m_neibour_procs.at(i)->m_area.m_gcell_bbox), false );
+		ids.reserve( p_trias->size() );
 		for( j=0; j<p_trias->size(); j++ ) {
-			ids.push_back( p_trias->at(j)->get_id() );
+			ids.insert( p_trias->at(j)->get_id(), j );
 		}
 #ifdef DEBUG
 	PL_DBGOSH << "gid:" << p_pg->get_id() << " neibour_rank:" << m_neibour_procs.at(i)->m_rank
 			  << " 除外三角形数:" << ids.size() << endl;
 #endif
 
-		// migrate除外三角形IDマップに追加
-		m_neibour_procs.at(i)->m_exclusion_map[p_pg->get_internal_id()] = ids;
-
 		// search結果あとしまつ
 		delete p_trias;
 	}
+
+	// 検索で復元した三角形は解放する
+	p_pg->release_decoded_triangles();
 	return PLSTAT_OK;
 
 }
@@ -12,6 +12,9 @@
 #include <fstream>
 #include <map>
 #include "Polylib.h"
+#include "file_io/TriMeshIO.h"
+#include "file_io/GzipStream.h"
+#include "util/time.h"
 
 using namespace std;
 using namespace PolylibNS;
@@ -73,6 +76,33 @@ POLYLIB_STAT Polylib::load(
 	}
 }
 
+// public /////////////////////////////////////////////////////////////////////
+POLYLIB_STAT Polylib::load(
+	string		config_name,
+	const BBox	&region,
+	float		scale
+) {
+#ifdef DEBUG
+	PL_DBGOSH << "Polylib::load() in. region min=" << region.min 
+			  << " max=" << region.max << endl;
+#endif
+
+	// 設定ファイル読み込み
+	try {
+	  tp->read(config_name);
+
+	  // グループツリー作成
+	  POLYLIB_STAT stat = make_group_tree(tp);
+	  if (stat != PLSTAT_OK)	return stat;
+
+	  // 領域内の三角形だけをSTLファイルから読み込む
+	  return load_polygons(false, ID_BIN, scale, &region);
+	}
+	catch (POLYLIB_STAT e) {
+		return e;
+	}
+}
+
 // public /////////////////////////////////////////////////////////////////////
 //TextParser 版
 
@@ -84,6 +114,33 @@ POLYLIB_STAT Polylib::save(
   //#ifdef DEBUG
 	PL_DBGOSH << "Polylib::save() in." << endl;
 	//#endif
+	return save_files(p_config_name, stl_format, extend, NULL);
+}
+
+// public /////////////////////////////////////////////////////////////////////
+POLYLIB_STAT Polylib::save_async(
+	PolylibAsyncSave	*handle,
+	string				*p_config_name,
+	string				stl_format,
+	string				extend
+) {
+#ifdef DEBUG
+	PL_DBGOSH << "Polylib::save_async() in." << endl;
+#endif
+	if (handle == NULL) {
+		PL_ERROSH << "[ERROR]Polylib::save_async():handle is NULL." << endl;
+		return PLSTAT_NG;
+	}
+	return save_files(p_config_name, stl_format, extend, handle);
+}
+
+// protected //////////////////////////////////////////////////////////////////
+POLYLIB_STAT Polylib::save_files(
+	string				*p_config_name,
+	string				stl_format,
+	string				extend,
+	PolylibAsyncSave	*async
+) {
 	char	my_extend[128];
 	POLYLIB_STAT stat=PLSTAT_OK;
 
@@ -104,22 +161,10 @@ POLYLIB_STAT Polylib::save(
 
 	map<string,string> stl_fname_map;
 
-	vector<PolygonGroup*>::iterator	it;
-	for (it = m_pg_list.begin(); it != m_pg_list.end(); it++) {
-	  //リーフのみがポリゴン情報を持っている
-	  if ((*it)->get_children().empty() == false)	continue;
-
-	  // ポリゴン数が0ならばファイル出力不要 2010.10.19
-	  if ((*it)->get_triangles()->size() == 0)	continue;
-
-	  // STLファイル保存 (第一引数のランク番号は不要)
-	  stat = (*it)->save_stl_file("", my_extend, stl_format,
-						   stl_fname_map);
-	  if (stat != PLSTAT_OK) return stat;
-
-	  stat = (*it)->mk_param_tag(tp, "", "", "");
-	  if (stat != PLSTAT_OK) return stat;
-	}
+	// STLファイル保存 (第一引数のランク番号は不要)
+	stat = save_polygons("", my_extend, stl_format, ID_BIN, false,
+						 stl_fname_map, async);
+	if (stat != PLSTAT_OK) return stat;
 
 
 	// update stl filepath 
@@ -134,6 +179,9 @@ POLYLIB_STAT Polylib::save(
 	char	*config_name = save_config_file("", my_extend, stl_format);
 	//	PL_DBGOSH << __FUNCTION__ << " config_name "<< config_name << endl;
 
+	// 設定ファイルを書き出した後、STLファイルの書き出しを開始する
+	if (async != NULL)	async->start();
+
 	if (config_name == NULL)	return PLSTAT_NG;
 	else	*p_config_name = string(config_name);
 	return PLSTAT_OK;
@@ -157,9 +205,12 @@ POLYLIB_STAT Polylib::move(
 		if ((*it)->get_children().empty() == true && (*it)->get_movable() ) {
 			ret = (*it)->move(params);
 			if (ret != PLSTAT_OK)	return ret;
+			(*it)->set_dirty();
 
 			// 座標移動したのでKD木の再構築
+			double t0 = cost_clock();
 			ret = (*it)->rebuild_polygons();
+			if( m_cost_measure ) m_rebuild_time += cost_clock() - t0;
 			if( ret != PLSTAT_OK ) return ret;
 		}
 
@@ -212,14 +263,12 @@ POLYLIB_STAT Polylib::check_group_name(
 		return PLSTAT_GROUP_NAME_EMPTY;
 	}
 
-	vector<PolygonGroup*>::iterator it;
-	for (it = m_pg_list.begin(); it != m_pg_list.end(); it++) {
-		if ((*it)->get_name() == name && (*it)->get_parent_path() == path) {
-			PL_ERROSH << "[ERROR]Polylib::check_group_name():Group name is "
-				<< "duplicate:name:" << name << "," << "path:" << path 
-				<< endl;
-			return PLSTAT_GROUP_NAME_DUP;
-		}
+	string fullpath = path.empty() ? name : path + "/" + name;
+	if (m_pg_path_map.find(fullpath) != m_pg_path_map.end()) {
+		PL_ERROSH << "[ERROR]Polylib::check_group_name():Group name is "
+			<< "duplicate:name:" << name << "," << "path:" << path 
+			<< endl;
+		return PLSTAT_GROUP_NAME_DUP;
 	}
 	return PLSTAT_OK;
 }
@@ -240,6 +289,26 @@ void Polylib::add_pg_list(PolygonGroup *pg)
 	PL_DBGOSH << "Polylib::add_pg_list() in." << endl;
 #endif
 	m_pg_list.push_back(pg);
+
+	// 名前が設定済みのグループは索引にも登録する
+	if (pg != NULL && pg->get_name().empty() == false) register_group(pg);
+}
+
+// public /////////////////////////////////////////////////////////////////////
+void Polylib::register_group(PolygonGroup *pg)
+{
+#ifdef DEBUG
+	PL_DBGOSH << "Polylib::register_group() in." << endl;
+#endif
+	if (pg == NULL) return;
+
+	m_pg_path_map[pg->acq_fullpath()] = pg;
+	m_pg_name_map.insert(map<string, PolygonGroup*>::value_type(pg->get_name(), pg));
+
+	int id = pg->get_internal_id();
+	if (id < 0) return;
+	if ((size_t)id >= m_pg_id_table.size()) m_pg_id_table.resize(id + 1, NULL);
+	m_pg_id_table[id] = pg;
 }
 
 // public /////////////////////////////////////////////////////////////////////
@@ -278,48 +347,51 @@ POLYLIB_STAT Polylib::show_group_info(string group_name)
 }
 
 // public /////////////////////////////////////////////////////////////////////
-unsigned int Polylib::used_memory_size()
+size_t Polylib::used_memory_size()
 {
-	unsigned int						size;
-	vector<PolygonGroup*>::iterator		pg;
-	vector<PrivateTriangle*>::iterator	pt;
-
-	// 自クラスとFactoryクラス
-	size = sizeof(Polylib) + sizeof(PolygonGroupFactory);
+	PolylibMemoryUsage	usage;
 
-	// ポリゴングループ
-#ifdef DEBUG
-PL_DBGOSH << "Polylib::used_memory_size:PolygonGroup num=" << m_pg_list.size() << endl;
-#endif
-	for (pg = m_pg_list.begin(); pg != m_pg_list.end(); pg++) {
+	used_memory_usage(&usage);
+	return PolylibMemory::total(usage);
+}
 
-		// PolygonGroupクラス
-		size += sizeof(PolygonGroup);
+// public /////////////////////////////////////////////////////////////////////
+POLYLIB_STAT Polylib::used_memory_usage(
+	PolylibMemoryUsage					*usage,
+	map<string, PolylibMemoryUsage>		*group_usage
+) {
+	vector<PolygonGroup*>::iterator		pg;
 
-		// TriMeshクラス
-		size += sizeof(TriMesh);
+	if (usage == NULL) return PLSTAT_ARGUMENT_NULL;
+	PolylibMemory::clear(usage);
+	if (group_usage != NULL) group_usage->clear();
 
-		// 三角形移動前一時リスト
-		size += (*pg)->get_num_of_trias_before_move() * sizeof(vector<void> *);
+	// 自クラスとFactoryクラス、グループリスト
+	usage->others += sizeof(Polylib) + sizeof(PolygonGroupFactory);
+	usage->others += m_pg_list.capacity() * sizeof(PolygonGroup*);
 
-		// リーフにはポリゴンがある
-		if ((*pg)->get_children().empty()) {
+	// グループ索引(mapのノードは要素+左右親ポインタ+色で概算)
+	size_t node_size = sizeof(map<string, PolygonGroup*>::value_type)
+					 + 4 * sizeof(void*);
+	usage->others += (m_pg_path_map.size() + m_pg_name_map.size()) * node_size;
+	usage->others += m_pg_id_table.capacity() * sizeof(PolygonGroup*);
 
-			// 三角形ポリゴン
-			vector<PrivateTriangle*>	*tri_list = (*pg)->get_triangles();
+	// ポリゴングループ
 #ifdef DEBUG
-PL_DBGOSH << "Polylib::used_memory_size:PrivateTriangle num=" << tri_list->size() << endl;
+PL_DBGOSH << "Polylib::used_memory_usage:PolygonGroup num=" << m_pg_list.size() << endl;
 #endif
-			size += tri_list->size() * sizeof(PrivateTriangle);
+	for (pg = m_pg_list.begin(); pg != m_pg_list.end(); pg++) {
+		PolylibMemoryUsage	gusage;
 
-			// KD木
-			VTree	*vtree = (*pg)->get_vtree();
-			size += vtree->memory_size();
+		PolylibMemory::clear(&gusage);
+		(*pg)->memory_usage(&gusage);
+		PolylibMemory::add(usage, gusage);
+		if (group_usage != NULL) {
+			(*group_usage)[(*pg)->acq_fullpath()] = gusage;
 		}
-
 	}
 
-	return size;
+	return PLSTAT_OK;
 }
 
 // public /////////////////////////////////////////////////////////////////////
@@ -328,21 +400,19 @@ PolygonGroup* Polylib::get_group(string name) const
 #ifdef DEBUG
 	PL_DBGOSH << "Polylib::get_group(" << name << ") in." << endl;
 #endif
-	vector<PolygonGroup*>::const_iterator it;
-	for (it = m_pg_list.begin(); it != m_pg_list.end(); it++) {
-		if (name == (*it)->acq_fullpath()) {
+	// フルパス名で検索し、見つからなければグループ名で検索
+	map<string, PolygonGroup*>::const_iterator it = m_pg_path_map.find(name);
+	if (it != m_pg_path_map.end()) {
 #ifdef DEBUG
-			PL_DBGOS	<< "get_group: " << (*it)->get_parent_path()
-						<< " name: " << (*it)->get_name()
-						<< " size: " << (*it)->get_children().size() << endl;
+		PL_DBGOS	<< "get_group: " << it->second->get_parent_path()
+					<< " name: " << it->second->get_name()
+					<< " size: " << it->second->get_children().size() << endl;
 #endif
-			return *it;
-		}
+		return it->second;
 	}
-	for (it = m_pg_list.begin(); it != m_pg_list.end(); it++) {
-		if (name == (*it)->get_name()) {
-			return *it;
-		}
+	it = m_pg_name_map.find(name);
+	if (it != m_pg_name_map.end()) {
+		return it->second;
 	}
 #ifdef DEBUG
 	PL_DBGOS << "Polylib::get_group(" << name << ") returns NULL" << endl;
@@ -363,6 +433,7 @@ const Triangle* Polylib::search_nearest_polygon(
 		return 0;
 	}
 
+	double t0 = cost_clock();
 	vector<PolygonGroup*>* pg_list2 = new vector<PolygonGroup*>;
 
 	//子孫を検索
@@ -395,16 +466,108 @@ const Triangle* Polylib::search_nearest_polygon(
 		}
 
 	delete pg_list2;
+	if (m_cost_measure) m_query_time += cost_clock() - t0;
 
 	return (const Triangle*)tri_min;
 }
 
+// public /////////////////////////////////////////////////////////////////////
+const Triangle* Polylib::search_ray_polygon(
+	string			group_name,
+	const Vec3f&	orig,
+	const Vec3f&	dir,
+	float			tmax,
+	float			*t
+) const {
+#ifdef DEBUG
+	PL_DBGOSH << "Polylib::search_ray_polygon() in." << endl;
+#endif
+	vector<PolygonGroup*> leaves;
+	if (acq_leaf_groups(group_name, &leaves) != PLSTAT_OK) return 0;
+
+	double t0 = cost_clock();
+	const PrivateTriangle* hit = 0;
+	float tbest = tmax;
+
+	// 見つけた交差位置を上限として、リーフグループ毎に検索する
+	vector<PolygonGroup*>::iterator it;
+	for (it = leaves.begin(); it != leaves.end(); it++) {
+		if ((*it)->get_num_triangles() == 0) continue;
+		float tt;
+		const PrivateTriangle* tri = (*it)->search_ray(orig, dir, tbest, &tt);
+		if (tri) {
+			hit = tri;
+			tbest = tt;
+		}
+	}
+	if (m_cost_measure) m_query_time += cost_clock() - t0;
+
+	if (hit) *t = tbest;
+	return (const Triangle*)hit;
+}
+
+// public /////////////////////////////////////////////////////////////////////
+vector<Triangle*>* Polylib::search_owned_polygons(
+	string		group_name, 
+	Vec3f		min_pos, 
+	Vec3f		max_pos, 
+	bool		every
+) const {
+#ifdef DEBUG
+	PL_DBGOSH << "Polylib::search_owned_polygons() in." << endl;
+#endif
+	POLYLIB_STAT ret;
+	vector<PrivateTriangle*>* tri_list =
+		search_polygons(group_name, min_pos, max_pos, every, false, &ret);
+
+	// 他rankが所有する三角形を詰めて除く
+	size_t n = 0;
+	for (size_t i = 0; i < tri_list->size(); i++) {
+		if ((*tri_list)[i]->is_owned()) (*tri_list)[n++] = (*tri_list)[i];
+	}
+	tri_list->resize(n);
+	return (vector<Triangle*>*)tri_list;
+}
+
+// public /////////////////////////////////////////////////////////////////////
+POLYLIB_STAT Polylib::get_owned_stats(
+	string				group_name,
+	unsigned long long	*num,
+	double				*area
+) const {
+#ifdef DEBUG
+	PL_DBGOSH << "Polylib::get_owned_stats() in." << endl;
+#endif
+	*num = 0;
+	*area = 0.0;
+
+	vector<PolygonGroup*> leaves;
+	POLYLIB_STAT ret = acq_leaf_groups(group_name, &leaves);
+	if (ret != PLSTAT_OK) return ret;
+
+	vector<PolygonGroup*>::iterator it;
+	for (it = leaves.begin(); it != leaves.end(); it++) {
+		vector<PrivateTriangle*>* tri_list = (*it)->acquire_triangles();
+		for (size_t i = 0; i < tri_list->size(); i++) {
+			if ((*tri_list)[i]->is_owned() == false) continue;
+			(*num)++;
+			*area += (*tri_list)[i]->get_area();
+		}
+		(*it)->release_triangles(tri_list);
+	}
+	return PLSTAT_OK;
+}
+
 // protected //////////////////////////////////////////////////////////////////
 Polylib::Polylib()
 {
 	gs_rankno = "";
 	// デフォルトのファクトリークラスを登録する 2010.08.16
 	m_factory = new PolygonGroupFactory();
+	m_delta_save = false;
+	m_cost_measure = false;
+	m_query_time = 0.0;
+	m_rebuild_time = 0.0;
 
 	
 	//Polylib にTextParser クラスを持たせる。
@@ -427,6 +590,9 @@ PL_DBGOSH << "~Polylib():" << (*it)->get_name() << endl;
 		delete *it;
 		it = m_pg_list.erase(it);
 	}
+	m_pg_path_map.clear();
+	m_pg_name_map.clear();
+	m_pg_id_table.clear();
 	if(tp !=0) delete tp;
 
 }
@@ -616,27 +782,118 @@ POLYLIB_STAT Polylib::load_with_idfile(
 POLYLIB_STAT Polylib::load_polygons(
 	bool		with_id_file,
 	ID_FORMAT	id_format,
-	float		scale
+	float		scale,
+	const BBox	*region
 )
 {
 #ifdef DEBUG
 	PL_DBGOSH << "Polylib::load_polygons() in." << endl;
 #endif
+	// リーフグループを抽出
+	vector<PolygonGroup*> leaves;
 	vector<PolygonGroup*>::iterator it;
 	for (it = m_pg_list.begin(); it != m_pg_list.end(); it++) {
-		// リーフの場合
-		if ((*it)->get_children().empty() == true) {
+		if ((*it)->get_children().empty() == true) leaves.push_back(*it);
+	}
+
+	// リーフグループ毎に並列に読み込み、読み込んだものからKD木を作成する
+	int n_leaf = leaves.size();
+	vector<POLYLIB_STAT> rets(n_leaf, PLSTAT_OK);
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic,1)
+#endif
+	for (int i = 0; i < n_leaf; i++) {
+		//STLファイルを読み込む
+		rets[i] = leaves[i]->load_stl_file(scale, region);
+
+		// 必要であればIDファイルを読み込んでm_idを設定
+		if (rets[i] == PLSTAT_OK && with_id_file == true) {
+			rets[i] = leaves[i]->load_id_file(id_format);
+		}
+	}
+
+	// グループリスト順で最初のエラーを返す
+	for (int i = 0; i < n_leaf; i++) {
+		if (rets[i] != PLSTAT_OK)		return rets[i];
+	}
+	return PLSTAT_OK;
+}
 
-			//STLファイルを読み込む
-			POLYLIB_STAT ret = (*it)->load_stl_file(scale);
-			if (ret != PLSTAT_OK)		return ret;
 
-			// 必要であればIDファイルを読み込んでm_idを設定
-			if (with_id_file == true) {
-				POLYLIB_STAT ret = (*it)->load_id_file(id_format);
-				if (ret != PLSTAT_OK)		return ret;
+// protected //////////////////////////////////////////////////////////////////
+POLYLIB_STAT Polylib::save_polygons(
+	string				rank_no,
+	string				extend,
+	string				stl_format,
+	ID_FORMAT			id_format,
+	bool				with_id_file,
+	map<string,string>	&stl_fname_map,
+	PolylibAsyncSave	*async
+)
+{
+#ifdef DEBUG
+	PL_DBGOSH << "Polylib::save_polygons() in." << endl;
+#endif
+	// ポリゴンを持つリーフグループを抽出
+	// (ポリゴン数が0ならばファイル出力不要 2010.10.19)
+	vector<PolygonGroup*> leaves;
+	vector<PolygonGroup*>::iterator it;
+	for (it = m_pg_list.begin(); it != m_pg_list.end(); it++) {
+		if ((*it)->get_children().empty() == false)	continue;
+		if ((*it)->get_num_triangles() == 0)	continue;
+		leaves.push_back(*it);
+	}
+
+	// 非同期保存では前回の書き出しの完了を待つ。スナップショットはKD木を
+	// 含むので複製せずに書き出す
+	// 前回の書き出しに失敗していれば、差分保存でもファイルを参照しない
+	if (async != NULL) {
+		if (async->wait() != PLSTAT_OK) {
+			for (it = leaves.begin(); it != leaves.end(); it++) {
+				(*it)->set_dirty();
+			}
+		}
+		if (stl_format == TriMeshIO::FMT_SNAP) async = NULL;
+	}
+
+	// リーフグループ毎に並列にSTLファイルとIDファイルを書き出す
+	// (非同期保存では並列に複製して登録する)
+	int n_leaf = leaves.size();
+	vector<POLYLIB_STAT> rets(n_leaf, PLSTAT_OK);
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic,1)
+#endif
+	for (int i = 0; i < n_leaf; i++) {
+		// 差分保存では、変更のないグループは前回のファイルを参照する
+		if (m_delta_save && leaves[i]->refer_saved_file(rank_no, stl_format,
+								stl_fname_map, with_id_file, id_format)) {
+			continue;
+		}
+		if (async != NULL) {
+			rets[i] = leaves[i]->save_files_async(async, rank_no, extend,
+									stl_format, stl_fname_map, with_id_file,
+									id_format);
+		}
+		else {
+			rets[i] = leaves[i]->save_stl_file(rank_no, extend, stl_format,
+											   stl_fname_map);
+			if (rets[i] == PLSTAT_OK && with_id_file == true) {
+				rets[i] = leaves[i]->save_id_file(rank_no, extend, id_format,
+										GzipStreamBuf::is_gzip(stl_format));
 			}
 		}
+		if (rets[i] == PLSTAT_OK) {
+			leaves[i]->mark_saved(rank_no, stl_format, stl_fname_map,
+								  with_id_file, id_format);
+		}
+	}
+
+	// TextParserは排他制御しないので、パラメータの設定はグループリスト順に
+	// 逐次に行う。最初のエラーを返す
+	for (int i = 0; i < n_leaf; i++) {
+		if (rets[i] != PLSTAT_OK)		return rets[i];
+		POLYLIB_STAT stat = leaves[i]->mk_param_tag(tp, "", "", "");
+		if (stat != PLSTAT_OK)			return stat;
 	}
 	return PLSTAT_OK;
 }
@@ -717,7 +974,8 @@ POLYLIB_STAT Polylib::save_with_rankno(
 	int 		maxrank,
 	string		extend,
 	string		stl_format,
-	ID_FORMAT	id_format
+	ID_FORMAT	id_format,
+	PolylibAsyncSave	*async
 ){
 #ifdef DEBUG
 	PL_DBGOSH << "Polylib::save_with_rankno() in. " << endl;
@@ -747,27 +1005,11 @@ POLYLIB_STAT Polylib::save_with_rankno(
 
 	map<string,string> stl_fname_map;
 	// STLファイルとIDファイルの保存
-	vector<PolygonGroup*>::iterator	it;
-	for (it = m_pg_list.begin(); it != m_pg_list.end(); it++) {
-		POLYLIB_STAT	stat;
-		//リーフのみがポリゴン情報を持っている
-		if ((*it)->get_children().empty() == false) continue;
-
-		// ポリゴン数が0ならばファイル出力不要 2010.10.19
-		if ((*it)->get_triangles()->size() == 0) continue;
-
-		//stat = (*it)->save_stl_file(rank_no, my_extend, stl_format);
-		stat = (*it)->save_stl_file(rank_no, my_extend, stl_format,stl_fname_map);
-		if (stat != PLSTAT_OK)	return stat;
-		stat = (*it)->save_id_file(rank_no, my_extend, id_format);
-		if (stat != PLSTAT_OK)	return stat;
-		string rank_string,my_extend_string;
-		rank_string=rank_no;
-		my_extend_string = my_extend;
-		stat = (*it)->mk_param_tag(tp, "", "", "");
-		if (stat != PLSTAT_OK) return stat;
-	  
-	}
+	// スナップショットは三角形IDを含むのでIDファイルは不要
+	POLYLIB_STAT stat = save_polygons(rank_no, my_extend, stl_format, id_format,
+								stl_format != TriMeshIO::FMT_SNAP, stl_fname_map,
+								async);
+	if (stat != PLSTAT_OK)	return stat;
 	tp->changeNode("/"); //
 	//	cout << "before cleanfilepath" <<endl;
 	clearfilepath(tp); //clear whole file path
@@ -781,6 +1023,9 @@ POLYLIB_STAT Polylib::save_with_rankno(
 
 
 	char	*config_name = save_config_file(rank_no, my_extend, stl_format);
+
+	// 設定ファイルを書き出した後、STLファイルとIDファイルの書き出しを開始する
+	if (async != NULL)	async->start();
 #ifdef DEBUG	
 	PL_DBGOSH << __FUNCTION__ << " config_name "<< config_name << endl;
 #endif 
@@ -935,11 +1180,9 @@ PolygonGroup* Polylib::get_group(int internal_id) const
 #ifdef DEBUG
 	PL_DBGOSH << "Polylib::get_group(" << internal_id << ") in." << endl;
 #endif
-	vector<PolygonGroup*>::const_iterator it;
-	for (it = m_pg_list.begin(); it != m_pg_list.end(); it++) {
-		if (internal_id == (*it)->get_internal_id()) {
-			return *it;
-		}
+	if (internal_id >= 0 && (size_t)internal_id < m_pg_id_table.size() &&
+		m_pg_id_table[internal_id] != NULL) {
+		return m_pg_id_table[internal_id];
 	}
 #ifdef DEBUG
 	PL_DBGOS << "Polylib::get_group(" << internal_id << ") returns NULL" << endl;
@@ -969,6 +1212,7 @@ vector<PrivateTriangle*>* Polylib::search_polygons(
 		return tri_list;
 	}
 	vector<PolygonGroup*>* pg_list2 = new vector<PolygonGroup*>;
+	double t0 = cost_clock();
 
 #ifdef BENCHMARK
 	double st1, st2, ut1, ut2, tt1, tt2;
@@ -1032,10 +1276,43 @@ vector<PrivateTriangle*>* Polylib::search_polygons(
 #endif
 
 	delete pg_list2;
+	if (m_cost_measure) m_query_time += cost_clock() - t0;
 	*ret = PLSTAT_OK;
 	return tri_list;
 }
 
+// protected //////////////////////////////////////////////////////////////////
+POLYLIB_STAT Polylib::acq_leaf_groups(
+	string					group_name,
+	vector<PolygonGroup*>	*leaves
+) const {
+	PolygonGroup* pg = get_group(group_name);
+	if (pg == 0) {
+		PL_ERROSH << "[ERROR]Polylib::acq_leaf_groups():Group not found: " 
+				  << group_name << endl;
+		return PLSTAT_GROUP_NOT_FOUND;
+	}
+
+	vector<PolygonGroup*> pg_list2;
+	search_group(pg, &pg_list2);
+	pg_list2.push_back(pg);
+
+	vector<PolygonGroup*>::iterator it;
+	for (it = pg_list2.begin(); it != pg_list2.end(); it++) {
+		if ((*it)->get_children().size() == 0) leaves->push_back(*it);
+	}
+	return PLSTAT_OK;
+}
+
+// protected //////////////////////////////////////////////////////////////////
+double Polylib::cost_clock() const
+{
+	double usr_time, sys_time, total;
+	if (m_cost_measure == false) return 0.0;
+	getrusage_sec(&usr_time, &sys_time, &total);
+	return total;
+}
+
 // private ////////////////////////////////////////////////////////////////////
 void Polylib::search_group(
 	PolygonGroup			*p, 
@@ -65,6 +65,19 @@ mpipolylib_load_parallel(char* config_name)
 
 
 
+// load_distributed
+POLYLIB_STAT
+mpipolylib_load_distributed(char* config_name)
+{
+	if( config_name == NULL ) {
+		return (MPIPolylib::get_instance())->load_distributed();
+	}
+	string fname = config_name;
+	return (MPIPolylib::get_instance())->load_distributed( fname );
+}
+
+
+
 // save_rank0
 POLYLIB_STAT
 mpipolylib_save_rank0(
@@ -198,9 +211,35 @@ POLYLIB_STAT mpipolylib_show_group_info(char* group_name)
 
 
 // used_memory_size
-unsigned int mpipolylib_used_memory_size()
+size_t mpipolylib_used_memory_size()
 {
 	return (MPIPolylib::get_instance())->used_memory_size();
 }
 
+// used_memory_usage
+POLYLIB_STAT mpipolylib_used_memory_usage(PolylibMemoryUsage *usage)
+{
+	return (MPIPolylib::get_instance())->used_memory_usage(usage);
+}
+
+// group_memory_usage
+POLYLIB_STAT mpipolylib_group_memory_usage(
+	char				*group_name,
+	PolylibMemoryUsage	*usage)
+{
+	POLYLIB_STAT						ret;
+	map<string, PolylibMemoryUsage>		group_usage;
+	PolylibMemoryUsage					total;
+
+	if (group_name == NULL || usage == NULL) return PLSTAT_ARGUMENT_NULL;
+	ret = (MPIPolylib::get_instance())->used_memory_usage(&total, &group_usage);
+	if (ret != PLSTAT_OK) return ret;
+
+	map<string, PolylibMemoryUsage>::iterator it =
+											group_usage.find(group_name);
+	if (it == group_usage.end()) return PLSTAT_GROUP_NOT_FOUND;
+	*usage = it->second;
+	return PLSTAT_OK;
+}
+
 // eof
@@ -135,11 +135,37 @@ polylib_show_group_info(char* group_name)
 }
 
 // used_memory_size
-unsigned int
+size_t
 polylib_used_memory_size()
 {
 	return (Polylib::get_instance())->used_memory_size();
 }
 
+// used_memory_usage
+POLYLIB_STAT polylib_used_memory_usage(PolylibMemoryUsage *usage)
+{
+	return (Polylib::get_instance())->used_memory_usage(usage);
+}
+
+// group_memory_usage
+POLYLIB_STAT polylib_group_memory_usage(
+	char				*group_name,
+	PolylibMemoryUsage	*usage)
+{
+	POLYLIB_STAT						ret;
+	map<string, PolylibMemoryUsage>		group_usage;
+	PolylibMemoryUsage					total;
+
+	if (group_name == NULL || usage == NULL) return PLSTAT_ARGUMENT_NULL;
+	ret = (Polylib::get_instance())->used_memory_usage(&total, &group_usage);
+	if (ret != PLSTAT_OK) return ret;
+
+	map<string, PolylibMemoryUsage>::iterator it =
+											group_usage.find(group_name);
+	if (it == group_usage.end()) return PLSTAT_GROUP_NOT_FOUND;
+	*usage = it->second;
+	return PLSTAT_OK;
+}
+
 
 // eof
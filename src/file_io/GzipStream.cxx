@@ -0,0 +1,399 @@
+/*
+ * Polylib - Polygon Management Library
+ *
+ * Copyright (c) 2010-2011 VCAD System Research Program, RIKEN.
+ * All rights reserved.
+ *
+ * Copyright (c) 2012-2013 Advanced Institute for Computational Science, RIKEN.
+ * All rights reserved.
+ *
+ */
+
+#include <vector>
+#ifdef USE_ZLIB
+#include <pthread.h>
+#include <zlib.h>
+#endif
+#include "common/PolylibCommon.h"
+#include "file_io/GzipStream.h"
+
+#define GZ_BLOCK		(1<<20)	// block size passed to the worker thread
+#define GZ_NUM_BLOCK	4		// number of blocks in the ring
+#define GZ_ZBUF			(1<<18)	// zlib internal buffer size
+
+namespace PolylibNS {
+
+using namespace std;
+
+const string GzipStreamBuf::SUFFIX = ".gz";
+
+////////////////////////////////////////////////////////////////////////////
+///
+/// 構造体:GzipStreamBuf::State
+/// 作業スレッドとブロックを受け渡すための状態。
+/// ブロックはリング状に並べ、作業スレッドと消費側がそれぞれ先頭から
+/// 順に処理する。fullがtrueのブロックは、読み込みでは消費側、
+/// 書き出しでは作業スレッドが処理する。
+///
+////////////////////////////////////////////////////////////////////////////
+struct GzipStreamBuf::State {
+#ifdef USE_ZLIB
+	/// 受け渡し用ブロック。
+	struct Block {
+		vector<char>	data;	///< データ
+		int				len;	///< 有効長(読み込みで0は終端、負はエラー)
+		bool			full;	///< ブロックの状態
+	};
+
+	gzFile			file;		///< gzipファイル
+	bool			write;		///< 書き出しモードか
+	pthread_t		thread;		///< 作業スレッド
+	vector<Block>	blocks;		///< 受け渡し用ブロックのリング
+	int				cur;		///< 消費側が使用中のブロック番号
+	bool			eof;		///< 読み込みで終端に達したか
+	bool			error;		///< 読み書きエラーが発生したか
+	bool			finish;		///< 作業スレッドの終了要求
+	pthread_mutex_t	mutex;		///< ブロックの状態を保護する
+	pthread_cond_t	cond;		///< ブロックの状態変化を通知する
+#endif
+};
+
+/************************************************************************
+ *
+ * GzipStreamBufクラス
+ *
+ ***********************************************************************/
+// public /////////////////////////////////////////////////////////////////////
+GzipStreamBuf::GzipStreamBuf() {
+	m_state = NULL;
+}
+
+// public /////////////////////////////////////////////////////////////////////
+GzipStreamBuf::~GzipStreamBuf() {
+	close();
+}
+
+// public /////////////////////////////////////////////////////////////////////
+bool GzipStreamBuf::open(
+	const string		&fname,
+	ios::openmode		mode
+) {
+#ifdef USE_ZLIB
+	if (m_state != NULL) return false;
+
+	bool	write = (mode & ios::out) != 0;
+	gzFile	file = gzopen(fname.c_str(), write ? "wb" : "rb");
+	if (file == NULL) return false;
+	gzbuffer(file, GZ_ZBUF);
+
+	State *st = new State;
+	st->file	= file;
+	st->write	= write;
+	st->blocks.resize(GZ_NUM_BLOCK);
+	for (int i = 0; i < GZ_NUM_BLOCK; i++) {
+		st->blocks[i].data.resize(GZ_BLOCK);
+		st->blocks[i].len	= 0;
+		st->blocks[i].full	= false;
+	}
+	st->cur		= write ? 0 : -1;
+	st->eof		= false;
+	st->error	= false;
+	st->finish	= false;
+	pthread_mutex_init(&st->mutex, NULL);
+	pthread_cond_init(&st->cond, NULL);
+
+	if (pthread_create(&st->thread, NULL, worker, st) != 0) {
+		pthread_mutex_destroy(&st->mutex);
+		pthread_cond_destroy(&st->cond);
+		gzclose(file);
+		delete st;
+		return false;
+	}
+	m_state = st;
+
+	if (write) {
+		char *p = &st->blocks[0].data[0];
+		setp(p, p + GZ_BLOCK);
+	}
+	else {
+		setg(NULL, NULL, NULL);
+	}
+	return true;
+#else
+	(void)mode;
+	PL_ERROSH << "[ERROR]GzipStreamBuf::open():Polylib is built without zlib "
+			  << "(define USE_ZLIB). Can't open " << fname << endl;
+	return false;
+#endif
+}
+
+// public /////////////////////////////////////////////////////////////////////
+bool GzipStreamBuf::close() {
+#ifdef USE_ZLIB
+	if (m_state == NULL) return true;
+	State *st = m_state;
+
+	// 書き出しは最後のブロックを渡してから、読み込みは先読みを打ち切って
+	// 作業スレッドを終了させる
+	if (st->write) flush_block(true);
+	pthread_mutex_lock(&st->mutex);
+	st->finish = true;
+	pthread_cond_broadcast(&st->cond);
+	pthread_mutex_unlock(&st->mutex);
+	pthread_join(st->thread, NULL);
+
+	bool ok = !st->error;
+	if (gzclose(st->file) != Z_OK && st->write) ok = false;
+
+	pthread_mutex_destroy(&st->mutex);
+	pthread_cond_destroy(&st->cond);
+	delete st;
+	m_state = NULL;
+	setg(NULL, NULL, NULL);
+	setp(NULL, NULL);
+	return ok;
+#else
+	return true;
+#endif
+}
+
+// public /////////////////////////////////////////////////////////////////////
+bool GzipStreamBuf::is_gzip(
+	const string		&fname
+) {
+	size_t n = SUFFIX.size();
+	if (fname.size() <= n) return false;
+	string ext = fname.substr(fname.size() - n);
+	return ext == SUFFIX || ext == ".GZ";
+}
+
+// public /////////////////////////////////////////////////////////////////////
+string GzipStreamBuf::strip_gzip(
+	const string		&fname
+) {
+	if (!is_gzip(fname)) return fname;
+	return fname.substr(0, fname.size() - SUFFIX.size());
+}
+
+// protected //////////////////////////////////////////////////////////////////
+GzipStreamBuf::int_type GzipStreamBuf::underflow() {
+#ifdef USE_ZLIB
+	State *st = m_state;
+	if (st == NULL || st->write || st->eof) return traits_type::eof();
+	if (gptr() < egptr()) return traits_type::to_int_type(*gptr());
+
+	// 読み終えたブロックを作業スレッドへ返し、次のブロックを待つ
+	pthread_mutex_lock(&st->mutex);
+	if (st->cur >= 0) {
+		st->blocks[st->cur].full = false;
+		pthread_cond_broadcast(&st->cond);
+	}
+	st->cur = (st->cur + 1) % GZ_NUM_BLOCK;
+	State::Block &blk = st->blocks[st->cur];
+	while (!blk.full) pthread_cond_wait(&st->cond, &st->mutex);
+	pthread_mutex_unlock(&st->mutex);
+
+	if (blk.len <= 0) {
+		if (blk.len < 0) st->error = true;
+		st->eof = true;
+		return traits_type::eof();
+	}
+	char *p = &blk.data[0];
+	setg(p, p, p + blk.len);
+	return traits_type::to_int_type(*p);
+#else
+	return traits_type::eof();
+#endif
+}
+
+// protected //////////////////////////////////////////////////////////////////
+GzipStreamBuf::int_type GzipStreamBuf::overflow(int_type c) {
+#ifdef USE_ZLIB
+	if (m_state == NULL || !m_state->write) return traits_type::eof();
+	if (!flush_block(false)) return traits_type::eof();
+	if (!traits_type::eq_int_type(c, traits_type::eof())) {
+		*pptr() = traits_type::to_char_type(c);
+		pbump(1);
+	}
+	return traits_type::not_eof(c);
+#else
+	(void)c;
+	return traits_type::eof();
+#endif
+}
+
+// protected //////////////////////////////////////////////////////////////////
+int GzipStreamBuf::sync() {
+	// endl毎に小さなブロックを渡さないよう、書き出しはclose()でまとめて行う。
+	// ここではエラーの有無だけを返す
+#ifdef USE_ZLIB
+	if (m_state == NULL) return 0;
+	pthread_mutex_lock(&m_state->mutex);
+	bool error = m_state->error;
+	pthread_mutex_unlock(&m_state->mutex);
+	return error ? -1 : 0;
+#else
+	return 0;
+#endif
+}
+
+// private ////////////////////////////////////////////////////////////////////
+bool GzipStreamBuf::flush_block(bool last) {
+#ifdef USE_ZLIB
+	State *st = m_state;
+	State::Block &blk = st->blocks[st->cur];
+	blk.len = (int)(pptr() - pbase());
+
+	pthread_mutex_lock(&st->mutex);
+	if (blk.len > 0) {
+		blk.full = true;
+		pthread_cond_broadcast(&st->cond);
+		st->cur = (st->cur + 1) % GZ_NUM_BLOCK;
+	}
+	bool ok = !st->error;
+	if (last) {
+		pthread_mutex_unlock(&st->mutex);
+		setp(NULL, NULL);
+		return ok;
+	}
+
+	// 次のブロックの書き出し完了を待つ
+	State::Block &next = st->blocks[st->cur];
+	while (next.full) pthread_cond_wait(&st->cond, &st->mutex);
+	ok = !st->error;
+	pthread_mutex_unlock(&st->mutex);
+
+	char *p = &next.data[0];
+	setp(p, p + GZ_BLOCK);
+	return ok;
+#else
+	(void)last;
+	return false;
+#endif
+}
+
+// private ////////////////////////////////////////////////////////////////////
+void *GzipStreamBuf::worker(void *arg) {
+#ifdef USE_ZLIB
+	State *st = (State*)arg;
+	int wk = 0;
+
+	for (;;) {
+		State::Block &blk = st->blocks[wk];
+
+		pthread_mutex_lock(&st->mutex);
+		if (st->write) {
+			while (!blk.full && !st->finish) {
+				pthread_cond_wait(&st->cond, &st->mutex);
+			}
+			if (!blk.full) {
+				pthread_mutex_unlock(&st->mutex);
+				break;
+			}
+		}
+		else {
+			while (blk.full && !st->finish) {
+				pthread_cond_wait(&st->cond, &st->mutex);
+			}
+			if (st->finish) {
+				pthread_mutex_unlock(&st->mutex);
+				break;
+			}
+		}
+		pthread_mutex_unlock(&st->mutex);
+
+		// 伸長・圧縮はロックの外で行う
+		bool error = false;
+		if (st->write) {
+			if (gzwrite(st->file, &blk.data[0], blk.len) != blk.len) {
+				error = true;
+			}
+		}
+		else {
+			blk.len = gzread(st->file, &blk.data[0], GZ_BLOCK);
+
+			// 途中で切れたファイルは終端ではなくエラーとする
+			int errnum = Z_OK;
+			gzerror(st->file, &errnum);
+			if (blk.len == 0 && errnum != Z_OK) blk.len = -1;
+		}
+
+		pthread_mutex_lock(&st->mutex);
+		if (error) st->error = true;
+		blk.full = !st->write;
+		pthread_cond_broadcast(&st->cond);
+		pthread_mutex_unlock(&st->mutex);
+
+		if (!st->write && blk.len <= 0) break;
+		wk = (wk + 1) % GZ_NUM_BLOCK;
+	}
+#else
+	(void)arg;
+#endif
+	return NULL;
+}
+
+/************************************************************************
+ *
+ * GzipIFStreamクラス
+ *
+ ***********************************************************************/
+// public /////////////////////////////////////////////////////////////////////
+GzipIFStream::GzipIFStream(
+	const string		&fname,
+	ios::openmode		mode
+) : istream(NULL) {
+	if (GzipStreamBuf::is_gzip(fname)) {
+		if (m_gzbuf.open(fname, ios::in)) rdbuf(&m_gzbuf);
+	}
+	else if (m_fbuf.open(fname.c_str(), mode | ios::in) != NULL) {
+		rdbuf(&m_fbuf);
+	}
+	if (rdbuf() == NULL) setstate(ios::failbit);
+}
+
+// public /////////////////////////////////////////////////////////////////////
+void GzipIFStream::close() {
+	if (rdbuf() == &m_gzbuf) {
+		if (!m_gzbuf.close()) setstate(ios::badbit);
+	}
+	else if (m_fbuf.is_open()) {
+		m_fbuf.close();
+	}
+}
+
+/************************************************************************
+ *
+ * GzipOFStreamクラス
+ *
+ ***********************************************************************/
+// public /////////////////////////////////////////////////////////////////////
+GzipOFStream::GzipOFStream(
+	const string		&fname,
+	ios::openmode		mode
+) : ostream(NULL) {
+	if (GzipStreamBuf::is_gzip(fname)) {
+		if (m_gzbuf.open(fname, ios::out)) rdbuf(&m_gzbuf);
+	}
+	else if (m_fbuf.open(fname.c_str(), mode | ios::out) != NULL) {
+		rdbuf(&m_fbuf);
+	}
+	if (rdbuf() == NULL) setstate(ios::failbit);
+}
+
+// public /////////////////////////////////////////////////////////////////////
+GzipOFStream::~GzipOFStream() {
+	close();
+}
+
+// public /////////////////////////////////////////////////////////////////////
+void GzipOFStream::close() {
+	if (rdbuf() == &m_gzbuf) {
+		if (!m_gzbuf.close()) setstate(ios::failbit);
+	}
+	else if (m_fbuf.is_open()) {
+		if (m_fbuf.close() == NULL) setstate(ios::failbit);
+	}
+}
+
+} //namespace PolylibNS
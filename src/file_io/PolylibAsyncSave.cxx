@@ -0,0 +1,147 @@
+/*
+ * Polylib - Polygon Management Library
+ *
+ * Copyright (c) 2010-2011 VCAD System Research Program, RIKEN.
+ * All rights reserved.
+ *
+ * Copyright (c) 2012-2013 Advanced Institute for Computational Science, RIKEN.
+ * All rights reserved.
+ *
+ */
+
+#include <vector>
+#include <string>
+#include "polygons/Triangle.h"
+#include "file_io/TriMeshIO.h"
+#include "file_io/triangle_id.h"
+#include "file_io/PolylibAsyncSave.h"
+
+namespace PolylibNS {
+
+using namespace std;
+
+//
+// 書き出すファイル。三角形は連続領域に複製して保持する
+//
+struct PolylibAsyncSave::File {
+	vector<PrivateTriangle>		tris;
+	string						stl_fname;
+	string						stl_format;
+	string						id_fname;
+	ID_FORMAT					id_format;
+};
+
+/************************************************************************
+ *
+ * PolylibAsyncSaveクラス
+ *
+ ***********************************************************************/
+// public /////////////////////////////////////////////////////////////////////
+PolylibAsyncSave::PolylibAsyncSave() {
+	m_stat = PLSTAT_OK;
+	m_running = false;
+	m_done = true;
+	pthread_mutex_init(&m_mutex, NULL);
+}
+
+// public /////////////////////////////////////////////////////////////////////
+PolylibAsyncSave::~PolylibAsyncSave() {
+	wait();
+	pthread_mutex_destroy(&m_mutex);
+}
+
+// public /////////////////////////////////////////////////////////////////////
+POLYLIB_STAT PolylibAsyncSave::wait() {
+	if (m_running) {
+		pthread_join(m_thread, NULL);
+		m_running = false;
+	}
+	clear();
+	return m_stat;
+}
+
+// public /////////////////////////////////////////////////////////////////////
+bool PolylibAsyncSave::is_done() {
+	pthread_mutex_lock(&m_mutex);
+	bool done = m_done;
+	pthread_mutex_unlock(&m_mutex);
+	return done;
+}
+
+// public /////////////////////////////////////////////////////////////////////
+void PolylibAsyncSave::add_file(
+	const vector<PrivateTriangle*>	*tri_list,
+	const string					&stl_fname,
+	const string					&stl_format,
+	const string					&id_fname,
+	ID_FORMAT						id_format
+) {
+	// 複製はロックの外で行う
+	File *file = new File;
+	file->tris.reserve(tri_list->size());
+	vector<PrivateTriangle*>::const_iterator it;
+	for (it = tri_list->begin(); it != tri_list->end(); it++) {
+		file->tris.push_back(**it);
+	}
+	file->stl_fname = stl_fname;
+	file->stl_format = stl_format;
+	file->id_fname = id_fname;
+	file->id_format = id_format;
+
+	pthread_mutex_lock(&m_mutex);
+	m_files.push_back(file);
+	pthread_mutex_unlock(&m_mutex);
+}
+
+// public /////////////////////////////////////////////////////////////////////
+void PolylibAsyncSave::start() {
+	m_stat = PLSTAT_OK;
+	m_done = false;
+	if (pthread_create(&m_thread, NULL, worker, this) == 0) {
+		m_running = true;
+	}
+	else {
+		PL_ERROSH << "[ERROR]PolylibAsyncSave::start():Can't create a thread. "
+				  << "Files are written synchronously." << endl;
+		worker(this);
+		clear();
+	}
+}
+
+// private ////////////////////////////////////////////////////////////////////
+void *PolylibAsyncSave::worker(void *arg) {
+	PolylibAsyncSave *self = (PolylibAsyncSave*)arg;
+	POLYLIB_STAT stat = PLSTAT_OK;
+
+	for (size_t i = 0; i < self->m_files.size(); i++) {
+		File *file = self->m_files[i];
+		vector<PrivateTriangle*> tri_list(file->tris.size());
+		for (size_t j = 0; j < file->tris.size(); j++) {
+			tri_list[j] = &file->tris[j];
+		}
+
+		POLYLIB_STAT ret = TriMeshIO::save(&tri_list, file->stl_fname,
+										   file->stl_format);
+		if (ret == PLSTAT_OK && file->id_fname != "") {
+			ret = save_id(&tri_list, file->id_fname, file->id_format);
+		}
+		if (stat == PLSTAT_OK) stat = ret;
+
+		// 書き出した三角形はすぐに解放する
+		vector<PrivateTriangle>().swap(file->tris);
+	}
+
+	pthread_mutex_lock(&self->m_mutex);
+	self->m_stat = stat;
+	self->m_done = true;
+	pthread_mutex_unlock(&self->m_mutex);
+	return NULL;
+}
+
+// private ////////////////////////////////////////////////////////////////////
+void PolylibAsyncSave::clear() {
+	for (size_t i = 0; i < m_files.size(); i++) delete m_files[i];
+	m_files.clear();
+}
+
+} //namespace PolylibNS
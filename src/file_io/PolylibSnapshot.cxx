@@ -0,0 +1,124 @@
+/*
+ * Polylib - Polygon Management Library
+ *
+ * Copyright (c) 2010-2011 VCAD System Research Program, RIKEN.
+ * All rights reserved.
+ *
+ * Copyright (c) 2012-2013 Advanced Institute for Computational Science, RIKEN.
+ * All rights reserved.
+ *
+ */
+
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fstream>
+#include "common/PolylibCommon.h"
+#include "polygons/Polygons.h"
+#include "file_io/PolylibSnapshot.h"
+
+namespace PolylibNS {
+
+using namespace std;
+
+/// ファイル先頭のマジック。
+static const char			SNAP_MAGIC[8] = {'P','L','S','N','A','P','\0','\0'};
+
+/// バイトオーダー確認値。
+static const unsigned int	SNAP_ENDIAN = 0x01020304;
+
+const int PolylibSnapshot::VERSION = 1;
+
+/************************************************************************
+ *
+ * PolylibSnapshotクラス
+ *
+ ***********************************************************************/
+// public /////////////////////////////////////////////////////////////////////
+POLYLIB_STAT PolylibSnapshot::save(
+	const Polygons	*polygons,
+	const string	&fname
+) {
+	ofstream ofs(fname.c_str(), ios::out | ios::binary | ios::trunc);
+	if (ofs.fail()) {
+		PL_ERROSH << "[ERROR]PolylibSnapshot::save():Can't open " << fname
+				  << endl;
+		return PLSTAT_STL_IO_ERROR;
+	}
+
+	SnapshotWriter	wr(ofs);
+	int				version = VERSION;
+	unsigned int	endian = SNAP_ENDIAN;
+	bool			ok = wr.write(SNAP_MAGIC, sizeof(SNAP_MAGIC)) &&
+						 wr.write(&version, sizeof(int)) &&
+						 wr.write(&endian, sizeof(unsigned int));
+	POLYLIB_STAT	ret = ok ? polygons->save_snapshot(wr) : PLSTAT_NG;
+
+	ofs.close();
+	if (ret == PLSTAT_OK && ofs.fail()) ret = PLSTAT_NG;
+	if (ret != PLSTAT_OK) {
+		PL_ERROSH << "[ERROR]PolylibSnapshot::save():Write error " << fname
+				  << endl;
+	}
+	return ret;
+}
+
+// public /////////////////////////////////////////////////////////////////////
+POLYLIB_STAT PolylibSnapshot::load(
+	Polygons		*polygons,
+	const string	&fname
+) {
+	int fd = open(fname.c_str(), O_RDONLY);
+	if (fd < 0) {
+		PL_ERROSH << "[ERROR]PolylibSnapshot::load():Can't open " << fname
+				  << endl;
+		return PLSTAT_STL_IO_ERROR;
+	}
+
+	struct stat	st;
+	size_t		fsize = 0;
+	void		*map = MAP_FAILED;
+	if (fstat(fd, &st) == 0) fsize = (size_t)st.st_size;
+	if (fsize > 0) map = mmap(NULL, fsize, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED) {
+		PL_ERROSH << "[ERROR]PolylibSnapshot::load():Can't map " << fname
+				  << endl;
+		return PLSTAT_NG;
+	}
+	madvise(map, fsize, MADV_SEQUENTIAL);
+
+	// ヘッダの確認。バイトオーダーの異なる計算機で作成したものは読めない
+	SnapshotReader	rd((const char*)map, fsize);
+	char			magic[8];
+	int				version;
+	unsigned int	endian;
+	POLYLIB_STAT	ret = PLSTAT_OK;
+	if (!rd.read(magic, sizeof(magic)) ||
+		memcmp(magic, SNAP_MAGIC, sizeof(magic)) != 0 ||
+		!rd.read(&version, sizeof(int)) ||
+		!rd.read(&endian, sizeof(unsigned int))) {
+		PL_ERROSH << "[ERROR]PolylibSnapshot::load():Not a snapshot "
+				  << fname << endl;
+		ret = PLSTAT_NG;
+	}
+	else if (endian != SNAP_ENDIAN || version != VERSION) {
+		PL_ERROSH << "[ERROR]PolylibSnapshot::load():Incompatible snapshot "
+				  << fname << " version:" << version << endl;
+		ret = PLSTAT_NG;
+	}
+	else {
+		ret = polygons->load_snapshot(rd);
+		if (ret != PLSTAT_OK) {
+			PL_ERROSH << "[ERROR]PolylibSnapshot::load():Broken snapshot "
+					  << fname << endl;
+		}
+	}
+
+	munmap(map, fsize);
+	return ret;
+}
+
+} //namespace PolylibNS
@@ -14,6 +14,11 @@
 #include "polygons/Triangle.h"
 #include "file_io/TriMeshIO.h"
 #include "file_io/stl.h"
+#include "file_io/indexed_mesh.h"
+#include "file_io/GzipStream.h"
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 namespace PolylibNS {
 
@@ -23,6 +28,9 @@ const string TriMeshIO::FMT_STL_A  = "stl_a";
 const string TriMeshIO::FMT_STL_AA = "stl_aa";
 const string TriMeshIO::FMT_STL_B  = "stl_b";
 const string TriMeshIO::FMT_STL_BB = "stl_bb";
+const string TriMeshIO::FMT_SNAP   = "plsnap";
+const string TriMeshIO::FMT_OBJ    = "obj";
+const string TriMeshIO::FMT_PLY    = "ply";
 const string TriMeshIO::DEFAULT_FMT = TriMeshIO::FMT_STL_B;
 
 /************************************************************************
@@ -34,7 +42,8 @@ const string TriMeshIO::DEFAULT_FMT = TriMeshIO::FMT_STL_B;
 POLYLIB_STAT TriMeshIO::load(
 	vector<PrivateTriangle*>	*tri_list, 
 	const map<string, string>	&fmap,
-	float scale
+	float scale,
+	const BBox *region
 ) {
 	map<string, string>::const_iterator	it;
 	int									total;
@@ -46,23 +55,54 @@ POLYLIB_STAT TriMeshIO::load(
 	}
 
 	total = 0;	// 通算番号に初期値をセット
+	if (fmap.size() <= 1) {
+		for (it = fmap.begin(); it != fmap.end(); it++) {
+			ret = load_file(tri_list, it->first, it->second, &total, scale,
+							region);
+		}
+		return ret;
+	}
+
+	// 複数ファイルはファイル毎に並列に読み込む
+	vector<string>		fnames, fmts;
 	for (it = fmap.begin(); it != fmap.end(); it++) {
-		string fname	= it->first;
-		string fmt		= it->second;
+		fnames.push_back(it->first);
+		fmts.push_back(it->second);
+	}
+	int n_file = fnames.size();
+	vector< vector<PrivateTriangle*> >	lists(n_file);
+	vector<POLYLIB_STAT>				rets(n_file, PLSTAT_OK);
+	vector<int>							counts(n_file, 0);
 
-		if (fmt == "") {
-			PL_ERROSH << "[ERROR]:TTriMeshIO::load():Unknown stl format." << endl;
-			ret = PLSTAT_NG;
-		}
-		else if (fmt == FMT_STL_A || fmt == FMT_STL_AA) {
-			ret = stl_a_load(tri_list, fname, &total, scale);
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic,1)
+#endif
+	for (int i = 0; i < n_file; i++) {
+		rets[i] = load_file(&lists[i], fnames[i], fmts[i], &counts[i], scale,
+							region);
+	}
+
+	// ファイル名順に連結し、先行ファイルの三角形数だけ通算番号をずらす。
+	// 一ファイルでも読み込みに失敗したら、それ以降のファイルは破棄して戻る
+	size_t num = tri_list->size();
+	for (int i = 0; i < n_file && rets[i] == PLSTAT_OK; i++) {
+		num += lists[i].size();
+	}
+	tri_list->reserve(num);
+	for (int i = 0; i < n_file; i++) {
+		vector<PrivateTriangle*>::iterator t;
+		if (ret == PLSTAT_OK && (ret = rets[i]) == PLSTAT_OK) {
+			for (t = lists[i].begin(); t != lists[i].end(); t++) {
+				(*t)->set_id((*t)->get_id() + total);
+				tri_list->push_back(*t);
+			}
+			total += counts[i];
 		}
-		else if (fmt == FMT_STL_B || fmt == FMT_STL_BB) {
-			ret = stl_b_load(tri_list, fname, &total, scale);
+		else {
+			for (t = lists[i].begin(); t != lists[i].end(); t++) {
+				delete *t;
+			}
 		}
-
-		// 一ファイルでも読み込みに失敗したら戻る
-		if (ret != PLSTAT_OK)		return ret;
 	}
 
 	return ret;
@@ -82,10 +122,12 @@ POLYLIB_STAT TriMeshIO::save(
 		return PLSTAT_NG;
 	}
 
-	if (fmt == FMT_STL_A || fmt == FMT_STL_AA) {
+	// gzip圧縮はファイル名の拡張子.gzで指定されるので、書式からは取り除く
+	string base = GzipStreamBuf::strip_gzip(fmt);
+	if (base == FMT_STL_A || base == FMT_STL_AA) {
 		return stl_a_save(tri_list, fname);
 	}
-	else if (fmt == FMT_STL_B || fmt == FMT_STL_BB) {
+	else if (base == FMT_STL_B || base == FMT_STL_BB) {
 		return stl_b_save(tri_list, fname);
 	}
 	else{
@@ -98,8 +140,8 @@ string TriMeshIO::input_file_format(
 	const string &filename
 )
 {
-	//書式の決定
-	char	*ext = stl_get_ext(filename);
+	//書式の決定(gzip圧縮ファイルは.gzの手前の拡張子で判定する)
+	char	*ext = stl_get_ext(GzipStreamBuf::strip_gzip(filename));
 	if (!strcmp(ext, "stla") || !strcmp(ext, "STLA")) {
 		 return FMT_STL_A;
 	}
@@ -111,7 +153,50 @@ string TriMeshIO::input_file_format(
 		if(is_stl_a(filename) == true)	return FMT_STL_A;
 		else							return FMT_STL_B;
 	}
+	else if (!strcmp(ext, "plsnap") || !strcmp(ext, "PLSNAP")) {
+		 return FMT_SNAP;
+	}
+	else if (!strcmp(ext, "obj") || !strcmp(ext, "OBJ")) {
+		 return FMT_OBJ;
+	}
+	else if (!strcmp(ext, "ply") || !strcmp(ext, "PLY")) {
+		 return FMT_PLY;
+	}
 	return "";
 }
 
+// private ////////////////////////////////////////////////////////////////////
+POLYLIB_STAT TriMeshIO::load_file(
+	vector<PrivateTriangle*>	*tri_list, 
+	const string				&fname,
+	const string				&fmt,
+	int							*total,
+	float						scale,
+	const BBox					*region
+) {
+	if (fmt == "") {
+		PL_ERROSH << "[ERROR]:TTriMeshIO::load():Unknown stl format." << endl;
+		return PLSTAT_NG;
+	}
+	else if (fmt == FMT_STL_A || fmt == FMT_STL_AA) {
+		return stl_a_load(tri_list, fname, total, scale, region);
+	}
+	else if (fmt == FMT_STL_B || fmt == FMT_STL_BB) {
+		return stl_b_load(tri_list, fname, total, scale, region);
+	}
+	else if (fmt == FMT_OBJ) {
+		return obj_load(tri_list, fname, total, scale, region);
+	}
+	else if (fmt == FMT_PLY) {
+		return ply_load(tri_list, fname, total, scale, region);
+	}
+	else if (fmt == FMT_SNAP) {
+		// スナップショットはKD木を含むため、PolygonGroup単位でのみ読み込める
+		PL_ERROSH << "[ERROR]:TriMeshIO::load():Snapshot can't be mixed with "
+				  << "other files:" << fname << endl;
+		return PLSTAT_UNKNOWN_STL_FORMAT;
+	}
+	return PLSTAT_OK;
+}
+
 } //namespace PolylibNS
@@ -0,0 +1,615 @@
+/*
+ * Polylib - Polygon Management Library
+ *
+ * Copyright (c) 2010-2011 VCAD System Research Program, RIKEN.
+ * All rights reserved.
+ *
+ * Copyright (c) 2012-2013 Advanced Institute for Computational Science, RIKEN.
+ * All rights reserved.
+ *
+ */
+
+#include <string.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include "common/PolylibCommon.h"
+#include "polygons/Triangle.h"
+#include "file_io/indexed_mesh.h"
+#include "file_io/stl.h"
+#include "file_io/GzipStream.h"
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace PolylibNS {
+
+using namespace std;
+
+#define IDX_CHUNK_MIN		(1<<20)	// minimum chunk size for OBJ parser
+
+//
+// 読み込んだファイルの内容。メモリマップできればmapに、できなければ
+// (gzip圧縮ファイルを含む)dataに保持する
+//
+struct IdxFile {
+	const char		*begin;
+	size_t			size;
+	void			*map;
+	vector<char>	data;
+};
+
+//
+// インデックス形式のメッシュ。頂点座標と、面毎の頂点番号(0始まり)の並び
+//
+struct IdxMesh {
+	vector<float>	vtx;		// 頂点座標(x,y,z)
+	vector<int>		face_len;	// 面毎の頂点数
+	vector<int>		face_idx;	// 面の頂点番号
+};
+
+//
+// PLYの要素とプロパティ
+//
+enum PlyType {
+	PLY_INT8, PLY_UINT8, PLY_INT16, PLY_UINT16,
+	PLY_INT32, PLY_UINT32, PLY_FLOAT32, PLY_FLOAT64, PLY_UNKNOWN
+};
+struct PlyProp {
+	PlyType		type;		// 値(リストの場合は要素)の型
+	PlyType		count_type;	// リストの要素数の型。リストでなければPLY_UNKNOWN
+	string		name;
+};
+struct PlyElem {
+	string				name;
+	long				count;
+	vector<PlyProp>		props;
+};
+
+static bool idx_open(const string &fname, IdxFile *file);
+static void idx_close(IdxFile *file);
+static bool idx_build(const IdxMesh &mesh, float scale, const BBox *region,
+	vector<PrivateTriangle*> *tri_list, int *total);
+static bool obj_parse(const char *p, const char *end, IdxMesh *mesh,
+	vector<char> *rel);
+static const char *ply_parse_header(const char *p, const char *end,
+	int *format, vector<PlyElem> *elems);
+static bool ply_parse_body(const char *p, const char *end, int format,
+	const vector<PlyElem> &elems, IdxMesh *mesh);
+
+//////////////////////////////////////////////////////////////////////////////
+POLYLIB_STAT obj_load(
+	vector<PrivateTriangle*>	*tri_list,
+	string						fname,
+	int							*total,
+	float						scale,
+	const BBox					*region
+) {
+	IdxFile file;
+	if (!idx_open(fname, &file)) {
+		PL_ERROSH << "[ERROR]indexed_mesh:obj_load():Can't open " << fname << endl;
+		return PLSTAT_STL_IO_ERROR;
+	}
+
+	// 行頭で区切ったチャンク毎に並列に解析する
+	const char *begin = file.begin;
+	const char *end = file.begin + file.size;
+	int n_chunk = 1;
+#ifdef _OPENMP
+	n_chunk = omp_get_max_threads();
+	if ((size_t)n_chunk > file.size / IDX_CHUNK_MIN) {
+		n_chunk = (int)(file.size / IDX_CHUNK_MIN);
+	}
+	if (n_chunk < 1) n_chunk = 1;
+#endif
+	vector<const char*> bound(n_chunk + 1);
+	bound[0] = begin;
+	bound[n_chunk] = end;
+	for (int i = 1; i < n_chunk; i++) {
+		const char *p = begin + file.size / n_chunk * i;
+		if (p < bound[i-1]) p = bound[i-1];
+		const char *eol = (const char*)memchr(p, '\n', end - p);
+		bound[i] = (eol == NULL) ? end : eol + 1;
+	}
+
+	// 負の頂点番号はその行までの頂点数からの相対位置なので、チャンク内の
+	// 番号として解析し、後でチャンクの先頭頂点番号を加える
+	vector<IdxMesh>			parts(n_chunk);
+	vector< vector<char> >	rel(n_chunk);
+	int n_err = 0;
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic,1) reduction(+:n_err)
+#endif
+	for (int i = 0; i < n_chunk; i++) {
+		if (!obj_parse(bound[i], bound[i+1], &parts[i], &rel[i])) n_err++;
+	}
+	idx_close(&file);
+
+	if (n_err > 0) {
+		PL_ERROSH << "[ERROR]indexed_mesh:obj_load():Error in loading: "
+				  << fname << endl;
+		return PLSTAT_STL_IO_ERROR;
+	}
+
+	// チャンク順に連結する
+	IdxMesh mesh;
+	size_t n_vtx = 0, n_face = 0, n_idx = 0;
+	for (int i = 0; i < n_chunk; i++) {
+		n_vtx += parts[i].vtx.size();
+		n_face += parts[i].face_len.size();
+		n_idx += parts[i].face_idx.size();
+	}
+	mesh.vtx.reserve(n_vtx);
+	mesh.face_len.reserve(n_face);
+	mesh.face_idx.reserve(n_idx);
+	for (int i = 0; i < n_chunk; i++) {
+		int vbase = mesh.vtx.size() / 3;
+		for (size_t j = 0; j < parts[i].face_idx.size(); j++) {
+			int idx = parts[i].face_idx[j];
+			mesh.face_idx.push_back(rel[i][j] ? vbase + idx : idx);
+		}
+		mesh.vtx.insert(mesh.vtx.end(), parts[i].vtx.begin(), parts[i].vtx.end());
+		mesh.face_len.insert(mesh.face_len.end(), parts[i].face_len.begin(),
+							 parts[i].face_len.end());
+		vector<float>().swap(parts[i].vtx);
+		vector<int>().swap(parts[i].face_len);
+		vector<int>().swap(parts[i].face_idx);
+		vector<char>().swap(rel[i]);
+	}
+
+	if (!idx_build(mesh, scale, region, tri_list, total)) {
+		PL_ERROSH << "[ERROR]indexed_mesh:obj_load():Invalid vertex index in "
+				  << fname << endl;
+		return PLSTAT_STL_IO_ERROR;
+	}
+	return PLSTAT_OK;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+POLYLIB_STAT ply_load(
+	vector<PrivateTriangle*>	*tri_list,
+	string						fname,
+	int							*total,
+	float						scale,
+	const BBox					*region
+) {
+	IdxFile file;
+	if (!idx_open(fname, &file)) {
+		PL_ERROSH << "[ERROR]indexed_mesh:ply_load():Can't open " << fname << endl;
+		return PLSTAT_STL_IO_ERROR;
+	}
+
+	const char		*end = file.begin + file.size;
+	int				format;
+	vector<PlyElem>	elems;
+	IdxMesh			mesh;
+	const char *p = ply_parse_header(file.begin, end, &format, &elems);
+	bool ok = (p != NULL) && ply_parse_body(p, end, format, elems, &mesh);
+	idx_close(&file);
+
+	if (!ok) {
+		PL_ERROSH << "[ERROR]indexed_mesh:ply_load():Error in loading: "
+				  << fname << endl;
+		return PLSTAT_STL_IO_ERROR;
+	}
+	if (!idx_build(mesh, scale, region, tri_list, total)) {
+		PL_ERROSH << "[ERROR]indexed_mesh:ply_load():Invalid vertex index in "
+				  << fname << endl;
+		return PLSTAT_STL_IO_ERROR;
+	}
+	return PLSTAT_OK;
+}
+
+//=======================================================================
+// static関数
+//=======================================================================
+//////////////////////////////////////////////////////////////////////////////
+// ファイル全体をメモリマップする。gzip圧縮ファイルとマップできないファイルは
+// 伸長しながら読み込む
+static bool idx_open(const string &fname, IdxFile *file)
+{
+	file->begin = NULL;
+	file->size = 0;
+	file->map = MAP_FAILED;
+
+	if (!GzipStreamBuf::is_gzip(fname)) {
+		int fd = open(fname.c_str(), O_RDONLY);
+		if (fd < 0) return false;
+		struct stat	st;
+		if (fstat(fd, &st) == 0) file->size = (size_t)st.st_size;
+		if (file->size > 0) {
+			file->map = mmap(NULL, file->size, PROT_READ, MAP_PRIVATE, fd, 0);
+		}
+		close(fd);
+		if (file->map != MAP_FAILED) {
+#ifdef MADV_SEQUENTIAL
+			madvise(file->map, file->size, MADV_SEQUENTIAL);
+#endif
+			file->begin = (const char*)file->map;
+			return true;
+		}
+	}
+
+	GzipIFStream is(fname, ios::in | ios::binary);
+	if (is.fail()) return false;
+	file->data.assign(istreambuf_iterator<char>(is), istreambuf_iterator<char>());
+	is.close();
+	if (is.bad()) return false;
+	file->size = file->data.size();
+	file->begin = file->data.empty() ? NULL : &file->data[0];
+	return true;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+static void idx_close(IdxFile *file)
+{
+	if (file->map != MAP_FAILED) munmap(file->map, file->size);
+	file->map = MAP_FAILED;
+	vector<char>().swap(file->data);
+	file->begin = NULL;
+	file->size = 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// 面の頂点番号faceのi番目の頂点座標にスケールを掛けて返す
+static inline Vec3f idx_vertex(const IdxMesh &mesh, const int *face, int i,
+							   float scale)
+{
+	const float *v = &mesh.vtx[(size_t)face[i] * 3];
+	return Vec3f(v[0] * scale, v[1] * scale, v[2] * scale);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// 面を扇形に三角形分割してtri_listに追加する。三角形IDは領域外で読み飛ばした
+// 三角形も含めて、ファイル中の順に通番を振る
+static bool idx_build(
+	const IdxMesh &mesh, float scale, const BBox *region,
+	vector<PrivateTriangle*> *tri_list, int *total
+) {
+	int n_vtx = mesh.vtx.size() / 3;
+	int n_face = mesh.face_len.size();
+
+	// 面毎の頂点番号の位置と、三角形の通番
+	vector<size_t>	idx_off(n_face + 1, 0);
+	vector<int>		tri_off(n_face + 1, 0);
+	for (int f = 0; f < n_face; f++) {
+		int len = mesh.face_len[f];
+		idx_off[f+1] = idx_off[f] + len;
+		tri_off[f+1] = tri_off[f] + (len >= 3 ? len - 2 : 0);
+	}
+	for (size_t i = 0; i < mesh.face_idx.size(); i++) {
+		if (mesh.face_idx[i] < 0 || mesh.face_idx[i] >= n_vtx) return false;
+	}
+	int n_tri = tri_off[n_face];
+	const int *idx = mesh.face_idx.empty() ? NULL : &mesh.face_idx[0];
+
+	// 領域と交差する三角形を判定する
+	vector<char> keep(n_tri, 1);
+	if (region != NULL) {
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static)
+#endif
+		for (int f = 0; f < n_face; f++) {
+			const int *face = idx + idx_off[f];
+			for (int k = 0; k < tri_off[f+1] - tri_off[f]; k++) {
+				BBox bbox;
+				bbox.init();
+				bbox.add(idx_vertex(mesh, face, 0, scale));
+				bbox.add(idx_vertex(mesh, face, k + 1, scale));
+				bbox.add(idx_vertex(mesh, face, k + 2, scale));
+				keep[tri_off[f] + k] = bbox.crossed(*region);
+			}
+		}
+	}
+
+	// 残す三角形のtri_list上の位置
+	vector<size_t>	pos(n_tri);
+	size_t			n_keep = 0;
+	for (int t = 0; t < n_tri; t++) {
+		pos[t] = n_keep;
+		n_keep += keep[t];
+	}
+	size_t base = tri_list->size();
+	tri_list->resize(base + n_keep);
+
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static)
+#endif
+	for (int f = 0; f < n_face; f++) {
+		const int *face = idx + idx_off[f];
+		for (int k = 0; k < tri_off[f+1] - tri_off[f]; k++) {
+			int t = tri_off[f] + k;
+			if (!keep[t]) continue;
+			Vec3f vtx[3];
+			vtx[0] = idx_vertex(mesh, face, 0, scale);
+			vtx[1] = idx_vertex(mesh, face, k + 1, scale);
+			vtx[2] = idx_vertex(mesh, face, k + 2, scale);
+			(*tri_list)[base + pos[t]] = new PrivateTriangle(vtx, *total + t);
+		}
+	}
+
+	*total += n_tri;		// 更新した通番をセット
+	return true;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// 行内の空白(改行以外)を読み飛ばす
+static inline const char *idx_skip_blank(const char *p, const char *end)
+{
+	while (p < end && (*p == ' ' || *p == '\t' || *p == '\r')) p++;
+	return p;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// 符号付き整数の解析。先頭の空白は読み飛ばす。数値でなければNULL
+static const char *idx_parse_int(const char *p, const char *end, long *val)
+{
+	while (p < end && (unsigned char)*p <= ' ') p++;
+	bool neg = false;
+	if (p < end && (*p == '-' || *p == '+')) neg = (*p++ == '-');
+	const char *q = p;
+	long v = 0;
+	for (; q < end && (unsigned)(*q - '0') < 10; q++) v = v * 10 + (*q - '0');
+	if (q == p) return NULL;
+	*val = neg ? -v : v;
+	return q;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// [p, end)のOBJを行毎に解析する。頂点番号は正ならば0始まりの絶対番号、
+// 負ならばチャンク内の頂点番号(チャンク先頭より前を指す場合は負)とし、
+// relに相対番号か否かを記録する
+static bool obj_parse(
+	const char *p, const char *end, IdxMesh *mesh, vector<char> *rel
+) {
+	mesh->vtx.reserve((end - p) / 40 * 3);
+	while (p < end) {
+		const char *eol = (const char*)memchr(p, '\n', end - p);
+		if (eol == NULL) eol = end;
+		const char *q = idx_skip_blank(p, eol);
+		bool key = (eol - q >= 2) && (q[1] == ' ' || q[1] == '\t');
+
+		if (key && q[0] == 'v') {
+			q++;
+			for (int i = 0; i < 3; i++) {
+				float v;
+				if ((q = stl_a_parse_float(q, eol, &v)) == NULL) return false;
+				mesh->vtx.push_back(v);
+			}
+		}
+		else if (key && q[0] == 'f') {
+			int n_local = mesh->vtx.size() / 3;
+			int len = 0;
+			for (q++; (q = idx_skip_blank(q, eol)) < eol; len++) {
+				// "v/vt/vn"のうち頂点番号のみを使用する
+				long idx;
+				if ((q = idx_parse_int(q, eol, &idx)) == NULL || idx == 0) {
+					return false;
+				}
+				while (q < eol && *q != ' ' && *q != '\t' && *q != '\r') q++;
+				mesh->face_idx.push_back(idx > 0 ? (int)(idx - 1) : n_local + (int)idx);
+				rel->push_back(idx < 0);
+			}
+			mesh->face_len.push_back(len);
+		}
+		p = eol + 1;
+	}
+	return true;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// PLYの型名から型を求める
+static PlyType ply_type(const string &name)
+{
+	if (name == "char"   || name == "int8")		return PLY_INT8;
+	if (name == "uchar"  || name == "uint8")	return PLY_UINT8;
+	if (name == "short"  || name == "int16")	return PLY_INT16;
+	if (name == "ushort" || name == "uint16")	return PLY_UINT16;
+	if (name == "int"    || name == "int32")	return PLY_INT32;
+	if (name == "uint"   || name == "uint32")	return PLY_UINT32;
+	if (name == "float"  || name == "float32")	return PLY_FLOAT32;
+	if (name == "double" || name == "float64")	return PLY_FLOAT64;
+	return PLY_UNKNOWN;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// PLYの型のバイト数
+static inline int ply_size(PlyType type)
+{
+	static const int size[] = {1, 1, 2, 2, 4, 4, 4, 8, 0};
+	return size[type];
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// PLYのヘッダを解析する。formatは0:ascii、1:リトルエンディアン、
+// 2:ビッグエンディアン。ヘッダの次の位置を返す。不正ならばNULL
+static const char *ply_parse_header(
+	const char *p, const char *end, int *format, vector<PlyElem> *elems
+) {
+	*format = -1;
+	bool first = true;
+	while (p < end) {
+		const char *eol = (const char*)memchr(p, '\n', end - p);
+		if (eol == NULL) return NULL;
+		string line(p, eol);
+		p = eol + 1;
+		if (!line.empty() && line[line.size() - 1] == '\r') {
+			line.erase(line.size() - 1);
+		}
+
+		// 空白区切りのトークンに分割する
+		vector<string> tok;
+		size_t pos = 0;
+		while ((pos = line.find_first_not_of(" \t", pos)) != string::npos) {
+			size_t next = line.find_first_of(" \t", pos);
+			tok.push_back(line.substr(pos, next - pos));
+			pos = next;
+		}
+
+		if (first) {
+			if (tok.size() != 1 || tok[0] != "ply") return NULL;
+			first = false;
+		}
+		else if (tok.empty() || tok[0] == "comment" || tok[0] == "obj_info") {
+			continue;
+		}
+		else if (tok[0] == "format" && tok.size() >= 2) {
+			if (tok[1] == "ascii")						*format = 0;
+			else if (tok[1] == "binary_little_endian")	*format = 1;
+			else if (tok[1] == "binary_big_endian")		*format = 2;
+			else										return NULL;
+		}
+		else if (tok[0] == "element" && tok.size() == 3) {
+			PlyElem elem;
+			elem.name = tok[1];
+			elem.count = atol(tok[2].c_str());
+			if (elem.count < 0) return NULL;
+			elems->push_back(elem);
+		}
+		else if (tok[0] == "property" && !elems->empty()) {
+			PlyProp prop;
+			if (tok.size() == 5 && tok[1] == "list") {
+				prop.count_type = ply_type(tok[2]);
+				prop.type = ply_type(tok[3]);
+				prop.name = tok[4];
+				if (prop.count_type == PLY_UNKNOWN) return NULL;
+			}
+			else if (tok.size() == 3) {
+				prop.count_type = PLY_UNKNOWN;
+				prop.type = ply_type(tok[1]);
+				prop.name = tok[2];
+			}
+			else {
+				return NULL;
+			}
+			if (prop.type == PLY_UNKNOWN) return NULL;
+			elems->back().props.push_back(prop);
+		}
+		else if (tok[0] == "end_header") {
+			return (*format < 0) ? NULL : p;
+		}
+		else {
+			return NULL;
+		}
+	}
+	return NULL;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// PLYの値を1つ読み込み、次の位置を返す。範囲外や数値でなければNULL
+static inline const char *ply_read(
+	const char *p, const char *end, PlyType type, int format, double *val
+) {
+	if (format == 0) {
+		if (type == PLY_FLOAT32 || type == PLY_FLOAT64) {
+			float f;
+			p = stl_a_parse_float(p, end, &f);
+			*val = f;
+		}
+		else {
+			long l;
+			p = idx_parse_int(p, end, &l);
+			*val = (double)l;
+		}
+		return p;
+	}
+
+	int size = ply_size(type);
+	if (end - p < size) return NULL;
+	unsigned char b[8];
+	memcpy(b, p, size);
+
+	// ファイルと計算機のバイト順が異なれば反転する
+	static const int one = 1;
+	bool little = *(const char*)&one != 0;
+	if (little != (format == 1)) reverse(b, b + size);
+
+	switch (type) {
+	case PLY_INT8:		*val = *(signed char*)b;		break;
+	case PLY_UINT8:		*val = *(unsigned char*)b;		break;
+	case PLY_INT16:		{ short v;			memcpy(&v, b, 2); *val = v; } break;
+	case PLY_UINT16:	{ unsigned short v;	memcpy(&v, b, 2); *val = v; } break;
+	case PLY_INT32:		{ int v;			memcpy(&v, b, 4); *val = v; } break;
+	case PLY_UINT32:	{ unsigned int v;	memcpy(&v, b, 4); *val = v; } break;
+	case PLY_FLOAT32:	{ float v;			memcpy(&v, b, 4); *val = v; } break;
+	case PLY_FLOAT64:	{ double v;			memcpy(&v, b, 8); *val = v; } break;
+	default:			return NULL;
+	}
+	return p + size;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// PLYの本体を解析し、vertex要素の座標とface要素の頂点番号をmeshに設定する
+static bool ply_parse_body(
+	const char *p, const char *end, int format,
+	const vector<PlyElem> &elems, IdxMesh *mesh
+) {
+	for (size_t e = 0; e < elems.size(); e++) {
+		const PlyElem &elem = elems[e];
+		bool is_vertex = (elem.name == "vertex");
+		bool is_face = (elem.name == "face");
+
+		// 使用するプロパティの番号(vertex:x,y,z / face:頂点番号のリスト)
+		int use[3] = {-1, -1, -1};
+		for (int i = 0; i < (int)elem.props.size(); i++) {
+			const string &name = elem.props[i].name;
+			if (is_vertex && name.size() == 1 && name[0] >= 'x' && name[0] <= 'z') {
+				use[name[0] - 'x'] = i;
+			}
+			if (is_face && elem.props[i].count_type != PLY_UNKNOWN &&
+				(name == "vertex_indices" || name == "vertex_index")) {
+				use[0] = i;
+			}
+		}
+		// 1レコードは少なくとも1バイトなので、残りより多ければ不正
+		if (!elem.props.empty() && elem.count > end - p) return false;
+		if (is_vertex) {
+			if (use[0] < 0 || use[1] < 0 || use[2] < 0) return false;
+			mesh->vtx.resize(elem.count * 3);
+		}
+		if (is_face) {
+			if (use[0] < 0) return false;
+			mesh->face_len.reserve(elem.count);
+			mesh->face_idx.reserve(elem.count * 3);
+		}
+
+		for (long r = 0; r < elem.count; r++) {
+			for (int i = 0; i < (int)elem.props.size(); i++) {
+				const PlyProp &prop = elem.props[i];
+				double val;
+				if (prop.count_type == PLY_UNKNOWN) {
+					if ((p = ply_read(p, end, prop.type, format, &val)) == NULL) {
+						return false;
+					}
+					for (int k = 0; is_vertex && k < 3; k++) {
+						if (use[k] == i) mesh->vtx[r * 3 + k] = (float)val;
+					}
+					continue;
+				}
+
+				if ((p = ply_read(p, end, prop.count_type, format, &val)) == NULL) {
+					return false;
+				}
+				int len = (int)val;
+				if (len < 0) return false;
+				bool take = is_face && use[0] == i;
+				if (take) mesh->face_len.push_back(len);
+				for (int k = 0; k < len; k++) {
+					if ((p = ply_read(p, end, prop.type, format, &val)) == NULL) {
+						return false;
+					}
+					if (take) mesh->face_idx.push_back((int)val);
+				}
+			}
+		}
+	}
+	return true;
+}
+
+} //namespace PolylibNS
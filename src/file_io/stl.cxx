@@ -10,13 +10,23 @@
  */
 
 #include <string.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <fstream>
 #include <vector>
 #include <iomanip>
+#include <algorithm>
 #include "common/tt.h"
 #include "polygons/Triangle.h"
 #include "file_io/TriMeshIO.h"
 #include "file_io/stl.h"
+#include "file_io/GzipStream.h"
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 namespace PolylibNS {
 
@@ -24,6 +34,14 @@ using namespace std;
 
 #define SCIENTIFIC_OUT		0
 #define STL_HEAD			80		// header size for STL binary
+#define STL_B_RECORD		STL_B_RECORD_SIZE	// facet record size for STL binary
+#define STL_A_CHUNK_MIN		(1<<20)	// minimum chunk size for STL ascii parser
+#define STL_A_CHUNK_MAX		(1<<26)	// maximum chunk size for STL ascii parser
+#define STL_B_RELEASE		(1<<24)	// page release interval for STL binary
+#define STL_B_RANGE_CHUNK	(1<<16)	// records per pread for STL binary range
+#define STL_SAVE_CHUNK		(1<<15)	// facets formatted at a time by a thread
+#define STL_A_RECORD_MAX	256		// maximum length of a facet in STL ascii
+#define STL_A_LIMB_MAX		16		// base 1e9 limbs to expand a float exactly
 #define STL_BUFF_LEN		256
 #define TT_OTHER_ENDIAN		1
 #define TT_LITTLE_ENDIAN	2
@@ -32,74 +50,83 @@ using namespace std;
 static void	tt_invert_byte_order(void* _mem, int size, int n);
 static int	tt_check_machine_endian();
 static void	tt_read(istream& is, void* _data, int size, int n, int inv);
-static void	tt_write(ostream& os, const void* _data, int size, int n, int inv);
+static POLYLIB_STAT stl_b_load_stream(vector<PrivateTriangle*> *tri_list,
+						string fname, int *total, float scale, const BBox *region);
+static bool stl_a_load_buffer(const char *begin, const char *end, float scale,
+						const BBox *region, bool release,
+						vector<PrivateTriangle*> *tri_list, int *total);
+static POLYLIB_STAT stl_a_load_gzip(vector<PrivateTriangle*> *tri_list,
+						string fname, int *total, float scale, const BBox *region);
+static const char *stl_a_last_facet(const char *begin, const char *end);
+static bool stl_a_parse(const char *p, const char *end, float scale,
+						const BBox *region, vector<float> *facets,
+						vector<int> *seq, int *n_facet);
+static bool stl_in_region(const float *vtx, const BBox *region);
+static void stl_release_pages(const char *from, const char *to);
+static bool stl_save_records(ostream &os, vector<PrivateTriangle*> *tri_list,
+	size_t (*put)(char *p, const PrivateTriangle *tri, int inv),
+	size_t max_len, int inv);
+static size_t stl_a_put_facet(char *p, const PrivateTriangle *tri, int inv);
+static size_t stl_b_put_facet(char *p, const PrivateTriangle *tri, int inv);
+static ushort stl_b_decode(const char *p, float scale, int inv, float *rec);
+static const char *stl_a_next_facet(const char *p, const char *begin,
+									const char *end);
 
 //////////////////////////////////////////////////////////////////////////////
 POLYLIB_STAT stl_a_load(
 	vector<PrivateTriangle*>	*tri_list, 
 	string 						fname,
 	int							*total,
-	float						scale
+	float						scale,
+	const BBox					*region
 ) {
+	// gzip圧縮ファイルはブロック毎に伸長しながら解析する
+	if (GzipStreamBuf::is_gzip(fname)) {
+		return stl_a_load_gzip(tri_list, fname, total, scale, region);
+	}
 
-	ifstream is(fname.c_str());
-	if (is.fail()) {
+	// ファイル全体をメモリマップ(できなければ読み込み)する
+	int fd = open(fname.c_str(), O_RDONLY);
+	if (fd < 0) {
 		PL_ERROSH << "[ERROR]stl:stl_a_load():Can't open " << fname << endl;
 		return PLSTAT_STL_IO_ERROR;
 	}
 
-	int n_tri = *total;		// 通番の初期値をセット
-	int n_vtx = 0;
-
-	string token;
-	Vec3f nml;
-	Vec3f vtx[3];
-	while (is >> token && !is.eof()) {
-		if (token == "solid") {
-			string s;
-			is >> s;
-		}
-		else if (token == "facet") {
-			n_vtx = 0;
+	struct stat	st;
+	size_t		fsize = 0;
+	void		*map = MAP_FAILED;
+	if (fstat(fd, &st) == 0) fsize = (size_t)st.st_size;
+	if (fsize > 0) map = mmap(NULL, fsize, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
 
-			string s;
-			is >> s;
-			is >> nml;
-			nml.normalize();
-		}
-		else if (token == "vertex") {
-			Vec3f v;
-			is >> v;
-			if (n_vtx < 3) {
-				vtx[n_vtx] = v * scale;
-			}
-			n_vtx++;
-		}
-		else if (token == "outer") {
-			string s;
-			is >> s;
-		}
-		else if (token == "endloop") {
-		}
-		else if (token == "endfacet") {
-			if (n_vtx == 3) {
-				PrivateTriangle *tri = new PrivateTriangle(vtx, nml, n_tri);
-				tri_list->push_back(tri);
-				n_tri++;
-			}
-		}
-		else if (token == "endsolid") {
-			string s;
-			is >> s;
+	vector<char> buf;
+	const char *begin;
+	if (map != MAP_FAILED) {
+#ifdef MADV_SEQUENTIAL
+		madvise(map, fsize, MADV_SEQUENTIAL);
+#endif
+		begin = (const char*)map;
+	}
+	else {
+		ifstream is(fname.c_str(), ios::in | ios::binary);
+		if (is.fail()) {
+			PL_ERROSH << "[ERROR]stl:stl_a_load():Can't open " << fname << endl;
+			return PLSTAT_STL_IO_ERROR;
 		}
+		buf.assign(istreambuf_iterator<char>(is), istreambuf_iterator<char>());
+		fsize = buf.size();
+		begin = buf.empty() ? NULL : &buf[0];
 	}
 
-	if (!is.eof() && is.fail()) {
+	bool ok = stl_a_load_buffer(begin, begin + fsize, scale, region,
+								map != MAP_FAILED, tri_list, total);
+
+	if (map != MAP_FAILED) munmap(map, fsize);
+
+	if (!ok) {
 		PL_ERROSH << "[ERROR]stl:stl_a_load():Error in loading: " << fname << endl;
 		return PLSTAT_STL_IO_ERROR;
 	}
-
-	*total = n_tri;		// 更新した通番をセット
 #ifdef DEBUG
 PL_DBGOSH <<  "stl_a_load total=" << *total << endl;
 #endif
@@ -111,40 +138,23 @@ POLYLIB_STAT stl_a_save(
 	vector<PrivateTriangle*>	*tri_list, 
 	string 						fname
 ) {
-	ofstream os(fname.c_str());
+	GzipOFStream os(fname);
 
 	if (os.fail()) {
 		PL_ERROSH << "[ERROR]stl:stl_a_save():Can't open " << fname << endl;
 		return PLSTAT_STL_IO_ERROR;
 	}
 
-	os << "solid " << "model1" << endl;
+	os << "solid " << "model1" << '\n';
 
-	vector<PrivateTriangle*>::iterator itr;
-	for (itr = tri_list->begin(); itr != tri_list->end(); itr++) {
-#if SCIENTIFIC_OUT
-		os	<< "  facet " << "normal " << setprecision(6) << scientific 
-			<< (*itr)->get_normal() << endl;
-#else
-		os	<< "  facet " << "normal " << setprecision(6) 
-			<< (*itr)->get_normal() << endl;
-#endif
-		os << "	outer " << "loop" << endl;
-		for (int j = 0; j < 3; j++) {
-#if SCIENTIFIC_OUT
-			os	<< "	  vertex " << setprecision(6) << scientific 
-				<< (*itr)->get_vertex()[j] << endl;
-#else
-			os	<< "	  vertex " << setprecision(6) 
-				<< (*itr)->get_vertex()[j] << endl;
-#endif
-		}
-		os << "	endloop" << endl;
-		os << "  endfacet" << endl;
-	}
-	os << "endsolid " << "model1" << endl;
+	// 三角形を分割して並列に整形し、大きなバッファ単位で書き出す。
+	// endlによる行毎のフラッシュは行わない
+	bool ok = stl_save_records(os, tri_list, stl_a_put_facet, STL_A_RECORD_MAX, 0);
 
-	if (!os.eof() && os.fail()) {
+	os << "endsolid " << "model1" << '\n';
+	os.close();
+
+	if (!ok || (!os.eof() && os.fail())) {
 		PL_ERROSH << "[ERROR]stl:stl_a_save():Error in saving: " << fname << endl;
 		return PLSTAT_STL_IO_ERROR;
 	}
@@ -157,60 +167,205 @@ POLYLIB_STAT stl_b_load(
 	vector<PrivateTriangle*>	*tri_list, 
 	string 						fname,
 	int							*total,
-	float						scale
+	float						scale,
+	const BBox					*region
 ) {
-	ifstream ifs(fname.c_str(), ios::in | ios::binary);
-	if (ifs.fail()) {
-		PL_ERROSH << "[ERROR]stl:stl_b_load():Can't open " << fname << endl;
+	// ファイルをメモリマップし、50byteの三角形レコードを直接読み取る。
+	// マップできない場合とgzip圧縮ファイルはストリーム読み込みで代替する。
+	void		*map;
+	size_t		fsize;
+	const char	*ptr;
+	uint		element;
+	POLYLIB_STAT ret = stl_b_map(fname, &map, &fsize, &ptr, &element);
+	if (ret == PLSTAT_NG) {
+		return stl_b_load_stream(tri_list, fname, total, scale, region);
+	}
+	if (ret != PLSTAT_OK) return ret;
+#ifdef MADV_SEQUENTIAL
+	madvise(map, fsize, MADV_SEQUENTIAL);
+#endif
+
+	int n_tri = *total;		// 通番の初期値をセット
+	if (region == NULL) tri_list->reserve(tri_list->size() + element);
+
+	// STL_B_RELEASEバイト分ずつデコードし、読み終えたページを解放する
+	const uint batch = STL_B_RELEASE / STL_B_RECORD;
+	for (uint i = 0; i < element; i += batch) {
+		uint	n = min(element - i, batch);
+		size_t	size = (size_t)n * STL_B_RECORD;
+		stl_b_get_records(tri_list, ptr, n, n_tri, NULL, scale, region);
+		stl_release_pages(ptr, ptr + size);
+		ptr += size;
+		n_tri += (int)n;
+	}
+
+	stl_b_unmap(map, fsize);
+
+	*total = n_tri;		// 更新した通番をセット
+	return PLSTAT_OK;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+POLYLIB_STAT stl_b_map(
+	string			fname,
+	void			**map,
+	size_t			*map_size,
+	const char		**records,
+	unsigned int	*num
+) {
+	// gzip圧縮ファイルと、ヘッダに満たないファイルはマップしない
+	if (GzipStreamBuf::is_gzip(fname)) return PLSTAT_NG;
+	int fd = open(fname.c_str(), O_RDONLY);
+	if (fd < 0) {
+		PL_ERROSH << "[ERROR]stl:stl_b_map():Can't open " << fname << endl;
 		return PLSTAT_STL_IO_ERROR;
 	}
 
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size < STL_HEAD + (off_t)sizeof(uint)) {
+		close(fd);
+		return PLSTAT_NG;
+	}
+
+	size_t	fsize = (size_t)st.st_size;
+	void	*p = mmap(NULL, fsize, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (p == MAP_FAILED) return PLSTAT_NG;
+
 	int inv = tt_check_machine_endian() == TT_LITTLE_ENDIAN ? 0 : 1;
 
-	int		n_tri = *total;		// 通番の初期値をセット
-	uint	element = 0;
+	const char	*ptr = (const char*)p + STL_HEAD;
+	uint		element;
+	memcpy(&element, ptr, sizeof(uint));
+	if (inv) tt_invert_byte_order(&element, sizeof(uint), 1);
+	ptr += sizeof(uint);
 
-	char buf[STL_HEAD];
-	for (int i = 0; i < STL_HEAD; i++) buf[i] = 0;
-	tt_read(ifs, buf, sizeof(char), STL_HEAD, inv);
-	tt_read(ifs, &element, sizeof(uint), 1, inv);
+	// ファイルサイズが三角形数に足りない
+	size_t avail = (fsize - STL_HEAD - sizeof(uint)) / STL_B_RECORD;
+	if (element > avail) {
+		PL_ERROSH << "[ERROR]stl:stl_b_map():Error in loading: " << fname
+				  << " (truncated: " << avail << "/" << element << ")" << endl;
+		munmap(p, fsize);
+		return PLSTAT_STL_IO_ERROR;
+	}
 
-	ushort padding = 0;
-	for (uint i = 0; i < element; i++) {
-		// one plane normal
-		float nml[3];
-		tt_read(ifs, nml, sizeof(float), 3, inv);
-		Vec3f normal(nml);
+	*map = p;
+	*map_size = fsize;
+	*records = ptr;
+	*num = element;
+	return PLSTAT_OK;
+}
 
-		// three vertices
-		Vec3f vertex[3];
-		for (int j = 0; j < 3; j++) {
-			float vtx[3];
-			tt_read(ifs, vtx, sizeof(float), 3, inv);
-			vtx[0] = vtx[0] * scale;
-			vtx[1] = vtx[1] * scale;
-			vtx[2] = vtx[2] * scale;
-			Vec3f _vertex(vtx);
-			vertex[j] = _vertex;
-		}
+//////////////////////////////////////////////////////////////////////////////
+void stl_b_unmap(
+	void			*map,
+	size_t			map_size
+) {
+	if (map != NULL) munmap(map, map_size);
+}
 
-		// ２バイト予備領域
-		tt_read(ifs, &padding, sizeof(ushort), 1, inv);
+//////////////////////////////////////////////////////////////////////////////
+int stl_b_get_record(
+	const char		*p,
+	float			scale,
+	float			*rec
+) {
+	int inv = tt_check_machine_endian() == TT_LITTLE_ENDIAN ? 0 : 1;
+	return (int)stl_b_decode(p, scale, inv, rec);
+}
 
-		PrivateTriangle *tri = new PrivateTriangle(vertex, normal, n_tri);
-		// ２バイト予備領域をユーザ定義IDとして利用(Polylib-2.1より)
-		tri->set_exid( (int)padding );
-		tri_list->push_back(tri);
-		n_tri++;
+//////////////////////////////////////////////////////////////////////////////
+POLYLIB_STAT stl_b_num_trias(
+	string			fname,
+	unsigned int	*num
+) {
+	if (GzipStreamBuf::is_gzip(fname)) {
+		PL_ERROSH << "[ERROR]stl:stl_b_num_trias():Can't read a range of "
+				  << "compressed file " << fname << endl;
+		return PLSTAT_STL_IO_ERROR;
+	}
+	int fd = open(fname.c_str(), O_RDONLY);
+	if (fd < 0) {
+		PL_ERROSH << "[ERROR]stl:stl_b_num_trias():Can't open " << fname << endl;
+		return PLSTAT_STL_IO_ERROR;
+	}
 
+	struct stat st;
+	uint		element = 0;
+	bool		ok = fstat(fd, &st) == 0 &&
+					 st.st_size >= STL_HEAD + (off_t)sizeof(uint) &&
+					 pread(fd, &element, sizeof(uint), STL_HEAD) ==
+						(ssize_t)sizeof(uint);
+	close(fd);
+	if (!ok) {
+		PL_ERROSH << "[ERROR]stl:stl_b_num_trias():Can't read header: "
+				  << fname << endl;
+		return PLSTAT_STL_IO_ERROR;
+	}
+	if (tt_check_machine_endian() != TT_LITTLE_ENDIAN) {
+		tt_invert_byte_order(&element, sizeof(uint), 1);
 	}
 
-	if (!ifs.eof() && ifs.fail()) {
-		PL_ERROSH << "[ERROR]stl:stl_b_load():Error in loading: " << fname << endl;
+	// ファイルサイズが三角形数に足りない
+	off_t avail = (st.st_size - STL_HEAD - sizeof(uint)) / STL_B_RECORD;
+	if ((off_t)element > avail) {
+		PL_ERROSH << "[ERROR]stl:stl_b_num_trias():Error in loading: " << fname
+				  << " (truncated: " << avail << "/" << element << ")" << endl;
 		return PLSTAT_STL_IO_ERROR;
 	}
 
-	*total = n_tri;		// 更新した通番をセット
+	*num = element;
+	return PLSTAT_OK;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+POLYLIB_STAT stl_b_load_range(
+	vector<PrivateTriangle*>	*tri_list, 
+	string 						fname,
+	unsigned int				first,
+	unsigned int				num,
+	int							id_base,
+	float						scale
+) {
+	if (num == 0) return PLSTAT_OK;
+
+	int fd = open(fname.c_str(), O_RDONLY);
+	if (fd < 0) {
+		PL_ERROSH << "[ERROR]stl:stl_b_load_range():Can't open " << fname
+				  << endl;
+		return PLSTAT_STL_IO_ERROR;
+	}
+
+	// 読み込み範囲のレコードを一定量ずつ読み込む
+	vector<char>	buf((size_t)STL_B_RECORD * min(num, (uint)STL_B_RANGE_CHUNK));
+	off_t			offset = STL_HEAD + sizeof(uint) + (off_t)first * STL_B_RECORD;
+	int				n_tri = id_base + (int)first;
+	tri_list->reserve(tri_list->size() + num);
+
+	for (uint done = 0; done < num; ) {
+		uint	n = min(num - done, (uint)STL_B_RANGE_CHUNK);
+		size_t	size = (size_t)n * STL_B_RECORD;
+		size_t	got = 0;
+		while (got < size) {
+			ssize_t r = pread(fd, &buf[got], size - got, offset + got);
+			if (r <= 0) break;
+			got += r;
+		}
+		if (got < size) {
+			PL_ERROSH << "[ERROR]stl:stl_b_load_range():Error in loading: "
+					  << fname << " (" << first + done << "/" << num << ")"
+					  << endl;
+			close(fd);
+			return PLSTAT_STL_IO_ERROR;
+		}
+
+		stl_b_get_records(tri_list, &buf[0], n, n_tri, NULL, scale);
+		n_tri	+= n;
+		done	+= n;
+		offset	+= size;
+	}
+
+	close(fd);
 	return PLSTAT_OK;
 }
 
@@ -219,7 +374,7 @@ POLYLIB_STAT stl_b_save(
 	vector<PrivateTriangle*>	*tri_list, 
 	string 						fname
 ) {
-	ofstream ofs(fname.c_str(), ios::out | ios::binary);
+	GzipOFStream ofs(fname, ios::out | ios::binary);
 	if (ofs.fail()) {
 		PL_ERROSH << "[ERROR]stl:stl_b_save():Can't open " << fname << endl;
 		return PLSTAT_STL_IO_ERROR;
@@ -227,35 +382,88 @@ POLYLIB_STAT stl_b_save(
 
 	int inv = tt_check_machine_endian() == TT_LITTLE_ENDIAN ? 0 : 1;
 
-	uint element = tri_list->size();
+	char head[STL_B_HEADER_SIZE];
+	ofs.write(head, stl_b_put_header(head, tri_list->size()));
 
-	char buf[STL_HEAD];
-	for (int i = 0; i < STL_HEAD; i++) buf[i] = 0;
-	strcpy(buf, "default");
-	tt_write(ofs, buf, 1, STL_HEAD, inv);
-	tt_write(ofs, &element, sizeof(uint), 1, inv);
+	// レコードをまとめてバッファに詰め、大きな単位で書き出す
+	bool ok = stl_save_records(ofs, tri_list, stl_b_put_facet, STL_B_RECORD, inv);
+	ofs.close();
 
-	vector<PrivateTriangle*>::iterator itr = tri_list->begin();
-	for (uint m = 0; m < element; m++,itr++) {
-		// one plane normal
-		tt_write(ofs, (*itr)->get_normal().ptr(), sizeof(float), 3, inv);
+	if (!ok || (!ofs.eof() && ofs.fail())) {
+		PL_ERROSH << "[ERROR]stl:stl_b_load():Error in saving: " << fname << endl;
+		return PLSTAT_STL_IO_ERROR;
+	}
 
-		// three vertices
-		tt_write(ofs, (*itr)->get_vertex()[0].ptr(), sizeof(float), 3, inv);
-		tt_write(ofs, (*itr)->get_vertex()[1].ptr(), sizeof(float), 3, inv);
-		tt_write(ofs, (*itr)->get_vertex()[2].ptr(), sizeof(float), 3, inv);
+	return PLSTAT_OK;
+}
 
-		// ２バイト予備領域にユーザ定義IDを記録(Polylib-2.1より)
-		int exid = (*itr)->get_exid();
-		tt_write(ofs, &exid, sizeof(ushort), 1, inv);
+//////////////////////////////////////////////////////////////////////////////
+size_t stl_b_put_header(
+	char			*p,
+	unsigned int	num
+) {
+	memset(p, 0, STL_HEAD);
+	strcpy(p, "default");
+
+	uint element = num;
+	if (tt_check_machine_endian() != TT_LITTLE_ENDIAN) {
+		tt_invert_byte_order(&element, sizeof(uint), 1);
 	}
+	memcpy(p + STL_HEAD, &element, sizeof(uint));
+	return STL_B_HEADER_SIZE;
+}
 
-	if (!ofs.eof() && ofs.fail()) {
-		PL_ERROSH << "[ERROR]stl:stl_b_load():Error in saving: " << fname << endl;
-		return PLSTAT_STL_IO_ERROR;
+//////////////////////////////////////////////////////////////////////////////
+size_t stl_b_put_records(
+	char								*p,
+	const vector<PrivateTriangle*>		*tri_list
+) {
+	int inv = tt_check_machine_endian() == TT_LITTLE_ENDIAN ? 0 : 1;
+	size_t len = 0;
+	vector<PrivateTriangle*>::const_iterator it;
+	for (it = tri_list->begin(); it != tri_list->end(); it++) {
+		len += stl_b_put_facet(p + len, *it, inv);
 	}
+	return len;
+}
 
-	return PLSTAT_OK;
+//////////////////////////////////////////////////////////////////////////////
+void stl_b_get_records(
+	vector<PrivateTriangle*>	*tri_list,
+	const char					*p,
+	unsigned int				num,
+	int							id_base,
+	const int					*ids,
+	float						scale,
+	const BBox					*region
+) {
+	int inv = tt_check_machine_endian() == TT_LITTLE_ENDIAN ? 0 : 1;
+
+	// 分割して呼ばれても再確保が繰り返されないよう倍々で確保する
+	size_t need = tri_list->size() + num;
+	if (region == NULL && tri_list->capacity() < need) {
+		tri_list->reserve(max(need, 2 * tri_list->capacity()));
+	}
+
+	for (uint i = 0; i < num; i++, p += STL_B_RECORD) {
+		float	rec[12];
+		ushort	padding = stl_b_decode(p, scale, inv, rec);
+
+		// 領域外の三角形は作成しない(IDはレコード番号のまま進む)
+		if (!stl_in_region(&rec[3], region)) continue;
+
+		Vec3f normal(rec);
+		Vec3f vertex[3];
+		vertex[0] = Vec3f(&rec[3]);
+		vertex[1] = Vec3f(&rec[6]);
+		vertex[2] = Vec3f(&rec[9]);
+
+		int id = (ids != NULL) ? ids[i] : id_base + (int)i;
+		PrivateTriangle *tri = new PrivateTriangle(vertex, normal, id);
+		// ２バイト予備領域をユーザ定義IDとして利用(Polylib-2.1より)
+		tri->set_exid( (int)padding );
+		tri_list->push_back(tri);
+	}
 }
 
 //////////////////////////////////////////////////////////////////////////////
@@ -266,7 +474,7 @@ bool is_stl_a(string path)
 	size_t		i = 0;
 	char		c;
 
-	ifstream ifs(path.c_str());
+	GzipIFStream ifs(path);
 	if (!ifs)				   return false;
 
 	// ファイル内容の一部を読み込み
@@ -308,6 +516,630 @@ char *stl_get_ext(const string path) {
 //=======================================================================
 // static関数
 //=======================================================================
+//////////////////////////////////////////////////////////////////////////////
+static POLYLIB_STAT stl_b_load_stream(
+	vector<PrivateTriangle*>	*tri_list, 
+	string 						fname,
+	int							*total,
+	float						scale,
+	const BBox					*region
+) {
+	GzipIFStream ifs(fname, ios::in | ios::binary);
+	if (ifs.fail()) {
+		PL_ERROSH << "[ERROR]stl:stl_b_load_stream():Can't open " << fname << endl;
+		return PLSTAT_STL_IO_ERROR;
+	}
+
+	int inv = tt_check_machine_endian() == TT_LITTLE_ENDIAN ? 0 : 1;
+
+	int		n_tri = *total;		// 通番の初期値をセット
+	uint	element = 0;
+
+	char buf[STL_HEAD];
+	for (int i = 0; i < STL_HEAD; i++) buf[i] = 0;
+	tt_read(ifs, buf, sizeof(char), STL_HEAD, inv);
+	tt_read(ifs, &element, sizeof(uint), 1, inv);
+
+	// STL_B_RANGE_CHUNK件ずつ読み込んでデコードする
+	vector<char> recs((size_t)STL_B_RECORD * STL_B_RANGE_CHUNK);
+	for (uint i = 0; i < element; ) {
+		uint n = min(element - i, (uint)STL_B_RANGE_CHUNK);
+		ifs.read(&recs[0], (streamsize)n * STL_B_RECORD);
+		uint got = (uint)(ifs.gcount() / STL_B_RECORD);
+		stl_b_get_records(tri_list, &recs[0], got, n_tri, NULL, scale, region);
+		n_tri += (int)got;
+		i += got;
+		if (got < n) break;
+	}
+
+	// 三角形数に満たずに終端に達した場合もエラー
+	ifs.close();
+	if (ifs.fail()) {
+		PL_ERROSH << "[ERROR]stl:stl_b_load_stream():Error in loading: " << fname << endl;
+		return PLSTAT_STL_IO_ERROR;
+	}
+
+	*total = n_tri;		// 更新した通番をセット
+	return PLSTAT_OK;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// [begin, end)のASCII STLをチャンクに分けて並列に解析し、tri_listに三角形を
+// 追加する。releaseがtrueならば解析済みのページを解放する(メモリマップ時)
+static bool stl_a_load_buffer(
+	const char *begin, const char *end, float scale, const BBox *region,
+	bool release, vector<PrivateTriangle*> *tri_list, int *total
+) {
+	size_t fsize = end - begin;
+
+	// facetの区切りでチャンクに分割する。大きなファイルはチャンクの上限で
+	// 分割し、解析済みのチャンクのページを解放して常駐量を抑える
+	int n_chunk = 1;
+#ifdef _OPENMP
+	n_chunk = omp_get_max_threads();
+#endif
+	if ((size_t)n_chunk > fsize / STL_A_CHUNK_MIN) {
+		n_chunk = (int)(fsize / STL_A_CHUNK_MIN);
+	}
+	if ((size_t)n_chunk < fsize / STL_A_CHUNK_MAX + 1) {
+		n_chunk = (int)(fsize / STL_A_CHUNK_MAX + 1);
+	}
+	if (n_chunk < 1) n_chunk = 1;
+
+	vector<const char*> bound(n_chunk + 1);
+	bound[0] = begin;
+	bound[n_chunk] = end;
+	for (int i = 1; i < n_chunk; i++) {
+		bound[i] = stl_a_next_facet(begin + fsize / n_chunk * i, begin, end);
+		if (bound[i] < bound[i-1]) bound[i] = bound[i-1];
+	}
+
+	// チャンク毎に並列に解析(三角形1つにつき法線+3頂点の12要素)。
+	// 領域指定時は、残した三角形のチャンク内での通番をseqに記録する
+	vector< vector<float> > facets(n_chunk);
+	vector< vector<int> >	seq(n_chunk);
+	vector<int>				n_facet(n_chunk, 0);
+	int n_err = 0;
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic,1) reduction(+:n_err)
+#endif
+	for (int i = 0; i < n_chunk; i++) {
+		if (!stl_a_parse(bound[i], bound[i+1], scale, region, &facets[i],
+						 &seq[i], &n_facet[i])) {
+			n_err++;
+		}
+		if (release) stl_release_pages(bound[i], bound[i+1]);
+	}
+
+	if (n_err > 0) return false;
+
+	// チャンク順に通番を振って三角形を生成する(スレッド数に依らず同じ並び)
+	vector<size_t>	offset(n_chunk + 1, 0);		// tri_list上の位置
+	vector<int>		id_base(n_chunk + 1, 0);	// 通番
+	for (int i = 0; i < n_chunk; i++) {
+		offset[i+1] = offset[i] + facets[i].size() / 12;
+		id_base[i+1] = id_base[i] + n_facet[i];
+	}
+	size_t base = tri_list->size();
+	int n_tri = *total;		// 通番の初期値をセット
+	tri_list->resize(base + offset[n_chunk]);
+
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic,1)
+#endif
+	for (int i = 0; i < n_chunk; i++) {
+		const float *f = facets[i].empty() ? NULL : &facets[i][0];
+		for (size_t j = offset[i]; j < offset[i+1]; j++, f += 12) {
+			Vec3f nml(f);
+			Vec3f vtx[3];
+			vtx[0] = Vec3f(&f[3]);
+			vtx[1] = Vec3f(&f[6]);
+			vtx[2] = Vec3f(&f[9]);
+			int k = (region == NULL) ? (int)(j - offset[i]) : seq[i][j - offset[i]];
+			(*tri_list)[base + j] = 
+				new PrivateTriangle(vtx, nml, n_tri + id_base[i] + k);
+		}
+		vector<float>().swap(facets[i]);
+		vector<int>().swap(seq[i]);
+	}
+
+	*total = n_tri + id_base[n_chunk];		// 更新した通番をセット
+	return true;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// gzip圧縮したASCII STLを読み込む。伸長済みのブロックから完結したfacetまでを
+// 解析し、残りは次のブロックに繰り越す。伸長はGzipStreamBufの作業スレッドが
+// 先読みするので、解析と並行して進む
+static POLYLIB_STAT stl_a_load_gzip(
+	vector<PrivateTriangle*>	*tri_list, 
+	string 						fname,
+	int							*total,
+	float						scale,
+	const BBox					*region
+) {
+	GzipIFStream is(fname);
+	if (is.fail()) {
+		PL_ERROSH << "[ERROR]stl:stl_a_load_gzip():Can't open " << fname << endl;
+		return PLSTAT_STL_IO_ERROR;
+	}
+
+	vector<char>	buf(STL_A_CHUNK_MAX);
+	size_t			len = 0;	// バッファ内の有効長
+	bool			ok = true;
+	while (ok) {
+		if (len == buf.size()) buf.resize(buf.size() * 2);
+		is.read(&buf[len], buf.size() - len);
+		len += is.gcount();
+		bool last = !is;
+
+		// 最後のfacetは途中で切れているかもしれないので繰り越す
+		const char *begin = &buf[0];
+		const char *cut = last ? begin + len : stl_a_last_facet(begin, begin + len);
+		ok = stl_a_load_buffer(begin, cut, scale, region, false, tri_list, total);
+		if (last) break;
+
+		len = begin + len - cut;
+		memmove(&buf[0], cut, len);
+	}
+
+	bool read_error = is.fail() && !is.eof();
+	is.close();
+	if (!ok || read_error || is.bad()) {
+		PL_ERROSH << "[ERROR]stl:stl_a_load_gzip():Error in loading: " << fname
+				  << endl;
+		return PLSTAT_STL_IO_ERROR;
+	}
+	return PLSTAT_OK;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// 空白と制御文字を区切りとみなす
+static inline bool stl_a_is_space(char c)
+{
+	return (unsigned char)c <= ' ';
+}
+
+//////////////////////////////////////////////////////////////////////////////
+static inline const char *stl_a_skip_space(const char *p, const char *end)
+{
+	while (p < end && stl_a_is_space(*p)) p++;
+	return p;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+static inline bool stl_a_is_token(
+	const char *p, const char *tok_end, const char *kw, size_t len
+) {
+	return (size_t)(tok_end - p) == len && memcmp(p, kw, len) == 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// 浮動小数点数の解析(localeに依存しない)。
+// 有効数字19桁を超える桁は指数に繰り入れ、10^22を超える指数は分割して掛ける。
+const char *stl_a_parse_float(const char *p, const char *end, float *val)
+{
+	static const double pow10[] = {
+		1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,
+		1e10, 1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19,
+		1e20, 1e21, 1e22
+	};
+	unsigned long long mant = 0;
+	bool	neg = false;
+	int		exp10 = 0;
+	int		n_digit = 0;
+	int		n_sig = 0;
+
+	p = stl_a_skip_space(p, end);
+	if (p < end && (*p == '-' || *p == '+')) neg = (*p++ == '-');
+
+	// 整数部と小数部。仮数には先頭の0を除いて19桁までを入れる
+	for (; p < end && (unsigned)(*p - '0') < 10; p++, n_digit++) {
+		if (n_sig < 19) {
+			mant = mant * 10 + (*p - '0');
+			if (mant != 0) n_sig++;
+		}
+		else {
+			exp10++;
+		}
+	}
+	if (p < end && *p == '.') {
+		for (p++; p < end && (unsigned)(*p - '0') < 10; p++, n_digit++) {
+			if (n_sig < 19) {
+				mant = mant * 10 + (*p - '0');
+				if (mant != 0) n_sig++;
+				exp10--;
+			}
+		}
+	}
+	if (n_digit == 0) return NULL;
+
+	// 指数部
+	if (p < end && (*p == 'e' || *p == 'E')) {
+		const char *q = p + 1;
+		bool eneg = false;
+		if (q < end && (*q == '-' || *q == '+')) eneg = (*q++ == '-');
+		if (q < end && (unsigned)(*q - '0') < 10) {
+			int e = 0;
+			for (; q < end && (unsigned)(*q - '0') < 10; q++) {
+				if (e < 10000) e = e * 10 + (*q - '0');
+			}
+			exp10 += eneg ? -e : e;
+			p = q;
+		}
+	}
+
+	// 仮数が2^53未満かつ10^22以下の指数であれば、double演算1回で正しく丸められる。
+	// それ以外もdoubleの誤差は数ulpなので、floatへの丸めには影響しない
+	double d = (double)mant;
+	if (mant != 0) {
+		for (; exp10 > 22; exp10 -= 22)		d *= pow10[22];
+		for (; exp10 < -22; exp10 += 22)	d /= pow10[22];
+		d = exp10 < 0 ? d / pow10[-exp10] : d * pow10[exp10];
+	}
+	*val = (float)(neg ? -d : d);
+	return p;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// pの"facet"がfacetの始まりか。行頭(前は空白のみ)にあって"normal"が続くものに
+// 限り、ソリッド名や"endfacet"、"facets"などに含まれるものは対象外
+static inline bool stl_a_is_facet_start(
+	const char *p, const char *begin, const char *end
+) {
+	if (end - p < 5 || *p != 'f' || memcmp(p, "facet", 5) != 0) return false;
+
+	const char *q = p;
+	while (q > begin && (q[-1] == ' ' || q[-1] == '\t')) q--;
+	if (q > begin && q[-1] != '\n' && q[-1] != '\r') return false;
+
+	q = p + 5;
+	if (q == end || !stl_a_is_space(*q)) return false;
+	q = stl_a_skip_space(q, end);
+	return end - q >= 6 && memcmp(q, "normal", 6) == 0 &&
+		   (q + 6 == end || stl_a_is_space(q[6]));
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// pから後方で最初に現れるfacetの始まりの位置(無ければend)
+static const char *stl_a_next_facet(
+	const char *p, const char *begin, const char *end
+) {
+	for (; p + 5 <= end; p++) {
+		if (stl_a_is_facet_start(p, begin, end)) return p;
+	}
+	return end;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// [begin, end)で最後に現れるfacetの始まりの位置(無ければbegin)
+static const char *stl_a_last_facet(const char *begin, const char *end)
+{
+	for (const char *p = end - 5; p > begin; p--) {
+		if (stl_a_is_facet_start(p, begin, end)) return p;
+	}
+	return begin;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// [p, end)のASCII STLを解析し、三角形1つにつき法線+3頂点の12要素を追加する。
+// n_facetには解析した三角形数を返す。regionを指定した場合は領域と交差する
+// 三角形だけを追加し、その解析順の番号をseqに追加する。
+static bool stl_a_parse(
+	const char *p, const char *end, float scale, const BBox *region,
+	vector<float> *facets, vector<int> *seq, int *n_facet
+) {
+	float	f[12];
+	int		n_vtx = 0;
+
+	if (region == NULL) facets->reserve((end - p) / 200 * 12);
+	while ((p = stl_a_skip_space(p, end)) < end) {
+		const char *t = p;
+		while (p < end && !stl_a_is_space(*p)) p++;
+
+		if (stl_a_is_token(t, p, "vertex", 6)) {
+			float v[3];
+			for (int i = 0; i < 3; i++) {
+				if ((p = stl_a_parse_float(p, end, &v[i])) == NULL) return false;
+			}
+			if (n_vtx < 3) {
+				f[3 + n_vtx*3 + 0] = v[0] * scale;
+				f[3 + n_vtx*3 + 1] = v[1] * scale;
+				f[3 + n_vtx*3 + 2] = v[2] * scale;
+			}
+			n_vtx++;
+		}
+		else if (stl_a_is_token(t, p, "facet", 5)) {
+			n_vtx = 0;
+			// "normal"
+			p = stl_a_skip_space(p, end);
+			while (p < end && !stl_a_is_space(*p)) p++;
+			for (int i = 0; i < 3; i++) {
+				if ((p = stl_a_parse_float(p, end, &f[i])) == NULL) return false;
+			}
+			Vec3f nml(f);
+			nml.normalize();
+			f[0] = nml[0];	f[1] = nml[1];	f[2] = nml[2];
+		}
+		else if (stl_a_is_token(t, p, "endfacet", 8)) {
+			if (n_vtx == 3) {
+				if (stl_in_region(&f[3], region)) {
+					facets->insert(facets->end(), f, f + 12);
+					if (region != NULL) seq->push_back(*n_facet);
+				}
+				(*n_facet)++;
+			}
+		}
+		else if (stl_a_is_token(t, p, "solid", 5) ||
+				 stl_a_is_token(t, p, "endsolid", 8)) {
+			// ソリッド名は行末まで読み飛ばす
+			while (p < end && *p != '\n' && *p != '\r') p++;
+		}
+		// outer, loop, endloop等はそのまま読み飛ばす
+	}
+	return true;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// 3頂点(9要素)のBounding Boxが領域と交差するか(regionがNULLなら常に真)
+static inline bool stl_in_region(const float *vtx, const BBox *region)
+{
+	if (region == NULL) return true;
+	for (int i = 0; i < 3; i++) {
+		float lo = vtx[i], hi = vtx[i];
+		if (vtx[i+3] < lo) lo = vtx[i+3];
+		if (vtx[i+3] > hi) hi = vtx[i+3];
+		if (vtx[i+6] < lo) lo = vtx[i+6];
+		if (vtx[i+6] > hi) hi = vtx[i+6];
+		if (hi < region->min[i] || lo > region->max[i]) return false;
+	}
+	return true;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// 読み取り済みのマップ領域[from, to)に完全に含まれるページを解放する
+static void stl_release_pages(const char *from, const char *to)
+{
+#ifdef MADV_DONTNEED
+	size_t page = (size_t)sysconf(_SC_PAGESIZE);
+	size_t b = ((size_t)from + page - 1) / page * page;
+	size_t e = (size_t)to / page * page;
+	if (e > b) madvise((void*)b, e - b, MADV_DONTNEED);
+#endif
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// tri_listの三角形をSTL_SAVE_CHUNK個ずつ分割し、putでスレッド毎のバッファに
+// 整形してから、元の順にまとめて書き出す。max_lenは三角形1つの最大長
+static bool stl_save_records(
+	ostream &os, vector<PrivateTriangle*> *tri_list,
+	size_t (*put)(char *p, const PrivateTriangle *tri, int inv),
+	size_t max_len, int inv
+) {
+	int n_tri = tri_list->size();
+	int n_buf = 1;
+#ifdef _OPENMP
+	n_buf = omp_get_max_threads();
+#endif
+	vector<vector<char> >	bufs(n_buf);
+	vector<size_t>			lens(n_buf);
+	for (int i = 0; i < n_buf; i++) bufs[i].resize(STL_SAVE_CHUNK * max_len);
+
+	for (int top = 0; top < n_tri; top += n_buf * STL_SAVE_CHUNK) {
+		int n_chunk = min(n_buf, (n_tri - top + STL_SAVE_CHUNK - 1) / STL_SAVE_CHUNK);
+#ifdef _OPENMP
+#pragma omp parallel for schedule(static,1)
+#endif
+		for (int i = 0; i < n_chunk; i++) {
+			int first = top + i * STL_SAVE_CHUNK;
+			int last = min(first + STL_SAVE_CHUNK, n_tri);
+			char *p = &bufs[i][0];
+			for (int k = first; k < last; k++) p += put(p, (*tri_list)[k], inv);
+			lens[i] = p - &bufs[i][0];
+		}
+		for (int i = 0; i < n_chunk; i++) {
+			if (!os.write(&bufs[i][0], lens[i])) return false;
+		}
+	}
+	return true;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// 文字列をpにコピーし、末尾の次の位置を返す
+static inline char *stl_a_put_str(char *p, const char *str)
+{
+	while (*str) *p++ = *str++;
+	return p;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// 10^9進の多倍長整数limb[0, n)にfを掛け、桁数を返す
+static inline int stl_a_big_mul(unsigned int *limb, int n, unsigned int f)
+{
+	unsigned long long carry = 0;
+	for (int i = 0; i < n; i++) {
+		carry += (unsigned long long)limb[i] * f;
+		limb[i] = (unsigned int)(carry % 1000000000);
+		carry /= 1000000000;
+	}
+	for (; carry != 0; carry /= 1000000000) {
+		limb[n++] = (unsigned int)(carry % 1000000000);
+	}
+	return n;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// 浮動小数点数を有効数字6桁で整形し、末尾の次の位置を返す(localeに依存しない)。
+// 書式はprintfの"%.6g"(SCIENTIFIC_OUTの場合は"%.6e")と同じ。
+// 値M * 2^kを10進に厳密に展開してから偶数丸めするので、結果もprintfと一致する
+static char *stl_a_put_float(char *p, float val)
+{
+	unsigned int bits;
+	memcpy(&bits, &val, sizeof(bits));
+	int				bexp = (bits >> 23) & 0xff;
+	unsigned int	frac = bits & 0x7fffff;
+
+	if (bits >> 31) *p++ = '-';
+	if (bexp == 0xff) return stl_a_put_str(p, frac != 0 ? "nan" : "inf");
+	if (bexp == 0 && frac == 0) {
+#if SCIENTIFIC_OUT
+		return stl_a_put_str(p, "0.000000e+00");
+#else
+		*p++ = '0';
+		return p;
+#endif
+	}
+
+	// k < 0の場合は M * 5^-k (5^13ずつ掛ける)を求め、小数点をshift桁ずらす
+	unsigned int	limb[STL_A_LIMB_MAX];
+	int		n_limb = 1;
+	int		k = (bexp == 0) ? -149 : bexp - 150;
+	int		shift = (k < 0) ? -k : 0;
+	limb[0] = (bexp == 0) ? frac : (frac | 0x800000);
+	for (; k >= 29; k -= 29)	n_limb = stl_a_big_mul(limb, n_limb, 1u << 29);
+	if (k > 0)					n_limb = stl_a_big_mul(limb, n_limb, 1u << k);
+	for (; k <= -13; k += 13)	n_limb = stl_a_big_mul(limb, n_limb, 1220703125u);
+	for (; k < 0; k++)			n_limb = stl_a_big_mul(limb, n_limb, 5);
+
+	// 10進の数字列(先頭の0は除く)
+	char	dig[STL_A_LIMB_MAX * 9];
+	int		nd = 0;
+	for (int i = n_limb - 1; i >= 0; i--) {
+		unsigned int v = limb[i];
+		for (int j = 8; j >= 0; j--, v /= 10) dig[nd + j] = '0' + v % 10;
+		nd += 9;
+	}
+	const char *d = dig;
+	while (*d == '0') d++, nd--;
+	int e10 = nd - 1 - shift;
+
+	// 有効数字(%gは6桁、%eは小数点以下6桁の7桁)に偶数丸め
+#if SCIENTIFIC_OUT
+	const int prec = 7;
+#else
+	const int prec = 6;
+#endif
+	char m[7];
+	for (int i = 0; i < prec; i++) m[i] = (i < nd) ? d[i] : '0';
+	if (nd > prec && d[prec] >= '5') {
+		bool up = d[prec] > '5' || ((m[prec - 1] - '0') & 1) != 0;
+		for (int i = prec + 1; i < nd && !up; i++) up = (d[i] != '0');
+		if (up) {
+			int i = prec - 1;
+			while (i >= 0 && m[i] == '9') m[i--] = '0';
+			if (i >= 0) {
+				m[i]++;
+			}
+			else {
+				m[0] = '1';
+				e10++;
+			}
+		}
+	}
+
+	// %gでは末尾の0を省き、指数が-4未満か6以上なら指数形式とする
+	int n_sig = prec;
+#if SCIENTIFIC_OUT
+	bool expo = true;
+#else
+	while (n_sig > 1 && m[n_sig - 1] == '0') n_sig--;
+	bool expo = (e10 < -4 || e10 >= prec);
+#endif
+	if (expo) {
+		*p++ = m[0];
+		if (n_sig > 1) *p++ = '.';
+		for (int i = 1; i < n_sig; i++) *p++ = m[i];
+		*p++ = 'e';
+		*p++ = (e10 < 0) ? '-' : '+';
+		int ae = (e10 < 0) ? -e10 : e10;
+		if (ae >= 100) *p++ = '0' + ae / 100;
+		*p++ = '0' + ae / 10 % 10;
+		*p++ = '0' + ae % 10;
+	}
+	else if (e10 >= 0) {
+		for (int i = 0; i <= e10; i++) *p++ = m[i];
+		if (n_sig > e10 + 1) *p++ = '.';
+		for (int i = e10 + 1; i < n_sig; i++) *p++ = m[i];
+	}
+	else {
+		*p++ = '0';
+		*p++ = '.';
+		for (int i = e10 + 1; i < 0; i++) *p++ = '0';
+		for (int i = 0; i < n_sig; i++) *p++ = m[i];
+	}
+	return p;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// ベクトルを空白区切りで整形し、改行を付ける。書式はiostreamの
+// setprecision(6)と同じ
+static inline char *stl_a_put_vec(char *p, const Vec3f &v)
+{
+	for (int i = 0; i < 3; i++) {
+		if (i > 0) *p++ = ' ';
+		p = stl_a_put_float(p, v[i]);
+	}
+	*p++ = '\n';
+	return p;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// ASCII STLのfacet1つをpに整形し、その長さを返す。テキストなのでバイト順の
+// 反転指定は使わない
+static size_t stl_a_put_facet(char *p, const PrivateTriangle *tri, int)
+{
+	char *top = p;
+	p = stl_a_put_str(p, "  facet normal ");
+	p = stl_a_put_vec(p, tri->get_normal());
+	p = stl_a_put_str(p, "\touter loop\n");
+	for (int j = 0; j < 3; j++) {
+		p = stl_a_put_str(p, "\t  vertex ");
+		p = stl_a_put_vec(p, tri->get_vertex()[j]);
+	}
+	p = stl_a_put_str(p, "\tendloop\n  endfacet\n");
+	return p - top;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// バイナリSTLのレコード1つをrec(法線3要素、頂点9要素)に読み取り、頂点を
+// スケーリングする。戻り値は2バイトの予備領域
+static inline ushort stl_b_decode(const char *p, float scale, int inv, float *rec)
+{
+	// 法線(3) + 頂点(3x3)の12要素はアラインされていないのでコピーする
+	ushort padding;
+	memcpy(rec, p, sizeof(float) * 12);
+	memcpy(&padding, p + sizeof(float) * 12, sizeof(ushort));
+	if (inv) {
+		tt_invert_byte_order(rec, sizeof(float), 12);
+		tt_invert_byte_order(&padding, sizeof(ushort), 1);
+	}
+	// 頂点座標のスケーリング(分岐のない連続9要素のループ)
+	for (int j = 3; j < 12; j++) rec[j] *= scale;
+	return padding;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// バイナリSTLのレコード1つ(法線、3頂点、2バイトの予備領域)をpに詰める
+static size_t stl_b_put_facet(char *p, const PrivateTriangle *tri, int inv)
+{
+	// one plane normal and three vertices
+	memcpy(p, tri->get_normal().ptr(), sizeof(float) * 3);
+	for (int j = 0; j < 3; j++) {
+		memcpy(p + sizeof(float) * 3 * (j + 1), tri->get_vertex()[j].ptr(),
+			   sizeof(float) * 3);
+	}
+
+	// ２バイト予備領域にユーザ定義IDを記録(Polylib-2.1より)
+	ushort exid = tri->get_exid();
+	memcpy(p + sizeof(float) * 12, &exid, sizeof(ushort));
+
+	if (inv) {
+		tt_invert_byte_order(p, sizeof(float), 12);
+		tt_invert_byte_order(p + sizeof(float) * 12, sizeof(ushort), 1);
+	}
+	return STL_B_RECORD;
+}
+
 //////////////////////////////////////////////////////////////////////////////
 static void tt_invert_byte_order(void* _mem, int size, int n)
 {
@@ -351,25 +1183,4 @@ static void tt_read(istream& is, void* _data, int size, int n, int inv)
 	}
 }
 
-//////////////////////////////////////////////////////////////////////////////
-static void tt_write(ostream& os, const void* _data, int size, int n, int inv)
-{
-	const char* data = (const char*)_data;
-	char* tmp = 0;
-
-	if (inv) {
-		int sz = size * n;
-		tmp = new char[sz];
-		for (int i=0; i<sz; i++) tmp[i] = data[i];
-		tt_invert_byte_order(tmp, size, n);
-		data = tmp;
-	}
-
-	os.write(data, size * n);
-
-	if (inv) {
-		delete [] tmp;
-	}
-}
-
 } //namespace PolylibNS
@@ -14,45 +14,50 @@
 #include <fstream>
 #include <vector>
 #include <iomanip>
+#include <algorithm>
 #include "polygons/Triangle.h"
 #include "file_io/triangle_id.h"
+#include "file_io/GzipStream.h"
 
 #define AS_BINARY	0
 #define AS_ASCII	1
 
+#define ID_SAVE_CHUNK	(1<<16)	// IDs per write
+#define ID_ASCII_MAX	16		// maximum length of an ID line in ASCII
+
 namespace PolylibNS {
 
 using namespace std;
 
+static char *put_id(char *p, int id);
+
 //////////////////////////////////////////////////////////////////////////////
 // 変更:ポリゴンIDのバイナリ入力対応 2010.10.19
 POLYLIB_STAT load_id(
-	vector<PrivateTriangle*>	*tri_list, 
+	vector<int>					*ids, 
 	string 						fname,
 	ID_FORMAT					id_format
 ) {
-	ifstream	is;
-
-	if (id_format == ID_BIN)	is.open(fname.c_str(), ios::binary);
-	else						is.open(fname.c_str());
+	// 拡張子が.gzならば伸長しながら読み込む
+	GzipIFStream is(fname, id_format == ID_BIN ? ios::in | ios::binary : ios::in);
 
 	if (is.fail()) {
 		PL_ERROSH << "[ERROR]triangle_id:load_id():Can't open " << fname << endl;
 		return PLSTAT_STL_IO_ERROR;
 	}
 
-	vector<PrivateTriangle*>::iterator itr = tri_list->begin();
+	vector<int>::iterator itr = ids->begin();
 
 	if (id_format == ID_BIN) {
 		int		id;
 		while (is.read((char*)&id, sizeof(int)) && !is.eof()) {
 			// ポリゴン数とIDファイルの行数が一致しているか?
-			if (itr == tri_list->end()) {
+			if (itr == ids->end()) {
 				PL_ERROSH << "[ERROR]triangle_id::load_id():Triangle number "
 						  << "is short:" << fname << endl;
 				return PLSTAT_STL_IO_ERROR;
 			}
-			(*itr)->set_id(id);
+			*itr = id;
 			itr++;
 		}
 	}
@@ -60,24 +65,26 @@ POLYLIB_STAT load_id(
 		string	id;
 		while (is >> id && !is.eof()) {
 			// ポリゴン数とIDファイルの行数が一致しているか?
-			if (itr == tri_list->end()) {
+			if (itr == ids->end()) {
 				PL_ERROSH << "[ERROR]triangle_id::load_id():Triangle number "
 						  << "is short:" << fname << endl;
 				return PLSTAT_STL_IO_ERROR;
 			}
-			(*itr)->set_id(atoi(id.c_str()));
+			*itr = atoi(id.c_str());
 			itr++;
 		}
 	}
 
 	// ポリゴン数とIDファイルの行数が一致しているか?
-	if (itr != tri_list->end()) {
+	if (itr != ids->end()) {
 		PL_ERROSH << "[ERROR]triangle_id::load_id():ID number is short:" 
 				  << fname << endl;
 		return PLSTAT_STL_IO_ERROR;
 	}
 
-	if (!is.eof() && is.fail()) {
+	bool read_error = !is.eof() && is.fail();
+	is.close();
+	if (read_error || is.bad()) {
 		PL_ERROSH << "[ERROR]triangle_id:load_id():Error in loading:" 
 				  << fname << endl;
 		return PLSTAT_STL_IO_ERROR;
@@ -93,28 +100,35 @@ POLYLIB_STAT save_id(
 	string 						fname,
 	ID_FORMAT					id_format
 ) {
-	ofstream os;
-
-	if (id_format == ID_BIN)	os.open(fname.c_str(), ios::binary);
-	else						os.open(fname.c_str());
+	// 拡張子が.gzならば圧縮しながら書き出す
+	GzipOFStream os(fname, id_format == ID_BIN ? ios::out | ios::binary : ios::out);
 
 	if (os.fail()) {
 		PL_ERROSH << "[ERROR]triangle_id:save_id():Can't open " << fname << endl;
 		return PLSTAT_STL_IO_ERROR;
 	}
 
-	vector<PrivateTriangle*>::iterator itr;
-	if (id_format == ID_BIN) {
-		for (itr = tri_list->begin(); itr != tri_list->end(); itr++) {
-			int		id = (*itr)->get_id();
-			os.write((char *)&id, sizeof(int));
-		}
-	}
-	else {
-		for (itr = tri_list->begin(); itr != tri_list->end(); itr++) {
-			os	<< (*itr)->get_id() << endl;
+	// IDをバッファに詰め、ID_SAVE_CHUNK個毎にまとめて書き出す。
+	// テキストモードでも行毎のフラッシュは行わない
+	size_t	rec_len = (id_format == ID_BIN) ? sizeof(int) : ID_ASCII_MAX;
+	vector<char>	buf(ID_SAVE_CHUNK * rec_len);
+	size_t	n_tri = tri_list->size();
+	for (size_t top = 0; top < n_tri && os; top += ID_SAVE_CHUNK) {
+		size_t	last = min(top + ID_SAVE_CHUNK, n_tri);
+		char	*p = &buf[0];
+		for (size_t i = top; i < last; i++) {
+			int		id = (*tri_list)[i]->get_id();
+			if (id_format == ID_BIN) {
+				memcpy(p, &id, sizeof(int));
+				p += sizeof(int);
+			}
+			else {
+				p = put_id(p, id);
+			}
 		}
+		os.write(&buf[0], p - &buf[0]);
 	}
+	os.close();
 
 	if (!os.eof() && os.fail()) {
 		PL_ERROSH << "[ERROR]triangle_id:save_id():Error in saving:" 
@@ -125,4 +139,21 @@ POLYLIB_STAT save_id(
 	return PLSTAT_OK;
 }
 
+//////////////////////////////////////////////////////////////////////////////
+// IDを10進数で整形して改行を付け、末尾の次の位置を返す
+static char *put_id(char *p, int id)
+{
+	char	tmp[ID_ASCII_MAX];
+	int		n = 0;
+	unsigned int	u = (id < 0) ? 0u - (unsigned int)id : (unsigned int)id;
+	do {
+		tmp[n++] = '0' + u % 10;
+		u /= 10;
+	} while (u != 0);
+	if (id < 0) *p++ = '-';
+	while (n > 0) *p++ = tmp[--n];
+	*p++ = '\n';
+	return p;
+}
+
 } //namespace PolylibNS
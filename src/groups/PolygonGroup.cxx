@@ -20,10 +20,14 @@
 #include "polygons/Polygons.h"
 #include "polygons/Triangle.h"
 #include "polygons/TriMesh.h"
+#include "polygons/TriangleIdIndex.h"
 #include "groups/PolygonGroup.h"
 //#include "file_io/PolylibConfig.h"
 #include "file_io/TriMeshIO.h"
+#include "file_io/PolylibSnapshot.h"
+#include "file_io/GzipStream.h"
 #include "file_io/triangle_id.h"
+#include "file_io/PolylibAsyncSave.h"
 
 //#define BENCHMARK
 //#define DEBUG
@@ -48,6 +52,10 @@ const char *PolygonGroup::ATT_NAME_CLASS = "class_name";
 #define ATT_NAME_LABEL		"label"
 // ユーザ定義タイプ追加 2013.07.17
 #define ATT_NAME_TYPE		"type"
+// 頂点座標の量子化ビット数
+#define ATT_NAME_QUANTIZE	"quantize"
+// バイナリSTLファイルをマップしたまま保持するか
+#define ATT_NAME_MAPPED		"keep_mapped"
 
 /************************************************************************
  *
@@ -60,6 +68,7 @@ PolygonGroup::PolygonGroup() {
 	m_polygons	= new TriMesh();
 	m_movable	= false;
 	m_need_rebuild = false;
+	m_dirty		= true;
 	m_trias_before_move = NULL;
 }
 
@@ -88,6 +97,7 @@ POLYLIB_STAT PolygonGroup::init(
 #endif
 	if (clear == true) {
 		m_polygons->init(tri_list);
+		m_dirty = true;
 	}
 	return build_polygon_tree();
 }
@@ -107,6 +117,9 @@ POLYLIB_STAT PolygonGroup::build_group_tree(
 	POLYLIB_STAT 	ret = setup_attribute(polylib, parent, tp);
 	if (ret != PLSTAT_OK)		return ret;
 
+	// 名前と内部IDが確定したのでグループ索引に登録
+	polylib->register_group(this);
+
 	// 元コードの説明
 	// PolylibCfgElem がなくなるまでループ
 	// すでにelem には、情報が読み込まれていて、それを使用する。
@@ -211,12 +224,19 @@ POLYLIB_STAT PolygonGroup::build_polygon_tree()
 }
 
 // public /////////////////////////////////////////////////////////////////////
-POLYLIB_STAT PolygonGroup::load_stl_file( float scale )
-{
+POLYLIB_STAT PolygonGroup::load_stl_file(
+	float		scale,
+	const BBox	*region
+) {
 #ifdef DEBUG
 PL_DBGOSH << "PolygonGroup:load_stl_file():IN" << endl;
 #endif
-	POLYLIB_STAT ret = m_polygons->import(m_file_name, scale);
+	// スナップショットは三角形ポリゴン(m_exidを含む)とKD木を保存済み
+	if (is_snapshot()) {
+		return PolylibSnapshot::load(m_polygons, m_file_name.begin()->first);
+	}
+
+	POLYLIB_STAT ret = m_polygons->import(m_file_name, scale, region);
 	if (ret != PLSTAT_OK) return ret;
 
 	// m_idが指定されていたら、その値で全三角形のm_exidを更新
@@ -242,6 +262,9 @@ POLYLIB_STAT PolygonGroup::load_id_file(
     return PLSTAT_OK;	
   }
 
+	// スナップショットは三角形IDを含んでいる
+	if (is_snapshot()) return PLSTAT_OK;
+
 	// IDはsave_id()関数で一括して出力されるので、ファイル数は必ず1個
 
 
@@ -251,14 +274,22 @@ POLYLIB_STAT PolygonGroup::load_id_file(
 				  << m_file_name.size() << endl;
 		return PLSTAT_NG;	
 	}
-	string	fname	= m_file_name.begin()->first;
-	int		pos		= fname.find_last_of(".");
+	// STLファイルがgzip圧縮ならば、IDファイルも圧縮されている
+	string	stl_fname	= m_file_name.begin()->first;
+	string	fname		= GzipStreamBuf::strip_gzip(stl_fname);
+	int		pos			= fname.find_last_of(".");
 
 	fname.replace(pos + 1, fname.length(), "id");
+	if (GzipStreamBuf::is_gzip(stl_fname)) fname += GzipStreamBuf::SUFFIX;
 #ifdef DEBUG
 PL_DBGOSH << "load_id_file:" << fname.c_str() << endl;
 #endif
-	return load_id(m_polygons->get_tri_list(), fname, id_format);
+	// IDはポリゴン集合を通して設定し、IDインデックスも合わせて作り直す
+	// (量子化している場合も三角形ポリゴンは復元しない)
+	vector<int> ids(m_polygons->get_num_triangles());
+	POLYLIB_STAT ret = load_id(&ids, fname, id_format);
+	if (ret != PLSTAT_OK) return ret;
+	return m_polygons->set_triangle_ids(ids);
 }
 
 // public /////////////////////////////////////////////////////////////////////
@@ -267,8 +298,20 @@ POLYLIB_STAT PolygonGroup::save_stl_file(
 	string	extend,
 	string	format
 ) {
-	char	*fname = mk_stl_fname(rank_no, extend, format);
-	return TriMeshIO::save(m_polygons->get_tri_list(), fname, format);
+	// mk_stl_fname()は静的領域を返すので、グループ毎の並列書き出しに備えて
+	// 排他してコピーする
+	string	fname;
+#ifdef _OPENMP
+#pragma omp critical (polylib_mk_fname)
+#endif
+	fname = mk_stl_fname(rank_no, extend, format);
+	if (format == TriMeshIO::FMT_SNAP) {
+		return PolylibSnapshot::save(m_polygons, fname);
+	}
+	vector<PrivateTriangle*> *tri_list = m_polygons->acquire_tri_list();
+	POLYLIB_STAT ret = TriMeshIO::save(tri_list, fname, format);
+	m_polygons->release_tri_list(tri_list);
+	return ret;
 }
 
 
@@ -281,21 +324,137 @@ POLYLIB_STAT PolygonGroup::save_stl_file(
 	string	format,
 	map<string,string>& stl_fname_map
 ) {
-  char	*fname = mk_stl_fname(rank_no, extend, format,stl_fname_map);
-	return TriMeshIO::save(m_polygons->get_tri_list(), fname, format);
+	// ファイル名の作成とstl_fname_mapへの登録は排他して行う
+	string	fname;
+#ifdef _OPENMP
+#pragma omp critical (polylib_mk_fname)
+#endif
+	fname = mk_stl_fname(rank_no, extend, format, stl_fname_map);
+	if (format == TriMeshIO::FMT_SNAP) {
+		return PolylibSnapshot::save(m_polygons, fname);
+	}
+	vector<PrivateTriangle*> *tri_list = m_polygons->acquire_tri_list();
+	POLYLIB_STAT ret = TriMeshIO::save(tri_list, fname, format);
+	m_polygons->release_tri_list(tri_list);
+	return ret;
 }
 
 // public /////////////////////////////////////////////////////////////////////
 POLYLIB_STAT PolygonGroup::save_id_file(
 	string		rank_no,
 	string		extend,
-	ID_FORMAT	id_format
+	ID_FORMAT	id_format,
+	bool		gzip
 ) {
-	char	*fname = mk_id_fname(rank_no, extend);
+	string	fname;
+#ifdef _OPENMP
+#pragma omp critical (polylib_mk_fname)
+#endif
+	fname = mk_id_fname(rank_no, extend, gzip);
 #ifdef DEBUG
 PL_DBGOSH <<  "save_id_file:" << fname << endl;
 #endif
-	return save_id(m_polygons->get_tri_list(), fname, id_format);
+	vector<PrivateTriangle*> *tri_list = m_polygons->acquire_tri_list();
+	POLYLIB_STAT ret = save_id(tri_list, fname, id_format);
+	m_polygons->release_tri_list(tri_list);
+	return ret;
+}
+
+// public /////////////////////////////////////////////////////////////////////
+POLYLIB_STAT PolygonGroup::save_files_async(
+	PolylibAsyncSave	*async,
+	string				rank_no,
+	string				extend,
+	string				format,
+	map<string,string>&	stl_fname_map,
+	bool				with_id,
+	ID_FORMAT			id_format
+) {
+	if (format == TriMeshIO::FMT_SNAP) {
+		PL_ERROSH << "[ERROR]PolygonGroup::save_files_async():Snapshot can't "
+				  << "be saved asynchronously." << endl;
+		return PLSTAT_UNKNOWN_STL_FORMAT;
+	}
+
+	string	stl_fname, id_fname;
+#ifdef _OPENMP
+#pragma omp critical (polylib_mk_fname)
+#endif
+	{
+		stl_fname = mk_stl_fname(rank_no, extend, format, stl_fname_map);
+		if (with_id) {
+			id_fname = mk_id_fname(rank_no, extend, GzipStreamBuf::is_gzip(format));
+		}
+	}
+	// 三角形ポリゴンはadd_file()内で複製されるので、すぐに解放できる
+	vector<PrivateTriangle*> *tri_list = m_polygons->acquire_tri_list();
+	async->add_file(tri_list, stl_fname, format, id_fname, id_format);
+	m_polygons->release_tri_list(tri_list);
+	return PLSTAT_OK;
+}
+
+// public /////////////////////////////////////////////////////////////////////
+void PolygonGroup::acq_save_fnames(
+	string				rank_no,
+	string				extend,
+	string				format,
+	string				*stl_fname,
+	string				*id_fname
+) {
+#ifdef _OPENMP
+#pragma omp critical (polylib_mk_fname)
+#endif
+	{
+		*stl_fname = mk_stl_fname(rank_no, extend, format);
+		*id_fname = mk_id_fname(rank_no, extend, GzipStreamBuf::is_gzip(format));
+	}
+}
+
+// public /////////////////////////////////////////////////////////////////////
+bool PolygonGroup::refer_saved_file(
+	string				rank_no,
+	string				format,
+	map<string,string>&	stl_fname_map,
+	bool				with_id,
+	ID_FORMAT			id_format
+) {
+	if (m_dirty || m_saved_fname == "") return false;
+	if (m_saved_key != mk_saved_key(rank_no, format, with_id, id_format)) {
+		return false;
+	}
+#ifdef _OPENMP
+#pragma omp critical (polylib_mk_fname)
+#endif
+	stl_fname_map.insert(map<string,string>::value_type(acq_fullpath(),
+														m_saved_fname));
+#ifdef DEBUG
+	PL_DBGOSH << "PolygonGroup::refer_saved_file():" << m_saved_fname << endl;
+#endif
+	return true;
+}
+
+// public /////////////////////////////////////////////////////////////////////
+void PolygonGroup::mark_saved(
+	string						rank_no,
+	string						format,
+	const map<string,string>&	stl_fname_map,
+	bool						with_id,
+	ID_FORMAT					id_format
+) {
+	// 他のグループがstl_fname_mapに登録中かもしれないので排他して参照する
+	string	fname;
+#ifdef _OPENMP
+#pragma omp critical (polylib_mk_fname)
+#endif
+	{
+		map<string,string>::const_iterator it;
+		it = stl_fname_map.find(acq_fullpath());
+		if (it != stl_fname_map.end()) fname = it->second;
+	}
+	if (fname == "") return;
+	m_saved_fname = fname;
+	m_saved_key = mk_saved_key(rank_no, format, with_id, id_format);
+	m_dirty = false;
 }
 
 
@@ -357,6 +516,21 @@ POLYLIB_STAT PolygonGroup::linear_search(
 	return m_polygons->linear_search(bbox, every, tri_list);
 }
 
+// public /////////////////////////////////////////////////////////////////////
+const vector<PrivateTriangle*>* PolygonGroup::get_owned_triangles() const
+{
+	// 量子化している場合は、返却する三角形だけを復元して保持する
+	vector<PrivateTriangle*> *owned = new vector<PrivateTriangle*>;
+	vector<PrivateTriangle*> *tri_list = m_polygons->acquire_tri_list();
+	for (unsigned int i = 0; i < tri_list->size(); i++) {
+		if ((*tri_list)[i]->is_owned()) {
+			owned->push_back(m_polygons->get_triangle(i));
+		}
+	}
+	m_polygons->release_tri_list(tri_list);
+	return owned;
+}
+
 // public /////////////////////////////////////////////////////////////////////
 string PolygonGroup::acq_fullpath() {
 	if (m_parent_path.empty() == true)	return m_name;
@@ -379,11 +553,17 @@ string PolygonGroup::acq_file_name() {
 	return fnames;
 }
 
+// public /////////////////////////////////////////////////////////////////////
+bool PolygonGroup::is_snapshot() const {
+	return m_file_name.size() == 1 &&
+		   m_file_name.begin()->second == TriMeshIO::FMT_SNAP;
+}
+
 // public /////////////////////////////////////////////////////////////////////
 const std::vector<PrivateTriangle*>*
 PolygonGroup::search_outbounded(
 	BBox neibour_bbox,
-	vector<int> *exclude_tria_ids
+	const TriangleIdIndex *exclude_index
 )
 {
 #ifdef DEBUG
@@ -391,33 +571,34 @@ PolygonGroup::search_outbounded(
 #endif
 	vector<PrivateTriangle*> *p_trias;
 
-	// 除外IDリストを昇順ソート
-	std::sort( exclude_tria_ids->begin(), exclude_tria_ids->end() );
-
 	// 隣接PE領域(ガイドセル含)に懸かる三角形を検索
 	p_trias = (vector<PrivateTriangle*>*)search( &neibour_bbox, false );
 #ifdef DEBUG
 PL_DBGOSH << "p_trias org num:" << p_trias->size() << endl;
 #endif
 
-	// 検索結果から除外対象を除く
-	vector<PrivateTriangle*>::iterator itr;
-	for( itr=p_trias->begin(); itr!=p_trias->end(); ) {
-		int id = (*itr)->get_id();
-		if( std::binary_search(exclude_tria_ids->begin(),
-							   exclude_tria_ids->end(), id) ) {
-			itr = p_trias->erase(itr);
-		}
-		else {
-			itr++;
+	// 検索結果から除外対象を除く(残すものを前詰め)
+	vector<PrivateTriangle*>::iterator itr, dst;
+	for( itr=dst=p_trias->begin(); itr!=p_trias->end(); itr++ ) {
+		if( exclude_index->find( (*itr)->get_id() ) < 0 ) {
+			*dst++ = *itr;
 		}
 	}
+	p_trias->erase( dst, p_trias->end() );
 #ifdef DEBUG
 PL_DBGOSH << "p_trias ret num:" << p_trias->size() << endl;
 #endif
 	return p_trias;
 }
 
+// public /////////////////////////////////////////////////////////////////////
+PrivateTriangle *
+PolygonGroup::get_triangle_by_id(
+	int		id
+) const {
+	return m_polygons->get_triangle_by_id( id );
+}
+
 // public /////////////////////////////////////////////////////////////////////
 POLYLIB_STAT
 PolygonGroup::add_triangles(
@@ -433,12 +614,45 @@ PolygonGroup::add_triangles(
 
 	m_polygons->add( tri_list );
 
-	// KD木要再構築フラグを立てる
+	// KD木要再構築フラグと変更フラグを立てる
 	m_need_rebuild = true;
+	m_dirty = true;
 
 	return PLSTAT_OK;
 }
 
+// public /////////////////////////////////////////////////////////////////////
+POLYLIB_STAT
+PolygonGroup::adopt_triangles(
+	vector<PrivateTriangle*> *tri_list
+)
+{
+#ifdef DEBUG
+	PL_DBGOSH << "PolygonGroup::adopt_triangles() in. " << endl;
+#endif
+	if( tri_list==NULL || tri_list->size()==0 ) {
+		return PLSTAT_OK;
+	}
+
+	m_polygons->adopt( tri_list );
+
+	// KD木要再構築フラグと変更フラグを立てる
+	m_need_rebuild = true;
+	m_dirty = true;
+
+	return PLSTAT_OK;
+}
+
+// public /////////////////////////////////////////////////////////////////////
+void
+PolygonGroup::sort_triangles_by_id()
+{
+	m_polygons->sort_by_id();
+
+	// 並びが変わるのでKD木要再構築フラグを立てる
+	m_need_rebuild = true;
+}
+
 // public /////////////////////////////////////////////////////////////////////
 POLYLIB_STAT
 PolygonGroup::rebuild_polygons()
@@ -498,19 +712,23 @@ POLYLIB_STAT PolygonGroup::show_group_info(
 		PL_DBGOSH << "  file name: empty." << endl;
 	}
 
+	if (m_polygons != NULL && m_polygons->get_quantize_bits() > 0) {
+		PL_DBGOSH << "  quantize bits: " << m_polygons->get_quantize_bits()
+				  << " error: " << m_polygons->get_quantize_error() << endl;
+	}
+
 	if (m_polygons == NULL) {
 		PL_ERROSH << "[ERROR]PolygonGroup::show_group_info():Polygon is nothing:"
 				  << endl;
 		return PLSTAT_POLYGON_NOT_EXIST;
 	}
-	if (m_polygons->get_tri_list() == 0) {
+	vector<PrivateTriangle*>* tmp_list = m_polygons->acquire_tri_list();
+	if (tmp_list == 0) {
 		PL_ERROSH << "[ERROR]PolygonGroup::show_group_info():Triangle is nothing:"
 				  << endl;
 		return PLSTAT_TRIANGLE_NOT_EXIST;
 	}
 
-	vector<PrivateTriangle*>* tmp_list = m_polygons->get_tri_list();
-
 	PL_DBGOSH << "  triangle list size: " << tmp_list->size() << endl;
 	PL_DBGOSH << "  vertex vector list: " << endl;
 	vector<PrivateTriangle*>::iterator it;
@@ -532,15 +750,77 @@ POLYLIB_STAT PolygonGroup::show_group_info(
 	for (it = tmp_list->begin(); it != tmp_list->end(); it++) {
 		PL_DBGOSH << "    area:" << (*it)->get_area() << endl;
 	}
+	m_polygons->release_tri_list(tmp_list);
 	return PLSTAT_OK;
 }
 
+// public /////////////////////////////////////////////////////////////////////
+void PolygonGroup::memory_usage(
+	PolylibMemoryUsage	*usage
+) {
+	// PolygonGroupクラスとグループ情報
+	usage->others += sizeof(PolygonGroup);
+	usage->others += m_name.capacity() + m_parent_path.capacity();
+	usage->others += m_label.capacity() + m_type.capacity();
+	usage->others += m_children.capacity() * sizeof(PolygonGroup*);
+	map<string, string>::iterator fit = m_file_name.begin();
+	for (; fit != m_file_name.end(); fit++) {
+		usage->others += sizeof(*fit) + fit->first.capacity() +
+						 fit->second.capacity();
+	}
+
+	// 三角形移動前一時リスト
+	if (m_trias_before_move != NULL) {
+		usage->triangles += sizeof(vector<PrivateTriangle*>);
+		usage->triangles += m_trias_before_move->size() * sizeof(PrivateTriangle);
+		usage->triangles += m_trias_before_move->capacity() *
+							sizeof(PrivateTriangle*);
+	}
+
+	// 三角形ポリゴンとKD木
+	if (m_polygons != NULL) m_polygons->memory_usage(usage);
+}
+
+// public /////////////////////////////////////////////////////////////////////
+POLYLIB_STAT PolygonGroup::set_quantize_bits(
+	int		bits
+) {
+	// 再構築時に頂点座標が量子化されるので、次回の差分保存で書き出す
+	m_dirty = true;
+	return m_polygons->set_quantize_bits(bits);
+}
+
+// public /////////////////////////////////////////////////////////////////////
+int PolygonGroup::get_quantize_bits() const
+{
+	return m_polygons->get_quantize_bits();
+}
+
+// public /////////////////////////////////////////////////////////////////////
+float PolygonGroup::get_quantize_error() const
+{
+	return m_polygons->get_quantize_error();
+}
+
+// public /////////////////////////////////////////////////////////////////////
+void PolygonGroup::set_keep_mapped(
+	bool	keep
+) {
+	m_polygons->set_keep_mapped(keep);
+}
+
+// public /////////////////////////////////////////////////////////////////////
+bool PolygonGroup::get_keep_mapped() const
+{
+	return m_polygons->get_keep_mapped();
+}
+
 // add keno 20120331
 float PolygonGroup::get_group_area( void ) {
   
   float m_area=0.0, a;
   
-	vector<PrivateTriangle*>* tmp_list = m_polygons->get_tri_list();
+	vector<PrivateTriangle*>* tmp_list = m_polygons->acquire_tri_list();
   
 	vector<PrivateTriangle*>::iterator it;
   
@@ -548,14 +828,13 @@ float PolygonGroup::get_group_area( void ) {
     a = (*it)->get_area();
 		m_area += a;
 	}
+	m_polygons->release_tri_list(tmp_list);
 	return m_area;
 }
 
 int PolygonGroup::get_group_num_tria( void ) {
   
-	vector<PrivateTriangle*>* tmp_list = m_polygons->get_tri_list();
-  
-	return (int)tmp_list->size();
+	return m_polygons->get_num_triangles();
 }// add keno 20120331
 
 POLYLIB_STAT PolygonGroup::rescale_polygons( float scale )
@@ -577,6 +856,7 @@ POLYLIB_STAT PolygonGroup::rescale_polygons( float scale )
 		(*it)->set_vertexes( scaled, true, true );
 	}
 	m_need_rebuild = true;
+	m_dirty = true;
 	return rebuild_polygons();
 }
 
@@ -585,6 +865,7 @@ POLYLIB_STAT PolygonGroup::set_all_exid_of_trias( int id )
 {
   m_id = id;           // keno 2013-07-20
   m_id_defined = true; // keno 2013-07-20
+	m_dirty = true;
 	return m_polygons->set_all_exid( id );
 }
 
@@ -595,6 +876,25 @@ const PrivateTriangle* PolygonGroup::search_nearest(
 	return m_polygons->search_nearest(pos);
 }
 
+// public /////////////////////////////////////////////////////////////////////
+const PrivateTriangle* PolygonGroup::search_nearest(
+	const Vec3f&	pos,
+	float			max_dist,
+	float			*dist
+) const {
+	return m_polygons->search_nearest(pos, max_dist, dist);
+}
+
+// public /////////////////////////////////////////////////////////////////////
+const PrivateTriangle* PolygonGroup::search_ray(
+	const Vec3f&	orig,
+	const Vec3f&	dir,
+	float			tmax,
+	float			*t
+) const {
+	return m_polygons->search_ray(orig, dir, tmax, t);
+}
+
 // TextParser Version
 // protected //////////////////////////////////////////////////////////////////
 POLYLIB_STAT PolygonGroup::setup_attribute (
@@ -657,6 +957,22 @@ POLYLIB_STAT PolygonGroup::setup_attribute (
     //<<endl;
   }
 
+  // 頂点座標の量子化ビット数
+  string quantize_string = "";
+  leaf_iter = find(leaves.begin(),leaves.end(),ATT_NAME_QUANTIZE);
+
+  if(leaf_iter!=leaves.end()) {
+    tp_error=tp->getValue((*leaf_iter),quantize_string);
+  }
+
+  // バイナリSTLファイルをマップしたまま保持するか
+  string mapped_string = "";
+  leaf_iter = find(leaves.begin(),leaves.end(),ATT_NAME_MAPPED);
+
+  if(leaf_iter!=leaves.end()) {
+    tp_error=tp->getValue((*leaf_iter),mapped_string);
+  }
+
   // moveメソッドにより移動するグループか?
   if (this->whoami() == this->get_class_name()) {
     // 基本クラスの場合はmovableの設定は不要
@@ -775,6 +1091,21 @@ POLYLIB_STAT PolygonGroup::setup_attribute (
 	// ユーザ定義タイプ追加 2013.07.17
 	m_type = type_string;
 
+	// 頂点座標の量子化
+	if (quantize_string != "") {
+		int bits = tp->convertInt(quantize_string,&ierror);
+		if (m_polygons->set_quantize_bits(bits) != PLSTAT_OK) {
+			PL_ERROSH << "[ERROR]PolygonGroup::setup_attribute():Invalid "
+					  << ATT_NAME_QUANTIZE << ":" << quantize_string << endl;
+			return PLSTAT_CONFIG_ERROR;
+		}
+	}
+
+	// バイナリSTLファイルのマップ
+	if (mapped_string != "") {
+		m_polygons->set_keep_mapped(tp->convertBool(mapped_string,&ierror));
+	}
+
 	return PLSTAT_OK;
 
 }
@@ -787,16 +1118,17 @@ PolygonGroup::init_check_leaped()
 	PL_DBGOSH << "PolygonGroup::init_check_leaped() in. " << endl;
 #endif
 
-	vector<PrivateTriangle*>* p_trias = get_triangles();
-
 	// 動かないポリゴングループならば何もしないで終了
-	if( !m_movable || p_trias==NULL || p_trias->size()==0 ) return PLSTAT_OK;
+	if( !m_movable || get_num_triangles()==0 ) return PLSTAT_OK;
 
-	// move後と比較するために三角形ポリゴンリストのディープコピーを保存
+	// move後と比較するために三角形ポリゴンリストのディープコピーを保存。
+	// 量子化している場合も三角形を復元して保持しないよう一時リストから読む
+	vector<PrivateTriangle*>* p_trias = acquire_triangles();
 	m_trias_before_move = new vector<PrivateTriangle*>;
 	for( unsigned int i=0; i<p_trias->size(); i++ ) {
 		m_trias_before_move->push_back( new PrivateTriangle(*(p_trias->at(i))) );
 	}
+	release_triangles( p_trias );
 	return PLSTAT_OK;
 }
 
@@ -811,10 +1143,11 @@ PolygonGroup::check_leaped(
 	PL_DBGOSH << "PolygonGroup::check_leaped() in. " << endl;
 #endif
 	unsigned int i, j;
-	vector<PrivateTriangle*>* p_trias = get_triangles();
 
 	// 動かないポリゴングループならば何もしないで終了
-	if( !m_movable || p_trias==NULL || p_trias->size()==0 ) return PLSTAT_OK;
+	if( !m_movable || get_num_triangles()==0 ) return PLSTAT_OK;
+
+	vector<PrivateTriangle*>* p_trias = acquire_triangles();
 
 	// move前の三角形と座標を比較。
 	for( i=0; i<p_trias->size(); i++ ) {
@@ -838,6 +1171,7 @@ PolygonGroup::check_leaped(
 
 	// あとしまつ
 	delete m_trias_before_move;
+	release_triangles( p_trias );
 
 	return PLSTAT_OK;
 }
@@ -898,12 +1232,18 @@ char *PolygonGroup::mk_stl_fname(
 #ifdef DEBUG
 	PL_DBGOS << __FUNCTION__ << " fname1 " <<fname1<<endl;
 #endif //  DEBUG
-	if (format == TriMeshIO::FMT_STL_A || format == TriMeshIO::FMT_STL_AA) {
+	// 書式の末尾が.gzならば、gzip圧縮ファイルとして拡張子に.gzを付ける
+	string base = GzipStreamBuf::strip_gzip(format);
+	if (base == TriMeshIO::FMT_STL_A || base == TriMeshIO::FMT_STL_AA) {
 		prefix = "stla";
 	}
+	else if (base == TriMeshIO::FMT_SNAP) {
+		prefix = "plsnap";
+	}
 	else {
 		prefix = "stlb";
 	}
+	if (GzipStreamBuf::is_gzip(format)) prefix += GzipStreamBuf::SUFFIX;
 
 	if (rank_no == "") {
 		sprintf(fname2, "%s_%s.%s", fname1, extend.c_str(), prefix.c_str());
@@ -943,12 +1283,18 @@ char *PolygonGroup::mk_stl_fname(
 
 	//cout << __FUNCTION__ << " fname1 " <<fname1<<endl;
 
-	if (format == TriMeshIO::FMT_STL_A || format == TriMeshIO::FMT_STL_AA) {
+	// 書式の末尾が.gzならば、gzip圧縮ファイルとして拡張子に.gzを付ける
+	string base = GzipStreamBuf::strip_gzip(format);
+	if (base == TriMeshIO::FMT_STL_A || base == TriMeshIO::FMT_STL_AA) {
 		prefix = "stla";
 	}
+	else if (base == TriMeshIO::FMT_SNAP) {
+		prefix = "plsnap";
+	}
 	else {
 		prefix = "stlb";
 	}
+	if (GzipStreamBuf::is_gzip(format)) prefix += GzipStreamBuf::SUFFIX;
 
 	if (rank_no == "") {
 		sprintf(fname2, "%s_%s.%s", fname1, extend.c_str(), prefix.c_str());
@@ -969,7 +1315,8 @@ char *PolygonGroup::mk_stl_fname(
 // protected //////////////////////////////////////////////////////////////////
 char *PolygonGroup::mk_id_fname(
 	string		rank_no,
-	string		extend
+	string		extend,
+	bool		gzip
 ) {
 	char		fname1[1024];
 	static char	fname2[1024];
@@ -986,9 +1333,24 @@ char *PolygonGroup::mk_id_fname(
 	else {
 		sprintf(fname2, "%s_%s_%s.id", fname1, rank_no.c_str(), extend.c_str());
 	}
+	if (gzip) strcat(fname2, GzipStreamBuf::SUFFIX.c_str());
 	return fname2;
 }
 
+// protected //////////////////////////////////////////////////////////////////
+string PolygonGroup::mk_saved_key(
+	string		rank_no,
+	string		format,
+	bool		with_id,
+	ID_FORMAT	id_format
+) {
+	ostringstream	oss;
+	oss << rank_no << ":" << format << ":";
+	if (with_id)	oss << (int)id_format;
+	else			oss << "-";
+	return oss.str();
+}
+
 // protected //////////////////////////////////////////////////////////////////
 int PolygonGroup::create_global_id() {
 	static int global_id = 0;
@@ -12,6 +12,7 @@
 #include <iostream>
 #include "common/PolylibCommon.h"
 #include "polygons/Polygons.h"
+#include "polygons/Triangle.h"
 
 namespace PolylibNS {
 
@@ -29,4 +30,44 @@ using namespace std;
 ///
 Polygons::~Polygons() {}
 
+// public /////////////////////////////////////////////////////////////////////
+void Polygons::get_triangle_bbox(
+	int		idx,
+	float	*ebox
+) const {
+	const Vec3f *v = get_triangle(idx)->get_vertex();
+	for (int i = 0; i < 3; i++) {
+		ebox[i]   = v[0][i];
+		ebox[i+3] = v[0][i];
+		for (int j = 1; j < 3; j++) {
+			if (v[j][i] < ebox[i])   ebox[i]   = v[j][i];
+			if (v[j][i] > ebox[i+3]) ebox[i+3] = v[j][i];
+		}
+	}
+}
+
+// public /////////////////////////////////////////////////////////////////////
+void Polygons::set_triangle_owned(
+	int		idx,
+	bool	owned
+) {
+	(*m_tri_list)[idx]->set_owned(owned);
+}
+
+// public /////////////////////////////////////////////////////////////////////
+POLYLIB_STAT Polygons::set_triangle_ids(
+	const vector<int>	&ids
+) {
+	if ((int)ids.size() != get_num_triangles()) {
+		PL_ERROSH << "[ERROR]Polygons::set_triangle_ids():Num of IDs mismatch:"
+				  << ids.size() << endl;
+		return PLSTAT_NG;
+	}
+	for (unsigned int i = 0; i < ids.size(); i++) {
+		(*m_tri_list)[i]->set_id(ids[i]);
+	}
+	rebuild_id_index();
+	return PLSTAT_OK;
+}
+
 } //namespace PolylibNS
@@ -0,0 +1,308 @@
+/*
+ * Polylib - Polygon Management Library
+ *
+ * Copyright (c) 2010-2011 VCAD System Research Program, RIKEN.
+ * All rights reserved.
+ *
+ * Copyright (c) 2012-2013 Advanced Institute for Computational Science, RIKEN.
+ * All rights reserved.
+ *
+ */
+
+#include <math.h>
+#include <float.h>
+#include <vector>
+#include "common/PolylibCommon.h"
+#include "polygons/Triangle.h"
+#include "polygons/QuantizedTriangles.h"
+#include "file_io/stl.h"
+
+namespace PolylibNS {
+
+using namespace std;
+
+#define QT_NORMAL_SCALE	32767.0f	/// 法線符号化のスケール
+#define QT_MASK21		0x1fffffULL	/// 21bit分のマスク
+
+///
+/// 法線ベクトルをoctahedral符号化する。
+///
+static void oct_encode(
+	const Vec3f	&n,
+	short		*enc
+) {
+	float ax = fabsf(n[0]) + fabsf(n[1]) + fabsf(n[2]);
+	if (ax == 0.0f) {
+		enc[0] = enc[1] = 0;
+		return;
+	}
+	float x = n[0] / ax;
+	float y = n[1] / ax;
+	if (n[2] < 0.0f) {
+		float tx = (1.0f - fabsf(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+		float ty = (1.0f - fabsf(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+		x = tx;
+		y = ty;
+	}
+	enc[0] = (short)floorf(x * QT_NORMAL_SCALE + 0.5f);
+	enc[1] = (short)floorf(y * QT_NORMAL_SCALE + 0.5f);
+}
+
+///
+/// octahedral符号化した法線ベクトルを復元する。
+///
+static Vec3f oct_decode(
+	const short	*enc
+) {
+	float x = enc[0] / QT_NORMAL_SCALE;
+	float y = enc[1] / QT_NORMAL_SCALE;
+	float z = 1.0f - fabsf(x) - fabsf(y);
+	if (z < 0.0f) {
+		float tx = (1.0f - fabsf(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+		float ty = (1.0f - fabsf(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+		x = tx;
+		y = ty;
+	}
+	Vec3f n(x, y, z);
+	if (n.lengthSquared() > 0.0f) n.normalize();
+	return n;
+}
+
+/************************************************************************
+ *
+ * QuantizedTriangles
+ *  @attention 三角形ポリゴンを省メモリ形式で保持するクラス
+ *
+ ***********************************************************************/
+// public /////////////////////////////////////////////////////////////////////
+QuantizedTriangles::QuantizedTriangles()
+{
+	m_bits = 0;
+	m_error = 0.0f;
+	m_map = NULL;
+	m_map_size = 0;
+	m_records = NULL;
+	m_scale = 1.0f;
+}
+
+// public /////////////////////////////////////////////////////////////////////
+QuantizedTriangles::~QuantizedTriangles()
+{
+	clear();
+}
+
+// public /////////////////////////////////////////////////////////////////////
+POLYLIB_STAT QuantizedTriangles::encode(
+	const vector<PrivateTriangle*>	*tri_list,
+	const BBox						&bbox,
+	int								bits
+) {
+	if (bits != 16 && bits != 21) {
+		PL_ERROSH << "[ERROR]QuantizedTriangles::encode():Invalid bits:"
+				  << bits << endl;
+		return PLSTAT_NG;
+	}
+	clear();
+	m_bits = bits;
+
+	// 刻み幅と誤差の上限を求める。
+	// 誤差は刻み幅の半分に、復元時の浮動小数点の丸め分を加えたもの。
+	float qmax = (float)((1u << bits) - 1);
+	m_error = 0.0f;
+	for (int i = 0; i < 3; i++) {
+		m_origin[i] = bbox.min[i];
+		float extent = bbox.max[i] - bbox.min[i];
+		m_step[i] = (extent > 0.0f) ? extent / qmax : 0.0f;
+		float amax = fabsf(bbox.min[i]) > fabsf(bbox.max[i]) ?
+					 fabsf(bbox.min[i]) : fabsf(bbox.max[i]);
+		float err = 0.5f * m_step[i] + 2.0f * FLT_EPSILON * amax;
+		if (err > m_error) m_error = err;
+	}
+
+	size_t num = tri_list->size();
+	if (m_bits == 16)	m_vtx16.resize(num * 9);
+	else				m_vtx21.resize(num * 3);
+	m_normal.resize(num * 2);
+	m_id.resize(num);
+	m_exid.resize(num);
+	m_shell.resize(num);
+	m_owned.resize(num);
+
+	for (size_t n = 0; n < num; n++) {
+		const PrivateTriangle *tri = (*tri_list)[n];
+		const Vec3f *v = tri->get_vertex();
+		for (int j = 0; j < 3; j++) {
+			unsigned int qx = quantize(v[j][0], 0);
+			unsigned int qy = quantize(v[j][1], 1);
+			unsigned int qz = quantize(v[j][2], 2);
+			if (m_bits == 16) {
+				m_vtx16[n*9 + j*3 + 0] = (unsigned short)qx;
+				m_vtx16[n*9 + j*3 + 1] = (unsigned short)qy;
+				m_vtx16[n*9 + j*3 + 2] = (unsigned short)qz;
+			}
+			else {
+				m_vtx21[n*3 + j] = (unsigned long long)qx |
+								   ((unsigned long long)qy << 21) |
+								   ((unsigned long long)qz << 42);
+			}
+		}
+		oct_encode(tri->get_normal(), &m_normal[n*2]);
+		m_id[n]    = tri->get_id();
+		m_exid[n]  = tri->get_exid();
+		m_shell[n] = tri->get_shell();
+		m_owned[n] = tri->is_owned() ? 1 : 0;
+	}
+	return PLSTAT_OK;
+}
+
+// public /////////////////////////////////////////////////////////////////////
+POLYLIB_STAT QuantizedTriangles::map_stl_b(
+	const string	&fname,
+	float			scale,
+	int				id_base
+) {
+	clear();
+
+	unsigned int num;
+	POLYLIB_STAT ret = stl_b_map(fname, &m_map, &m_map_size, &m_records, &num);
+	if (ret != PLSTAT_OK) {
+		m_map = NULL;
+		m_records = NULL;
+		return ret;
+	}
+	m_bits = 0;
+	m_error = 0.0f;
+	m_scale = scale;
+
+	// 属性だけを配列に取り出す。IDはレコード番号の通番、ユーザ定義IDは
+	// 2バイトの予備領域(stl_b_load()と同じ)
+	m_id.resize(num);
+	m_exid.resize(num);
+	m_shell.assign(num, 0);
+	m_owned.assign(num, 1);
+	for (unsigned int n = 0; n < num; n++) {
+		float rec[12];
+		m_id[n]   = id_base + (int)n;
+		m_exid[n] = stl_b_get_record(m_records + (size_t)n * STL_B_RECORD_SIZE,
+									 scale, rec);
+	}
+	return PLSTAT_OK;
+}
+
+// public /////////////////////////////////////////////////////////////////////
+void QuantizedTriangles::clear()
+{
+	stl_b_unmap(m_map, m_map_size);
+	m_map = NULL;
+	m_map_size = 0;
+	m_records = NULL;
+	vector<unsigned short>().swap(m_vtx16);
+	vector<unsigned long long>().swap(m_vtx21);
+	vector<short>().swap(m_normal);
+	vector<int>().swap(m_id);
+	vector<int>().swap(m_exid);
+	vector<int>().swap(m_shell);
+	vector<char>().swap(m_owned);
+}
+
+// public /////////////////////////////////////////////////////////////////////
+PrivateTriangle *QuantizedTriangles::decode(
+	int		idx
+) const {
+	Vec3f vtx[3];
+	Vec3f normal;
+	if (m_records != NULL) {
+		float rec[12];
+		stl_b_get_record(m_records + (size_t)idx * STL_B_RECORD_SIZE, m_scale, rec);
+		normal = Vec3f(rec);
+		for (int j = 0; j < 3; j++) vtx[j] = Vec3f(&rec[3 + j*3]);
+	}
+	else {
+		get_vertex(idx, vtx);
+		normal = oct_decode(&m_normal[idx*2]);
+	}
+
+	// 面積は復元後の頂点座標から再計算する
+	PrivateTriangle *tri = new PrivateTriangle(vtx, normal, m_id[idx]);
+	tri->set_exid(m_exid[idx]);
+	tri->set_shell(m_shell[idx]);
+	tri->set_owned(m_owned[idx] != 0);
+	return tri;
+}
+
+// public /////////////////////////////////////////////////////////////////////
+void QuantizedTriangles::get_vertex(
+	int		idx,
+	Vec3f	vtx[3]
+) const {
+	if (m_records != NULL) {
+		float rec[12];
+		stl_b_get_record(m_records + (size_t)idx * STL_B_RECORD_SIZE, m_scale, rec);
+		for (int j = 0; j < 3; j++) vtx[j] = Vec3f(&rec[3 + j*3]);
+		return;
+	}
+	for (int j = 0; j < 3; j++) {
+		unsigned int q[3];
+		if (m_bits == 16) {
+			q[0] = m_vtx16[idx*9 + j*3 + 0];
+			q[1] = m_vtx16[idx*9 + j*3 + 1];
+			q[2] = m_vtx16[idx*9 + j*3 + 2];
+		}
+		else {
+			unsigned long long p = m_vtx21[idx*3 + j];
+			q[0] = (unsigned int)( p        & QT_MASK21);
+			q[1] = (unsigned int)((p >> 21) & QT_MASK21);
+			q[2] = (unsigned int)((p >> 42) & QT_MASK21);
+		}
+		for (int i = 0; i < 3; i++) {
+			vtx[j][i] = dequantize(q[i], i);
+		}
+	}
+}
+
+// public /////////////////////////////////////////////////////////////////////
+void QuantizedTriangles::get_bbox(
+	int		idx,
+	float	*ebox
+) const {
+	Vec3f vtx[3];
+	get_vertex(idx, vtx);
+	for (int i = 0; i < 3; i++) {
+		ebox[i]   = vtx[0][i];
+		ebox[i+3] = vtx[0][i];
+		for (int j = 1; j < 3; j++) {
+			if (vtx[j][i] < ebox[i])   ebox[i]   = vtx[j][i];
+			if (vtx[j][i] > ebox[i+3]) ebox[i+3] = vtx[j][i];
+		}
+	}
+}
+
+// public /////////////////////////////////////////////////////////////////////
+size_t QuantizedTriangles::memory_size() const
+{
+	size_t size = sizeof(QuantizedTriangles);
+	size += m_vtx16.capacity()  * sizeof(unsigned short);
+	size += m_vtx21.capacity()  * sizeof(unsigned long long);
+	size += m_normal.capacity() * sizeof(short);
+	size += m_id.capacity()     * sizeof(int);
+	size += m_exid.capacity()   * sizeof(int);
+	size += m_shell.capacity()  * sizeof(int);
+	size += m_owned.capacity()  * sizeof(char);
+	return size;
+}
+
+// private ////////////////////////////////////////////////////////////////////
+unsigned int QuantizedTriangles::quantize(
+	float	v,
+	int		axis
+) const {
+	// 21bitではfloatの仮数部が不足するため倍精度で計算する
+	if (m_step[axis] <= 0.0f) return 0;
+	double qmax = (double)((1u << m_bits) - 1);
+	double q = floor(((double)v - m_origin[axis]) / m_step[axis] + 0.5);
+	if (q < 0.0)	q = 0.0;
+	if (q > qmax)	q = qmax;
+	return (unsigned int)q;
+}
+
+} //namespace PolylibNS
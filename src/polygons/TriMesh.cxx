@@ -9,6 +9,7 @@
  *
  */
 
+#include <string.h>
 #include <vector>
 #include <algorithm>
 #include "Polylib.h"
@@ -16,11 +17,15 @@
 #include "polygons/Triangle.h"
 #include "polygons/TriMesh.h"
 #include "polygons/VTree.h"
+#include "polygons/QuantizedTriangles.h"
+#include "polygons/TriangleIdIndex.h"
 #include "common/PolylibCommon.h"
 #include "common/tt.h"
 #include "common/Vec3.h"
 #include "common/BBox.h"
 #include "file_io/TriMeshIO.h"
+#include "file_io/GzipStream.h"
+#include "file_io/PolylibSnapshot.h"
 
 using namespace std;
 
@@ -40,12 +45,21 @@ TriMesh::TriMesh()
 	m_vtree = NULL;
 	m_tri_list = NULL;
 	m_max_elements = M_MAX_ELEMENTS;
+	m_quant_bits = 0;
+	m_qtris = NULL;
+	m_keep_mapped = false;
+	m_list_exposed = false;
+	m_id_index = new TriangleIdIndex();
+	pthread_mutex_init(&m_decode_mutex, NULL);
 }
 
 // public /////////////////////////////////////////////////////////////////////
 TriMesh::~TriMesh()
 {
 	delete m_vtree;
+	delete m_qtris;
+	delete m_id_index;
+	pthread_mutex_destroy(&m_decode_mutex);
 	if (m_tri_list != NULL) {
 		vector<PrivateTriangle*>::iterator itr;
 		for (itr = m_tri_list->begin(); itr != m_tri_list->end(); itr++) {
@@ -62,28 +76,12 @@ void TriMesh::init(const vector<PrivateTriangle*>* trias)
 	init_tri_list();
 	vector<PrivateTriangle*>::const_iterator itr;
 	for (itr = trias->begin(); itr != trias->end(); itr++) {
-		m_tri_list->push_back(
-			new PrivateTriangle((*itr)->get_vertex(),	(*itr)->get_normal(), 
-								(*itr)->get_area(),		(*itr)->get_id())
-		);
+		m_tri_list->push_back(new PrivateTriangle(**itr));
 	}
+	build_id_index();
 }
 
 // public /////////////////////////////////////////////////////////////////////
-// std::sort用ファンクタ
-struct PrivTriaLess{
-	bool operator()( const PrivateTriangle *l, const PrivateTriangle *r ) const
-	{
-		return l->get_id() < r->get_id();
-	}
-};
-// std::equal用ファンクタ
-struct PrivTriaEqual{
-	bool operator()( const PrivateTriangle *l, const PrivateTriangle *r ) const
-	{
-		return l->get_id() == r->get_id();
-	}
-};
 void
 TriMesh::add(
 	const vector<PrivateTriangle*> *trias
@@ -92,31 +90,70 @@ TriMesh::add(
 #ifdef DEBUG
 	PL_DBGOSH << "TriMesh::add_triangles() in." << endl;
 #endif
-	unsigned int i;
+	merge( trias, true );
+}
 
-	if (m_tri_list == NULL) {
-		m_tri_list = new vector<PrivateTriangle*>;
-	}
+// public /////////////////////////////////////////////////////////////////////
+void
+TriMesh::adopt(
+	vector<PrivateTriangle*> *trias
+)
+{
+#ifdef DEBUG
+	PL_DBGOSH << "TriMesh::adopt() in." << endl;
+#endif
+	merge( trias, false );
+	trias->clear();
+}
 
-	// ひとまず全部追加
-	for( i=0; i<trias->size(); i++ ) {
-		m_tri_list->push_back( new PrivateTriangle(*(trias->at(i))) );
+// public /////////////////////////////////////////////////////////////////////
+// std::sort用ファンクタ
+struct PrivTriaLess{
+	bool operator()( const PrivateTriangle *l, const PrivateTriangle *r ) const
+	{
+		return l->get_id() < r->get_id();
 	}
+};
+void
+TriMesh::sort_by_id()
+{
+	if (m_tri_list == NULL) return;
 
-	// 三角形リストをID順にソート
+	expand_triangles();
 	std::sort( m_tri_list->begin(), m_tri_list->end(), PrivTriaLess() );
-
-	// ID重複ぶんを削除
-	m_tri_list->erase(
-		std::unique(m_tri_list->begin(), m_tri_list->end(), PrivTriaEqual()),
-		m_tri_list->end());
+	build_id_index();
 }
 
 // public /////////////////////////////////////////////////////////////////////
-POLYLIB_STAT TriMesh::import(const map<string, string> fmap, float scale)
-{
+POLYLIB_STAT TriMesh::import(
+	const map<string, string>	fmap,
+	float						scale,
+	const BBox					*region
+) {
 	init_tri_list();
-	return TriMeshIO::load(m_tri_list, fmap, scale);
+
+	// 単一の非圧縮バイナリSTLファイルを領域指定なしで読み込む場合は、
+	// 頂点座標をマップ領域に置いたまま保持する。マップできなければ
+	// 通常の読み込みを行う
+	if (m_keep_mapped && region == NULL && fmap.size() == 1) {
+		string fname = fmap.begin()->first;
+		string fmt = fmap.begin()->second;
+		if ((fmt == TriMeshIO::FMT_STL_B || fmt == TriMeshIO::FMT_STL_BB) &&
+			GzipStreamBuf::strip_gzip(fname) == fname) {
+			m_qtris = new QuantizedTriangles();
+			if (m_qtris->map_stl_b(fname, scale, 0) == PLSTAT_OK) {
+				m_tri_list->assign(m_qtris->size(), NULL);
+				build_id_index();
+				return PLSTAT_OK;
+			}
+			delete m_qtris;
+			m_qtris = NULL;
+		}
+	}
+
+	POLYLIB_STAT ret = TriMeshIO::load(m_tri_list, fmap, scale, region);
+	build_id_index();
+	return ret;
 }
 
 // public /////////////////////////////////////////////////////////////////////
@@ -125,6 +162,26 @@ POLYLIB_STAT TriMesh::build()
 	BBox bbox;
 	vector<PrivateTriangle*>::iterator itr;
 
+	// マップしたファイルを参照している場合は、三角形が書き換えられて
+	// いなければマップしたままKD木を作る
+	if (m_qtris != NULL && m_qtris->is_mapped() && !m_list_exposed) {
+		bbox.init();
+		for (unsigned int i = 0; i < m_tri_list->size(); i++) {
+			float ebox[6];
+			get_triangle_bbox(i, ebox);
+			bbox.add(Vec3f(ebox[0], ebox[1], ebox[2]));
+			bbox.add(Vec3f(ebox[3], ebox[4], ebox[5]));
+		}
+		m_bbox = bbox;
+
+		if (m_vtree != NULL) delete m_vtree;
+		m_vtree = new VTree(m_max_elements, m_bbox, m_tri_list, this);
+		return PLSTAT_OK;
+	}
+
+	// 量子化している場合は全三角形を復元してから再構築する
+	expand_triangles();
+
 	/// TriMeshクラスに含まれる全三角形ポリゴンを外包するBoundingBoxを計算
 	bbox.init();
 	for (itr = m_tri_list->begin(); itr != m_tri_list->end(); itr++) {
@@ -141,9 +198,15 @@ POLYLIB_STAT TriMesh::build()
 	PL_DBGOSH << "TriMesh::build:min=(" <<min<< "),max=(" <<max<< ")" << endl;
 #endif
 
+	// 頂点座標の量子化
+	if (m_quant_bits > 0) {
+		POLYLIB_STAT ret = compact_triangles();
+		if (ret != PLSTAT_OK) return ret;
+	}
+
 	// 木構造作成
 	if (m_vtree != NULL) delete m_vtree;
-	m_vtree = new VTree(m_max_elements, m_bbox, m_tri_list);
+	m_vtree = new VTree(m_max_elements, m_bbox, m_tri_list, this);
 	return PLSTAT_OK;
 }
 
@@ -164,7 +227,8 @@ const vector<PrivateTriangle*> *TriMesh::search(
 	PL_DBGOSH << "TriMesh::search:min=(" <<min<< "),max=(" <<max<< ")" << endl;
 #endif
 
-	return m_vtree->search(bbox, every);
+	BBox q_bbox = search_bbox(bbox);
+	return m_vtree->search(&q_bbox, every);
 }
 
 // public /////////////////////////////////////////////////////////////////////
@@ -173,18 +237,22 @@ POLYLIB_STAT TriMesh::search(
 	bool						every, 
 	vector<PrivateTriangle*>	*tri_list
 ) const {
-	return m_vtree->search(bbox, every, tri_list);
+	BBox q_bbox = search_bbox(bbox);
+	return m_vtree->search(&q_bbox, every, tri_list);
 }
 
 // public /////////////////////////////////////////////////////////////////////
 const vector<PrivateTriangle*>* TriMesh::linear_search(
-	BBox	*q_bbox, 
+	BBox	*bbox, 
 	bool	every
 ) const {
 	vector<PrivateTriangle*>		   *tri_list = new vector<PrivateTriangle*>;
+	vector<PrivateTriangle*>		   *all_list = acquire_tri_list();
 	vector<PrivateTriangle*>::iterator itr;
+	BBox							   s_bbox = search_bbox(bbox);
+	BBox							   *q_bbox = &s_bbox;
 
-	for (itr = m_tri_list->begin(); itr != m_tri_list->end(); itr++) {
+	for (itr = all_list->begin(); itr != all_list->end(); itr++) {
 		BBox bbox;
 		bbox.init();
 		const Vec3f* vtx_arr = (*itr)->get_vertex();
@@ -196,7 +264,7 @@ const vector<PrivateTriangle*>* TriMesh::linear_search(
 				q_bbox->contain(vtx_arr[1]) == true &&
 				q_bbox->contain(vtx_arr[2]) == true)
 			{
-				tri_list->push_back(*itr);
+				tri_list->push_back(get_triangle(itr - all_list->begin()));
 			}
 		}
 		else {
@@ -208,24 +276,28 @@ const vector<PrivateTriangle*>* TriMesh::linear_search(
 #else
 			if (bbox.crossed(*q_bbox) == true) {
 #endif
-				tri_list->push_back(*itr);
+				tri_list->push_back(get_triangle(itr - all_list->begin()));
 			}
 		}
 	}
+	release_tri_list(all_list);
 	return tri_list;
 }
 
 // public /////////////////////////////////////////////////////////////////////
 POLYLIB_STAT TriMesh::linear_search(
-	BBox						*q_bbox, 
+	BBox						*bbox, 
 	bool						every, 
 	vector<PrivateTriangle*>	*tri_list
 ) const {
 	if (tri_list == NULL) return PLSTAT_ARGUMENT_NULL;
 
-	vector<PrivateTriangle*>::iterator itr;
+	vector<PrivateTriangle*>			*all_list = acquire_tri_list();
+	vector<PrivateTriangle*>::iterator	itr;
+	BBox								s_bbox = search_bbox(bbox);
+	BBox								*q_bbox = &s_bbox;
 
-	for (itr = m_tri_list->begin(); itr != m_tri_list->end(); itr++) {
+	for (itr = all_list->begin(); itr != all_list->end(); itr++) {
 		BBox bbox;
 		bbox.init();
 		const Vec3f* vtx_arr = (*itr)->get_vertex();
@@ -236,7 +308,7 @@ POLYLIB_STAT TriMesh::linear_search(
 			if (q_bbox->contain(vtx_arr[0]) == true	&&
 				q_bbox->contain(vtx_arr[1]) == true	&&
 				q_bbox->contain(vtx_arr[2]) == true) {
-				tri_list->push_back(*itr);
+				tri_list->push_back(get_triangle(itr - all_list->begin()));
 #ifdef DEBUG
 			PL_DBGOSH << "TriMesh::linear_search:IN TRUE" << endl;
 			PL_DBGOSH << "     vertex 0:" << vtx_arr[0] << endl;
@@ -254,7 +326,7 @@ POLYLIB_STAT TriMesh::linear_search(
 #else
 			if (bbox.crossed(*q_bbox) == true) {
 #endif
-				tri_list->push_back(*itr);
+				tri_list->push_back(get_triangle(itr - all_list->begin()));
 #ifdef DEBUG
 				PL_DBGOSH << "TriMesh::linear_search:IN FALSE" << endl;
 #endif
@@ -269,6 +341,7 @@ POLYLIB_STAT TriMesh::linear_search(
 				  << ",v(" << vtx_arr << ")" << endl;
 #endif
 	}
+	release_tri_list(all_list);
 	return PLSTAT_OK;
 }
 
@@ -279,6 +352,25 @@ const PrivateTriangle* TriMesh::search_nearest(
 	return m_vtree->search_nearest(pos);
 }
 
+// public /////////////////////////////////////////////////////////////////////
+const PrivateTriangle* TriMesh::search_nearest(
+	const Vec3f&	pos,
+	float			max_dist,
+	float			*dist
+) const {
+	return m_vtree->search_nearest(pos, max_dist, dist);
+}
+
+// public /////////////////////////////////////////////////////////////////////
+const PrivateTriangle* TriMesh::search_ray(
+	const Vec3f&	orig,
+	const Vec3f&	dir,
+	float			tmax,
+	float			*t
+) const {
+	return m_vtree->search_ray(orig, dir, tmax, t);
+}
+
 // public /////////////////////////////////////////////////////////////////////
 POLYLIB_STAT TriMesh::set_all_exid(
 	const int    id
@@ -286,14 +378,427 @@ POLYLIB_STAT TriMesh::set_all_exid(
 	// 全ポリゴンのm_exidをidで上書き
 	vector<PrivateTriangle*>::iterator itr;
 	for (itr = m_tri_list->begin(); itr != m_tri_list->end(); itr++) {
-		(*itr)->set_exid( id );
+		if (*itr != NULL) (*itr)->set_exid( id );
+	}
+	if (m_qtris != NULL) {
+		for (int i = 0; i < m_qtris->size(); i++) {
+			m_qtris->set_exid(i, id);
+		}
+	}
+	return PLSTAT_OK;
+}
+
+// public /////////////////////////////////////////////////////////////////////
+POLYLIB_STAT TriMesh::set_quantize_bits(
+	int		bits
+) {
+	if (bits != 0 && bits != 16 && bits != 21) {
+		PL_ERROSH << "[ERROR]TriMesh::set_quantize_bits():Invalid bits:"
+				  << bits << endl;
+		return PLSTAT_NG;
+	}
+	m_quant_bits = bits;
+	return PLSTAT_OK;
+}
+
+// public /////////////////////////////////////////////////////////////////////
+float TriMesh::get_quantize_error() const
+{
+	if (m_qtris == NULL)	return 0.0;
+	else					return m_qtris->get_error();
+}
+
+// public /////////////////////////////////////////////////////////////////////
+void TriMesh::memory_usage(
+	PolylibMemoryUsage	*usage
+) const {
+	// TriMeshクラス
+	usage->others += sizeof(TriMesh);
+
+	// 三角形ポリゴン(量子化時は復元済みのもののみ)
+	if (m_tri_list != NULL) {
+		size_t num = 0;
+		vector<PrivateTriangle*>::iterator itr;
+		for (itr = m_tri_list->begin(); itr != m_tri_list->end(); itr++) {
+			if (*itr != NULL) num++;
+		}
+		usage->triangles += sizeof(vector<PrivateTriangle*>);
+		usage->triangles += num * sizeof(PrivateTriangle);
+		usage->triangles += m_tri_list->capacity() * sizeof(PrivateTriangle*);
+	}
+	if (m_qtris != NULL) {
+		usage->triangles += m_qtris->memory_size();
+		if (m_qtris->get_error() > usage->quantize_error) {
+			usage->quantize_error = m_qtris->get_error();
+		}
+	}
+
+	// 三角形IDインデックス
+	usage->others += m_id_index->memory_size();
+
+	// KD木
+	if (m_vtree != NULL) {
+		size_t node_size, leaf_size;
+		m_vtree->memory_usage(&node_size, &leaf_size);
+		usage->tree_nodes += node_size;
+		usage->leaf_lists += leaf_size;
+	}
+}
+
+// public /////////////////////////////////////////////////////////////////////
+POLYLIB_STAT TriMesh::save_snapshot(
+	SnapshotWriter	&wr
+) const {
+	int n = get_num_triangles();
+
+	// 三角形ポリゴンは項目毎の配列にまとめて書き出す
+	vector<PrivateTriangle*> *all_list = acquire_tri_list();
+	vector<int>		ids(n), exids(n), shells(n);
+	vector<float>	vtx(n * 9), nml(n * 3), area(n);
+	for (int i = 0; i < n; i++) {
+		const PrivateTriangle *tri = (*all_list)[i];
+		const Vec3f *v = tri->get_vertex();
+		Vec3f nv = tri->get_normal();
+		ids[i] = tri->get_id();
+		exids[i] = tri->get_exid();
+		shells[i] = tri->get_shell();
+		for (int j = 0; j < 3; j++) {
+			for (int k = 0; k < 3; k++) vtx[i * 9 + j * 3 + k] = v[j][k];
+			nml[i * 3 + j] = nv[j];
+		}
+		area[i] = tri->get_area();
+	}
+	release_tri_list(all_list);
+
+	float bbox[6] = {	m_bbox.min[0], m_bbox.min[1], m_bbox.min[2],
+						m_bbox.max[0], m_bbox.max[1], m_bbox.max[2]	};
+	int has_tree = (m_vtree != NULL) ? 1 : 0;
+	bool ok =	wr.write(&n, sizeof(int)) &&
+				wr.write(bbox, sizeof(bbox));
+	if (ok && n > 0) {
+		ok =	wr.write(&ids[0], n * sizeof(int)) &&
+				wr.write(&exids[0], n * sizeof(int)) &&
+				wr.write(&shells[0], n * sizeof(int)) &&
+				wr.write(&vtx[0], n * 9 * sizeof(float)) &&
+				wr.write(&nml[0], n * 3 * sizeof(float)) &&
+				wr.write(&area[0], n * sizeof(float));
+	}
+	if (!ok || !wr.write(&has_tree, sizeof(int))) return PLSTAT_NG;
+
+	if (m_vtree != NULL) return m_vtree->save_snapshot(wr);
+	return PLSTAT_OK;
+}
+
+// public /////////////////////////////////////////////////////////////////////
+POLYLIB_STAT TriMesh::load_snapshot(
+	SnapshotReader	&rd
+) {
+	int		n, has_tree;
+	float	bbox[6];
+
+	init_tri_list();
+	if (m_vtree != NULL) {
+		delete m_vtree;
+		m_vtree = NULL;
+	}
+	if (!rd.read(&n, sizeof(int)) || n < 0 || !rd.read(bbox, sizeof(bbox))) {
+		return PLSTAT_NG;
+	}
+
+	// 各配列はマップ領域を直接参照し、三角形ポリゴンの生成時にコピーする
+	const char *ids		= rd.skip(n * sizeof(int));
+	const char *exids	= rd.skip(n * sizeof(int));
+	const char *shells	= rd.skip(n * sizeof(int));
+	const char *vtx		= rd.skip(n * 9 * sizeof(float));
+	const char *nml		= rd.skip(n * 3 * sizeof(float));
+	const char *area	= rd.skip(n * sizeof(float));
+	if (ids == NULL || exids == NULL || shells == NULL || vtx == NULL ||
+		nml == NULL || area == NULL || !rd.read(&has_tree, sizeof(int))) {
+		return PLSTAT_NG;
+	}
+
+	m_tri_list->reserve(n);
+	for (int i = 0; i < n; i++) {
+		int		id, exid, shell;
+		float	v[9], nv[3], a;
+		memcpy(&id, ids + i * sizeof(int), sizeof(int));
+		memcpy(&exid, exids + i * sizeof(int), sizeof(int));
+		memcpy(&shell, shells + i * sizeof(int), sizeof(int));
+		memcpy(v, vtx + i * sizeof(v), sizeof(v));
+		memcpy(nv, nml + i * sizeof(nv), sizeof(nv));
+		memcpy(&a, area + i * sizeof(float), sizeof(float));
+
+		Vec3f vertex[3];
+		for (int j = 0; j < 3; j++) {
+			vertex[j] = Vec3f(v[j * 3], v[j * 3 + 1], v[j * 3 + 2]);
+		}
+		PrivateTriangle *tri = 
+			new PrivateTriangle(vertex, Vec3f(nv[0], nv[1], nv[2]), a, id);
+		tri->set_exid(exid);
+		tri->set_shell(shell);
+		m_tri_list->push_back(tri);
+	}
+	build_id_index();
+
+	// 量子化する場合はKD木を量子化後の三角形から作り直す
+	if (has_tree == 0 || m_quant_bits > 0) return build();
+
+	m_bbox.setMinMax(Vec3f(bbox[0], bbox[1], bbox[2]),
+					 Vec3f(bbox[3], bbox[4], bbox[5]));
+	m_vtree = VTree::load_snapshot(rd, m_tri_list, this);
+	if (m_vtree == NULL) return PLSTAT_NG;
+	return PLSTAT_OK;
+}
+
+// public /////////////////////////////////////////////////////////////////////
+vector<PrivateTriangle*> *TriMesh::get_tri_list() const
+{
+	if (m_qtris != NULL) {
+		for (int i = 0; i < m_qtris->size(); i++) get_triangle(i);
+		if (m_qtris->is_mapped()) m_list_exposed = true;
+	}
+	return m_tri_list;
+}
+
+// public /////////////////////////////////////////////////////////////////////
+PrivateTriangle *TriMesh::get_triangle(
+	int		idx
+) const {
+	PrivateTriangle *tri = (*m_tri_list)[idx];
+	if (tri == NULL && m_qtris != NULL) {
+		// 検索は複数スレッドから同時に行われるので、復元した三角形は空きの
+		// 場合だけ登録し、先に登録されていれば自分の復元分は破棄する
+		PrivateTriangle *dec = m_qtris->decode(idx);
+		pthread_mutex_lock(&m_decode_mutex);
+		tri = (*m_tri_list)[idx];
+		if (tri == NULL) (*m_tri_list)[idx] = tri = dec;
+		pthread_mutex_unlock(&m_decode_mutex);
+		if (tri != dec) delete dec;
+	}
+	return tri;
+}
+
+// public /////////////////////////////////////////////////////////////////////
+vector<PrivateTriangle*> *TriMesh::acquire_tri_list() const
+{
+	if (m_qtris == NULL) return m_tri_list;
+
+	// 復元済みの三角形はそのまま使い、未復元のものは一時的に復元する
+	vector<PrivateTriangle*> *tri_list = 
+		new vector<PrivateTriangle*>(m_tri_list->size());
+	for (unsigned int i = 0; i < m_tri_list->size(); i++) {
+		PrivateTriangle *tri = (*m_tri_list)[i];
+		(*tri_list)[i] = (tri != NULL) ? tri : m_qtris->decode(i);
+	}
+	return tri_list;
+}
+
+// public /////////////////////////////////////////////////////////////////////
+void TriMesh::release_tri_list(
+	vector<PrivateTriangle*>	*tri_list
+) const {
+	if (tri_list == NULL || tri_list == m_tri_list) return;
+
+	// ポリゴンリストに登録されていない三角形が一時的に復元したもの
+	for (unsigned int i = 0; i < tri_list->size(); i++) {
+		if ((*tri_list)[i] != (*m_tri_list)[i]) delete (*tri_list)[i];
+	}
+	delete tri_list;
+}
+
+// public /////////////////////////////////////////////////////////////////////
+void TriMesh::set_triangle_owned(
+	int		idx,
+	bool	owned
+) {
+	PrivateTriangle *tri = (*m_tri_list)[idx];
+	if (tri != NULL)		tri->set_owned(owned);
+	if (m_qtris != NULL)	m_qtris->set_owned(idx, owned);
+}
+
+// public /////////////////////////////////////////////////////////////////////
+POLYLIB_STAT TriMesh::set_triangle_ids(
+	const vector<int>	&ids
+) {
+	if ((int)ids.size() != get_num_triangles()) {
+		PL_ERROSH << "[ERROR]TriMesh::set_triangle_ids():Num of IDs mismatch:"
+				  << ids.size() << endl;
+		return PLSTAT_NG;
+	}
+	for (unsigned int i = 0; i < ids.size(); i++) {
+		PrivateTriangle *tri = (*m_tri_list)[i];
+		if (tri != NULL)		tri->set_id(ids[i]);
+		if (m_qtris != NULL)	m_qtris->set_id(i, ids[i]);
+	}
+	build_id_index();
+	return PLSTAT_OK;
+}
+
+// public /////////////////////////////////////////////////////////////////////
+PrivateTriangle *TriMesh::get_triangle_by_id(
+	int		id
+) const {
+	int idx = m_id_index->find(id);
+	if (idx < 0)	return NULL;
+	else			return get_triangle(idx);
+}
+
+// public /////////////////////////////////////////////////////////////////////
+void TriMesh::get_triangle_bbox(
+	int		idx,
+	float	*ebox
+) const {
+	if (m_qtris != NULL)	m_qtris->get_bbox(idx, ebox);
+	else					Polygons::get_triangle_bbox(idx, ebox);
+}
+
+// public /////////////////////////////////////////////////////////////////////
+void TriMesh::release_triangles()
+{
+	if (m_qtris == NULL) return;
+
+	// マップ中に渡したリストは頂点座標を書き換えられた可能性があるので、
+	// 解放せずにマップから切り離す
+	if (m_qtris->is_mapped() && m_list_exposed) {
+		expand_triangles();
+		return;
+	}
+
+	bool id_changed = false;
+	for (int i = 0; i < m_qtris->size(); i++) {
+		PrivateTriangle *tri = (*m_tri_list)[i];
+		if (tri == NULL) continue;
+		if (tri->get_id() != m_qtris->get_id(i)) {
+			m_qtris->set_id(i, tri->get_id());
+			id_changed = true;
+		}
+		m_qtris->set_exid(i, tri->get_exid());
+		m_qtris->set_shell(i, tri->get_shell());
+		m_qtris->set_owned(i, tri->is_owned());
+		delete tri;
+		(*m_tri_list)[i] = NULL;
+	}
+	if (id_changed) build_id_index();
+}
+
+// private ////////////////////////////////////////////////////////////////////
+void TriMesh::expand_triangles()
+{
+	if (m_qtris == NULL) return;
+
+	get_tri_list();
+	delete m_qtris;
+	m_qtris = NULL;
+	m_list_exposed = false;
+}
+
+// private ////////////////////////////////////////////////////////////////////
+POLYLIB_STAT TriMesh::compact_triangles()
+{
+	m_qtris = new QuantizedTriangles();
+	POLYLIB_STAT ret = m_qtris->encode(m_tri_list, m_bbox, m_quant_bits);
+	if (ret != PLSTAT_OK) {
+		delete m_qtris;
+		m_qtris = NULL;
+		return ret;
+	}
+
+	vector<PrivateTriangle*>::iterator itr;
+	for (itr = m_tri_list->begin(); itr != m_tri_list->end(); itr++) {
+		delete *itr;
+		*itr = NULL;
 	}
+
+#ifdef DEBUG
+	PL_DBGOSH << "TriMesh::compact_triangles:bits=" << m_quant_bits
+			  << ",error=" << m_qtris->get_error() << endl;
+#endif
 	return PLSTAT_OK;
 }
 
+// private ////////////////////////////////////////////////////////////////////
+BBox TriMesh::search_bbox(
+	const BBox	*bbox
+) const {
+	// 量子化している場合は誤差の上限だけ検索範囲を広げ、元の形状に対して
+	// 検索漏れが生じないようにする
+	BBox q_bbox = *bbox;
+	if (m_qtris != NULL) {
+		float err = m_qtris->get_error();
+		for (int i = 0; i < 3; i++) {
+			q_bbox.min[i] -= err;
+			q_bbox.max[i] += err;
+		}
+	}
+	return q_bbox;
+}
+
+// private ////////////////////////////////////////////////////////////////////
+void TriMesh::merge(
+	const vector<PrivateTriangle*>	*trias,
+	bool							copy
+) {
+	unsigned int i;
+
+	if (m_tri_list == NULL) {
+		m_tri_list = new vector<PrivateTriangle*>;
+	}
+
+	// 量子化している場合は復元してから追加する(次回のbuild()で再量子化)
+	expand_triangles();
+
+	// 少数ずつ繰り返し追加されても再確保が償却O(1)となるよう倍々で確保する
+	size_t num = m_tri_list->size() + trias->size();
+	if( num > m_tri_list->capacity() ) {
+		m_tri_list->reserve( std::max( num, m_tri_list->capacity() * 2 ) );
+	}
+	m_id_index->reserve( num );
+
+	// IDが未登録のものだけを末尾に追加(ID重複ぶんは既存のものを優先)。
+	// 既存の三角形の並びとIDインデックスは変えないので、追加はO(k)
+	for( i=0; i<trias->size(); i++ ) {
+		PrivateTriangle *tri = trias->at(i);
+		int idx = m_tri_list->size();
+		if( m_id_index->insert( tri->get_id(), idx ) ) {
+			m_tri_list->push_back( copy ? new PrivateTriangle(*tri) : tri );
+		}
+		else if( !copy ) {
+			delete tri;
+		}
+	}
+}
+
+// private ////////////////////////////////////////////////////////////////////
+void TriMesh::build_id_index()
+{
+	m_id_index->clear();
+	if (m_tri_list == NULL) return;
+
+	m_id_index->reserve(m_tri_list->size());
+	for (unsigned int i = 0; i < m_tri_list->size(); i++) {
+		// 量子化している場合、未復元の三角形のIDは量子化データから取る
+		PrivateTriangle *tri = (*m_tri_list)[i];
+		int id = (tri != NULL) ? tri->get_id() : m_qtris->get_id(i);
+
+		// IDが重複する場合は先に登録したものを優先する
+#ifdef DEBUG
+		if (!m_id_index->insert(id, i)) {
+			PL_DBGOSH << "TriMesh::build_id_index:duplicate id:" << id << endl;
+		}
+#else
+		m_id_index->insert(id, i);
+#endif
+	}
+}
+
 // private ////////////////////////////////////////////////////////////////////
 void TriMesh::init_tri_list()
 {
+	delete m_qtris;
+	m_qtris = NULL;
+	m_list_exposed = false;
+	m_id_index->clear();
+
 	if (m_tri_list == NULL) {
 		m_tri_list = new vector<PrivateTriangle*>;
 	}
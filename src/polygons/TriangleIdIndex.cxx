@@ -0,0 +1,120 @@
+/*
+ * Polylib - Polygon Management Library
+ *
+ * Copyright (c) 2010-2011 VCAD System Research Program, RIKEN.
+ * All rights reserved.
+ *
+ * Copyright (c) 2012-2013 Advanced Institute for Computational Science, RIKEN.
+ * All rights reserved.
+ *
+ */
+
+#include <vector>
+#include "polygons/TriangleIdIndex.h"
+
+namespace PolylibNS {
+
+using namespace std;
+
+#define TII_MIN_CAPACITY	16	/// ハッシュ表の最小スロット数
+
+/************************************************************************
+ *
+ * TriangleIdIndexクラス
+ *
+ ***********************************************************************/
+// public /////////////////////////////////////////////////////////////////////
+TriangleIdIndex::TriangleIdIndex()
+{
+	m_num = 0;
+	m_shift = 0;
+}
+
+// public /////////////////////////////////////////////////////////////////////
+void TriangleIdIndex::clear()
+{
+	vector<int>().swap(m_keys);
+	vector<int>().swap(m_vals);
+	m_num = 0;
+	m_shift = 0;
+}
+
+// public /////////////////////////////////////////////////////////////////////
+void TriangleIdIndex::reserve(
+	size_t	num
+) {
+	// 負荷率を1/2以下に保つ
+	size_t cap = TII_MIN_CAPACITY;
+	while (cap < num * 2) cap <<= 1;
+	if (cap > m_keys.size()) rehash(cap);
+}
+
+// public /////////////////////////////////////////////////////////////////////
+bool TriangleIdIndex::insert(
+	int		id,
+	int		idx
+) {
+	if ((m_num + 1) * 2 > m_keys.size()) {
+		rehash(m_keys.empty() ? TII_MIN_CAPACITY : m_keys.size() * 2);
+	}
+
+	size_t mask = m_keys.size() - 1;
+	size_t pos = slot(id);
+	while (m_vals[pos] >= 0) {
+		if (m_keys[pos] == id) return false;
+		pos = (pos + 1) & mask;
+	}
+	m_keys[pos] = id;
+	m_vals[pos] = idx;
+	m_num++;
+	return true;
+}
+
+// public /////////////////////////////////////////////////////////////////////
+int TriangleIdIndex::find(
+	int		id
+) const {
+	if (m_num == 0) return -1;
+
+	size_t mask = m_keys.size() - 1;
+	size_t pos = slot(id);
+	while (m_vals[pos] >= 0) {
+		if (m_keys[pos] == id) return m_vals[pos];
+		pos = (pos + 1) & mask;
+	}
+	return -1;
+}
+
+// public /////////////////////////////////////////////////////////////////////
+size_t TriangleIdIndex::memory_size() const
+{
+	return sizeof(TriangleIdIndex)
+		 + m_keys.capacity() * sizeof(int)
+		 + m_vals.capacity() * sizeof(int);
+}
+
+// private ////////////////////////////////////////////////////////////////////
+void TriangleIdIndex::rehash(
+	size_t	cap
+) {
+	vector<int> keys(cap, 0);
+	vector<int> vals(cap, -1);
+	m_keys.swap(keys);
+	m_vals.swap(vals);
+
+	// スロット数は2のべき乗なので、ハッシュ値の上位ビットを用いる
+	int bits = 0;
+	while (((size_t)1 << bits) < cap) bits++;
+	m_shift = 32 - bits;
+
+	size_t mask = cap - 1;
+	for (size_t i = 0; i < keys.size(); i++) {
+		if (vals[i] < 0) continue;
+		size_t pos = slot(keys[i]);
+		while (m_vals[pos] >= 0) pos = (pos + 1) & mask;
+		m_keys[pos] = keys[i];
+		m_vals[pos] = vals[i];
+	}
+}
+
+} //namespace PolylibNS
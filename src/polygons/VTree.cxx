@@ -9,6 +9,7 @@
  *
  */
 
+#include <string.h>
 #include "common/PolylibCommon.h"
 #include "common/Vec3.h"
 #include "common/BBox.h"
@@ -16,6 +17,7 @@
 #include "polygons/Polygons.h"
 #include "polygons/TriMesh.h"
 #include "polygons/VTree.h"
+#include "file_io/PolylibSnapshot.h"
 
 
 namespace PolylibNS {
@@ -26,22 +28,8 @@ using namespace std;
 static vector<VNode*> m_vnode;
 #endif
 
-/************************************************************************
- *  
- * VElementクラス
- *  @attention KD木構造の要素クラス
- *  
- ***********************************************************************/
-// public /////////////////////////////////////////////////////////////////////
-VElement::VElement(
-	PrivateTriangle* tri
-) {
-	m_tri = tri;
-	for(int i=0; i<3; i++){
-		m_bbox.add(tri->get_vertex()[i]);
-	}
-	m_pos = m_bbox.center();
-}
+/// スナップショットから復元するKD木の深さの上限(不正データ対策)。
+static const int SNAP_MAX_DEPTH = 1024;
 
 /************************************************************************
  *  
@@ -64,18 +52,16 @@ VNode::VNode()
 // public /////////////////////////////////////////////////////////////////////
 VNode::~VNode()
 {
-	vector<VElement*>::iterator itr = m_vlist.begin();
-	for (; itr != m_vlist.end(); itr++) {
-		delete *itr;
-	}
 	m_vlist.clear();
 	if (m_left!=NULL) {delete m_left; m_left=NULL;}
 	if (m_right!=NULL){delete m_right; m_right=NULL;}
 }
 
 // public /////////////////////////////////////////////////////////////////////
-void VNode::split(const int& max_elem)
-{
+void VNode::split(
+	const int&		max_elem,
+	const float		*elm_bbox
+) {
 	m_left = new VNode();
 	m_right = new VNode();
 
@@ -94,18 +80,21 @@ void VNode::split(const int& max_elem)
 	m_right->m_depth = m_depth+1;
 #endif
 
-	vector<VElement*>::const_iterator itr = m_vlist.begin();
+	// 要素の振り分けはBounding Boxの中心位置で行う
+	vector<int>::const_iterator itr = m_vlist.begin();
 	for (; itr != m_vlist.end(); itr++) {
-		if ((*itr)->get_pos()[m_axis] < x) {
+		const float *ebox = &elm_bbox[(size_t)(*itr) * 6];
+		float pos = .5f * (ebox[m_axis] + ebox[m_axis + 3]);
+		if (pos < x) {
 			m_left->m_vlist.push_back((*itr));
-			m_left->set_bbox_search((*itr));
+			m_left->set_bbox_search(ebox);
 		}
 		else {
 			m_right->m_vlist.push_back((*itr));
-			m_right->set_bbox_search((*itr));
+			m_right->set_bbox_search(ebox);
 		}
 	}
-	m_vlist.clear();
+	vector<int>().swap(m_vlist);
 
 	// set the next axis to split a bounding box
 	AxisEnum axis;
@@ -116,10 +105,10 @@ void VNode::split(const int& max_elem)
 	m_right->set_axis(axis);
 
 	if (m_left->get_elements_num() > max_elem) {
-		m_left->split(max_elem);
+		m_left->split(max_elem, elm_bbox);
 	}
 	if (m_right->get_elements_num() > max_elem) {
-		m_right->split(max_elem);
+		m_right->split(max_elem, elm_bbox);
 	}
 }
 
@@ -157,12 +146,24 @@ void dump_depth(int n) {
 VTree::VTree(
 	int							max_elem, 
 	const BBox					bbox, 
-	vector<PrivateTriangle*>	*tri_list
+	vector<PrivateTriangle*>	*tri_list,
+	const Polygons				*polygons
 ) {
 	m_root = NULL;
+	m_tri_list = NULL;
+	m_polygons = polygons;
 	create(max_elem, bbox, tri_list);
 }
 
+// private ////////////////////////////////////////////////////////////////////
+VTree::VTree()
+{
+	m_root = NULL;
+	m_max_elements = 0;
+	m_tri_list = NULL;
+	m_polygons = NULL;
+}
+
 // public /////////////////////////////////////////////////////////////////////
 VTree::~VTree()
 {
@@ -176,6 +177,7 @@ void VTree::destroy()
 		delete m_root;
 		m_root = NULL;
 	}
+	vector<float>().swap(m_elm_bbox);
 }
 
 // public /////////////////////////////////////////////////////////////////////
@@ -194,35 +196,16 @@ vector<PrivateTriangle*>* VTree::search(
 		cerr << "Polylib::vtree::Error" << endl;
 		exit(1);
 	}
-	vector<VElement*> vlist;
-	search_recursive(m_root, *bbox, every, &vlist);
-
-	vector<VElement*>::iterator itr=vlist.begin();
+	vector<PrivateTriangle*> *tri_list = new vector<PrivateTriangle*>;
+	search_recursive(m_root, *bbox, every, tri_list);
 
 #ifdef DEBUG_VTREE
 	PL_DBGOSH << "VTree::search_recursive end" << endl;
-	for (; itr != vlist.end(); itr++) {
-		PL_DBGOSH << "VTree::search:tid=" << (*itr)->get_triangle()->get_id() 
-				  << endl;
+	vector<PrivateTriangle*>::iterator itr=tri_list->begin();
+	for (; itr != tri_list->end(); itr++) {
+		PL_DBGOSH << "VTree::search:tid=" << (*itr)->get_id() << endl;
 	}
-	itr=vlist.begin();
-#endif
-
-	vector<PrivateTriangle*> *tri_list = new vector<PrivateTriangle*>;
-	for (; itr != vlist.end(); itr++) {
-#ifdef MEMCOPY_TYPE
-		PrivateTriangle *tri = new PrivateTriangle(
-				(*itr)->getVertex(), (*itr)->get_normal(),
-				(*itr)->getArea(), (*itr)->get_id()) ;
-
-#ifdef DEBUG_VTREE
-		PL_DBGOSH << "VTree::get_id:" << tri->get_id() << endl;
-#endif
-		tri_list->push_back(*tri);
-		delete(tri);
 #endif
-		tri_list->push_back((*itr)->get_triangle());
-	}
 	return tri_list;
 }
 
@@ -243,70 +226,94 @@ POLYLIB_STAT VTree::search(
 		cout << "Error" << endl;
 		return PLSTAT_ROOT_NODE_NOT_EXIST;
 	}
-	vector<VElement*> vlist;
-	search_recursive(m_root, *bbox, every, &vlist);
-
-	vector<VElement*>::iterator itr=vlist.begin();
+	// 木を検索して、リーフのインデックスを三角形に変換した結果を追加する。
+#ifdef DEBUG_VTREE
+	size_t top = tri_list->size();
+#endif
+	search_recursive(m_root, *bbox, every, tri_list);
 
 #ifdef DEBUG_VTREE
-	for (; itr != vlist.end(); itr++) {
-		PL_DBGOSH << "VTree::search:tid=" << (*itr)->get_triangle()->get_id() 
-				  << endl;
+	for (size_t i = top; i < tri_list->size(); i++) {
+		PL_DBGOSH << "VTree::search:tid=" << (*tri_list)[i]->get_id() << endl;
 	}
 #endif
+	return PLSTAT_OK;
+}
 
-// 木を検索して返ってきた結果を返り値に変換する。
-
-	itr = vlist.begin();
-	for (; itr != vlist.end(); itr++) {
-#ifdef MEMCOPY_TYPE
-		PrivateTriangle *tri = new PrivateTriangle;
-
-		tri->m_id =  (*itr)->m_id;
-		tri->m_area =  (*itr)->m_area;
-		for (int j=0; j<3; j++) {
-			(tri->m_vertex[j])[AXIS_X] = (((*itr)->m_vertex)[j])[AXIS_X];
-			(tri->m_vertex[j])[AXIS_Y] = (((*itr)->m_vertex)[j])[AXIS_Y];
-			(tri->m_vertex[j])[AXIS_Z] = (((*itr)->m_vertex)[j])[AXIS_Z];
-		}
-		tri->m_normal[0] = ((*itr)->m_normal)[0];
-		tri->m_normal[1] = ((*itr)->m_normal)[1];
-		tri->m_normal[2] = ((*itr)->m_normal)[2];
+// public /////////////////////////////////////////////////////////////////////
+size_t VTree::memory_size() const {
+	size_t	node_size, leaf_size;
 
-		tri_list->push_back(tri);
-#endif
-		tri_list->push_back( (*itr)->get_triangle() );
-	}
-	return PLSTAT_OK;
+	memory_usage(&node_size, &leaf_size);
+	return node_size + leaf_size;
 }
 
 // public /////////////////////////////////////////////////////////////////////
-unsigned int VTree::memory_size() {
-	VNode			*vnode;
-	unsigned int	node_cnt = 1;		// ノード数
-	unsigned int	poly_cnt = 0;		// ポリゴン数
-	unsigned int	size;
+void VTree::memory_usage(
+	size_t	*node_size,
+	size_t	*leaf_size
+) const {
+	size_t	node_cnt = 0;		// ノード数
+	size_t	elem_cap = 0;		// リーフ要素リストの確保済み要素数
 
-	if ((vnode = m_root->get_left()) != NULL) {; 
-		node_count(vnode, &node_cnt, &poly_cnt);
+	if (m_root != NULL) {
+		node_count(m_root, &node_cnt, &elem_cap);
 	}
 #ifdef DEBUG_VTREE
-	PL_DBGOSH << "VTree::memory_size1():node,poly=" << node_cnt << "," 
-			  << poly_cnt << endl;
+	PL_DBGOSH << "VTree::memory_usage():node,elem=" << node_cnt << "," 
+			  << elem_cap << endl;
 #endif
-		
-	if ((vnode = m_root->get_right()) != NULL) {; 
-		node_count(vnode, &node_cnt, &poly_cnt);
+
+	*node_size  = sizeof(VTree);
+	*node_size += sizeof(VNode) * node_cnt;
+	*leaf_size  = sizeof(int)   * elem_cap;
+	*leaf_size += sizeof(float) * m_elm_bbox.capacity();
+}
+
+// public /////////////////////////////////////////////////////////////////////
+POLYLIB_STAT VTree::save_snapshot(
+	SnapshotWriter	&wr
+) const {
+	int num = m_elm_bbox.size() / 6;
+	int has_root = (m_root != NULL) ? 1 : 0;
+	bool ok =	wr.write(&m_max_elements, sizeof(int)) &&
+				wr.write(&num, sizeof(int)) &&
+				(num == 0 || 
+				 wr.write(&m_elm_bbox[0], (size_t)num * 6 * sizeof(float))) &&
+				wr.write(&has_root, sizeof(int));
+	if (ok && m_root != NULL) ok = save_node(m_root, wr);
+	return ok ? PLSTAT_OK : PLSTAT_NG;
+}
+
+// public /////////////////////////////////////////////////////////////////////
+VTree *VTree::load_snapshot(
+	SnapshotReader				&rd,
+	vector<PrivateTriangle*>	*tri_list,
+	const Polygons				*polygons
+) {
+	int max_elem, num, has_root;
+	if (!rd.read(&max_elem, sizeof(int)) || !rd.read(&num, sizeof(int)) ||
+		num != (int)tri_list->size()) {
+		return NULL;
 	}
-#ifdef DEBUG_VTREE
-	PL_DBGOSH << "VTree::memory_size2():node,poly=" << node_cnt << "," 
-			  << poly_cnt << endl;
-#endif
 
-	size  = sizeof(VTree);
-	size += sizeof(VNode)	 * node_cnt;
-	size += sizeof(VElement) * poly_cnt;
-	return size;
+	VTree *vtree = new VTree();
+	vtree->m_max_elements = max_elem;
+	vtree->m_tri_list = tri_list;
+	vtree->m_polygons = polygons;
+	vtree->m_elm_bbox.resize((size_t)num * 6);
+	bool ok = (num == 0 || 
+			   rd.read(&vtree->m_elm_bbox[0], (size_t)num * 6 * sizeof(float))) &&
+			  rd.read(&has_root, sizeof(int));
+	if (ok && has_root != 0) {
+		vtree->m_root = vtree->load_node(rd, 0);
+		ok = (vtree->m_root != NULL);
+	}
+	if (!ok) {
+		delete vtree;
+		return NULL;
+	}
+	return vtree;
 }
 
 // public /////////////////////////////////////////////////////////////////////
@@ -331,9 +338,9 @@ const PrivateTriangle* VTree::search_nearest_recursive(
 		float dist2_min = 0.0;
  
 		// ノード内のポリゴンから最も近い物を探す(リニアサーチ)
-		vector<VElement*>::const_iterator itr = vn->get_vlist().begin();
+		vector<int>::const_iterator itr = vn->get_vlist().begin();
 		for (; itr != vn->get_vlist().end(); itr++) {
-			const PrivateTriangle* tri = (*itr)->get_triangle();
+			const PrivateTriangle* tri = triangle(*itr);
 			const Vec3f *v = tri->get_vertex();
 			Vec3f c((v[0][0]+v[1][0]+v[2][0])/3.0,
 					(v[0][1]+v[1][1]+v[2][1])/3.0,
@@ -367,12 +374,50 @@ const PrivateTriangle* VTree::search_nearest_recursive(
 	}
 }
 
+// public /////////////////////////////////////////////////////////////////////
+const PrivateTriangle* VTree::search_nearest(
+	const Vec3f&	pos,
+	float			max_dist,
+	float			*dist
+) const {
+	if (m_root == 0) {
+		cerr << "Polylib::vtree::Error" << endl;
+		return 0;
+	}
+
+	float dist2 = max_dist * max_dist;
+	const PrivateTriangle* hit = 0;
+	search_nearest_bounded(m_root, pos, &dist2, &hit);
+	if (hit) *dist = sqrtf(dist2);
+	return hit;
+}
+
+// public /////////////////////////////////////////////////////////////////////
+const PrivateTriangle* VTree::search_ray(
+	const Vec3f&	orig,
+	const Vec3f&	dir,
+	float			tmax,
+	float			*t
+) const {
+	if (m_root == 0) {
+		cerr << "Polylib::vtree::Error" << endl;
+		return 0;
+	}
+
+	float tbest = tmax;
+	const PrivateTriangle* hit = 0;
+	search_ray_recursive(m_root, orig, dir, &tbest, &hit);
+	if (hit) *t = tbest;
+	return hit;
+}
+
 // private ////////////////////////////////////////////////////////////////////
-void VTree::traverse(VNode* vn, VElement* elm, VNode** vnode) const
+void VTree::traverse(VNode* vn, int idx, VNode** vnode) const
 {
+	const float *ebox = elm_bbox(idx);
 // --- ims ---<
 	// set bbox for search triangle
-	vn->set_bbox_search(elm);
+	vn->set_bbox_search(ebox);
 // --- ims --->
 
 	if (vn->is_leaf()) {
@@ -382,27 +427,29 @@ void VTree::traverse(VNode* vn, VElement* elm, VNode** vnode) const
 		return;
 	}
 
-	Vec3f vtx = elm->get_pos();
+	Vec3f vtx(.5f * (ebox[0] + ebox[3]),
+			  .5f * (ebox[1] + ebox[4]),
+			  .5f * (ebox[2] + ebox[5]));
 #ifdef SQ_RADIUS
 	float& sqdist = q->m_sqdist;
 #endif
 	AxisEnum axis = vn->get_axis();
 	float x = vn->get_left()->get_bbox().max[axis];
 	if (vtx[axis] < x) {
-		traverse(vn->get_left(), elm, vnode);
+		traverse(vn->get_left(), idx, vnode);
 #ifdef SQ_RADIUS
 		float d = x - vtx[axis];
 		if (d*d < sqdist) {
-			traverse(vn->get_right(), elm, vnode);
+			traverse(vn->get_right(), idx, vnode);
 		}
 #endif
 	}
 	else {
-		traverse(vn->get_right(), elm, vnode);
+		traverse(vn->get_right(), idx, vnode);
 #ifdef SQ_RADIUS
 		float d = vtx[axis] - x;
 		if (d*d < sqdist) {
-			traverse(vn->get_left(), elm, vnode);
+			traverse(vn->get_left(), idx, vnode);
 		}
 #endif
 	}
@@ -410,22 +457,28 @@ void VTree::traverse(VNode* vn, VElement* elm, VNode** vnode) const
 
 // private ////////////////////////////////////////////////////////////////////
 void VTree::search_recursive(
-	VNode				*vn, 
-	const BBox			&bbox, 
-	bool				every, 
-	vector<VElement*>	*vlist
+	VNode						*vn, 
+	const BBox					&bbox, 
+	bool						every, 
+	vector<PrivateTriangle*>	*tri_list
 ) const {
 #ifdef DEBUG_VTREE
 try{
 	PL_DBGOSH << "VTree::search_recursive:@@@----------------------@@@" << endl;
 #endif
 	if (vn->is_leaf()) {
-		vector<VElement*>::const_iterator itr = vn->get_vlist().begin();
+		vector<int>::const_iterator itr = vn->get_vlist().begin();
 		for (; itr != vn->get_vlist().end(); itr++) {
 			// determine between bbox and 3 vertices of each triangle.
+			const float *e = elm_bbox(*itr);
 			if (every == true) {
+				// 3頂点が含まれるならBounding Boxは交差するので先に判定する
+				if (e[3] < bbox.min[0] || bbox.max[0] < e[0]) continue;
+				if (e[4] < bbox.min[1] || bbox.max[1] < e[1]) continue;
+				if (e[5] < bbox.min[2] || bbox.max[2] < e[2]) continue;
+				PrivateTriangle *tri = triangle(*itr);
 				bool iscontain = true;
-				const Vec3f *temp = (*itr)->get_triangle()->get_vertex();
+				const Vec3f *temp = tri->get_vertex();
 				for (int i = 0; i < 3; i++) {
 					if (bbox.contain(temp[i]) == false)  {
 						iscontain = false;
@@ -433,16 +486,16 @@ try{
 					}
 				}
 				if (iscontain == true) {
-					vlist->push_back(*itr);
+					tri_list->push_back(tri);
 				}
 			}
 			else{
 				// determine between bbox and bbox crossed
-				BBox e_bbox = (*itr)->get_bbox();
-
-				if (e_bbox.crossed(bbox) == true) {
-						vlist->push_back(*itr);
-				}
+				// (三角形を参照せず、パックされたBounding Boxのみで判定する)
+				if (e[3] < bbox.min[0] || bbox.max[0] < e[0]) continue;
+				if (e[4] < bbox.min[1] || bbox.max[1] < e[1]) continue;
+				if (e[5] < bbox.min[2] || bbox.max[2] < e[2]) continue;
+				tri_list->push_back(triangle(*itr));
 			}
 		}
 #ifdef USE_DEPTH
@@ -468,14 +521,14 @@ try{
 #ifdef USE_DEPTH
 		PL_DBGOSH << "VTree::search_recursive:left=" << vn->get_depth() << endl;
 #endif
-		search_recursive(vn->get_left(), bbox, every, vlist);
+		search_recursive(vn->get_left(), bbox, every, tri_list);
 	}
 
 	if (rbox.crossed(bbox) == true) {
 #ifdef USE_DEPTH
 	PL_DBGOSH << "VTree::search_recursive:right=" << vn->get_depth() << endl;
 #endif
-		search_recursive(vn->get_right(), bbox, every, vlist);
+		search_recursive(vn->get_right(), bbox, every, tri_list);
 	}
 #ifdef DEBUG_VTREE
 }
@@ -485,6 +538,93 @@ catch(char *str) {
 #endif
 }
 
+// private ////////////////////////////////////////////////////////////////////
+void VTree::search_nearest_bounded(
+	VNode					*vn, 
+	const Vec3f				&pos, 
+	float					*dist2, 
+	const PrivateTriangle	**hit
+) const {
+	if (vn->is_leaf()) {
+		vector<int>::const_iterator itr = vn->get_vlist().begin();
+		for (; itr != vn->get_vlist().end(); itr++) {
+			const PrivateTriangle* tri = triangle(*itr);
+			const Vec3f *v = tri->get_vertex();
+			Vec3f c((v[0][0]+v[1][0]+v[2][0])/3.0,
+					(v[0][1]+v[1][1]+v[2][1])/3.0,
+					(v[0][2]+v[1][2]+v[2][2])/3.0);
+			float d2 = (c - pos).lengthSquared();
+			if (d2 < *dist2) {
+				*dist2 = d2;
+				*hit = tri;
+			}
+		}
+		return;
+	}
+
+	// 重心は三角形のBounding Boxに含まれるので、検索用BBoxまでの距離が
+	// 見つけた距離以上のノードは省く。近い子ノードから調べる
+	VNode *vn1 = vn->get_left();
+	VNode *vn2 = vn->get_right();
+	float d1 = vn1->get_bbox_search().distanceSquared(pos);
+	float d2 = vn2->get_bbox_search().distanceSquared(pos);
+	if (d2 < d1) {
+		std::swap(vn1, vn2);
+		std::swap(d1, d2);
+	}
+	if (d1 < *dist2) search_nearest_bounded(vn1, pos, dist2, hit);
+	if (d2 < *dist2) search_nearest_bounded(vn2, pos, dist2, hit);
+}
+
+// private ////////////////////////////////////////////////////////////////////
+void VTree::search_ray_recursive(
+	VNode					*vn, 
+	const Vec3f				&orig, 
+	const Vec3f				&dir, 
+	float					*tbest, 
+	const PrivateTriangle	**hit
+) const {
+	if (vn->is_leaf()) {
+		// Moller-Trumboreの方法で交差判定(表裏は区別しない)
+		vector<int>::const_iterator itr = vn->get_vlist().begin();
+		for (; itr != vn->get_vlist().end(); itr++) {
+			const PrivateTriangle *tri = triangle(*itr);
+			const Vec3f *v = tri->get_vertex();
+			Vec3f e1 = v[1] - v[0];
+			Vec3f e2 = v[2] - v[0];
+			Vec3f p = cross(dir, e2);
+			float det = dot(e1, p);
+			if (det == 0.0f) continue;
+			float inv = 1.0f / det;
+			Vec3f s = orig - v[0];
+			float u = dot(s, p) * inv;
+			if (u < 0.0f || u > 1.0f) continue;
+			Vec3f q = cross(s, e1);
+			float w = dot(dir, q) * inv;
+			if (w < 0.0f || u + w > 1.0f) continue;
+			float t = dot(e2, q) * inv;
+			if (t < 0.0f || t > *tbest) continue;
+			*tbest = t;
+			*hit = tri;
+		}
+		return;
+	}
+
+	// 入る位置が近い子ノードから調べ、見つけた交差位置より遠いノードは省く
+	VNode *vn1 = vn->get_left();
+	VNode *vn2 = vn->get_right();
+	float t1 = 0.0f, t2 = 0.0f;
+	bool h1 = vn1->get_bbox_search().crossed_ray(orig, dir, *tbest, &t1);
+	bool h2 = vn2->get_bbox_search().crossed_ray(orig, dir, *tbest, &t2);
+	if (h2 && (h1 == false || t2 < t1)) {
+		std::swap(vn1, vn2);
+		std::swap(h1, h2);
+		std::swap(t1, t2);
+	}
+	if (h1) search_ray_recursive(vn1, orig, dir, tbest, hit);
+	if (h2 && t2 <= *tbest) search_ray_recursive(vn2, orig, dir, tbest, hit);
+}
+
 // private ////////////////////////////////////////////////////////////////////
 #ifdef SQ_RADIUS
 POLYLIB_STAT VTree::create(float sqradius) {
@@ -498,18 +638,34 @@ POLYLIB_STAT VTree::create(
 	destroy();
 
 	m_max_elements = max_elem;
+	m_tri_list = tri_list;
 	m_root = new VNode();
 	m_root->set_bbox(bbox);
 	m_root->set_axis(AXIS_X);
 
-	vector<PrivateTriangle*>::iterator itr;
-	for (itr = tri_list->begin(); itr != tri_list->end(); itr++) {
-		// make a new triangle
-		VElement* elm = NULL;
-		elm = new VElement(*itr);
+	// 三角形毎のBounding Boxを一つの配列にまとめて作成する
+	int num = tri_list->size();
+	m_elm_bbox.resize((size_t)num * 6);
+	for (int i = 0; i < num; i++) {
+		float *e = &m_elm_bbox[(size_t)i * 6];
+		if (m_polygons != NULL) {
+			m_polygons->get_triangle_bbox(i, e);
+			continue;
+		}
+		const Vec3f *v = (*tri_list)[i]->get_vertex();
+		for (int j = 0; j < 3; j++) {
+			e[j]   = v[0][j];
+			e[j+3] = v[0][j];
+			for (int k = 1; k < 3; k++) {
+				if (v[k][j] < e[j])   e[j]   = v[k][j];
+				if (v[k][j] > e[j+3]) e[j+3] = v[k][j];
+			}
+		}
+	}
 
+	for (int idx = 0; idx < num; idx++) {
 		VNode* vnode = NULL;
-		traverse(m_root, elm, &vnode);
+		traverse(m_root, idx, &vnode);
 
 		// the vtx didn't find in the tree
 		// add a new vertex
@@ -520,12 +676,12 @@ POLYLIB_STAT VTree::create(
 		}
 
 		// find node to add a new triangle
-		vnode->set_element(elm);
+		vnode->set_element(idx);
 
 		// set bbox for search triangle
-		vnode->set_bbox_search(elm);
+		vnode->set_bbox_search(elm_bbox(idx));
 		if (vnode->get_elements_num() > m_max_elements) {
-			vnode->split(m_max_elements);
+			vnode->split(m_max_elements, &m_elm_bbox[0]);
 #ifdef DEBUG_VTREE
 			m_vnode.push_back(vnode->get_left());
 			m_vnode.push_back(vnode->get_right());
@@ -539,31 +695,116 @@ POLYLIB_STAT VTree::create(
 	return PLSTAT_OK;
 }
 
+// private ////////////////////////////////////////////////////////////////////
+PrivateTriangle *VTree::triangle(
+	int		idx
+) const {
+	PrivateTriangle *tri = (*m_tri_list)[idx];
+	if (tri == NULL && m_polygons != NULL) {
+		// 省メモリ形式で保持されている三角形はPolygons側で復元する
+		tri = m_polygons->get_triangle(idx);
+	}
+	return tri;
+}
+
 // private ////////////////////////////////////////////////////////////////////
 void VTree::node_count(
-	VNode			*parent, 
-	unsigned int	*node_cnt, 
-	unsigned int	*tri_cnt
-) {
-	VNode	*vnode;
+	VNode	*vnode, 
+	size_t	*node_cnt, 
+	size_t	*elem_cap
+) const {
+	(*node_cnt)++;
+	(*elem_cap) += vnode->get_vlist().capacity();
 
-#ifdef DEBUG_VTREE
-	PL_DBGOSH << "VTree::node_count1():" << *node_cnt << endl;
-#endif
-	if ((vnode = parent->get_left()) != NULL) {; 
-		(*node_cnt)++;
-		node_count(vnode, node_cnt, tri_cnt);
+	if (vnode->get_left() != NULL) {
+		node_count(vnode->get_left(), node_cnt, elem_cap);
 	}
-	else {
-		(*tri_cnt) += parent->get_elements_num();
+	if (vnode->get_right() != NULL) {
+		node_count(vnode->get_right(), node_cnt, elem_cap);
 	}
-#ifdef DEBUG_VTREE
-	PL_DBGOSH << "VTree::node_count2():" << *node_cnt << endl;
-#endif
-	if ((vnode = parent->get_right()) != NULL) {; 
-		(*node_cnt)++;
-		node_count(vnode, node_cnt, tri_cnt);
+}
+
+// private ////////////////////////////////////////////////////////////////////
+bool VTree::save_node(
+	VNode			*vn,
+	SnapshotWriter	&wr
+) const {
+	BBox	bbox = vn->get_bbox();
+	BBox	sbox = vn->get_bbox_search();
+	float	box[12] = {	bbox.min[0], bbox.min[1], bbox.min[2],
+						bbox.max[0], bbox.max[1], bbox.max[2],
+						sbox.min[0], sbox.min[1], sbox.min[2],
+						sbox.max[0], sbox.max[1], sbox.max[2]	};
+	int		axis = vn->get_axis();
+	int		leaf = vn->is_leaf() ? 1 : 0;
+	if (!wr.write(&axis, sizeof(int)) || !wr.write(&leaf, sizeof(int)) ||
+		!wr.write(box, sizeof(box))) {
+		return false;
+	}
+
+	if (leaf) {
+		const vector<int> &vlist = vn->get_vlist();
+		int num = vlist.size();
+		if (!wr.write(&num, sizeof(int))) return false;
+		return (num == 0) || wr.write(&vlist[0], num * sizeof(int));
+	}
+	return save_node(vn->get_left(), wr) && save_node(vn->get_right(), wr);
+}
+
+// private ////////////////////////////////////////////////////////////////////
+VNode *VTree::load_node(
+	SnapshotReader	&rd,
+	int				depth
+) {
+	int		axis, leaf;
+	float	box[12];
+	if (depth > SNAP_MAX_DEPTH || !rd.read(&axis, sizeof(int)) ||
+		!rd.read(&leaf, sizeof(int)) || !rd.read(box, sizeof(box)) ||
+		axis < AXIS_X || axis > AXIS_Z) {
+		return NULL;
+	}
+
+	VNode	*vn = new VNode();
+	BBox	bbox;
+	vn->set_axis((AxisEnum)axis);
+	bbox.setMinMax(Vec3f(box[0], box[1], box[2]), Vec3f(box[3], box[4], box[5]));
+	vn->set_bbox(bbox);
+	bbox.setMinMax(Vec3f(box[6], box[7], box[8]), Vec3f(box[9], box[10], box[11]));
+	vn->set_bbox_search(bbox);
+
+	if (leaf) {
+		int num;
+		const char *p = NULL;
+		if (rd.read(&num, sizeof(int)) && num >= 0) {
+			p = rd.skip(num * sizeof(int));
+		}
+		if (p == NULL) {
+			delete vn;
+			return NULL;
+		}
+		vector<int> &vlist = vn->get_vlist();
+		vlist.resize(num);
+		if (num > 0) memcpy(&vlist[0], p, num * sizeof(int));
+
+		// 三角形ポリゴンリストの範囲外を指すデータは不正
+		int n_tri = m_tri_list->size();
+		for (int i = 0; i < num; i++) {
+			if (vlist[i] < 0 || vlist[i] >= n_tri) {
+				delete vn;
+				return NULL;
+			}
+		}
+		return vn;
+	}
+
+	VNode *left = load_node(rd, depth + 1);
+	VNode *right = (left != NULL) ? load_node(rd, depth + 1) : NULL;
+	vn->set_children(left, right);
+	if (right == NULL) {
+		delete vn;
+		return NULL;
 	}
+	return vn;
 }
 
 } //namespace PolylibNS